@@ -60,6 +60,31 @@ func _enter_tree() -> void:
 	_test_section_8_auto_indent()
 	_test_section_9_generate_diff()
 	_test_section_10_validate()
+	_test_section_11_staged_edits()
+	_test_section_12_workspace_edits()
+	_test_section_13_history()
+	_test_section_14_diff_engine()
+	_test_section_15_structured_diff()
+	_test_section_16_ast_diff()
+	_test_section_17_diff_file()
+	_test_section_18_merge()
+	_test_section_19_apply_patch()
+	_test_section_20_format()
+	_test_section_21_highlighting()
+	_test_section_22_outline()
+	_test_section_23_symbol_index()
+	_test_section_24_symbol_index_file()
+	_test_section_25_references()
+	_test_section_26_completion()
+	_test_section_27_workspace_symbols()
+	_test_section_28_lint()
+	_test_section_29_dependencies()
+	_test_section_30_file_watcher()
+	_test_section_31_tree_cache()
+	_test_section_32_file_budget()
+	_test_section_33_memory_stats()
+	_test_section_34_pool_allocator()
+	_test_section_35_perf_stats()
 
 	_log("")
 	_log("═══════════════════════════════════════════")
@@ -602,3 +627,1140 @@ func _test_section_10_validate() -> void:
 
 	# validate 不影响缓存
 	_check_eq(_ast.get_open_files().size(), 0, "validate 不会打开任何文件缓存")
+
+
+# ──────────────────────────────────────────────
+# Section 11: 暂存编辑 (stage / commit / discard)
+# ──────────────────────────────────────────────
+
+func _test_section_11_staged_edits() -> void:
+	_begin_section("11. 暂存编辑")
+
+	var code := "extends Node\n\nvar health: int = 100\n"
+	_ast.open_file("test://staged", code)
+
+	# 11.1 暂存后缓存不变，commit 后生效
+	var s1 := _ast.stage_node_edits("test://staged", [
+		{"old_text": "100", "new_text": "250"}
+	], {})
+	_check_eq(s1["success"], true, "11.1 stage_node_edits 成功")
+	_check_eq(s1["has_error"], false, "11.1 暂存结果无语法错误")
+	var staged: StagedEdit = s1["staged"]
+	_check(staged.is_pending(), "11.1 staged.is_pending() == true")
+	_check_contains(staged.get_new_source(), "250", "11.1 预览包含 250")
+	_check_eq(_ast.get_file_source("test://staged"), code, "11.1 commit 前缓存未变")
+	var c1 := staged.commit()
+	_check_eq(c1["success"], true, "11.1 commit 成功")
+	_check_contains(_ast.get_file_source("test://staged"), "250", "11.1 commit 后缓存已更新")
+	_check_eq(staged.commit()["success"], false, "11.1 重复 commit 失败")
+
+	# 11.2 discard 不修改缓存
+	var before := _ast.get_file_source("test://staged")
+	var s2 := _ast.stage_node_edits("test://staged", [
+		{"old_text": "var health: int = 250", "new_text": "var health: int ="}
+	], {})
+	var staged2: StagedEdit = s2["staged"]
+	_check_eq(staged2.has_error(), true, "11.2 残缺代码 has_error == true")
+	_check(staged2.get_error_count() > 0, "11.2 error_count > 0")
+	staged2.discard()
+	_check(not staged2.is_pending(), "11.2 discard 后不再 pending")
+	_check_eq(_ast.get_file_source("test://staged"), before, "11.2 discard 后缓存未变")
+
+	# 11.3 文件在暂存后被修改 → commit 拒绝过期的编辑
+	var s3 := _ast.stage_text_edits("test://staged", [
+		{"start_byte": 0, "end_byte": 7, "new_text": "extends"}
+	])
+	var staged3: StagedEdit = s3["staged"]
+	_ast.update_file("test://staged", code)
+	_check(staged3.is_stale(), "11.3 update_file 后 is_stale == true")
+	_check_eq(staged3.commit()["success"], false, "11.3 过期的 staged edit 无法 commit")
+	staged3.discard()
+
+	# 11.4 非法编辑在暂存阶段即失败
+	var s4 := _ast.stage_text_edits("test://staged", [
+		{"start_byte": 5, "end_byte": 1, "new_text": "x"}
+	])
+	_check_eq(s4["success"], false, "11.4 非法范围 stage 失败")
+
+	_ast.close_file("test://staged")
+
+
+# ──────────────────────────────────────────────
+# Section 12: 多文件原子编辑
+# ──────────────────────────────────────────────
+
+func _test_section_12_workspace_edits() -> void:
+	_begin_section("12. 多文件原子编辑")
+
+	var code_a := "extends Node\n\nvar speed: int = 1\n"
+	var code_b := "extends Node\n\nfunc go() -> void:\n\tspeed = 2\n"
+	_ast.open_file("test://ws_a", code_a)
+	_ast.open_file("test://ws_b", code_b)
+
+	# 12.1 两个文件同时改名
+	var r1 := _ast.apply_workspace_edits({
+		"test://ws_a": [{"old_text": "var speed", "new_text": "var velocity"}],
+		"test://ws_b": [{"old_text": "speed = 2", "new_text": "velocity = 2"}],
+	}, {})
+	_check_eq(r1["success"], true, "12.1 多文件编辑成功")
+	_check_eq(r1["committed"], true, "12.1 已提交")
+	_check_contains(_ast.get_file_source("test://ws_a"), "velocity", "12.1 文件 a 已更新")
+	_check_contains(_ast.get_file_source("test://ws_b"), "velocity", "12.1 文件 b 已更新")
+
+	# 12.2 一个文件引入语法错误 → 全部不提交
+	var src_a := _ast.get_file_source("test://ws_a")
+	var src_b := _ast.get_file_source("test://ws_b")
+	var r2 := _ast.apply_workspace_edits({
+		"test://ws_a": [{"old_text": "var velocity", "new_text": "var speed"}],
+		"test://ws_b": [{"old_text": "func go() -> void:", "new_text": "func go( -> void:"}],
+	}, {"error_policy": "no_new_errors"})
+	_check_eq(r2["success"], false, "12.2 违反错误策略时失败")
+	_check_eq(r2["committed"], false, "12.2 未提交")
+	_check("test://ws_b" in r2["failed_files"], "12.2 failed_files 包含 ws_b")
+	_check_eq(_ast.get_file_source("test://ws_a"), src_a, "12.2 文件 a 未被修改")
+	_check_eq(_ast.get_file_source("test://ws_b"), src_b, "12.2 文件 b 未被修改")
+
+	# 12.3 dry_run 只返回预览
+	var r3 := _ast.apply_workspace_edits({
+		"test://ws_a": [{"old_text": "= 1", "new_text": "= 5"}],
+	}, {"dry_run": true})
+	_check_eq(r3["success"], true, "12.3 dry_run 成功")
+	_check_eq(r3["committed"], false, "12.3 dry_run 不提交")
+	_check_contains(r3["files"]["test://ws_a"]["new_source"], "= 5", "12.3 预览包含新内容")
+	_check_eq(_ast.get_file_source("test://ws_a"), src_a, "12.3 缓存未变")
+
+	# 12.4 未打开的文件
+	var r4 := _ast.apply_workspace_edits({
+		"test://ws_missing": [{"start_byte": 0, "end_byte": 0, "new_text": "x"}],
+	}, {})
+	_check_eq(r4["success"], false, "12.4 未打开的文件导致失败")
+
+	_ast.close_file("test://ws_a")
+	_ast.close_file("test://ws_b")
+
+
+# ──────────────────────────────────────────────
+# Section 13: 撤销 / 重做
+# ──────────────────────────────────────────────
+
+func _test_section_13_history() -> void:
+	_begin_section("13. 撤销 / 重做")
+
+	var v0 := "extends Node\n\nvar hp: int = 1\n"
+	_ast.open_file("test://history", v0)
+	_ast.apply_node_edits("test://history", [{"old_text": "= 1", "new_text": "= 2"}], {})
+	var v1 := _ast.get_file_source("test://history")
+	_ast.update_file("test://history", v1 + "\nfunc f() -> void:\n\tpass\n")
+	var v2 := _ast.get_file_source("test://history")
+
+	var info := _ast.get_history_info("test://history")
+	_check_eq(info["undo_count"], 2, "13.1 两次修改后 undo_count == 2")
+	_check_eq(info["redo_count"], 0, "13.1 redo_count == 0")
+
+	var u1 := _ast.undo("test://history")
+	_check_eq(u1["success"], true, "13.2 undo 成功")
+	_check_eq(_ast.get_file_source("test://history"), v1, "13.2 undo 恢复到 v1")
+	_check_eq(u1["has_error"], false, "13.2 恢复后的树无错误")
+
+	_ast.undo("test://history")
+	_check_eq(_ast.get_file_source("test://history"), v0, "13.3 再次 undo 恢复到 v0")
+	_check_eq(_ast.undo("test://history")["success"], false, "13.3 没有更多可撤销的修改")
+
+	var r1 := _ast.redo("test://history")
+	_check_eq(r1["success"], true, "13.4 redo 成功")
+	_check_eq(_ast.get_file_source("test://history"), v1, "13.4 redo 回到 v1")
+	_check_eq(r1["restored_from_snapshot"], true, "13.4 redo 直接使用快照，无需重解析")
+
+	# 新修改会丢弃 redo 分支
+	_ast.apply_node_edits("test://history", [{"old_text": "= 2", "new_text": "= 3"}], {})
+	_check_eq(_ast.get_history_info("test://history")["redo_count"], 0, "13.5 新修改后 redo_count == 0")
+	_check_eq(_ast.redo("test://history")["success"], false, "13.5 redo 分支已丢弃")
+	_check(_ast.get_file_source("test://history") != v2, "13.5 内容未回到 v2")
+
+	# 查询在撤销后仍然使用正确的树
+	_ast.undo("test://history")
+	var q := _ast.query("test://history", "(integer) @n")
+	_check_eq(q["matches"][0]["captures"][0]["text"], "2", "13.6 undo 后 query 读取到恢复的树")
+
+	_ast.close_file("test://history")
+
+
+# ──────────────────────────────────────────────
+# Section 14: diff 引擎 (算法 / 格式 / 性能)
+# ──────────────────────────────────────────────
+
+func _test_section_14_diff_engine() -> void:
+	_begin_section("14. diff 引擎")
+
+	var old_text := "a\nb\nc\nd\ne\nf\ng\nh\ni\nj\n"
+	var new_text := "a\nb\nC\nd\ne\nf\ng\nh\ni\nj\nk"
+	for algorithm in ["myers", "patience", "histogram"]:
+		var diff := _ast.generate_diff(old_text, new_text, "x.gd", {"algorithm": algorithm})
+		_check_contains(diff, "-c\n+C\n", "14.1 %s: 替换行" % algorithm)
+		_check_contains(diff, "+k\n\\ No newline at end of file", "14.1 %s: 末行无换行标记" % algorithm)
+
+	var tight := _ast.generate_diff(old_text, new_text, "x.gd", {"context": 0})
+	_check_contains(tight, "@@ -3,1 +3,1 @@", "14.2 context=0 时块头只覆盖修改行")
+	_check_contains(tight, "@@ -10,0 +11,1 @@", "14.2 纯插入块的旧起始行为前一行")
+
+	# 20k 行, 分散修改
+	var old_lines := PackedStringArray()
+	var new_lines := PackedStringArray()
+	for i in 20000:
+		var line := "\tvar v%d = %d" % [i % 500, i]
+		old_lines.append(line)
+		if i % 97 == 0:
+			new_lines.append(line + " # changed")
+		elif i % 131 != 0:
+			new_lines.append(line)
+		if i % 149 == 0:
+			new_lines.append("\tprint(%d)" % i)
+	var big_old := "\n".join(old_lines) + "\n"
+	var big_new := "\n".join(new_lines) + "\n"
+	for algorithm in ["myers", "patience", "histogram"]:
+		var start := Time.get_ticks_usec()
+		var diff := _ast.generate_diff(big_old, big_new, "big.gd", {"algorithm": algorithm})
+		var elapsed_ms := (Time.get_ticks_usec() - start) / 1000.0
+		_check(diff.length() > 0, "14.3 %s: 20k 行 diff 非空" % algorithm)
+		_log("  [bench] %s: 20000 行 %.2f ms, 输出 %d 字符" % [algorithm, elapsed_ms, diff.length()])
+
+
+# ──────────────────────────────────────────────
+# Section 15: 结构化 diff 与行内差异
+# ──────────────────────────────────────────────
+
+func _test_section_15_structured_diff() -> void:
+	_begin_section("15. 结构化 diff")
+
+	var old_text := "var a = 1\nvar b = 2\n"
+	var new_text := "var a = 10\nvar b = 2\n"
+
+	var plain := _ast.generate_structured_diff(old_text, new_text)
+	_check_eq(plain["success"], true, "15.1 调用成功")
+	_check_eq(plain["hunks"], PackedInt32Array([0, 2, 0, 2, 0, 2]), "15.1 单个 hunk 覆盖两行上下文")
+	_check_eq(plain["ops"], PackedInt32Array([3, 0, 1, 0, 1, 0, 1, 1, 1, 1]), "15.1 ops: 替换 + 相等")
+	_check(not plain.has("inline"), "15.1 未请求时不返回 inline")
+
+	var tokens := _ast.generate_structured_diff(old_text, new_text, {"inline": "token"})
+	_check_eq(tokens["inline"], PackedInt32Array([0, 0, 8, 9, 1, 0, 8, 10]), "15.2 token 级: 整个数字 token 被标记")
+
+	var chars := _ast.generate_structured_diff(old_text, new_text, {"inline": "char"})
+	_check_eq(chars["inline"], PackedInt32Array([1, 0, 9, 10]), "15.3 字符级: 只标记新增的 0")
+
+	var same := _ast.generate_structured_diff(old_text, old_text)
+	_check_eq(same["hunks"].size(), 0, "15.4 相同内容没有 hunk")
+
+	var removed := _ast.generate_structured_diff("a\nb\nc\n", "a\nc\n", {"context": 0})
+	_check_eq(removed["ops"], PackedInt32Array([1, 1, 1, 1, 0]), "15.5 删除 op 的新侧长度为 0")
+
+
+# ──────────────────────────────────────────────
+# Section 16: AST 结构 diff
+# ──────────────────────────────────────────────
+
+func _find_op(ops: Array, type: String, node_type: String) -> Dictionary:
+	for op in ops:
+		if op["type"] == type and op["node_type"] == node_type:
+			return op
+	return {}
+
+
+func _test_section_16_ast_diff() -> void:
+	_begin_section("16. AST 结构 diff")
+
+	var v0_text := "extends Node\n\nfunc a() -> void:\n\tprint(1)\n\nfunc b() -> void:\n\tprint(2)\n"
+	_ast.open_file("test://ast_diff", v0_text)
+	var v0: int = _ast.get_history_info("test://ast_diff")["version"]
+	_ast.update_file("test://ast_diff", "extends Node\n\nfunc b() -> void:\n\tprint(2)\n\nfunc a() -> void:\n\tprint(1)\n")
+
+	var same_file := _ast.diff_ast("test://ast_diff", "test://ast_diff", {"old_version": v0})
+	_check_eq(same_file["success"], true, "16.1 同一文件两个版本之间 diff 成功")
+	var moved := _find_op(same_file["operations"], "move", "function_definition")
+	_check(not moved.is_empty(), "16.1 函数调换顺序被识别为 move")
+	_check_eq(same_file["operations"].size(), 1, "16.1 只有一个操作")
+
+	_ast.open_file("test://ast_diff_b", "extends Node\n\nfunc a(x: int) -> void:\n\tprint(10)\n\nfunc b() -> void:\n\tprint(2)\n")
+	var two_files := _ast.diff_ast("test://ast_diff", "test://ast_diff_b", {"old_version": v0})
+	var updated := _find_op(two_files["operations"], "update", "integer")
+	_check_eq(updated.get("old_text", ""), "1", "16.2 更新前的文本")
+	_check_eq(updated.get("new_text", ""), "10", "16.2 更新后的文本")
+	_check(not _find_op(two_files["operations"], "insert", "typed_parameter").is_empty(), "16.2 新增参数被识别为 insert")
+
+	var missing := _ast.diff_ast("test://ast_diff", "test://ast_diff", {"old_version": 999999})
+	_check_eq(missing["success"], false, "16.3 不存在的版本返回错误")
+
+	_ast.close_file("test://ast_diff")
+	_ast.close_file("test://ast_diff_b")
+
+
+# ──────────────────────────────────────────────
+# Section 17: diff_file (基于缓存的版本 diff)
+# ──────────────────────────────────────────────
+
+func _test_section_17_diff_file() -> void:
+	_begin_section("17. diff_file")
+
+	var lines := PackedStringArray()
+	for i in 200:
+		lines.append("var v%d = %d" % [i, i])
+	var original := "\n".join(lines) + "\n"
+	_ast.open_file("test://diff_file", original)
+	var v0: int = _ast.get_history_info("test://diff_file")["version"]
+
+	var proposed := original.replace("var v100 = 100", "var v100 = -1")
+	var against_content := _ast.diff_file("test://diff_file", proposed)
+	_check_eq(against_content["success"], true, "17.1 与新内容 diff 成功")
+	_check_contains(against_content["diff"], "-var v100 = 100\n+var v100 = -1\n", "17.1 diff 包含修改行")
+	_check(against_content["skipped_lines"] >= 190, "17.1 公共首尾行被直接跳过, skipped=%d" % against_content["skipped_lines"])
+	_check_eq(_ast.diff_file("test://diff_file", original)["changed"], false, "17.2 内容相同时 changed == false")
+
+	_ast.apply_node_edits("test://diff_file", [{"old_text": "var v5 = 5", "new_text": "var v5 = 50"}], {})
+	var against_version := _ast.diff_file("test://diff_file", v0, {"file_name": "a.gd"})
+	_check_eq(against_version["success"], true, "17.3 与历史版本 diff 成功")
+	_check_contains(against_version["diff"], "--- a/a.gd", "17.3 使用 file_name 作为标签")
+	_check_contains(against_version["diff"], "-var v5 = 5\n+var v5 = 50\n", "17.3 历史版本 -> 当前")
+	_check(against_version["skipped_lines"] >= 190, "17.3 编辑历史之外的行被跳过")
+
+	var structured := _ast.diff_file("test://diff_file", v0, {"format": "structured", "context": 0})
+	_check_eq(structured["ops"], PackedInt32Array([3, 5, 1, 5, 1]), "17.4 结构化输出")
+
+	_check_eq(_ast.diff_file("test://diff_file", 123456789)["success"], false, "17.5 不可用的版本返回错误")
+	_ast.close_file("test://diff_file")
+
+
+# ──────────────────────────────────────────────
+# Section 18: 三方合并
+# ──────────────────────────────────────────────
+
+func _test_section_18_merge() -> void:
+	_begin_section("18. 三方合并")
+
+	var base := "var a = 1\nvar b = 2\nvar c = 3\nvar d = 4\nvar e = 5\n"
+	var ours := base.replace("var a = 1", "var a = 10")
+	var theirs := base.replace("var e = 5", "var e = 50")
+
+	var clean := _ast.merge_text(base, ours, theirs)
+	_check_eq(clean["clean"], true, "18.1 不重叠的修改合并无冲突")
+	_check_eq(clean["merged"], "var a = 10\nvar b = 2\nvar c = 3\nvar d = 4\nvar e = 50\n", "18.1 合并结果包含双方修改")
+
+	var conflicting := base.replace("var a = 1", "var a = 11")
+	var conflict := _ast.merge_text(base, ours, conflicting)
+	_check_eq(conflict["conflict_count"], 1, "18.2 同一行的不同修改产生冲突")
+	_check_contains(conflict["merged"], "<<<<<<< ours\nvar a = 10\n=======\nvar a = 11\n>>>>>>> theirs\n", "18.2 冲突标记")
+	var conflict_range: Dictionary = conflict["conflicts"][0]
+	_check_eq([conflict_range["merged_start"], conflict_range["merged_count"]], [0, 5], "18.2 冲突在合并结果中的行范围")
+	_check_eq(_ast.merge_text(base, ours, conflicting, {"conflict_style": "theirs"})["merged"], conflicting, "18.3 theirs 策略直接取对方")
+
+	# 文件: AI 基于旧版本生成内容, 期间用户已修改
+	_ast.open_file("test://merge", base)
+	var v0: int = _ast.get_history_info("test://merge")["version"]
+	_ast.update_file("test://merge", ours)
+	var merged_file := _ast.merge_file("test://merge", v0, theirs)
+	_check_eq(merged_file["applied"], true, "18.4 无冲突时直接应用到文件")
+	_check_eq(_ast.get_file_source("test://merge"), clean["merged"], "18.4 文件内容为合并结果")
+	_check_eq(merged_file["has_error"], false, "18.4 合并后重新解析无错误")
+
+	var blocked := _ast.merge_file("test://merge", v0, conflicting)
+	_check_eq(blocked["applied"], false, "18.5 有冲突时默认不修改文件")
+	_check_eq(blocked["conflict_count"], 1, "18.5 报告冲突")
+	_check_eq(_ast.get_file_source("test://merge"), clean["merged"], "18.5 文件内容未变化")
+	_ast.close_file("test://merge")
+
+
+# ──────────────────────────────────────────────
+# Section 19: apply_patch (unified diff 补丁)
+# ──────────────────────────────────────────────
+
+func _test_section_19_apply_patch() -> void:
+	_begin_section("19. 应用 unified diff 补丁")
+
+	var lines := PackedStringArray()
+	for i in 40:
+		lines.append("var v%d = %d" % [i, i])
+	var original := "\n".join(lines) + "\n"
+	var target := original.replace("var v20 = 20", "var v20 = 200").replace("var v30 = 30", "var v30 = 300")
+	var patch := _ast.generate_diff(original, target, "patch.gd")
+
+	_ast.open_file("test://patch", original)
+	var dry := _ast.apply_patch("test://patch", patch, {"dry_run": true})
+	_check_eq(dry["success"], true, "19.1 dry_run 成功")
+	_check_eq(dry["new_source"], target, "19.1 dry_run 返回补丁后的内容")
+	_check_eq(_ast.get_file_source("test://patch"), original, "19.1 dry_run 不修改文件")
+
+	var applied := _ast.apply_patch("test://patch", patch)
+	_check_eq([applied["applied"], applied["hunks_applied"], applied["rejected_count"]], [true, 2, 0], "19.2 两个 hunk 全部应用")
+	_check_eq(_ast.get_file_source("test://patch"), target, "19.2 文件内容为补丁结果")
+	_check_eq(applied["has_error"], false, "19.2 增量重新解析无错误")
+	_ast.close_file("test://patch")
+
+	# 文件开头多了两行, 且 hunk 的一行上下文被改过: 需要偏移和 fuzz
+	var shifted := "# header\n# note\n" + original.replace("var v18 = 18", "var v18 = 18 # edited")
+	_ast.open_file("test://patch", shifted)
+	var strict := _ast.apply_patch("test://patch", patch, {"max_fuzz": 0})
+	_check_eq([strict["success"], strict["rejected_count"]], [false, 1], "19.3 不允许 fuzz 时拒绝上下文已改动的 hunk")
+	_check_eq(_ast.get_file_source("test://patch"), shifted, "19.3 有 hunk 被拒绝时不修改文件")
+
+	var fuzzy := _ast.apply_patch("test://patch", patch)
+	_check_eq(fuzzy["success"], true, "19.4 偏移与 fuzz 下仍能应用")
+	var first_hunk: Dictionary = fuzzy["hunks"][0]
+	_check_eq([first_hunk["offset"], first_hunk["fuzz"]], [2, 2], "19.4 报告偏移和 fuzz")
+	_check_contains(_ast.get_file_source("test://patch"), "var v18 = 18 # edited\nvar v19 = 19\nvar v20 = 200\n", "19.4 上下文保留文件中的内容")
+	_ast.close_file("test://patch")
+
+	# hunk 内删除 "-- note" 再插入 "++ note", 看起来像新文件的 ---/+++ 头
+	var dashes := "var a = 1\n-- note\nvar b = 2\n"
+	var dash_patch := "--- a/p.gd\n+++ b/p.gd\n@@ -1,3 +1,3 @@\n var a = 1\n--- note\n+++ note\n var b = 2\n"
+	_ast.open_file("test://patch", dashes)
+	var dashed := _ast.apply_patch("test://patch", dash_patch, {"dry_run": true})
+	_check_eq(dashed["new_source"], dashes.replace("-- note", "++ note"), "19.5 hunk 内的 ---/+++ 行按删除和插入处理")
+	_ast.close_file("test://patch")
+
+
+# ──────────────────────────────────────────────
+# Section 20: format_file (格式化)
+# ──────────────────────────────────────────────
+
+func _test_section_20_format() -> void:
+	_begin_section("20. 格式化")
+
+	var messy := "extends Node\nvar x=1\nfunc foo(a,b):\n    var y = a+b  \n    return [y,2,]\n"
+	var formatted := "extends Node\nvar x = 1\n\n\nfunc foo(a, b):\n\tvar y = a + b\n\treturn [y, 2]\n"
+
+	_ast.open_file("test://format", messy)
+	var dry := _ast.format_file("test://format", {"dry_run": true})
+	_check_eq(dry["success"], true, "20.1 dry_run 成功")
+	_check_eq(dry["new_source"], formatted, "20.1 缩进、运算符空格、空行和尾随逗号")
+	_check(dry["edit_count"] > 0 and dry["edit_count"] < messy.length(), "20.1 输出的是局部编辑而不是整个文件")
+	_check_eq(_ast.get_file_source("test://format"), messy, "20.1 dry_run 不修改文件")
+
+	# 只格式化 "var x=1" 这一行
+	var line_start := messy.find("var x")
+	var ranged := _ast.format_file("test://format", {"start_byte": line_start, "end_byte": line_start + 7})
+	_check_eq(ranged["applied"], true, "20.2 范围格式化已应用")
+	_check_eq(_ast.get_file_source("test://format"), messy.replace("var x=1", "var x = 1"), "20.2 范围外的内容不变")
+
+	_ast.format_file("test://format")
+	_check_eq(_ast.get_file_source("test://format"), formatted, "20.3 整个文件格式化")
+	_check_eq(_ast.format_file("test://format")["edit_count"], 0, "20.3 再次格式化没有编辑")
+
+	# 只格式化最近一次编辑改动的行
+	var insert_at := formatted.find("\treturn")
+	_ast.apply_text_edits("test://format", [{"start_byte": insert_at, "end_byte": insert_at, "new_text": "\tvar z=y*2\n"}], false)
+	var changed := _ast.format_file("test://format", {"changed_only": true})
+	_check_eq(changed["edit_count"], 4, "20.4 只处理最近编辑的行")
+	_check_contains(_ast.get_file_source("test://format"), "\tvar z = y * 2\n", "20.4 最近编辑的行已格式化")
+	_ast.close_file("test://format")
+
+
+# ──────────────────────────────────────────────
+# Section 21: 语法高亮
+# ──────────────────────────────────────────────
+
+func _test_section_21_highlighting() -> void:
+	_begin_section("21. 语法高亮")
+
+	var config := _ast.configure_highlighting({"colors": {"comment": Color.RED}, "default_color": Color.WHITE})
+	_check_eq(config["success"], true, "21.1 配置高亮查询")
+	_check(Array(config["capture_names"]).has("comment"), "21.1 默认查询包含 @comment")
+
+	_ast.open_file("test://highlight", "extends Node\n# note\nfunc foo():\n\treturn \"hi\"\n")
+	var comment_line := _ast.get_line_highlighting("test://highlight", 1)
+	_check(comment_line.has(0) and comment_line[0]["color"] == Color.RED, "21.2 注释使用配置的颜色")
+	_check(comment_line.has(6) and comment_line[6]["color"] == Color.WHITE, "21.2 注释结束后恢复默认颜色")
+	_check(_ast.get_line_highlighting("test://highlight", 0).has(0), "21.2 关键字有高亮")
+	_check_eq(_ast.get_line_highlighting("test://highlight", 100).size(), 0, "21.2 超出范围的行为空")
+
+	# 编辑后行号整体下移，注释行跟着移动
+	_ast.apply_text_edits("test://highlight", [{"start_byte": 0, "end_byte": 0, "new_text": "var s = 1\n"}], false)
+	var moved := _ast.get_line_highlighting("test://highlight", 2)
+	_check(moved.has(0) and moved[0]["color"] == Color.RED, "21.3 编辑后注释行的高亮随之移动")
+	_ast.undo("test://highlight")
+	comment_line = _ast.get_line_highlighting("test://highlight", 1)
+	_check(comment_line.has(0) and comment_line[0]["color"] == Color.RED, "21.3 撤销后高亮恢复")
+
+	var spans := _ast.get_highlight_spans("test://highlight", 0, 10)
+	_check(spans.size() > 0 and spans.size() % 4 == 0, "21.4 批量获取 (行, 起始列, 结束列, 捕获) 区间")
+
+	_check_eq(_ast.configure_highlighting({"query": "(not_a_node) @x"})["success"], false, "21.5 无效查询返回错误")
+	_check_eq(_ast.configure_highlighting()["success"], true, "21.5 恢复默认高亮")
+	_ast.close_file("test://highlight")
+
+
+# ──────────────────────────────────────────────
+# Section 22: 大纲、折叠与选区
+# ──────────────────────────────────────────────
+
+func _test_section_22_outline() -> void:
+	_begin_section("22. 大纲、折叠与选区")
+
+	var source := "class_name Demo\n# one\n# two\nsignal hit\nconst MAX = 3\nvar items = [\n\t1,\n]\nfunc run():\n\tvar local = 1\n\treturn local\nclass Inner:\n\tfunc ping():\n\t\tpass\n"
+	_ast.open_file("test://outline", source)
+
+	var outline := _ast.get_document_outline("test://outline")
+	_check_eq(outline["success"], true, "22.1 获取大纲")
+	var names := []
+	for symbol in outline["symbols"]:
+		names.append(symbol["kind"] + ":" + symbol["name"])
+	_check_eq(names, ["class_name:Demo", "signal:hit", "constant:MAX", "variable:items", "function:run", "class:Inner"], "22.1 顶层符号（不含局部变量）")
+	var inner: Dictionary = outline["symbols"][5]
+	_check_eq(inner["children"].size(), 1, "22.1 内部类包含成员")
+	_check_eq(inner["children"][0]["name"], "ping", "22.1 内部类的方法")
+
+	var folds: Array = _ast.get_folding_ranges("test://outline")["ranges"]
+	var fold_keys := []
+	for fold in folds:
+		fold_keys.append("%d-%d:%s" % [fold["start_row"], fold["end_row"], fold["kind"]])
+	_check(fold_keys.has("1-2:comment"), "22.2 连续注释可折叠")
+	_check(fold_keys.has("5-7:literal"), "22.2 多行数组可折叠")
+	_check(fold_keys.has("8-10:block"), "22.2 函数体可折叠")
+
+	# 在文件开头插入一行后，大纲位置整体下移
+	_ast.apply_text_edits("test://outline", [{"start_byte": 0, "end_byte": 0, "new_text": "extends Node\n"}], false)
+	var moved := _ast.get_document_outline("test://outline")
+	_check_eq(moved["symbols"][4]["start_row"], 9, "22.3 编辑后符号行号已更新")
+	_check_eq(moved["symbol_count"], outline["symbol_count"], "22.3 编辑后符号数量不变")
+
+	var position := _ast.get_file_source("test://outline").find("local = 1")
+	var selection := _ast.get_selection_ranges("test://outline", PackedInt32Array([position]))
+	var chain: Array = selection["selections"][0]
+	_check(chain.size() > 2, "22.4 选区由内向外逐层扩大")
+	_check(chain[0]["end_byte"] - chain[0]["start_byte"] < chain[chain.size() - 1]["end_byte"] - chain[chain.size() - 1]["start_byte"], "22.4 最外层是整个文件")
+	_ast.close_file("test://outline")
+
+
+# ──────────────────────────────────────────────
+# Section 23: 项目符号索引
+# ──────────────────────────────────────────────
+
+func _test_section_23_symbol_index() -> void:
+	_begin_section("23. 项目符号索引")
+
+	var indexed := _ast.index_files({
+		"res://idx_player.gd": "class_name IdxPlayer\nsignal idx_died\nfunc idx_jump():\n\tpass\n",
+		"res://idx_enemy.gd": "class_name IdxEnemy\nconst IDX_SPEED = 3\nfunc idx_jump():\n\tpass\n",
+	})
+	_check_eq(indexed["success"], true, "23.1 批量索引未打开的脚本")
+	_check_eq(indexed["indexed_count"], 2, "23.1 两个文件都已索引")
+
+	var jumps: Array = _ast.find_symbols("idx_jump")["symbols"]
+	_check_eq(jumps.size(), 2, "23.2 按名称查找跨文件的同名函数")
+	var player: Array = _ast.find_symbols("IdxPlayer", {"kind": "class_name"})["symbols"]
+	_check(player.size() == 1 and player[0]["file_path"] == "res://idx_player.gd", "23.2 按种类过滤 class_name")
+	_check_eq(_ast.find_symbols("idx_died", {"kind": "function"})["symbols"].size(), 0, "23.2 种类不符时无结果")
+
+	var prefixed := _ast.find_symbols_by_prefix("Idx")
+	_check_eq(prefixed["names"], PackedStringArray(["IdxEnemy", "IdxPlayer"]), "23.3 前缀枚举按名称排序")
+
+	# 打开的文件随编辑更新索引
+	_ast.open_file("test://idx_open", "func idx_old():\n\tpass\n")
+	_check_eq(_ast.find_symbols("idx_old")["symbols"].size(), 1, "23.4 打开文件时建立索引")
+	_ast.apply_text_edits("test://idx_open", [{"start_byte": 5, "end_byte": 12, "new_text": "idx_new"}], false)
+	_check_eq(_ast.find_symbols("idx_old")["symbols"].size(), 0, "23.4 编辑后旧名称移除")
+	_check_eq(_ast.find_symbols("idx_new")["symbols"].size(), 1, "23.4 编辑后新名称可查")
+	_ast.close_file("test://idx_open")
+	_check_eq(_ast.find_symbols("idx_new")["symbols"].size(), 0, "23.4 关闭文件后移除")
+
+	_check_eq(_ast.unindex_file("res://idx_player.gd"), true, "23.5 移除索引文件")
+	_check_eq(_ast.find_symbols("idx_jump")["symbols"].size(), 1, "23.5 移除后只剩一个定义")
+	_ast.unindex_file("res://idx_enemy.gd")
+
+
+# ──────────────────────────────────────────────
+# Section 24: 符号索引持久化 (save / load)
+# ──────────────────────────────────────────────
+
+func _test_section_24_symbol_index_file() -> void:
+	_begin_section("24. 符号索引持久化")
+
+	var path_a := "user://idx_disk_a.gd"
+	var path_b := "user://idx_disk_b.gd"
+	var file := FileAccess.open(path_a, FileAccess.WRITE)
+	file.store_string("class_name IdxDiskA\nfunc idx_disk_run():\n\tpass\n")
+	file.close()
+	file = FileAccess.open(path_b, FileAccess.WRITE)
+	file.store_string("func idx_disk_run():\n\tpass\n")
+	file.close()
+
+	var refreshed := _ast.refresh_symbol_index(PackedStringArray([path_a, path_b]))
+	_check_eq(refreshed["reparsed_count"], 2, "24.1 首次刷新解析全部脚本")
+
+	var index_path := "user://ast_test_index.bin"
+	var saved := _ast.save_symbol_index(index_path)
+	_check_eq(saved["success"], true, "24.2 保存索引文件")
+	_check_eq(saved["file_count"], 2, "24.2 两个文件写入索引")
+	_check_eq(_ast.get_symbol_index_stats()["mapped_file_count"], 2, "24.2 保存后从映射文件查询")
+	_check_eq(_ast.find_symbols("idx_disk_run")["symbols"].size(), 2, "24.2 映射索引按名称查找")
+	_check_eq(_ast.find_symbols_by_prefix("IdxDisk")["names"], PackedStringArray(["IdxDiskA"]), "24.2 映射索引前缀查找")
+
+	var loaded := _ast.load_symbol_index(index_path)
+	_check_eq(loaded["success"], true, "24.3 重新加载索引文件")
+	refreshed = _ast.refresh_symbol_index(PackedStringArray([path_a, path_b]))
+	_check_eq(refreshed["unchanged_count"], 2, "24.3 未修改的脚本跳过解析")
+	_check_eq(refreshed["reparsed_count"], 0, "24.3 无需重新解析")
+
+	file = FileAccess.open(path_b, FileAccess.WRITE)
+	file.store_string("func idx_disk_walk():\n\tpass\n")
+	file.close()
+	refreshed = _ast.refresh_symbol_index(PackedStringArray([path_a, path_b]))
+	_check_eq(refreshed["reparsed_count"], 1, "24.4 只重新解析修改的脚本")
+	_check_eq(_ast.find_symbols("idx_disk_run")["symbols"].size(), 1, "24.4 旧定义被新内容覆盖")
+	_check_eq(_ast.find_symbols("idx_disk_walk")["symbols"].size(), 1, "24.4 新定义可查")
+
+	refreshed = _ast.refresh_symbol_index(PackedStringArray([path_a]))
+	_check_eq(refreshed["removed_count"], 1, "24.5 移除不再存在的脚本")
+	_check_eq(_ast.find_symbols("idx_disk_walk")["symbols"].size(), 0, "24.5 移除后不可查")
+
+	_check_eq(_ast.load_symbol_index("user://ast_missing_index.bin")["success"], false, "24.6 缺失的索引文件报错")
+	_ast.refresh_symbol_index(PackedStringArray())
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(index_path))
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(path_a))
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(path_b))
+
+
+# ──────────────────────────────────────────────
+# Section 25: 定义跳转与引用查找
+# ──────────────────────────────────────────────
+
+func _test_section_25_references() -> void:
+	_begin_section("25. 定义跳转与引用查找")
+
+	var source := "var ref_count = 0\n\nfunc ref_add(ref_step):\n\tvar ref_total = ref_count + ref_step\n\tref_count = ref_total\n\treturn ref_total\n"
+	_ast.open_file("test://refs", source)
+
+	var param := _ast.find_definition("test://refs", source.find("ref_step", source.find("+")))
+	_check_eq(param["resolution"], "local", "25.1 参数解析为本地定义")
+	_check_eq(param["definitions"][0]["kind"], "parameter", "25.1 定义种类为参数")
+	_check_eq(param["definitions"][0]["name_start_byte"], source.find("ref_step"), "25.1 指向参数声明")
+	var member := _ast.find_definition("test://refs", source.find("ref_count", 5))
+	_check_eq(member["resolution"], "file", "25.2 成员变量解析为文件内定义")
+	_check_eq(member["definitions"][0]["kind"], "variable", "25.2 定义来自符号索引")
+	_check_eq(_ast.find_definition("test://refs", source.find("0"))["success"], false, "25.2 非标识符位置报错")
+
+	_check_eq(_ast.find_references("ref_count")["references"].size(), 3, "25.3 按名称查找全部出现")
+	_check_eq(_ast.find_references("ref_count", {"include_definitions": false})["references"].size(), 2, "25.3 可排除定义")
+	var local := _ast.find_references({"file_path": "test://refs", "position": source.rfind("ref_total")})
+	_check_eq(local["scoped"], true, "25.4 局部变量限定在作用域内")
+	_check_eq(local["references"].size(), 3, "25.4 局部变量的全部出现")
+
+	_ast.index_files({"res://refs_other.gd": "func ref_call():\n\tref_add(1)\n"})
+	var user_source := "func ref_use():\n\tref_add(2)\n"
+	_ast.open_file("test://refs_user", user_source)
+	var remote := _ast.find_definition("test://refs_user", user_source.find("ref_add"))
+	_check_eq(remote["resolution"], "project", "25.5 跨文件解析到项目定义")
+	_check_eq(remote["definitions"][0]["file_path"], "test://refs", "25.5 定义所在文件")
+	var calls: Array = _ast.find_references("ref_add")["references"]
+	_check_eq(calls.size(), 3, "25.5 跨文件引用（含未打开的脚本）")
+
+	_ast.close_file("test://refs_user")
+	_ast.close_file("test://refs")
+	_ast.unindex_file("res://refs_other.gd")
+
+
+# ──────────────────────────────────────────────
+# Section 26: complete_at (作用域感知补全)
+# ──────────────────────────────────────────────
+
+func _test_section_26_completion() -> void:
+	_begin_section("26. 作用域感知补全")
+
+	_ast.index_files({"res://cmp_base.gd": "class_name CmpBase\nvar cmp_health = 10\nfunc cmp_heal():\n\tpass\n"})
+	var source := "extends CmpBase\nvar cmp_speed = 1\n\nfunc cmp_move(cmp_delta):\n\tvar cmp_step = cmp_delta\n\tcmp\n"
+	_ast.open_file("test://cmp", source)
+
+	var done := _ast.complete_at("test://cmp", 5, 4)
+	_check_eq(done["success"], true, "26.1 光标处补全")
+	_check_eq(done["prefix"], "cmp", "26.1 自动取光标前的单词作为前缀")
+	var names: Array = []
+	for item in done["items"]:
+		names.append(item["name"])
+	_check(names.has("cmp_step") and names.has("cmp_delta"), "26.1 局部变量和参数")
+	_check(names.has("cmp_speed") and names.has("cmp_move"), "26.2 本脚本成员")
+	_check(names.has("cmp_health") and names.has("cmp_heal"), "26.3 extends 继承的成员")
+	_check_eq(done["items"][0]["source"], "local", "26.4 局部候选排在最前")
+
+	var globals := _ast.complete_at("test://cmp", 5, 4, "CmpB")
+	_check(globals["items"].size() == 1 and globals["items"][0]["name"] == "CmpBase", "26.5 全局 class_name")
+	_check_eq(globals["items"][0]["source"], "global", "26.5 来源为全局")
+
+	var capped := _ast.complete_at("test://cmp", 5, 4, "", {"limit": 2})
+	_check_eq(capped["items"].size(), 2, "26.6 结果数量上限")
+	_check_eq(capped["is_incomplete"], true, "26.6 标记结果不完整")
+	_check_eq(_ast.complete_at("test://cmp", 99, 0)["success"], false, "26.6 行号越界报错")
+
+	_ast.close_file("test://cmp")
+	_ast.unindex_file("res://cmp_base.gd")
+
+
+# ──────────────────────────────────────────────
+# Section 27: 工作区符号模糊搜索
+# ──────────────────────────────────────────────
+
+func _test_section_27_workspace_symbols() -> void:
+	_begin_section("27. 工作区符号模糊搜索")
+
+	_ast.index_files({
+		"res://ws_a.gd": "class_name WsPlayerController\nfunc ws_get_parent_node():\n\tpass\nfunc ws_get_node_parent():\n\tpass\n",
+		"res://ws_b.gd": "var ws_grumpy_unicorn = 1\nsignal ws_player_died\n",
+	})
+
+	var found := _ast.search_workspace_symbols("wsgpn")
+	_check_eq(found["success"], true, "27.1 模糊搜索")
+	_check_eq(found["names"][0], "ws_get_parent_node", "27.1 词首匹配排在最前")
+	_check(found["names"].has("ws_grumpy_unicorn"), "27.1 子序列匹配")
+	_check_eq(found["symbols"].size(), found["names"].size() * 7, "27.2 每个结果 7 个整数")
+	var file: int = found["symbols"][2]
+	_check_eq(found["file_paths"][file], "res://ws_a.gd", "27.2 文件下标指向 file_paths")
+	_check_eq(found["symbols"][5], 1, "27.2 起始行")
+
+	var camel := _ast.search_workspace_symbols("WsPC")
+	_check_eq(camel["names"][0], "WsPlayerController", "27.3 驼峰边界匹配")
+	_check_eq(_ast.search_workspace_symbols("wsgpn", {"kind": "signal"})["names"].size(), 0, "27.4 按种类过滤")
+	_check_eq(_ast.search_workspace_symbols("ws", {"limit": 2})["names"].size(), 2, "27.5 结果数量上限")
+	_check_eq(_ast.search_workspace_symbols("zzq")["names"].size(), 0, "27.6 无匹配")
+
+	_ast.unindex_file("res://ws_a.gd")
+	_ast.unindex_file("res://ws_b.gd")
+	_check_eq(_ast.search_workspace_symbols("wsgpn")["names"].size(), 0, "27.7 移除文件后不再返回")
+
+
+# ──────────────────────────────────────────────
+# Section 28: Lint 规则引擎
+# ──────────────────────────────────────────────
+
+func _test_section_28_lint() -> void:
+	_begin_section("28. Lint 规则引擎")
+
+	var rules := [
+		{"id": "no-print", "query": "(call function: (identifier) @fn (#eq? @fn \"print\")) @call", "message": "Avoid {fn} in shipped code", "capture": "call"},
+		{"id": "snake-case-func", "query": "(function_definition name: (name) @name (#not-match? @name \"^_?[a-z][a-z0-9_]*$\"))", "severity": "info", "message": "Function {name} should be snake_case"},
+	]
+	var loaded := _ast.load_lint_rules(rules)
+	_check_eq(loaded["success"], true, "28.1 加载规则包")
+	_check_eq(loaded["rule_count"], 2, "28.1 规则数量")
+
+	var source := "func _ready():\n\tprint(\"hi\")\n\nfunc doThing():\n\tpass\n"
+	_ast.open_file("test://lint", source)
+	var linted := _ast.lint_file("test://lint")
+	_check_eq(linted["success"], true, "28.2 单文件 lint")
+	_check_eq(linted["diagnostics"].size(), 2, "28.2 两条诊断")
+	var first: Dictionary = linted["diagnostics"][0]
+	_check_eq(first["rule"], "no-print", "28.2 按位置排序")
+	_check_eq(first["severity"], "warning", "28.2 默认严重级别")
+	_check_eq(first["message"], "Avoid print in shipped code", "28.2 消息模板代入捕获文本")
+	_check_eq(first["start_row"], 1, "28.2 诊断行号")
+	_check_eq(linted["diagnostics"][1]["message"], "Function doThing should be snake_case", "28.2 #not-match? 谓词")
+
+	var edited := source + "\nfunc otherThing():\n\tpass\n"
+	_ast.update_file("test://lint", edited)
+	var again := _ast.lint_file("test://lint")
+	_check_eq(again["diagnostics"].size(), 3, "28.3 增量 lint 找到新诊断")
+	_check(again["scanned_bytes"] > 0 and again["scanned_bytes"] < edited.to_utf8_buffer().size(), "28.3 只重跑改动的语句")
+	_check_eq(_ast.lint_file("test://lint")["scanned_bytes"], 0, "28.3 未改动时直接复用")
+
+	_ast.update_file("test://lint", edited.replace("\tprint(\"hi\")", "\tpass"))
+	var removed := _ast.lint_file("test://lint")
+	_check_eq(removed["diagnostics"].size(), 2, "28.4 删除后诊断消失")
+	_check_eq(removed["diagnostics"][0]["rule"], "snake-case-func", "28.4 其余诊断保留")
+
+	var batch := _ast.lint_files(PackedStringArray(["test://lint", "res://no_such_lint.gd"]))
+	_check_eq(batch["success"], false, "28.5 缺失文件报错")
+	_check_eq(batch["files"]["test://lint"].size(), 2, "28.5 批量 lint 结果")
+	_check_eq(batch["failed_files"].size(), 1, "28.5 列出失败文件")
+
+	var stats := _ast.get_lint_stats(true)
+	_check_eq(stats["rules"].size(), 2, "28.6 每条规则的计数")
+	_check(stats["rules"][1]["diagnostic_count"] >= 2, "28.6 诊断计数")
+	_check_eq(_ast.get_lint_stats()["file_count"], 0, "28.6 重置计数")
+
+	_check_eq(_ast.load_lint_rules([{"id": "x", "query": "(name) @n (#contains? @n \"a\")"}])["success"], false, "28.7 不支持的谓词")
+	_check_eq(_ast.load_lint_rules([rules[0], rules[0]])["success"], false, "28.7 重复的规则 id")
+	_check_eq(_ast.lint_file("test://lint")["success"], false, "28.7 加载失败后没有规则")
+
+	# 可以匹配空串的行尾锚定模式在任何文本的末尾都成立
+	var tail_rules := [
+		{"id": "any-tail", "query": "(function_definition name: (name) @name (#match? @name \"\\\\s*$\"))"},
+		{"id": "no-tail", "query": "(function_definition name: (name) @name (#not-match? @name \"\\\\d?$\"))"},
+	]
+	_check_eq(_ast.load_lint_rules(tail_rules)["success"], true, "28.8 加载行尾锚定规则")
+	_ast.update_file("test://lint", "func foo():\n\tpass\n\nfunc bar_():\n\tpass\n")
+	var tails: Array = _ast.lint_file("test://lint")["diagnostics"]
+	_check_eq(tails.size(), 2, "28.8 \\s*$ 匹配每个函数名")
+	_check_eq(tails.filter(func(d): return d["rule"] == "no-tail").size(), 0, "28.8 #not-match? \\d?$ 不触发")
+
+	_ast.close_file("test://lint")
+
+
+# ──────────────────────────────────────────────
+# Section 29: 脚本依赖图
+# ──────────────────────────────────────────────
+
+func _test_section_29_dependencies() -> void:
+	_begin_section("29. 脚本依赖图")
+
+	_ast.index_files({
+		"res://dep/base.gd": "class_name DepBase\nextends Node\n",
+		"res://dep/player.gd": "extends DepBase\nconst Util = preload(\"util.gd\")\n",
+		"res://dep/util.gd": "static func make():\n\treturn load(\"res://dep/enemy.gd\")\n",
+		"res://dep/enemy.gd": "extends \"../dep/base.gd\"\nvar target: DepBase\n",
+	})
+
+	var deps := _ast.get_script_dependencies("res://dep/player.gd")
+	_check_eq(deps["success"], true, "29.1 查询依赖")
+	_check_eq(deps["file_paths"].size(), 2, "29.1 extends 与 preload 两个依赖")
+	var util_slot: int = deps["file_paths"].find("res://dep/util.gd")
+	_check(util_slot >= 0, "29.1 相对路径按脚本目录解析")
+	_check_eq(deps["kinds"][util_slot], 2, "29.1 preload 种类位")
+	_check(deps["kinds"][deps["file_paths"].find("res://dep/base.gd")] & 1 != 0, "29.1 通过 class_name 解析 extends")
+
+	var dependents := _ast.get_script_dependents("res://dep/base.gd")
+	_check_eq(dependents["file_paths"].size(), 2, "29.2 反向依赖")
+	_check(dependents["file_paths"].has("res://dep/enemy.gd"), "29.2 路径形式的 extends")
+	_check_eq(_ast.get_script_dependents("res://dep/base.gd", {"kinds": ["load"]})["file_paths"].size(), 0, "29.2 按种类过滤")
+
+	var closure := _ast.get_script_dependents("res://dep/enemy.gd", {"transitive": true})
+	_check_eq(closure["file_paths"], PackedStringArray(["res://dep/util.gd", "res://dep/player.gd"]), "29.3 传递反向依赖按广度优先")
+
+	var sorted := _ast.sort_scripts_by_dependencies(PackedStringArray(["res://dep/player.gd", "res://dep/util.gd", "res://dep/enemy.gd", "res://dep/base.gd"]))
+	_check_eq(sorted["file_paths"], PackedStringArray(["res://dep/base.gd", "res://dep/enemy.gd", "res://dep/util.gd", "res://dep/player.gd"]), "29.4 拓扑排序")
+	_check_eq(sorted["cyclic_files"].size(), 0, "29.4 无环")
+
+	_ast.index_file("res://dep/util.gd", "static func make():\n\treturn null\n")
+	_check_eq(_ast.get_script_dependents("res://dep/enemy.gd")["file_paths"].size(), 0, "29.5 增量更新后依赖消失")
+
+	_ast.index_file("res://dep/base.gd", "class_name DepBase\nconst Player = preload(\"player.gd\")\n")
+	var cyclic := _ast.sort_scripts_by_dependencies()
+	_check_eq(cyclic["cyclic_files"].size(), 2, "29.6 检测循环依赖")
+	_check(cyclic["cyclic_files"].has("res://dep/player.gd"), "29.6 列出环上的文件")
+	_check_eq(cyclic["file_paths"][-1], "res://dep/enemy.gd", "29.6 依赖环的文件排在最后")
+
+	_check_eq(_ast.get_script_dependencies("res://dep/player.gd", {"kinds": ["import"]})["success"], false, "29.7 未知种类")
+	_check_eq(_ast.get_script_dependencies("res://dep/none.gd")["success"], false, "29.7 未索引的文件")
+
+	for path in ["res://dep/base.gd", "res://dep/player.gd", "res://dep/util.gd", "res://dep/enemy.gd"]:
+		_ast.unindex_file(path)
+	_check_eq(_ast.get_script_dependents("res://dep/base.gd")["success"], false, "29.8 移除文件后不在图中")
+
+
+# ──────────────────────────────────────────────
+# Section 30: 文件系统监视
+# ──────────────────────────────────────────────
+
+# Polls until the watcher has nothing in flight (or the timeout passes) and
+# returns the files it reloaded meanwhile.
+func _wait_for_watcher(timeout_msec: int) -> PackedStringArray:
+	var changed := PackedStringArray()
+	var deadline := Time.get_ticks_msec() + timeout_msec
+	while Time.get_ticks_msec() < deadline:
+		OS.delay_msec(10)
+		var polled := _ast.poll_file_watcher()
+		changed.append_array(polled["changed_files"])
+		if not changed.is_empty() and not polled["busy"]:
+			break
+	return changed
+
+
+func _test_section_30_file_watcher() -> void:
+	_begin_section("30. 文件系统监视")
+
+	var dir := "user://ast_watch"
+	var path := dir + "/watched.gd"
+	DirAccess.make_dir_recursive_absolute(ProjectSettings.globalize_path(dir))
+	var file := FileAccess.open(path, FileAccess.WRITE)
+	file.store_string("var watched = 1\n")
+	file.close()
+	_ast.open_file(path, "var watched = 1\n")
+
+	var started := _ast.start_file_watcher(dir, {"debounce_msec": 20})
+	if OS.get_name() != "Linux":
+		_check_eq(started["success"], false, "30.1 非 Linux 平台报告不支持")
+		_ast.close_file(path)
+		return
+	_check_eq(started["success"], true, "30.1 开始监视")
+
+	var signalled := PackedStringArray()
+	var on_changed := func(paths: PackedStringArray) -> void: signalled.append_array(paths)
+	_ast.files_changed_on_disk.connect(on_changed)
+
+	file = FileAccess.open(path, FileAccess.WRITE)
+	file.store_string("var watched = 2\nfunc added():\n\tpass\n")
+	file.close()
+	var changed := _wait_for_watcher(2000)
+	_check_eq(changed, PackedStringArray([path]), "30.2 外部修改后重新加载")
+	_check_eq(_ast.get_file_source(path), "var watched = 2\nfunc added():\n\tpass\n", "30.2 缓冲区与磁盘一致")
+	_check_eq(signalled, PackedStringArray([path]), "30.2 信号列出变化的文件")
+	_check_eq(_ast.undo(path)["success"], true, "30.3 重新加载进入撤销历史")
+	_ast.redo(path)
+
+	file = FileAccess.open(path, FileAccess.WRITE)
+	file.store_string("var watched = 2\nfunc added():\n\tpass\n")
+	file.close()
+	_check_eq(_wait_for_watcher(300).size(), 0, "30.4 内容哈希相同则跳过")
+
+	# A renamed directory is watched under its new path.
+	var sub_dir := dir + "/sub"
+	var moved_dir := dir + "/moved"
+	var moved_path := moved_dir + "/inner.gd"
+	DirAccess.make_dir_recursive_absolute(ProjectSettings.globalize_path(sub_dir))
+	file = FileAccess.open(sub_dir + "/inner.gd", FileAccess.WRITE)
+	file.store_string("var inner = 1\n")
+	file.close()
+	_wait_for_watcher(300)
+	DirAccess.rename_absolute(ProjectSettings.globalize_path(sub_dir), ProjectSettings.globalize_path(moved_dir))
+	_wait_for_watcher(300)
+	_ast.open_file(moved_path, "var inner = 1\n")
+	file = FileAccess.open(moved_path, FileAccess.WRITE)
+	file.store_string("var inner = 2\n")
+	file.close()
+	_check_eq(_wait_for_watcher(2000), PackedStringArray([moved_path]), "30.6 重命名的目录按新路径监视")
+	_ast.close_file(moved_path)
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(moved_path))
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(moved_dir))
+
+	_ast.files_changed_on_disk.disconnect(on_changed)
+	_check_eq(_ast.stop_file_watcher(), true, "30.5 停止监视")
+	_check_eq(_ast.poll_file_watcher()["watching"], false, "30.5 已停止")
+	_ast.close_file(path)
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(path))
+	DirAccess.remove_absolute(ProjectSettings.globalize_path(dir))
+
+
+# ──────────────────────────────────────────────
+# Section 31: 共享语法树缓存
+# ──────────────────────────────────────────────
+
+func _test_section_31_tree_cache() -> void:
+	_begin_section("31. 共享语法树缓存")
+
+	var code := "class_name CachedScript\nvar cached = 31\nfunc cached_func():\n\treturn cached\n"
+	_ast.configure_tree_cache({"clear": true})
+	_ast.get_tree_cache_stats(true)
+	_ast.open_file("test://cache_a", code)
+	var stats := _ast.get_tree_cache_stats()
+	_check_eq(stats["misses"], 1, "31.1 首次打开未命中")
+	_check_eq(stats["entry_count"], 1, "31.1 解析结果已缓存")
+
+	var other := ASTManager.new()
+	other.open_file("test://cache_b", code)
+	stats = _ast.get_tree_cache_stats()
+	_check_eq(stats["hits"], 1, "31.2 另一个管理器命中缓存")
+	_check_eq(other.get_sexp("test://cache_b"), _ast.get_sexp("test://cache_a"), "31.2 缓存的语法树一致")
+
+	_ast.update_file("test://cache_a", code + "var extra = 1\n")
+	_ast.update_file("test://cache_a", code)
+	stats = _ast.get_tree_cache_stats()
+	_check_eq(stats["hits"], 2, "31.3 改回原内容时复用缓存")
+	_check_eq(_ast.get_file_source("test://cache_a"), code, "31.3 源码正确")
+	_check_eq(_ast.undo("test://cache_a")["success"], true, "31.3 命中缓存的更新可撤销")
+
+	_check_eq(_ast.validate(code)["valid"], true, "31.4 validate 使用缓存")
+	_check_eq(_ast.get_tree_cache_stats()["hits"], 3, "31.4 validate 命中")
+
+	stats = _ast.get_tree_cache_stats(true)
+	_check(stats["hit_rate"] > 0.0, "31.5 命中率 %.2f" % stats["hit_rate"])
+	_check_eq(_ast.get_tree_cache_stats()["hits"], 0, "31.5 统计已重置")
+
+	_ast.configure_tree_cache({"enabled": false})
+	other.open_file("test://cache_c", code)
+	stats = _ast.get_tree_cache_stats()
+	_check_eq(stats["hits"], 0, "31.6 禁用后不再命中")
+	_check_eq(stats["entry_count"], 0, "31.6 禁用时清空缓存")
+	_ast.configure_tree_cache({"enabled": true})
+
+	other.close_file("test://cache_b")
+	other.close_file("test://cache_c")
+	_ast.close_file("test://cache_a")
+
+
+# ──────────────────────────────────────────────
+# Section 32: 打开文件的内存预算
+# ──────────────────────────────────────────────
+
+func _test_section_32_file_budget() -> void:
+	_begin_section("32. 打开文件的内存预算")
+
+	var paths := PackedStringArray()
+	var sexps := {}
+	var before := _ast.get_file_budget_info()
+	for i in range(6):
+		var path := "test://budget_%d" % i
+		var code := "var value_%d = %d\nfunc f_%d(x):\n\tif x > %d:\n\t\treturn x\n\treturn value_%d\n" % [i, i, i, i, i]
+		_ast.open_file(path, code)
+		paths.append(path)
+		sexps[path] = _ast.get_sexp(path)
+	var info := _ast.get_file_budget_info()
+	var per_file: int = (info["tree_bytes"] - before["tree_bytes"]) / 6
+	_check(per_file > 0, "32.1 估算每棵树 %d 字节" % per_file)
+
+	_ast.set_file_pinned(paths[0])
+	_ast.configure_file_budget({"max_tree_bytes": info["tree_bytes"] - per_file * 2})
+	info = _ast.get_file_budget_info()
+	_check(info["evicted_count"] >= 3, "32.2 超出预算时淘汰最久未用的树 (%d)" % info["evicted_count"])
+	_check(info["tree_bytes"] <= info["max_tree_bytes"], "32.2 驻留树在预算内")
+	_check_eq(info["pinned_count"], 1, "32.3 固定的文件计数")
+
+	var reparses: int = info["reparse_count"]
+	_check_eq(_ast.get_sexp(paths[1]), sexps[paths[1]], "32.4 访问被淘汰的文件时透明重新解析")
+	_check_eq(_ast.get_file_budget_info()["reparse_count"], reparses + 1, "32.4 重新解析计数")
+	_check_eq(_ast.get_document_outline(paths[2])["success"], true, "32.4 大纲可用")
+
+	for path in paths:
+		_ast.get_sexp(path)
+	_check(_ast.get_file_budget_info()["tree_bytes"] <= info["max_tree_bytes"], "32.5 轮流访问后仍在预算内")
+	_check_eq(_ast.get_sexp(paths[0]), sexps[paths[0]], "32.5 固定的文件未被淘汰")
+
+	_check_eq(_ast.update_file(paths[3], "var edited = 1\n")["success"], true, "32.6 编辑被淘汰的文件")
+	_check_eq(_ast.undo(paths[3])["success"], true, "32.6 撤销")
+	_check_eq(_ast.get_sexp(paths[3]), sexps[paths[3]], "32.6 撤销后语法树一致")
+
+	# 预算极小: 只留下固定的文件和最近用过的两个
+	_ast.configure_file_budget({"max_tree_bytes": 1})
+	for path in [paths[3], paths[2], paths[4]]:
+		_ast.get_sexp(path)
+	var reparses_before_diff: int = _ast.get_file_budget_info()["reparse_count"]
+	var tree_diff := _ast.diff_ast(paths[2], paths[3])
+	_check_eq(tree_diff["success"], true, "32.7 只有新文件被淘汰时 diff_ast 可用")
+	_check(tree_diff["operations"].size() > 0, "32.7 diff_ast 找到差异")
+	_check_eq(_ast.get_file_budget_info()["reparse_count"], reparses_before_diff + 1, "32.7 只重新解析了新文件")
+
+	var version_1: int = _ast.get_history_info(paths[1])["version"]
+	var source_1 := _ast.get_file_source(paths[1])
+	var merged := _ast.merge_file(paths[1], version_1, source_1.replace("return x", "return -x"), {"dry_run": true})
+	_check_eq([merged["success"], merged["has_error"]], [true, false], "32.8 被淘汰的文件 merge_file 预演")
+	_check_contains(merged["merged"], "return -x", "32.8 预演返回合并结果")
+
+	var source_4 := _ast.get_file_source(paths[4])
+	var patch := _ast.generate_diff(source_4, source_4.replace("return x", "return x + 1"), paths[4])
+	var patched := _ast.apply_patch(paths[4], patch)
+	_check_eq([patched["success"], patched["has_error"]], [true, false], "32.9 被淘汰的文件应用补丁")
+	_check_contains(_ast.get_file_source(paths[4]), "return x + 1", "32.9 补丁已应用")
+
+	_ast.configure_file_budget({"max_tree_bytes": 0})
+	for path in paths:
+		_ast.close_file(path)
+	_check_eq(_ast.get_file_budget_info()["tree_bytes"], before["tree_bytes"], "32.10 关闭后释放计数")
+
+
+# ──────────────────────────────────────────────
+# Section 33: 内存统计
+# ──────────────────────────────────────────────
+
+func _test_section_33_memory_stats() -> void:
+	_begin_section("33. 内存统计")
+
+	var before := _ast.get_memory_stats()
+	var big := ""
+	for i in range(200):
+		big += "var member_%d = %d\n" % [i, i]
+	_ast.open_file("test://memory_big", big)
+	_ast.open_file("test://memory_small", "var x = 1\n")
+
+	var stats := _ast.get_memory_stats({"top_files": 1})
+	_check_eq(stats["tree_sitter"]["counting"], true, "33.1 已安装计数分配器")
+	_check(stats["tree_sitter"]["bytes"] > 0, "33.1 tree-sitter 占用 %d 字节" % stats["tree_sitter"]["bytes"])
+	_check_eq(stats["files"]["source_bytes"] - before["files"]["source_bytes"], big.length() + 10, "33.2 源码字节按文件累计")
+	_check(stats["files"]["tree_bytes"] > before["files"]["tree_bytes"], "33.2 语法树估算增加")
+	_check_eq(stats["top_files"].size(), 1, "33.3 top_files 数量受限")
+	_check_eq(stats["top_files"][0]["file_path"], "test://memory_big", "33.3 占用最多的文件排在最前")
+	_check(stats["indexes"]["symbol_bytes"] > 0, "33.4 符号索引占用")
+	_check(stats["total_bytes"] > stats["files"]["source_bytes"], "33.4 总量包含各部分")
+
+	_ast.configure_highlighting()
+	_check(_ast.get_memory_stats()["queries"]["highlight_bytes"] > 0, "33.5 高亮查询占用")
+
+	_check_eq(_ast.add_memory_monitors("AST Test"), true, "33.6 注册性能监视器")
+	_check(Performance.has_custom_monitor("AST Test/total_bytes"), "33.6 监视器存在")
+	_check(Performance.get_custom_monitor("AST Test/source_bytes") >= big.length(), "33.6 监视器返回源码字节")
+	_check_eq(_ast.add_memory_monitors("AST Test"), false, "33.6 重复注册被拒绝")
+	_ast.remove_memory_monitors()
+	_check(not Performance.has_custom_monitor("AST Test/total_bytes"), "33.7 移除监视器")
+	_check(Performance.has_custom_monitor("AST/tree_sitter_bytes"), "33.7 全局监视器一直存在")
+
+	_ast.close_file("test://memory_big")
+	_ast.close_file("test://memory_small")
+
+
+# ──────────────────────────────────────────────
+# Section 34: 池分配器
+# ──────────────────────────────────────────────
+
+func _test_section_34_pool_allocator() -> void:
+	_begin_section("34. 池分配器")
+
+	var before: String = _ast.get_memory_stats()["tree_sitter"]["backend"]
+	_check_eq(_ast.configure_allocator({"backend": "pool"})["backend"], "pool", "34.1 切换到池分配")
+	_ast.open_file("test://pool_file", "func f():\n\treturn 1\n")
+	_check_contains(_ast.get_sexp("test://pool_file"), "function_definition", "34.1 池分配下解析正常")
+	var stats: Dictionary = _ast.get_memory_stats()["tree_sitter"]
+	_check_eq(stats["backend"], "pool", "34.2 内存统计报告后端")
+	_check(stats["pool_reserved_bytes"] > 0, "34.2 池已保留 %d 字节" % stats["pool_reserved_bytes"])
+	_check(stats["pool_free_bytes"] <= stats["pool_reserved_bytes"], "34.2 空闲不超过保留")
+
+	_check_eq(_ast.configure_allocator({"backend": "system"})["backend"], "system", "34.3 切回系统分配")
+	_ast.update_file("test://pool_file", "func f():\n\treturn 2\n")
+	_check_contains(_ast.get_sexp("test://pool_file"), "return_statement", "34.3 切换后池中旧树仍可用")
+	_ast.close_file("test://pool_file")
+	_check_eq(_ast.configure_allocator({"backend": "arena"})["success"], false, "34.4 未知后端被拒绝")
+
+	var sources := PackedStringArray()
+	for i in range(64):
+		var source := "extends Node\n"
+		for j in range(100):
+			source += "func method_%d_%d(a, b):\n\tvar c = a + b * %d\n\tif c > 10:\n\t\treturn [c, a, b]\n\treturn {\"c\": c}\n" % [i, j, j]
+		sources.push_back(source)
+	var bench := _ast.benchmark_allocators(sources, {"rounds": 3})
+	_check_eq(bench["success"], true, "34.5 分配器基准测试完成")
+	for backend in ["system", "pool"]:
+		var entry: Dictionary = bench[backend]
+		_log("  [bench] %s: %d 文件 x %d 轮 %.2f ms, %.1f MB/s, 峰值 %d 字节, RSS 增长 %d 字节" % [backend, bench["file_count"], bench["rounds"], entry["msec"], entry["megabytes_per_second"], entry["peak_bytes"], entry["rss_growth_bytes"]])
+	_check_eq(_ast.get_memory_stats()["tree_sitter"]["backend"], "system", "34.5 基准测试后恢复原后端")
+	_ast.configure_allocator({"backend": before})
+
+
+# ──────────────────────────────────────────────
+# Section 35: 性能计时
+# ──────────────────────────────────────────────
+
+func _find_probe(probes: Array, probe_name: String) -> Dictionary:
+	for probe in probes:
+		if probe["name"] == probe_name:
+			return probe
+	return {}
+
+
+func _test_section_35_perf_stats() -> void:
+	_begin_section("35. 性能计时")
+
+	_ast.configure_perf_stats({"enabled": true, "reset": true})
+	var empty := _ast.get_perf_stats()
+	_check_eq(empty["enabled"], true, "35.1 计时已启用")
+	_check_eq(empty["methods"].size(), 0, "35.1 重置后没有记录")
+
+	var source := ""
+	for i in range(200):
+		source += "func f_%d(a):\n\treturn a * %d\n" % [i, i]
+	_ast.open_file("test://perf_file", source)
+	for i in range(20):
+		_ast.update_file("test://perf_file", source + "var tail_%d = %d\n" % [i, i])
+	_ast.query("test://perf_file", "(function_definition name: (name) @name)")
+	_ast.generate_structured_diff(source, source.replace("a * 7", "a * 8"))
+
+	var stats := _ast.get_perf_stats(true)
+	var update := _find_probe(stats["methods"], "update_file")
+	_check_eq(update.get("calls", 0), 20, "35.2 update_file 调用次数")
+	_check(update["p50_usec"] <= update["p95_usec"] and update["p95_usec"] <= update["p99_usec"], "35.2 百分位有序")
+	_check(update["p99_usec"] <= update["max_usec"], "35.2 p99 不超过最大值")
+	var parse := _find_probe(stats["phases"], "parse")
+	_check(parse.get("calls", 0) >= 21, "35.3 解析阶段 %d 次" % parse.get("calls", 0))
+	_check(parse["amount"] >= source.length() * 21, "35.3 解析字节数")
+	for phase in ["transcode", "query_compile", "query_exec", "marshal", "diff"]:
+		_check(not _find_probe(stats["phases"], phase).is_empty(), "35.4 记录了阶段 %s" % phase)
+	_check(stats["methods"][0]["total_usec"] >= stats["methods"][-1]["total_usec"], "35.5 方法按总耗时排序")
+	for phase in stats["phases"]:
+		_log("  [bench] %s: %d 次, p50 %.1f us, p99 %.1f us" % [phase["name"], phase["calls"], phase["p50_usec"], phase["p99_usec"]])
+
+	_check_eq(_ast.get_perf_stats()["methods"].size(), 0, "35.6 get_perf_stats(true) 已重置")
+	_ast.configure_perf_stats({"enabled": false})
+	_ast.get_file_source("test://perf_file")
+	_check_eq(_ast.get_perf_stats()["methods"].size(), 0, "35.7 停用后不再记录")
+	_ast.configure_perf_stats({"enabled": true})
+	_ast.close_file("test://perf_file")
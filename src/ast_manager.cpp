@@ -1,11 +1,42 @@
 #include "ast_manager.h"
-
+#include "content_hash.h"
+#include "document_outline.h"
+#include "gdscript_formatter.h"
+#include "highlight_cache.h"
+#include "line_diff.h"
+#include "line_merge.h"
+#include "memory_usage.h"
+#include "perf_stats.h"
+#include "reference_index.h"
+#include "staged_edit.h"
+#include "symbol_index.h"
+#include "symbol_index_file.h"
+#include "tree_cache.h"
+#include "tree_diff.h"
+#include "ts_allocator.h"
+#include "unified_patch.h"
+
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/performance.hpp>
+#include <godot_cpp/classes/project_settings.hpp>
+#include <godot_cpp/classes/time.hpp>
 #include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
-#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <vector>
 #include <functional>
-#include "../thirdparty/dtl/dtl.hpp"
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
 static int count_descendants(TSNode node) {
 	int count = 0;
@@ -27,7 +58,27 @@ static int count_all_descendants(TSNode node) {
 	return count;
 }
 
-static void collect_error_nodes(TSNode node, Array &errors) {
+static int count_error_nodes_under(TSNode node) {
+	if (!ts_node_has_error(node)) {
+		return 0;
+	}
+	int count = (ts_node_is_error(node) || ts_node_is_missing(node)) ? 1 : 0;
+	uint32_t child_count = ts_node_child_count(node);
+	for (uint32_t i = 0; i < child_count; i++) {
+		count += count_error_nodes_under(ts_node_child(node, i));
+	}
+	return count;
+}
+
+static int count_error_nodes(TSNode node) {
+	perf_stats::Scope scope(perf_stats::PHASE_ERROR_SCAN);
+	return count_error_nodes_under(node);
+}
+
+static void collect_error_nodes_under(TSNode node, Array &errors) {
+	if (!ts_node_has_error(node)) {
+		return;
+	}
 	if (ts_node_is_error(node) || ts_node_is_missing(node)) {
 		Dictionary err;
 		err["start_byte"] = (int)ts_node_start_byte(node);
@@ -43,10 +94,36 @@ static void collect_error_nodes(TSNode node, Array &errors) {
 
 	uint32_t child_count = ts_node_child_count(node);
 	for (uint32_t i = 0; i < child_count; i++) {
-		collect_error_nodes(ts_node_child(node, i), errors);
+		collect_error_nodes_under(ts_node_child(node, i), errors);
 	}
 }
 
+static void collect_error_nodes(TSNode node, Array &errors) {
+	perf_stats::Scope scope(perf_stats::PHASE_ERROR_SCAN);
+	collect_error_nodes_under(node, errors);
+}
+
+// ts_parser_parse_string(), timed.
+static TSTree *parse_source(TSParser *parser, const TSTree *old_tree, const char *data, uint32_t length) {
+	perf_stats::Scope scope(perf_stats::PHASE_PARSE);
+	scope.add_amount(length);
+	return ts_parser_parse_string(parser, old_tree, data, length);
+}
+
+// Conversions of whole sources, timed.
+static CharString source_to_utf8(const String &source) {
+	perf_stats::Scope scope(perf_stats::PHASE_TRANSCODE);
+	CharString utf8 = source.utf8();
+	scope.add_amount(utf8.length());
+	return utf8;
+}
+
+static String source_from_utf8(const char *data, int64_t length) {
+	perf_stats::Scope scope(perf_stats::PHASE_TRANSCODE);
+	scope.add_amount(length);
+	return String::utf8(data, length);
+}
+
 static Dictionary make_parse_result_dict(const String &file_path, TSTree *tree) {
 	Dictionary result;
 	result["success"] = true;
@@ -60,8 +137,11 @@ static Dictionary make_parse_result_dict(const String &file_path, TSTree *tree)
 
 	TSNode root = ts_tree_root_node(tree);
 	bool has_error = ts_node_has_error(root);
-	result["has_error"] = has_error;
-	result["node_count"] = count_all_descendants(root);
+	{
+		perf_stats::Scope scope(perf_stats::PHASE_MARSHAL);
+		result["has_error"] = has_error;
+		result["node_count"] = count_all_descendants(root);
+	}
 
 	Array error_ranges;
 	int error_count = 0;
@@ -75,741 +155,5314 @@ static Dictionary make_parse_result_dict(const String &file_path, TSTree *tree)
 	return result;
 }
 
-ASTManager::ASTManager() {
-	parser = ts_parser_new();
-	const TSLanguage *lang = tree_sitter_gdscript();
-	ts_parser_set_language(parser, lang);
+static bool edits_overlap(int start1, int end1, int start2, int end2) {
+	return end1 > start2;
 }
 
-ASTManager::~ASTManager() {
-	for (const KeyValue<String, FileState> &kv : open_files) {
-		if (kv.value.tree) {
-			ts_tree_delete(kv.value.tree);
+struct ByteEditComparator {
+	bool operator()(const ByteEdit &a, const ByteEdit &b) const {
+		return a.start_byte < b.start_byte;
+	}
+};
+
+static TSPoint advance_point(TSPoint point, const char *data, uint32_t length) {
+	for (uint32_t i = 0; i < length; i++) {
+		if (data[i] == '\n') {
+			point.row++;
+			point.column = 0;
+		} else {
+			point.column++;
 		}
 	}
-	open_files.clear();
+	return point;
+}
 
-	if (parser) {
-		ts_parser_delete(parser);
-		parser = nullptr;
+// Splices sorted, non-overlapping edits into one new buffer in a single pass
+// and fills the matching TSInputEdits (in the same ascending order).
+static PackedByteArray splice_byte_edits(const PackedByteArray &original, const Vector<ByteEdit> &edits, Vector<TSInputEdit> &r_input_edits) {
+	const char *src = reinterpret_cast<const char *>(original.ptr());
+	uint32_t src_len = original.size();
+
+	int64_t new_len = src_len;
+	for (int i = 0; i < edits.size(); i++) {
+		new_len += edits[i].new_bytes.size() - (int64_t)(edits[i].end_byte - edits[i].start_byte);
 	}
-}
 
-String ASTManager::ping() {
-	return "pong";
-}
+	PackedByteArray result;
+	result.resize(new_len);
+	uint8_t *dst = result.ptrw();
+	r_input_edits.resize(edits.size());
 
-String ASTManager::get_version() {
-	return AST_MANAGER_VERSION;
+	TSPoint point = { 0, 0 };
+	uint32_t src_pos = 0;
+	uint32_t dst_pos = 0;
+	for (int i = 0; i < edits.size(); i++) {
+		const ByteEdit &edit = edits[i];
+		uint32_t keep_len = edit.start_byte - src_pos;
+		memcpy(dst + dst_pos, src + src_pos, keep_len);
+		dst_pos += keep_len;
+
+		TSInputEdit &input_edit = r_input_edits.write[i];
+		point = advance_point(point, src + src_pos, keep_len);
+		input_edit.start_byte = edit.start_byte;
+		input_edit.start_point = point;
+		input_edit.old_end_byte = edit.end_byte;
+		input_edit.old_end_point = advance_point(point, src + edit.start_byte, edit.end_byte - edit.start_byte);
+
+		const char *insert_data = reinterpret_cast<const char *>(edit.new_bytes.ptr());
+		uint32_t insert_len = edit.new_bytes.size();
+		memcpy(dst + dst_pos, insert_data, insert_len);
+		input_edit.new_end_byte = edit.start_byte + insert_len;
+		input_edit.new_end_point = advance_point(point, insert_data, insert_len);
+		dst_pos += insert_len;
+
+		point = input_edit.old_end_point;
+		src_pos = edit.end_byte;
+	}
+	memcpy(dst + dst_pos, src + src_pos, src_len - src_pos);
+
+	return result;
 }
 
-Dictionary ASTManager::parse_test(const String &source_code) {
-	Dictionary result;
-	result["success"] = false;
-	result["root_kind"] = "";
-	result["node_count"] = 0;
-	result["has_error"] = false;
-	result["sexp"] = "";
+// Builds the edited buffer and, when the file has a tree, an edited copy of
+// it to reparse against. The cached tree itself stays untouched until a
+// staged edit is committed.
+static void build_staged_buffer(const FileState &state, const Vector<ByteEdit> &edits, PackedByteArray &r_bytes, TSTree *&r_edited_tree) {
+	Vector<TSInputEdit> input_edits;
+	r_bytes = splice_byte_edits(state.source_bytes, edits, input_edits);
 
-	if (!parser) {
-		return result;
+	r_edited_tree = nullptr;
+	if (state.tree) {
+		r_edited_tree = ts_tree_copy(state.tree);
+		for (int i = input_edits.size() - 1; i >= 0; i--) {
+			ts_tree_edit(r_edited_tree, &input_edits[i]);
+		}
 	}
+}
 
-	CharString utf8 = source_code.utf8();
-	const char *code_str = utf8.get_data();
-	uint32_t code_len = utf8.length();
+static bool parse_byte_edit_dicts(const TypedArray<Dictionary> &edits, uint32_t source_length, Vector<ByteEdit> &r_edits, Dictionary &result) {
+	r_edits.resize(edits.size());
 
-	TSTree *tree = ts_parser_parse_string(parser, nullptr, code_str, code_len);
-	if (!tree) {
-		return result;
-	}
+	for (int i = 0; i < edits.size(); i++) {
+		Dictionary edit_dict = edits[i];
 
-	result["success"] = true;
+		if (!edit_dict.has("start_byte") || !edit_dict.has("end_byte") || !edit_dict.has("new_text")) {
+			result["error"] = "Edit " + String::num_int64(i) + " missing required fields";
+			return false;
+		}
 
-	TSNode root = ts_tree_root_node(tree);
-	const char *kind_str = ts_node_type(root);
-	result["root_kind"] = String(kind_str);
+		int start_byte = edit_dict["start_byte"];
+		int end_byte = edit_dict["end_byte"];
 
-	result["node_count"] = count_descendants(root);
-	result["has_error"] = ts_node_has_error(root);
+		if (start_byte < 0) {
+			result["error"] = "Edit " + String::num_int64(i) + " has negative start_byte";
+			return false;
+		}
+		if (end_byte < 0) {
+			result["error"] = "Edit " + String::num_int64(i) + " has negative end_byte";
+			return false;
+		}
+		if (start_byte > end_byte) {
+			result["error"] = "Edit " + String::num_int64(i) + " has start_byte > end_byte";
+			return false;
+		}
+		if (static_cast<uint32_t>(end_byte) > source_length) {
+			result["error"] = "Edit " + String::num_int64(i) + " end_byte exceeds source length";
+			return false;
+		}
 
-	char *sexp_str = ts_node_string(root);
-	if (sexp_str) {
-		result["sexp"] = String(sexp_str);
-		::free(sexp_str);
+		ByteEdit &edit = r_edits.write[i];
+		edit.start_byte = start_byte;
+		edit.end_byte = end_byte;
+		edit.new_bytes = String(edit_dict["new_text"]).to_utf8_buffer();
 	}
 
-	ts_tree_delete(tree);
+	r_edits.sort_custom<ByteEditComparator>();
 
-	return result;
+	for (int i = 0; i < r_edits.size() - 1; i++) {
+		const ByteEdit &edit1 = r_edits[i];
+		const ByteEdit &edit2 = r_edits[i + 1];
+
+		if (edits_overlap(edit1.start_byte, edit1.end_byte, edit2.start_byte, edit2.end_byte)) {
+			result["error"] = "Edits overlap: edit at byte " + String::num_int64(edit1.start_byte) +
+					" and edit at byte " + String::num_int64(edit2.start_byte);
+			return false;
+		}
+	}
+
+	return true;
 }
 
-Dictionary ASTManager::open_file(const String &file_path, const String &content) {
-	CharString utf8 = content.utf8();
-	const char *code_str = utf8.get_data();
-	uint32_t code_len = utf8.length();
+// Lengths of the common byte prefix and of the common suffix of the rest.
+static void find_common_ends(const uint8_t *old_data, uint32_t old_len, const uint8_t *new_data, uint32_t new_len, uint32_t &r_prefix, uint32_t &r_suffix) {
+	uint32_t prefix = 0;
+	uint32_t max_prefix = MIN(old_len, new_len);
+	while (prefix < max_prefix && old_data[prefix] == new_data[prefix]) {
+		prefix++;
+	}
+	uint32_t suffix = 0;
+	uint32_t max_suffix = MIN(old_len, new_len) - prefix;
+	while (suffix < max_suffix && old_data[old_len - 1 - suffix] == new_data[new_len - 1 - suffix]) {
+		suffix++;
+	}
+	r_prefix = prefix;
+	r_suffix = suffix;
+}
 
-	TSTree *tree = ts_parser_parse_string(parser, nullptr, code_str, code_len);
-	if (!tree) {
-		Dictionary err;
-		err["success"] = false;
-		err["error"] = "Failed to create parse tree";
-		err["file_path"] = file_path;
-		return err;
+// Reduces a whole-content replacement to the single edit between the common
+// prefix and suffix, so update_file can reuse the incremental path.
+static Vector<ByteEdit> make_replacement_edit(const PackedByteArray &old_bytes, const uint8_t *new_data, uint32_t new_len) {
+	const uint8_t *old_data = old_bytes.ptr();
+	uint32_t old_len = old_bytes.size();
+
+	uint32_t prefix = 0;
+	uint32_t suffix = 0;
+	find_common_ends(old_data, old_len, new_data, new_len, prefix, suffix);
+
+	Vector<ByteEdit> edits;
+	if (prefix == old_len && prefix == new_len) {
+		return edits;
 	}
 
-	if (open_files.has(file_path)) {
-		FileState &old_state = open_files[file_path];
-		if (old_state.tree) {
-			ts_tree_delete(old_state.tree);
+	ByteEdit edit;
+	edit.start_byte = prefix;
+	edit.end_byte = old_len - suffix;
+	uint32_t insert_len = new_len - suffix - prefix;
+	edit.new_bytes.resize(insert_len);
+	memcpy(edit.new_bytes.ptrw(), new_data + prefix, insert_len);
+	edits.push_back(edit);
+	return edits;
+}
+
+static Vector<ByteEdit> make_replacement_edit(const PackedByteArray &old_bytes, const CharString &new_utf8) {
+	return make_replacement_edit(old_bytes, reinterpret_cast<const uint8_t *>(new_utf8.get_data()), new_utf8.length());
+}
+
+// Turns a history delta into edits against the buffer on the side being
+// left: the from_version buffer for redo, the to_version buffer for undo.
+// Undo edits are shifted by what the preceding (ascending) edits inserted.
+static Vector<ByteEdit> make_history_step_edits(const FileHistory::Entry &entry, bool redo) {
+	Vector<ByteEdit> byte_edits;
+	byte_edits.resize(entry.edits.size());
+	int64_t shift = 0;
+	for (int i = 0; i < entry.edits.size(); i++) {
+		const FileHistory::Edit &delta = entry.edits[i];
+		ByteEdit &edit = byte_edits.write[i];
+		if (redo) {
+			edit.start_byte = delta.start_byte;
+			edit.end_byte = delta.start_byte + delta.removed.size();
+			edit.new_bytes = delta.inserted;
+		} else {
+			edit.start_byte = delta.start_byte + shift;
+			edit.end_byte = edit.start_byte + delta.inserted.size();
+			edit.new_bytes = delta.removed;
+			shift += delta.inserted.size() - delta.removed.size();
 		}
 	}
+	return byte_edits;
+}
 
-	FileState new_state;
-	new_state.source_bytes.resize(code_len);
-	for (uint32_t i = 0; i < code_len; i++) {
-		new_state.source_bytes[i] = static_cast<uint8_t>(code_str[i]);
+// "algorithm": "myers" (default), "patience" or "histogram".
+static LineDiff::Algorithm parse_diff_algorithm(const Dictionary &options) {
+	String algorithm = options.get("algorithm", "myers");
+	if (algorithm == "patience") {
+		return LineDiff::ALGORITHM_PATIENCE;
 	}
-	new_state.tree = tree;
-	open_files.insert(file_path, new_state);
+	if (algorithm == "histogram") {
+		return LineDiff::ALGORITHM_HISTOGRAM;
+	}
+	return LineDiff::ALGORITHM_MYERS;
+}
 
-	return make_parse_result_dict(file_path, tree);
+// "context": number of unchanged lines around each hunk, default 3.
+static uint32_t parse_diff_context(const Dictionary &options) {
+	int context = options.get("context", 3);
+	return context < 0 ? 0 : (uint32_t)context;
 }
 
-bool ASTManager::close_file(const String &file_path) {
-	if (!open_files.has(file_path)) {
-		return false;
+// Appends the tree-sitter leaves overlapping [start, end), clipped to it.
+static void collect_leaf_ranges(TSNode node, uint32_t start, uint32_t end, std::vector<LineDiff::Line> &r_tokens) {
+	uint32_t child_count = ts_node_child_count(node);
+	if (child_count == 0) {
+		uint32_t leaf_start = MAX(ts_node_start_byte(node), start);
+		uint32_t leaf_end = MIN(ts_node_end_byte(node), end);
+		if (leaf_start < leaf_end) {
+			LineDiff::Line token;
+			token.start = leaf_start;
+			token.length = leaf_end - leaf_start;
+			r_tokens.push_back(token);
+		}
+		return;
 	}
-
-	FileState &state = open_files[file_path];
-	if (state.tree) {
-		ts_tree_delete(state.tree);
-		state.tree = nullptr;
+	for (uint32_t i = 0; i < child_count; i++) {
+		TSNode child = ts_node_child(node, i);
+		if (ts_node_end_byte(child) <= start) {
+			continue;
+		}
+		if (ts_node_start_byte(child) >= end) {
+			break;
+		}
+		collect_leaf_ranges(child, start, end, r_tokens);
 	}
+}
 
-	open_files.erase(file_path);
-	return true;
+// Splits text not covered by a leaf into whitespace and non-whitespace runs.
+static void append_word_tokens(const char *data, uint32_t start, uint32_t end, std::vector<LineDiff::Line> &r_tokens) {
+	uint32_t pos = start;
+	while (pos < end) {
+		bool space = data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r';
+		uint32_t run_end = pos + 1;
+		while (run_end < end) {
+			bool run_space = data[run_end] == ' ' || data[run_end] == '\t' || data[run_end] == '\r';
+			if (run_space != space) {
+				break;
+			}
+			run_end++;
+		}
+		LineDiff::Line token;
+		token.start = pos;
+		token.length = run_end - pos;
+		r_tokens.push_back(token);
+		pos = run_end;
+	}
 }
 
-Dictionary ASTManager::update_file(const String &file_path, const String &new_content) {
-	if (!open_files.has(file_path)) {
-		Dictionary err;
-		err["success"] = false;
-		err["error"] = "File not open: " + file_path;
-		return err;
+// Tokenizes one line for the intra-line diff. Token mode uses the leaves of
+// root (or word runs where there is no tree); char mode uses UTF-8 code
+// points. A line terminator becomes an empty token with has_newline set, so
+// the token diff also lines up across line breaks.
+static void tokenize_line(const char *data, const LineDiff::Line &line, bool char_mode, TSNode *root, std::vector<LineDiff::Line> &r_tokens) {
+	uint32_t line_end = line.start + line.length;
+	if (char_mode) {
+		uint32_t pos = line.start;
+		while (pos < line_end) {
+			uint8_t lead = (uint8_t)data[pos];
+			uint32_t length = lead < 0x80 ? 1 : lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+			LineDiff::Line token;
+			token.start = pos;
+			token.length = MIN(length, line_end - pos);
+			r_tokens.push_back(token);
+			pos += token.length;
+		}
+	} else {
+		std::vector<LineDiff::Line> leaves;
+		if (root) {
+			collect_leaf_ranges(*root, line.start, line_end, leaves);
+		}
+		uint32_t pos = line.start;
+		for (const LineDiff::Line &leaf : leaves) {
+			append_word_tokens(data, pos, leaf.start, r_tokens);
+			r_tokens.push_back(leaf);
+			pos = leaf.start + leaf.length;
+		}
+		append_word_tokens(data, pos, line_end, r_tokens);
 	}
+	if (line.has_newline) {
+		LineDiff::Line terminator;
+		terminator.start = line_end;
+		terminator.has_newline = true;
+		r_tokens.push_back(terminator);
+	}
+}
 
-	FileState &state = open_files[file_path];
-	if (state.tree) {
-		ts_tree_delete(state.tree);
-		state.tree = nullptr;
+// Appends (side, line, start_column, end_column) for every run of changed
+// tokens; columns are byte offsets within the line.
+static void append_inline_ranges(const LineDiff &token_diff, bool old_side, const std::vector<LineDiff::Line> &tokens,
+		const std::vector<uint32_t> &token_lines, const std::vector<LineDiff::Line> &lines, PackedInt32Array &r_inline) {
+	int32_t side = old_side ? 0 : 1;
+	int64_t open_line = -1;
+	uint32_t open_start = 0;
+	uint32_t open_end = 0;
+	for (uint32_t t = 0; t < tokens.size(); t++) {
+		bool changed = old_side ? token_diff.is_old_line_changed(t) : token_diff.is_new_line_changed(t);
+		const LineDiff::Line &token = tokens[t];
+		if (!changed || token.length == 0) {
+			continue;
+		}
+		uint32_t line = token_lines[t];
+		if (open_line == (int64_t)line && open_end == token.start) {
+			open_end = token.start + token.length;
+			continue;
+		}
+		if (open_line >= 0) {
+			uint32_t line_start = lines[open_line].start;
+			r_inline.push_back(side);
+			r_inline.push_back((int32_t)open_line);
+			r_inline.push_back(open_start - line_start);
+			r_inline.push_back(open_end - line_start);
+		}
+		open_line = line;
+		open_start = token.start;
+		open_end = token.start + token.length;
 	}
+	if (open_line >= 0) {
+		uint32_t line_start = lines[open_line].start;
+		r_inline.push_back(side);
+		r_inline.push_back((int32_t)open_line);
+		r_inline.push_back(open_start - line_start);
+		r_inline.push_back(open_end - line_start);
+	}
+}
 
-	CharString utf8 = new_content.utf8();
-	const char *code_str = utf8.get_data();
-	uint32_t code_len = utf8.length();
+static void append_diff_op(PackedInt32Array &r_ops, LineDiff::Op op, uint32_t old_start, uint32_t old_count, uint32_t new_start, uint32_t new_count) {
+	r_ops.push_back(op);
+	r_ops.push_back(old_start);
+	r_ops.push_back(old_count);
+	r_ops.push_back(new_start);
+	r_ops.push_back(new_count);
+}
 
-	TSTree *tree = ts_parser_parse_string(parser, nullptr, code_str, code_len);
-	if (!tree) {
-		Dictionary err;
-		err["success"] = false;
-		err["error"] = "Failed to parse updated content";
-		err["file_path"] = file_path;
-		return err;
+// Builds the structured result of a computed line diff:
+//   hunks:  6 ints per hunk (old_start, old_count, new_start, new_count, first_op, op_count)
+//   ops:    5 ints per op (op, old_start, old_count, new_start, new_count)
+//   inline: 4 ints per changed span (side, line, start_column, end_column),
+//           only when inline_mode is "token" or "char".
+// Line numbers are 0-based. Token mode takes its token boundaries from
+// old_tree / new_tree when given.
+static Dictionary make_structured_diff(const LineDiff &diff,
+		const char *old_data, const std::vector<LineDiff::Line> &old_lines,
+		const char *new_data, const std::vector<LineDiff::Line> &new_lines,
+		uint32_t context, const String &inline_mode, TSTree *old_tree, TSTree *new_tree) {
+	PackedInt32Array hunk_array;
+	PackedInt32Array op_array;
+	PackedInt32Array inline_array;
+	bool want_inline = inline_mode == "token" || inline_mode == "char";
+	bool char_mode = inline_mode == "char";
+
+	TSNode old_root = old_tree ? ts_tree_root_node(old_tree) : TSNode();
+	TSNode new_root = new_tree ? ts_tree_root_node(new_tree) : TSNode();
+
+	LineDiff token_diff;
+	std::vector<LineDiff::Line> old_tokens;
+	std::vector<LineDiff::Line> new_tokens;
+	std::vector<uint32_t> old_token_lines;
+	std::vector<uint32_t> new_token_lines;
+
+	const std::vector<LineDiff::Change> &changes = diff.get_changes();
+	std::vector<LineDiff::Hunk> hunks = diff.make_hunks(context);
+	for (const LineDiff::Hunk &hunk : hunks) {
+		uint32_t first_op = op_array.size() / 5;
+		uint32_t old_pos = hunk.old_start;
+		uint32_t new_pos = hunk.new_start;
+		for (uint32_t c = hunk.first_change; c < hunk.first_change + hunk.change_count; c++) {
+			const LineDiff::Change &change = changes[c];
+			if (change.old_start > old_pos) {
+				uint32_t equal = change.old_start - old_pos;
+				append_diff_op(op_array, LineDiff::OP_EQUAL, old_pos, equal, new_pos, equal);
+			}
+			LineDiff::Op op = change.new_count == 0 ? LineDiff::OP_DELETE : change.old_count == 0 ? LineDiff::OP_INSERT : LineDiff::OP_REPLACE;
+			append_diff_op(op_array, op, change.old_start, change.old_count, change.new_start, change.new_count);
+			old_pos = change.old_start + change.old_count;
+			new_pos = change.new_start + change.new_count;
+
+			if (!want_inline || op != LineDiff::OP_REPLACE) {
+				continue;
+			}
+			old_tokens.clear();
+			new_tokens.clear();
+			old_token_lines.clear();
+			new_token_lines.clear();
+			for (uint32_t i = change.old_start; i < change.old_start + change.old_count; i++) {
+				tokenize_line(old_data, old_lines[i], char_mode, old_tree ? &old_root : nullptr, old_tokens);
+				old_token_lines.resize(old_tokens.size(), i);
+			}
+			for (uint32_t i = change.new_start; i < change.new_start + change.new_count; i++) {
+				tokenize_line(new_data, new_lines[i], char_mode, new_tree ? &new_root : nullptr, new_tokens);
+				new_token_lines.resize(new_tokens.size(), i);
+			}
+			token_diff.compute(old_data, old_tokens.data(), old_tokens.size(),
+					new_data, new_tokens.data(), new_tokens.size(), LineDiff::ALGORITHM_MYERS);
+			append_inline_ranges(token_diff, true, old_tokens, old_token_lines, old_lines, inline_array);
+			append_inline_ranges(token_diff, false, new_tokens, new_token_lines, new_lines, inline_array);
+		}
+		uint32_t old_end = hunk.old_start + hunk.old_count;
+		if (old_end > old_pos) {
+			uint32_t equal = old_end - old_pos;
+			append_diff_op(op_array, LineDiff::OP_EQUAL, old_pos, equal, new_pos, equal);
+		}
+
+		hunk_array.push_back(hunk.old_start);
+		hunk_array.push_back(hunk.old_count);
+		hunk_array.push_back(hunk.new_start);
+		hunk_array.push_back(hunk.new_count);
+		hunk_array.push_back(first_op);
+		hunk_array.push_back(op_array.size() / 5 - first_op);
 	}
 
-	state.source_bytes.resize(code_len);
-	for (uint32_t i = 0; i < code_len; i++) {
-		state.source_bytes[i] = static_cast<uint8_t>(code_str[i]);
+	Dictionary result;
+	result["success"] = true;
+	result["hunks"] = hunk_array;
+	result["ops"] = op_array;
+	if (want_inline) {
+		result["inline"] = inline_array;
 	}
-	state.tree = tree;
+	result["old_line_count"] = (int)old_lines.size();
+	result["new_line_count"] = (int)new_lines.size();
+	return result;
+}
 
-	return make_parse_result_dict(file_path, tree);
+// Number of leading lines, newline included, inside the first bytes.
+static uint32_t count_leading_lines(const std::vector<LineDiff::Line> &lines, uint32_t bytes) {
+	auto end = std::partition_point(lines.begin(), lines.end(), [bytes](const LineDiff::Line &line) {
+		return line.has_newline && line.start + line.length + 1 <= bytes;
+	});
+	return end - lines.begin();
 }
 
-bool ASTManager::is_file_open(const String &file_path) {
-	return open_files.has(file_path);
+// Number of trailing lines starting inside the last bytes of the buffer; the
+// newline before such a line is inside that range too.
+static uint32_t count_trailing_lines(const std::vector<LineDiff::Line> &lines, uint32_t total_length, uint32_t bytes) {
+	uint32_t tail_start = total_length - bytes;
+	auto begin = std::partition_point(lines.begin(), lines.end(), [tail_start](const LineDiff::Line &line) {
+		return line.start <= tail_start;
+	});
+	return lines.end() - begin;
 }
 
-PackedStringArray ASTManager::get_open_files() {
-	PackedStringArray result;
-	for (const KeyValue<String, FileState> &kv : open_files) {
-		result.push_back(kv.key);
+static LineMerge::Options parse_merge_options(const Dictionary &options) {
+	LineMerge::Options merge_options;
+	merge_options.algorithm = parse_diff_algorithm(options);
+	String style = options.get("conflict_style", "merge");
+	if (style == "diff3") {
+		merge_options.style = LineMerge::STYLE_DIFF3;
+	} else if (style == "ours") {
+		merge_options.style = LineMerge::STYLE_OURS;
+	} else if (style == "theirs") {
+		merge_options.style = LineMerge::STYLE_THEIRS;
 	}
-	return result;
+	merge_options.ours_label = String(options.get("ours_label", "ours")).utf8().get_data();
+	merge_options.base_label = String(options.get("base_label", "base")).utf8().get_data();
+	merge_options.theirs_label = String(options.get("theirs_label", "theirs")).utf8().get_data();
+	return merge_options;
 }
 
-String ASTManager::get_file_source(const String &file_path) {
-	if (!open_files.has(file_path)) {
-		return "";
+static Array make_conflict_array(const std::vector<LineMerge::Conflict> &conflicts) {
+	Array result;
+	for (const LineMerge::Conflict &conflict : conflicts) {
+		Dictionary entry;
+		entry["base_start"] = (int)conflict.base_start;
+		entry["base_count"] = (int)conflict.base_count;
+		entry["ours_start"] = (int)conflict.ours_start;
+		entry["ours_count"] = (int)conflict.ours_count;
+		entry["theirs_start"] = (int)conflict.theirs_start;
+		entry["theirs_count"] = (int)conflict.theirs_count;
+		entry["merged_start"] = (int)conflict.merged_start;
+		entry["merged_count"] = (int)conflict.merged_count;
+		result.push_back(entry);
 	}
-	const FileState &state = open_files[file_path];
-	return String::utf8(reinterpret_cast<const char *>(state.source_bytes.ptr()), state.source_bytes.size());
+	return result;
 }
 
-Dictionary ASTManager::query(const String &file_path, const String &query_string) {
-	Dictionary result;
-	result["success"] = false;
-	result["error"] = "";
-	result["matches"] = Array();
+static LineMerge::Side make_merge_side(const char *data, uint32_t length, const std::vector<LineDiff::Line> &lines) {
+	LineMerge::Side side;
+	side.data = data;
+	side.length = length;
+	side.lines = lines.data();
+	side.line_count = lines.size();
+	return side;
+}
 
-	if (!open_files.has(file_path)) {
-		result["error"] = "File not open: " + file_path;
-		return result;
+static Vector<ByteEdit> make_byte_edits(const std::vector<LineMerge::Replacement> &replacements) {
+	Vector<ByteEdit> byte_edits;
+	byte_edits.resize(replacements.size());
+	for (size_t i = 0; i < replacements.size(); i++) {
+		ByteEdit &edit = byte_edits.write[i];
+		edit.start_byte = replacements[i].start_byte;
+		edit.end_byte = replacements[i].end_byte;
+		edit.new_bytes.resize(replacements[i].bytes.size());
+		memcpy(edit.new_bytes.ptrw(), replacements[i].bytes.data(), replacements[i].bytes.size());
 	}
+	return byte_edits;
+}
 
-	const FileState &state = open_files[file_path];
-	if (!state.tree) {
-		result["error"] = "No tree available for file: " + file_path;
-		return result;
+static GDScriptFormatter::Options parse_format_options(const Dictionary &options) {
+	GDScriptFormatter::Options format_options;
+	if (options.get("use_spaces", false)) {
+		format_options.indent = std::string(MAX(1, (int)options.get("indent_size", 4)), ' ');
 	}
+	format_options.blank_lines = MAX(0, (int)options.get("blank_lines", 2));
+	format_options.indentation = options.get("indentation", true);
+	format_options.spacing = options.get("spacing", true);
+	format_options.trailing_whitespace = options.get("trailing_whitespace", true);
+	format_options.trailing_commas = options.get("trailing_commas", true);
+	format_options.blank_lines_around_functions = options.get("blank_lines_around_functions", true);
+	return format_options;
+}
 
-	const TSLanguage *lang = tree_sitter_gdscript();
-	CharString query_utf8 = query_string.utf8();
-	const char *query_str = query_utf8.get_data();
-	uint32_t query_len = query_utf8.length();
+// Byte ranges of the current buffer written by the step that led to it: the
+// last commit, or the last undo/redo.
+static bool get_last_edit_ranges(const FileState &state, std::vector<GDScriptFormatter::Range> &r_ranges) {
+	const FileHistory &history = state.history;
+	Vector<ByteEdit> edits;
+	if (history.can_undo() && history.get_undo_entry().to_version == state.version) {
+		edits = make_history_step_edits(history.get_undo_entry(), false);
+	} else if (history.can_redo() && history.get_redo_entry().from_version == state.version) {
+		edits = make_history_step_edits(history.get_redo_entry(), true);
+	} else {
+		return false;
+	}
+	for (const ByteEdit &edit : edits) {
+		r_ranges.push_back({ edit.start_byte, edit.end_byte });
+	}
+	return true;
+}
 
-	uint32_t error_offset = 0;
-	TSQueryError error_type = TSQueryErrorNone;
-	TSQuery *query = ts_query_new(lang, query_str, query_len, &error_offset, &error_type);
+// Adds <prefix>start_byte/end_byte/start_row/end_row of node to op.
+static void add_tree_diff_range(Dictionary &op, const String &prefix, TSNode node) {
+	op[prefix + "start_byte"] = (int)ts_node_start_byte(node);
+	op[prefix + "end_byte"] = (int)ts_node_end_byte(node);
+	op[prefix + "start_row"] = (int)ts_node_start_point(node).row;
+	op[prefix + "end_row"] = (int)ts_node_end_point(node).row;
+}
 
-	if (!query) {
-		String error_msg = "Query error at offset " + String::num_int64(error_offset) + ": ";
-		switch (error_type) {
-			case TSQueryErrorSyntax:
-				error_msg += "Invalid syntax";
-				break;
-			case TSQueryErrorNodeType:
-				error_msg += "Invalid node type";
-				break;
-			case TSQueryErrorField:
-				error_msg += "Invalid field name";
-				break;
-			case TSQueryErrorCapture:
-				error_msg += "Invalid capture name";
-				break;
-			case TSQueryErrorStructure:
-				error_msg += "Impossible pattern structure";
-				break;
-			case TSQueryErrorLanguage:
-				error_msg += "Language mismatch";
-				break;
-			default:
-				error_msg += "Unknown error";
-				break;
+static String node_text(TSNode node, const PackedByteArray &bytes) {
+	uint32_t start = ts_node_start_byte(node);
+	return String::utf8(reinterpret_cast<const char *>(bytes.ptr()) + start, ts_node_end_byte(node) - start);
+}
+
+static String make_query_error(uint32_t error_offset, TSQueryError error_type) {
+	String error_msg = "Query error at offset " + String::num_int64(error_offset) + ": ";
+	switch (error_type) {
+		case TSQueryErrorSyntax:
+			error_msg += "Invalid syntax";
+			break;
+		case TSQueryErrorNodeType:
+			error_msg += "Invalid node type";
+			break;
+		case TSQueryErrorField:
+			error_msg += "Invalid field name";
+			break;
+		case TSQueryErrorCapture:
+			error_msg += "Invalid capture name";
+			break;
+		case TSQueryErrorStructure:
+			error_msg += "Impossible pattern structure";
+			break;
+		case TSQueryErrorLanguage:
+			error_msg += "Language mismatch";
+			break;
+		default:
+			error_msg += "Unknown error";
+			break;
+	}
+	return error_msg;
+}
+
+// Patterns of the built-in highlight query, most general first since later
+// captures win. Each is checked on its own so that a node type missing from
+// the linked grammar only loses its own pattern.
+static const char *DEFAULT_HIGHLIGHT_PATTERNS[] = {
+	"(identifier) @variable",
+	"(type) @type",
+	"(class_name_statement name: (name) @type)",
+	"(class_definition name: (name) @type)",
+	"(function_definition name: (name) @function)",
+	"(call function: (identifier) @function.call)",
+	"(annotation) @annotation",
+	"(integer) @number",
+	"(float) @number",
+	"(true) @constant",
+	"(false) @constant",
+	"(null) @constant",
+	"(string) @string",
+	"(comment) @comment",
+	"\"func\" @keyword",
+	"\"var\" @keyword",
+	"\"const\" @keyword",
+	"\"signal\" @keyword",
+	"\"enum\" @keyword",
+	"\"class\" @keyword",
+	"\"class_name\" @keyword",
+	"\"extends\" @keyword",
+	"\"return\" @keyword",
+	"\"if\" @keyword",
+	"\"elif\" @keyword",
+	"\"else\" @keyword",
+	"\"for\" @keyword",
+	"\"in\" @keyword",
+	"\"while\" @keyword",
+	"\"match\" @keyword",
+	"\"break\" @keyword",
+	"\"continue\" @keyword",
+	"\"pass\" @keyword",
+	"\"and\" @keyword",
+	"\"or\" @keyword",
+	"\"not\" @keyword",
+};
+
+// Roughly the script editor's default theme. Captures without a color
+// (such as @variable) are not highlighted.
+static const struct {
+	const char *capture;
+	float r, g, b, a;
+} DEFAULT_HIGHLIGHT_COLORS[] = {
+	{ "keyword", 1.0f, 0.44f, 0.52f, 1.0f },
+	{ "comment", 0.8f, 0.81f, 0.82f, 0.5f },
+	{ "string", 1.0f, 0.93f, 0.63f, 1.0f },
+	{ "number", 0.63f, 1.0f, 0.88f, 1.0f },
+	{ "constant", 1.0f, 0.44f, 0.52f, 1.0f },
+	{ "function", 0.34f, 0.7f, 1.0f, 1.0f },
+	{ "type", 0.26f, 1.0f, 0.76f, 1.0f },
+	{ "annotation", 1.0f, 0.7f, 0.45f, 1.0f },
+};
+
+static std::string make_default_highlight_query() {
+	perf_stats::Scope scope(perf_stats::PHASE_QUERY_COMPILE);
+	const TSLanguage *lang = tree_sitter_gdscript();
+	std::string source;
+	for (const char *pattern : DEFAULT_HIGHLIGHT_PATTERNS) {
+		uint32_t error_offset = 0;
+		TSQueryError error_type = TSQueryErrorNone;
+		TSQuery *query = ts_query_new(lang, pattern, strlen(pattern), &error_offset, &error_type);
+		if (query) {
+			ts_query_delete(query);
+			source += pattern;
+			source += '\n';
 		}
-		result["error"] = error_msg;
-		return result;
 	}
+	return source;
+}
 
-	TSQueryCursor *cursor = ts_query_cursor_new();
-	if (!cursor) {
-		ts_query_delete(query);
-		result["error"] = "Failed to create query cursor";
-		return result;
+// Color for a capture name: from colors, else the defaults, trying
+// "function.call" then "function".
+static bool find_highlight_color(const Dictionary &colors, String name, Color &r_color) {
+	while (true) {
+		if (colors.has(name)) {
+			r_color = colors[name];
+			return true;
+		}
+		for (const auto &entry : DEFAULT_HIGHLIGHT_COLORS) {
+			if (name == entry.capture) {
+				r_color = Color(entry.r, entry.g, entry.b, entry.a);
+				return true;
+			}
+		}
+		int dot = name.rfind(".");
+		if (dot < 0) {
+			return false;
+		}
+		name = name.substr(0, dot);
 	}
+}
 
+static const char *SYMBOL_KIND_NAMES[] = {
+	"class_name",
+	"class",
+	"function",
+	"signal",
+	"enum",
+	"constant",
+	"variable",
+};
+
+static const char *FOLD_KIND_NAMES[] = {
+	"block",
+	"literal",
+	"comment",
+};
+
+static bool parse_symbol_kind(const Dictionary &options, int &r_kind, Dictionary &result) {
+	r_kind = -1;
+	String kind = options.get("kind", "");
+	if (kind.is_empty()) {
+		return true;
+	}
+	for (int i = 0; i < (int)(sizeof(SYMBOL_KIND_NAMES) / sizeof(SYMBOL_KIND_NAMES[0])); i++) {
+		if (kind == SYMBOL_KIND_NAMES[i]) {
+			r_kind = i;
+			return true;
+		}
+	}
+	result["error"] = "Unknown symbol kind: " + kind;
+	return false;
+}
+
+static Dictionary make_symbol_dict(const SymbolIndex &index, const SymbolIndex::Location &location) {
+	const SymbolIndex::Symbol &symbol = index.get_symbol(location);
+	const std::string &name = index.get_name(symbol.name);
+	const std::string &path = index.get_file_path(location.file);
+	Dictionary entry;
+	entry["name"] = String::utf8(name.data(), name.size());
+	entry["kind"] = SYMBOL_KIND_NAMES[symbol.kind];
+	entry["file_path"] = String::utf8(path.data(), path.size());
+	if (symbol.container != SymbolIndex::NONE) {
+		const std::string &container = index.get_name(symbol.container);
+		entry["container"] = String::utf8(container.data(), container.size());
+	} else {
+		entry["container"] = "";
+	}
+	entry["start_byte"] = (int)symbol.start_byte;
+	entry["end_byte"] = (int)symbol.end_byte;
+	entry["start_row"] = (int)symbol.start_row;
+	entry["end_row"] = (int)symbol.end_row;
+	entry["name_start_byte"] = (int)symbol.name_start_byte;
+	entry["name_end_byte"] = (int)symbol.name_end_byte;
+	return entry;
+}
+
+static Dictionary make_mapped_symbol_dict(const SymbolIndexFile &index, uint32_t symbol_id) {
+	const SymbolIndexFile::SymbolRecord &symbol = index.get_symbol(symbol_id);
+	std::string_view name = index.get_name(symbol.name);
+	std::string_view path = index.get_file_path(symbol.file);
+	Dictionary entry;
+	entry["name"] = String::utf8(name.data(), name.size());
+	entry["kind"] = SYMBOL_KIND_NAMES[symbol.kind];
+	entry["file_path"] = String::utf8(path.data(), path.size());
+	if (symbol.container != SymbolIndexFile::NONE) {
+		std::string_view container = index.get_name(symbol.container);
+		entry["container"] = String::utf8(container.data(), container.size());
+	} else {
+		entry["container"] = "";
+	}
+	entry["start_byte"] = (int)symbol.start_byte;
+	entry["end_byte"] = (int)symbol.end_byte;
+	entry["start_row"] = (int)symbol.start_row;
+	entry["end_row"] = (int)symbol.end_row;
+	entry["name_start_byte"] = (int)symbol.name_start_byte;
+	entry["name_end_byte"] = (int)symbol.name_end_byte;
+	return entry;
+}
+
+static const char *DEFAULT_SYMBOL_INDEX_PATH = "res://.godot/ast_symbol_index.bin";
+
+// A script indexed from its text rather than from an open buffer.
+struct IndexJob {
+	std::string path;
+	std::string source;
+	uint64_t content_hash = 0;
+	int64_t mtime = 0;
+	DocumentOutline outline;
+	bool parsed = false;
+};
+
+static void parse_index_jobs(ParserPool &pool, std::vector<IndexJob> &jobs, int max_threads) {
+	pool.run(jobs.size(), max_threads, [&](int index, TSParser *worker_parser) {
+		IndexJob &job = jobs[index];
+		TSTree *tree = parse_source(worker_parser, nullptr, job.source.data(), job.source.size());
+		if (!tree) {
+			return;
+		}
+		job.outline.update(ts_tree_root_node(tree), job.source.data(), 1);
+		ts_tree_delete(tree);
+		job.parsed = true;
+	});
+}
+
+static bool is_scope_node(TSNode node) {
+	const char *type = ts_node_type(node);
+	return strcmp(type, "function_definition") == 0 || strcmp(type, "constructor_definition") == 0 || strcmp(type, "lambda") == 0 ||
+			strcmp(type, "class_definition") == 0 || strcmp(type, "source") == 0;
+}
+
+// Innermost scope the node's name is visible in; null above the root.
+static TSNode enclosing_scope(TSNode node) {
+	TSNode parent = ts_node_parent(node);
+	// The name of a function or class belongs to the scope around it.
+	if (!ts_node_is_null(parent) && is_scope_node(parent) && strcmp(ts_node_type(node), "name") == 0) {
+		parent = ts_node_parent(parent);
+	}
+	while (!ts_node_is_null(parent) && !is_scope_node(parent)) {
+		parent = ts_node_parent(parent);
+	}
+	return parent;
+}
+
+// Identifier or declared name under position, or just before it (a cursor
+// at the end of a word); null if there is none.
+static TSNode identifier_at(TSNode root, uint32_t position) {
+	for (uint32_t byte : { position, position > 0 ? position - 1 : position }) {
+		TSNode node = ts_node_descendant_for_byte_range(root, byte, byte);
+		const char *type = ts_node_type(node);
+		if ((strcmp(type, "identifier") == 0 || strcmp(type, "name") == 0) && ts_node_start_byte(node) <= position &&
+				position <= ts_node_end_byte(node)) {
+			return node;
+		}
+	}
+	return TSNode();
+}
+
+// Kind of a declaration found in a function body.
+static const char *local_definition_kind(TSNode definition) {
+	const char *type = ts_node_type(ts_node_parent(definition));
+	if (strcmp(type, "parameters") == 0 || strstr(type, "parameter")) {
+		return "parameter";
+	} else if (strcmp(type, "const_statement") == 0) {
+		return SYMBOL_KIND_NAMES[DocumentOutline::SYMBOL_CONSTANT];
+	} else if (strcmp(type, "function_definition") == 0) {
+		return SYMBOL_KIND_NAMES[DocumentOutline::SYMBOL_FUNCTION];
+	} else if (strcmp(type, "class_definition") == 0) {
+		return SYMBOL_KIND_NAMES[DocumentOutline::SYMBOL_CLASS];
+	}
+	return SYMBOL_KIND_NAMES[DocumentOutline::SYMBOL_VARIABLE];
+}
+
+static Dictionary make_local_definition_dict(const String &file_path, std::string_view name, TSNode definition) {
+	TSNode declaration = ts_node_parent(definition);
+	Dictionary entry;
+	entry["name"] = String::utf8(name.data(), name.size());
+	entry["kind"] = local_definition_kind(definition);
+	entry["file_path"] = file_path;
+	entry["container"] = "";
+	entry["start_byte"] = (int)ts_node_start_byte(declaration);
+	entry["end_byte"] = (int)ts_node_end_byte(declaration);
+	entry["start_row"] = (int)ts_node_start_point(declaration).row;
+	entry["end_row"] = (int)ts_node_end_point(declaration).row;
+	entry["name_start_byte"] = (int)ts_node_start_byte(definition);
+	entry["name_end_byte"] = (int)ts_node_end_byte(definition);
+	return entry;
+}
+
+static bool is_identifier_byte(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || (c & 0x80);
+}
+
+static bool has_prefix(std::string_view text, std::string_view prefix) {
+	return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+static const char *COMPLETION_SOURCE_NAMES[] = {
+	"local",
+	"member",
+	"inherited",
+	"global",
+};
+
+// A name matching a workspace symbol search.
+struct FuzzyHit {
+	int score;
+	std::string_view text;
+	uint32_t name;
+	bool mapped;
+};
+
+// Better hits sort last, so a max-heap pops them first: higher score, then
+// shorter name, then byte order.
+static bool fuzzy_hit_less(const FuzzyHit &a, const FuzzyHit &b) {
+	if (a.score != b.score) {
+		return a.score < b.score;
+	}
+	if (a.text.size() != b.text.size()) {
+		return a.text.size() > b.text.size();
+	}
+	return a.text > b.text;
+}
+
+// Ids of the names whose mask passes the matcher's prefilter. The
+// compaction is branch-free, so the loop vectorizes.
+static void prefilter_names(const FuzzyMatcher &matcher, const std::vector<uint64_t> &masks, std::vector<uint32_t> &r_ids) {
+	r_ids.resize(masks.size());
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < masks.size(); i++) {
+		r_ids[count] = i;
+		count += matcher.may_match(masks[i]);
+	}
+	r_ids.resize(count);
+}
+
+static int add_result_path(std::string_view path, std::unordered_map<std::string_view, int> &r_slots, PackedStringArray &r_paths) {
+	auto found = r_slots.find(path);
+	if (found != r_slots.end()) {
+		return found->second;
+	}
+	int slot = r_paths.size();
+	r_slots.emplace(path, slot);
+	r_paths.push_back(String::utf8(path.data(), path.size()));
+	return slot;
+}
+
+static void append_search_result(PackedInt32Array &r_symbols, int score, uint32_t kind, int file, uint32_t name_start_byte, uint32_t name_end_byte, uint32_t start_row, uint32_t end_row) {
+	r_symbols.push_back(score);
+	r_symbols.push_back(kind);
+	r_symbols.push_back(file);
+	r_symbols.push_back(name_start_byte);
+	r_symbols.push_back(name_end_byte);
+	r_symbols.push_back(start_row);
+	r_symbols.push_back(end_row);
+}
+
+// Lines of the buffer as the editor counts them: newlines + 1.
+static uint32_t count_editor_lines(const std::vector<LineDiff::Line> &lines) {
+	return lines.size() + ((lines.empty() || lines.back().has_newline) ? 1 : 0);
+}
+
+static uint32_t row_of_byte(const std::vector<LineDiff::Line> &lines, uint32_t byte) {
+	auto it = std::upper_bound(lines.begin(), lines.end(), byte, [](uint32_t value, const LineDiff::Line &line) {
+		return value < line.start;
+	});
+	if (it == lines.begin()) {
+		return 0;
+	}
+	uint32_t row = (it - lines.begin()) - 1;
+	// Only past a final newline.
+	if (byte > lines[row].start + lines[row].length) {
+		row++;
+	}
+	return row;
+}
+
+static uint32_t count_newlines(const uint8_t *data, uint32_t length) {
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < length; i++) {
+		count += data[i] == '\n';
+	}
+	return count;
+}
+
+static const char *LINT_SEVERITY_NAMES[] = {
+	"error",
+	"warning",
+	"info",
+	"hint",
+};
+
+// A file linted by lint_files(): an open one reuses its tree and cache, a
+// closed one is read here and parsed on a worker.
+struct LintJob {
+	String path;
+	FileState *state = nullptr;
+	std::string source;
+	std::vector<LintEngine::Diagnostic> diagnostics;
+	std::vector<LintEngine::RuleStats> stats;
+	uint32_t scanned_bytes = 0;
+	bool linted = false;
+};
+
+static Array make_diagnostic_array(const LintEngine &engine, const std::vector<LintEngine::Diagnostic> &diagnostics, const std::vector<LineDiff::Line> &lines) {
+	perf_stats::Scope scope(perf_stats::PHASE_MARSHAL);
+	scope.add_amount(diagnostics.size());
+	Array array;
+	for (const LintEngine::Diagnostic &diagnostic : diagnostics) {
+		uint32_t start_row = row_of_byte(lines, diagnostic.start_byte);
+		uint32_t end_row = row_of_byte(lines, diagnostic.end_byte);
+		Dictionary entry;
+		const std::string &rule = engine.get_rule_id(diagnostic.rule);
+		entry["rule"] = String::utf8(rule.data(), rule.size());
+		entry["severity"] = LINT_SEVERITY_NAMES[engine.get_rule_severity(diagnostic.rule)];
+		entry["message"] = String::utf8(diagnostic.message.data(), diagnostic.message.size());
+		entry["start_byte"] = (int)diagnostic.start_byte;
+		entry["end_byte"] = (int)diagnostic.end_byte;
+		entry["start_row"] = (int)start_row;
+		entry["start_col"] = (int)(diagnostic.start_byte - (start_row < lines.size() ? lines[start_row].start : diagnostic.start_byte));
+		entry["end_row"] = (int)end_row;
+		entry["end_col"] = (int)(diagnostic.end_byte - (end_row < lines.size() ? lines[end_row].start : diagnostic.end_byte));
+		array.push_back(entry);
+	}
+	return array;
+}
+
+static void add_lint_stats(std::vector<LintEngine::RuleStats> &r_total, const std::vector<LintEngine::RuleStats> &stats) {
+	for (size_t i = 0; i < stats.size() && i < r_total.size(); i++) {
+		r_total[i].match_count += stats[i].match_count;
+		r_total[i].diagnostic_count += stats[i].diagnostic_count;
+		r_total[i].nsec += stats[i].nsec;
+	}
+}
+
+// Bit i of a DependencyGraph kind mask.
+static const char *DEPENDENCY_KIND_NAMES[] = {
+	"extends",
+	"preload",
+	"load",
+	"class_reference",
+};
+
+static bool parse_dependency_kinds(const Dictionary &options, uint32_t &r_kinds, Dictionary &result) {
+	r_kinds = DependencyGraph::KIND_ALL;
+	if (!options.has("kinds")) {
+		return true;
+	}
+	PackedStringArray kinds = options["kinds"];
+	r_kinds = 0;
+	for (int k = 0; k < kinds.size(); k++) {
+		const String &kind = kinds[k];
+		int bit = -1;
+		for (int i = 0; i < (int)(sizeof(DEPENDENCY_KIND_NAMES) / sizeof(DEPENDENCY_KIND_NAMES[0])); i++) {
+			if (kind == DEPENDENCY_KIND_NAMES[i]) {
+				bit = i;
+				break;
+			}
+		}
+		if (bit < 0) {
+			result["error"] = "Unknown dependency kind: " + kind;
+			return false;
+		}
+		r_kinds |= 1u << bit;
+	}
+	return true;
+}
+
+// Adds what the script at path names in its extends statement and constant
+// preload()/load() calls. An extends target with a slash or a .gd suffix is
+// a path; otherwise it is a class, of which an inner class depends on the
+// outer one.
+static void add_script_dependencies(const std::string &path, std::string_view extends, const std::vector<std::string> &preloads,
+		const std::vector<std::string> &loads, std::vector<DependencyGraph::Dependency> &r_dependencies) {
+	if (!extends.empty()) {
+		bool is_path = extends.find('/') != std::string_view::npos || (extends.size() > 3 && extends.substr(extends.size() - 3) == ".gd");
+		if (is_path) {
+			r_dependencies.push_back({ DependencyGraph::resolve_path(path, std::string(extends)), DependencyGraph::KIND_EXTENDS });
+		} else {
+			r_dependencies.push_back({ std::string(extends.substr(0, extends.find('.'))), DependencyGraph::KIND_EXTENDS });
+		}
+	}
+	for (const std::string &preload : preloads) {
+		r_dependencies.push_back({ DependencyGraph::resolve_path(path, preload), DependencyGraph::KIND_PRELOAD });
+	}
+	for (const std::string &load : loads) {
+		r_dependencies.push_back({ DependencyGraph::resolve_path(path, load), DependencyGraph::KIND_LOAD });
+	}
+}
+
+static void split_lines(std::string_view text, std::vector<std::string> &r_lines) {
+	r_lines.clear();
+	while (!text.empty()) {
+		size_t end = text.find('\n');
+		r_lines.emplace_back(text.substr(0, end));
+		text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+	}
+}
+
+static void append_dependency_edges(const DependencyGraph &graph, const std::vector<DependencyGraph::Edge> &edges, PackedStringArray &r_paths, PackedInt32Array &r_kinds) {
+	for (const DependencyGraph::Edge &edge : edges) {
+		const std::string &path = graph.get_file_path(edge.file);
+		r_paths.push_back(String::utf8(path.data(), path.size()));
+		r_kinds.push_back((int32_t)edge.kinds);
+	}
+}
+
+// Reads a watched file and, unless its content hashes the same as the
+// snapshot, reparses it incrementally from the snapshot's tree. Runs on a
+// worker thread, so it touches nothing but the job.
+static void reload_watch_job(WatchJob &job, TSParser *worker_parser) {
+	std::ifstream file(job.native_path, std::ios::binary);
+	if (!file) {
+		// Deleted or unreadable: the open buffer stays as it is.
+		return;
+	}
+	std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (content_hash::hash_bytes(content.data(), content.size()) == content_hash::hash_bytes(job.base_bytes.ptr(), job.base_bytes.size())) {
+		return;
+	}
+
+	job.byte_edits = make_replacement_edit(job.base_bytes, reinterpret_cast<const uint8_t *>(content.data()), content.size());
+	Vector<TSInputEdit> input_edits;
+	job.new_bytes = splice_byte_edits(job.base_bytes, job.byte_edits, input_edits);
+	if (job.base_tree) {
+		for (int i = input_edits.size() - 1; i >= 0; i--) {
+			ts_tree_edit(job.base_tree, &input_edits[i]);
+		}
+	}
+	job.new_tree = parse_source(worker_parser, job.base_tree, reinterpret_cast<const char *>(job.new_bytes.ptr()), job.new_bytes.size());
+	job.changed = job.new_tree != nullptr;
+}
+
+// Memory of one open file, for get_memory_stats(). Trees are estimated
+// (see estimate_tree_cost()); the rest is counted.
+struct FileMemory {
+	String file_path;
+	int64_t source_bytes = 0;
+	int64_t tree_bytes = 0;
+	int64_t history_bytes = 0;
+	int64_t cache_bytes = 0;
+
+	int64_t get_total() const { return source_bytes + tree_bytes + history_bytes + cache_bytes; }
+};
+
+static FileMemory measure_file(const String &file_path, const FileState &state) {
+	FileMemory memory;
+	memory.file_path = file_path;
+	memory.source_bytes = state.source_bytes.size();
+	memory.tree_bytes = state.tree_cost;
+	memory.history_bytes = state.history.get_memory_bytes();
+	memory.cache_bytes = memory_usage::of(state.line_index) + state.highlights.get_memory_bytes() + state.outline.get_memory_bytes() + state.lint.get_memory_bytes();
+	return memory;
+}
+
+static const char *ALLOCATOR_BACKEND_NAMES[] = { "system", "pool" };
+
+// Resident set size of the process, -1 where it cannot be read.
+static int64_t get_resident_bytes() {
+#ifdef __linux__
+	std::ifstream statm("/proc/self/statm");
+	int64_t total_pages = 0;
+	int64_t resident_pages = 0;
+	if (statm >> total_pages >> resident_pages) {
+		return resident_pages * sysconf(_SC_PAGESIZE);
+	}
+#endif
+	return -1;
+}
+
+static Dictionary make_probe_dict(const perf_stats::ProbeStats &stats) {
+	Dictionary entry;
+	entry["name"] = String::utf8(stats.name.data(), stats.name.size());
+	entry["calls"] = (int64_t)stats.count;
+	entry["total_usec"] = stats.total_nsec / 1000.0;
+	entry["mean_usec"] = stats.total_nsec / 1000.0 / stats.count;
+	entry["max_usec"] = stats.max_nsec / 1000.0;
+	entry["p50_usec"] = stats.p50_nsec / 1000.0;
+	entry["p95_usec"] = stats.p95_nsec / 1000.0;
+	entry["p99_usec"] = stats.p99_nsec / 1000.0;
+	if (stats.phase) {
+		entry["amount"] = (int64_t)stats.amount;
+	}
+	return entry;
+}
+
+// Estimated size of a tree. tree-sitter keeps about this much per node (the
+// subtree and its slot in the parent's children), and the root stores its
+// descendant count, so estimating costs nothing. Hidden nodes are not
+// counted, hence the generous per-node figure.
+static const int64_t TREE_BASE_COST = 256;
+static const int64_t TREE_BYTES_PER_NODE = 96;
+
+static int64_t estimate_tree_cost(const TSTree *tree) {
+	if (!tree) {
+		return 0;
+	}
+	return TREE_BASE_COST + TREE_BYTES_PER_NODE * ts_node_descendant_count(ts_tree_root_node(tree));
+}
+
+ASTManager::ASTManager() {
+	parser = ts_parser_new();
+	const TSLanguage *lang = tree_sitter_gdscript();
+	ts_parser_set_language(parser, lang);
+}
+
+ASTManager::~ASTManager() {
+	stop_file_watcher();
+	remove_memory_monitors();
+
+	for (KeyValue<String, FileState> &kv : open_files) {
+		if (kv.value.tree) {
+			ts_tree_delete(kv.value.tree);
+		}
+		kv.value.history.clear();
+	}
+	open_files.clear();
+	history_bytes = 0;
+
+	if (highlight_cursor) {
+		ts_query_cursor_delete(highlight_cursor);
+		highlight_cursor = nullptr;
+	}
+	if (highlight_query) {
+		ts_query_delete(highlight_query);
+		highlight_query = nullptr;
+	}
+
+	if (parser) {
+		ts_parser_delete(parser);
+		parser = nullptr;
+	}
+}
+
+String ASTManager::ping() {
+	PERF_METHOD_SCOPE();
+	return "pong";
+}
+
+String ASTManager::get_version() {
+	PERF_METHOD_SCOPE();
+	return AST_MANAGER_VERSION;
+}
+
+Dictionary ASTManager::parse_test(const String &source_code) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["root_kind"] = "";
+	result["node_count"] = 0;
+	result["has_error"] = false;
+	result["sexp"] = "";
+
+	if (!parser) {
+		return result;
+	}
+
+	CharString utf8 = source_to_utf8(source_code);
+	const char *code_str = utf8.get_data();
+	uint32_t code_len = utf8.length();
+
+	TSTree *tree = parse_source(parser, nullptr, code_str, code_len);
+	if (!tree) {
+		return result;
+	}
+
+	result["success"] = true;
+
+	TSNode root = ts_tree_root_node(tree);
+	const char *kind_str = ts_node_type(root);
+	result["root_kind"] = String(kind_str);
+
+	result["node_count"] = count_descendants(root);
+	result["has_error"] = ts_node_has_error(root);
+
+	char *sexp_str = ts_node_string(root);
+	if (sexp_str) {
+		result["sexp"] = String(sexp_str);
+		ts_allocator::free(sexp_str);
+	}
+
+	ts_tree_delete(tree);
+
+	return result;
+}
+
+Dictionary ASTManager::open_file(const String &file_path, const String &content) {
+	PERF_METHOD_SCOPE();
+	CharString utf8 = source_to_utf8(content);
+	const char *code_str = utf8.get_data();
+	uint32_t code_len = utf8.length();
+
+	// Another manager may have parsed the same content already.
+	uint64_t hash = content_hash::hash_bytes(code_str, code_len);
+	PackedByteArray cached_bytes;
+	TSTree *tree = TreeCache::get_singleton().acquire(hash, reinterpret_cast<const uint8_t *>(code_str), code_len, &cached_bytes);
+	bool cached = tree != nullptr;
+	if (!cached) {
+		tree = parse_source(parser, nullptr, code_str, code_len);
+	}
+	if (!tree) {
+		Dictionary err;
+		err["success"] = false;
+		err["error"] = "Failed to create parse tree";
+		err["file_path"] = file_path;
+		return err;
+	}
+
+	bool pinned = false;
+	if (open_files.has(file_path)) {
+		FileState &old_state = open_files[file_path];
+		if (old_state.tree) {
+			ts_tree_delete(old_state.tree);
+		}
+		file_tree_bytes -= old_state.tree_cost;
+		pinned = old_state.pinned;
+		history_bytes -= old_state.history.get_memory_bytes();
+		old_state.history.clear();
+	}
+
+	FileState new_state;
+	new_state.pinned = pinned;
+	if (cached) {
+		new_state.source_bytes = cached_bytes;
+	} else {
+		new_state.source_bytes.resize(code_len);
+		memcpy(new_state.source_bytes.ptrw(), code_str, code_len);
+		TreeCache::get_singleton().store(hash, new_state.source_bytes, tree);
+	}
+	new_state.version = ++version_counter;
+	open_files.insert(file_path, new_state);
+	FileState &state = open_files[file_path];
+	set_file_tree(state, tree);
+	index_open_file(file_path, state);
+	enforce_file_budget();
+
+	return make_parse_result_dict(file_path, tree);
+}
+
+bool ASTManager::close_file(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	if (!open_files.has(file_path)) {
+		return false;
+	}
+
+	FileState &state = open_files[file_path];
+	if (state.tree) {
+		ts_tree_delete(state.tree);
+	}
+	set_file_tree(state, nullptr);
+	history_bytes -= state.history.get_memory_bytes();
+	state.history.clear();
+
+	open_files.erase(file_path);
+	// Scripts added with index_file() stay known with their last symbols.
+	std::string path = file_path.utf8().get_data();
+	if (!symbol_index.is_persistent(path)) {
+		remove_index_entry(path);
+	}
+	return true;
+}
+
+Dictionary ASTManager::update_file(const String &file_path, const String &new_content) {
+	PERF_METHOD_SCOPE();
+	if (!open_files.has(file_path)) {
+		Dictionary err;
+		err["success"] = false;
+		err["error"] = "File not open: " + file_path;
+		return err;
+	}
+
+	FileState &state = *access_open_file(file_path);
+	CharString utf8 = source_to_utf8(new_content);
+	Vector<ByteEdit> byte_edits = make_replacement_edit(state.source_bytes, utf8);
+	if (byte_edits.is_empty()) {
+		return make_parse_result_dict(file_path, state.tree);
+	}
+
+	// A cached tree of the new content replaces the incremental parse; the
+	// caches still get the edit and the changed ranges between the trees.
+	uint64_t hash = content_hash::hash_bytes(utf8.get_data(), utf8.length());
+	PackedByteArray cached_bytes;
+	TSTree *cached_tree = TreeCache::get_singleton().acquire(hash, reinterpret_cast<const uint8_t *>(utf8.get_data()), utf8.length(), &cached_bytes);
+	Ref<StagedEdit> staged;
+	if (cached_tree) {
+		staged = make_staged_edit(file_path, byte_edits, cached_bytes, cached_tree, 1);
+	} else {
+		Dictionary stage_result;
+		staged = stage_byte_edits(file_path, byte_edits, 1, stage_result);
+		if (staged.is_null()) {
+			Dictionary err;
+			err["success"] = false;
+			err["error"] = "Failed to parse updated content";
+			err["file_path"] = file_path;
+			return err;
+		}
+		TreeCache::get_singleton().store(hash, staged->source_bytes, staged->tree);
+	}
+	staged->commit();
+
+	return make_parse_result_dict(file_path, open_files[file_path].tree);
+}
+
+bool ASTManager::is_file_open(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	return open_files.has(file_path);
+}
+
+PackedStringArray ASTManager::get_open_files() {
+	PERF_METHOD_SCOPE();
+	PackedStringArray result;
+	for (const KeyValue<String, FileState> &kv : open_files) {
+		result.push_back(kv.key);
+	}
+	return result;
+}
+
+String ASTManager::get_file_source(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	if (!open_files.has(file_path)) {
+		return "";
+	}
+	const FileState &state = open_files[file_path];
+	return source_from_utf8(reinterpret_cast<const char *>(state.source_bytes.ptr()), state.source_bytes.size());
+}
+
+Dictionary ASTManager::query(const String &file_path, const String &query_string) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["error"] = "";
+	result["matches"] = Array();
+
+	if (!open_files.has(file_path)) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+
+	const FileState &state = *access_open_file(file_path);
+	if (!state.tree) {
+		result["error"] = "No tree available for file: " + file_path;
+		return result;
+	}
+
+	const TSLanguage *lang = tree_sitter_gdscript();
+	CharString query_utf8 = query_string.utf8();
+	const char *query_str = query_utf8.get_data();
+	uint32_t query_len = query_utf8.length();
+
+	uint32_t error_offset = 0;
+	TSQueryError error_type = TSQueryErrorNone;
+	TSQuery *query = nullptr;
+	{
+		perf_stats::Scope scope(perf_stats::PHASE_QUERY_COMPILE);
+		scope.add_amount(query_len);
+		query = ts_query_new(lang, query_str, query_len, &error_offset, &error_type);
+	}
+
+	if (!query) {
+		result["error"] = make_query_error(error_offset, error_type);
+		return result;
+	}
+
+	TSQueryCursor *cursor = ts_query_cursor_new();
+	if (!cursor) {
+		ts_query_delete(query);
+		result["error"] = "Failed to create query cursor";
+		return result;
+	}
+
+	// The cursor finds matches lazily, so its steps and the marshalling of
+	// each match are timed apart.
+	perf_stats::Stopwatch exec_time;
+	perf_stats::Stopwatch marshal_time;
+	exec_time.start();
 	TSNode root_node = ts_tree_root_node(state.tree);
 	ts_query_cursor_exec(cursor, query, root_node);
 
-	Array matches;
-	TSQueryMatch match;
-	while (ts_query_cursor_next_match(cursor, &match)) {
-		Dictionary match_dict;
-		match_dict["pattern_index"] = (int)match.pattern_index;
+	Array matches;
+	TSQueryMatch match;
+	while (ts_query_cursor_next_match(cursor, &match)) {
+		exec_time.stop();
+		marshal_time.start();
+		Dictionary match_dict;
+		match_dict["pattern_index"] = (int)match.pattern_index;
+
+		Array captures;
+		for (uint16_t i = 0; i < match.capture_count; i++) {
+			TSQueryCapture capture = match.captures[i];
+			TSNode node = capture.node;
+
+			uint32_t capture_name_len = 0;
+			const char *capture_name = ts_query_capture_name_for_id(query, capture.index, &capture_name_len);
+
+			uint32_t start_byte = ts_node_start_byte(node);
+			uint32_t end_byte = ts_node_end_byte(node);
+			TSPoint start_point = ts_node_start_point(node);
+			TSPoint end_point = ts_node_end_point(node);
+
+			String text = "";
+			if (start_byte < state.source_bytes.size() && end_byte <= state.source_bytes.size()) {
+				uint32_t text_len = end_byte - start_byte;
+				const char *text_start = reinterpret_cast<const char *>(state.source_bytes.ptr()) + start_byte;
+				text = String::utf8(text_start, text_len);
+			}
+
+			Dictionary capture_dict;
+			capture_dict["name"] = String::utf8(capture_name, capture_name_len);
+			capture_dict["node_kind"] = String(ts_node_type(node));
+			capture_dict["text"] = text;
+			capture_dict["start_byte"] = (int)start_byte;
+			capture_dict["end_byte"] = (int)end_byte;
+			capture_dict["start_row"] = (int)start_point.row;
+			capture_dict["start_col"] = (int)start_point.column;
+			capture_dict["end_row"] = (int)end_point.row;
+			capture_dict["end_col"] = (int)end_point.column;
+
+			captures.push_back(capture_dict);
+		}
+
+		match_dict["captures"] = captures;
+		matches.push_back(match_dict);
+		marshal_time.stop();
+		exec_time.start();
+	}
+	exec_time.stop();
+	exec_time.record(perf_stats::PHASE_QUERY_EXEC, matches.size());
+	marshal_time.record(perf_stats::PHASE_MARSHAL, matches.size());
+
+	ts_query_cursor_delete(cursor);
+	ts_query_delete(query);
+
+	result["success"] = true;
+	result["matches"] = matches;
+	return result;
+}
+
+String ASTManager::get_node_text(const String &file_path, int start_byte, int end_byte) {
+	PERF_METHOD_SCOPE();
+	if (!open_files.has(file_path)) {
+		return "";
+	}
+
+	const FileState &state = open_files[file_path];
+	if (start_byte < 0 || end_byte < 0 || start_byte > end_byte) {
+		return "";
+	}
+
+	uint32_t start = static_cast<uint32_t>(start_byte);
+	uint32_t end = static_cast<uint32_t>(end_byte);
+
+	if (start >= state.source_bytes.size() || end > state.source_bytes.size()) {
+		return "";
+	}
+
+	uint32_t length = end - start;
+	const char *text_start = reinterpret_cast<const char *>(state.source_bytes.ptr()) + start;
+	return String::utf8(text_start, length);
+}
+
+String ASTManager::get_sexp(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	if (!open_files.has(file_path)) {
+		return "";
+	}
+
+	const FileState &state = *access_open_file(file_path);
+	if (!state.tree) {
+		return "";
+	}
+
+	TSNode root_node = ts_tree_root_node(state.tree);
+	char *sexp_str = ts_node_string(root_node);
+	if (!sexp_str) {
+		return "";
+	}
+
+	perf_stats::Scope scope(perf_stats::PHASE_MARSHAL);
+	String result = String(sexp_str);
+	ts_allocator::free(sexp_str);
+	return result;
+}
+
+bool ASTManager::prepare_staged_buffer(const String &file_path, const TypedArray<Dictionary> &edits, Vector<ByteEdit> &r_byte_edits, PackedByteArray &r_bytes, TSTree *&r_edited_tree, Dictionary &result) {
+	r_edited_tree = nullptr;
+
+	if (!open_files.has(file_path)) {
+		result["error"] = "File not open: " + file_path;
+		return false;
+	}
+
+	// An evicted tree is parsed again here so the edit reparses incrementally.
+	const FileState &state = *access_open_file(file_path);
+	if (!parse_byte_edit_dicts(edits, state.source_bytes.size(), r_byte_edits, result)) {
+		return false;
+	}
+
+	build_staged_buffer(state, r_byte_edits, r_bytes, r_edited_tree);
+	return true;
+}
+
+Ref<StagedEdit> ASTManager::make_staged_edit(const String &file_path, const Vector<ByteEdit> &byte_edits, const PackedByteArray &bytes, TSTree *new_tree, int edits_applied) {
+	Ref<StagedEdit> staged;
+	staged.instantiate();
+	staged->manager = Ref<ASTManager>(this);
+	staged->file_path = file_path;
+	staged->base_version = open_files[file_path].version;
+	staged->byte_edits = byte_edits;
+	staged->source_bytes = bytes;
+	staged->tree = new_tree;
+	staged->edits_applied = edits_applied;
+
+	TSNode root = ts_tree_root_node(new_tree);
+	staged->has_error = ts_node_has_error(root);
+	if (staged->has_error) {
+		collect_error_nodes(root, staged->error_ranges);
+	}
+
+	return staged;
+}
+
+Ref<StagedEdit> ASTManager::stage_byte_edits(const String &file_path, const Vector<ByteEdit> &byte_edits, int edits_applied, Dictionary &result) {
+	PackedByteArray modified_bytes;
+	TSTree *edited_tree = nullptr;
+	build_staged_buffer(open_files[file_path], byte_edits, modified_bytes, edited_tree);
+
+	const char *parse_data = reinterpret_cast<const char *>(modified_bytes.ptr());
+	TSTree *new_tree = parse_source(parser, edited_tree, parse_data, modified_bytes.size());
+	if (edited_tree) {
+		ts_tree_delete(edited_tree);
+	}
+	if (!new_tree) {
+		result["error"] = "Failed to parse after edits";
+		return Ref<StagedEdit>();
+	}
+
+	return make_staged_edit(file_path, byte_edits, modified_bytes, new_tree, edits_applied);
+}
+
+Ref<StagedEdit> ASTManager::stage_edits_internal(const String &file_path, const TypedArray<Dictionary> &edits, Dictionary &result) {
+	if (!open_files.has(file_path)) {
+		result["error"] = "File not open: " + file_path;
+		return Ref<StagedEdit>();
+	}
+
+	Vector<ByteEdit> byte_edits;
+	if (!parse_byte_edit_dicts(edits, open_files[file_path].source_bytes.size(), byte_edits, result)) {
+		return Ref<StagedEdit>();
+	}
+
+	return stage_byte_edits(file_path, byte_edits, edits.size(), result);
+}
+
+Dictionary ASTManager::commit_staged_edit(StagedEdit *staged) {
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = staged->file_path;
+
+	FileState *state = open_files.getptr(staged->file_path);
+	if (!state) {
+		result["error"] = "File not open: " + staged->file_path;
+		return result;
+	}
+	if (state->version != staged->base_version) {
+		result["error"] = "File changed since the edit was staged: " + staged->file_path;
+		return result;
+	}
+
+	uint64_t new_version = ++version_counter;
+	update_caches_for_edit(*state, staged->byte_edits, staged->tree, new_version);
+
+	if (history_enabled) {
+		Vector<FileHistory::Edit> deltas;
+		deltas.resize(staged->byte_edits.size());
+		for (int i = 0; i < staged->byte_edits.size(); i++) {
+			const ByteEdit &edit = staged->byte_edits[i];
+			FileHistory::Edit &delta = deltas.write[i];
+			delta.start_byte = edit.start_byte;
+			delta.removed = state->source_bytes.slice(edit.start_byte, edit.end_byte);
+			delta.inserted = edit.new_bytes;
+		}
+		history_bytes -= state->history.get_memory_bytes();
+		state->history.record(state->version, new_version, deltas, state->tree, history_snapshot_interval);
+		history_bytes += state->history.get_memory_bytes();
+	} else if (state->tree) {
+		ts_tree_delete(state->tree);
+	}
+	state->source_bytes = staged->source_bytes;
+	set_file_tree(*state, staged->tree);
+	state->version = new_version;
+	staged->tree = nullptr;
+	staged->status = StagedEdit::STATUS_COMMITTED;
+	enforce_history_budget();
+	index_open_file(staged->file_path, *state);
+	enforce_file_budget();
+
+	result["success"] = true;
+	result["has_error"] = staged->has_error;
+	result["error_count"] = staged->error_ranges.size();
+	result["error_ranges"] = staged->error_ranges;
+	result["edits_applied"] = staged->edits_applied;
+	return result;
+}
+
+Dictionary ASTManager::stage_text_edits(const String &file_path, const TypedArray<Dictionary> &edits) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["error"] = "";
+
+	Ref<StagedEdit> staged = stage_edits_internal(file_path, edits, result);
+	if (staged.is_null()) {
+		return result;
+	}
+
+	result["success"] = true;
+	result["staged"] = staged;
+	result["has_error"] = staged->has_error;
+	result["error_count"] = staged->error_ranges.size();
+	result["error_ranges"] = staged->error_ranges;
+	return result;
+}
+
+Dictionary ASTManager::apply_text_edits(const String &file_path, const TypedArray<Dictionary> &edits, bool dry_run) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["error"] = "";
+	result["new_source"] = "";
+	result["has_error"] = false;
+	result["error_count"] = 0;
+	result["edits_applied"] = 0;
+
+	if (dry_run && open_files.has(file_path)) {
+		result["old_source"] = get_file_source(file_path);
+	}
+
+	Ref<StagedEdit> staged = stage_edits_internal(file_path, edits, result);
+	if (staged.is_null()) {
+		return result;
+	}
+
+	result["new_source"] = staged->get_new_source();
+	result["has_error"] = staged->has_error;
+	result["error_count"] = staged->error_ranges.size();
+
+	if (dry_run) {
+		staged->discard();
+	} else {
+		staged->commit();
+	}
+
+	result["success"] = true;
+	result["edits_applied"] = staged->edits_applied;
+	return result;
+}
+
+bool ASTManager::resolve_node_edits(const String &file_path, const TypedArray<Dictionary> &edits, const Dictionary &options, TypedArray<Dictionary> &r_text_edits, Dictionary &result) {
+	if (!open_files.has(file_path)) {
+		result["error"] = "File not open: " + file_path;
+		return false;
+	}
+
+	bool auto_indent = options.get("auto_indent", true);
+
+	FileState &state = *access_open_file(file_path);
+	uint32_t source_length = state.source_bytes.size();
+	String source = source_from_utf8(reinterpret_cast<const char *>(state.source_bytes.ptr()), source_length);
+
+	struct MatchInfo {
+		int edit_index;
+		int match_start;
+		int match_end;
+		String old_text;
+		String new_text;
+		String node_kind;
+	};
+
+	Vector<MatchInfo> matches;
+	matches.resize(edits.size());
+
+	for (int i = 0; i < edits.size(); i++) {
+		Dictionary edit_dict = edits[i];
+
+		if (!edit_dict.has("old_text") || !edit_dict.has("new_text")) {
+			result["error"] = "Edit #" + String::num_int64(i) + ": missing required fields";
+			return false;
+		}
+
+		String old_text = edit_dict["old_text"];
+		String new_text = edit_dict["new_text"];
+		String node_kind = edit_dict.get("node_kind", "");
+
+		int match_start = source.find(old_text);
+		if (match_start == -1) {
+			result["error"] = "Edit #" + String::num_int64(i) + ": old_text not found in source";
+			return false;
+		}
+
+		int second_match = source.find(old_text, match_start + 1);
+		if (second_match != -1) {
+			int match_count = 2;
+			int search_pos = second_match + 1;
+			while (source.find(old_text, search_pos) != -1) {
+				match_count++;
+				search_pos = source.find(old_text, search_pos) + 1;
+			}
+			result["error"] = "Edit #" + String::num_int64(i) + ": old_text matches " + String::num_int64(match_count) + " locations, must be unique";
+			return false;
+		}
+
+		int match_end = match_start + old_text.length();
+
+		if (!node_kind.is_empty()) {
+			CharString old_text_utf8 = old_text.utf8();
+			int match_start_byte = source.substr(0, match_start).utf8().length();
+			int match_end_byte = match_start_byte + old_text_utf8.length();
+
+			TSNode root = ts_tree_root_node(state.tree);
+			TSNode covering_node = ts_node_descendant_for_byte_range(root, match_start_byte, match_end_byte - 1);
+
+			bool found_kind = false;
+			TSNode current = covering_node;
+			while (!ts_node_is_null(current)) {
+				const char *node_type = ts_node_type(current);
+				if (String(node_type) == node_kind) {
+					found_kind = true;
+					break;
+				}
+				current = ts_node_parent(current);
+			}
+
+			if (!found_kind) {
+				const char *actual_type = ts_node_type(covering_node);
+				result["error"] = "Edit #" + String::num_int64(i) + ": matched text is inside '" + String(actual_type) + "', expected '" + node_kind + "'";
+				return false;
+			}
+		}
+
+		MatchInfo &match = matches.write[i];
+		match.edit_index = i;
+		match.match_start = match_start;
+		match.match_end = match_end;
+		match.old_text = old_text;
+		match.new_text = new_text;
+		match.node_kind = node_kind;
+	}
+
+	for (int i = 0; i < matches.size() - 1; i++) {
+		for (int j = i + 1; j < matches.size(); j++) {
+			const MatchInfo &m1 = matches[i];
+			const MatchInfo &m2 = matches[j];
+			if (m1.match_start < m2.match_end && m2.match_start < m1.match_end) {
+				result["error"] = "Edit #" + String::num_int64(m1.edit_index) + " and #" + String::num_int64(m2.edit_index) + " have overlapping match ranges";
+				return false;
+			}
+		}
+	}
+
+	if (auto_indent) {
+		for (int i = 0; i < matches.size(); i++) {
+			MatchInfo &match = matches.write[i];
+
+			int old_first_newline = match.old_text.find("\n");
+			String old_first_line = old_first_newline == -1 ? match.old_text : match.old_text.substr(0, old_first_newline);
+			String base_indent = "";
+			for (int j = 0; j < old_first_line.length(); j++) {
+				char32_t c = old_first_line[j];
+				if (c == ' ' || c == '\t') {
+					base_indent += String::chr(c);
+				} else {
+					break;
+				}
+			}
+
+			int new_first_newline = match.new_text.find("\n");
+			String new_first_line = new_first_newline == -1 ? match.new_text : match.new_text.substr(0, new_first_newline);
+			String new_indent = "";
+			for (int j = 0; j < new_first_line.length(); j++) {
+				char32_t c = new_first_line[j];
+				if (c == ' ' || c == '\t') {
+					new_indent += String::chr(c);
+				} else {
+					break;
+				}
+			}
+
+			if (!base_indent.is_empty() && new_indent.is_empty()) {
+				PackedStringArray lines = match.new_text.split("\n", true);
+				String indented_result = "";
+				for (int line_idx = 0; line_idx < lines.size(); line_idx++) {
+					String line = lines[line_idx];
+					if (line.is_empty()) {
+						indented_result += line;
+					} else {
+						indented_result += base_indent + line;
+					}
+					if (line_idx < lines.size() - 1) {
+						indented_result += "\n";
+					}
+				}
+				match.new_text = indented_result;
+			}
+		}
+	}
+
+	for (int i = 0; i < matches.size(); i++) {
+		const MatchInfo &match = matches[i];
+		CharString old_utf8 = match.old_text.utf8();
+		int start_byte = source.substr(0, match.match_start).utf8().length();
+		int end_byte = start_byte + old_utf8.length();
+
+		Dictionary text_edit;
+		text_edit["start_byte"] = start_byte;
+		text_edit["end_byte"] = end_byte;
+		text_edit["new_text"] = match.new_text;
+		r_text_edits.push_back(text_edit);
+	}
+
+	return true;
+}
+
+Dictionary ASTManager::stage_node_edits(const String &file_path, const TypedArray<Dictionary> &edits, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["error"] = "";
+
+	TypedArray<Dictionary> text_edits;
+	if (!resolve_node_edits(file_path, edits, options, text_edits, result)) {
+		return result;
+	}
+	return stage_text_edits(file_path, text_edits);
+}
+
+Dictionary ASTManager::apply_node_edits(const String &file_path, const TypedArray<Dictionary> &edits, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["error"] = "";
+	result["new_source"] = "";
+	result["has_error"] = false;
+	result["error_count"] = 0;
+	result["edits_applied"] = 0;
+
+	bool dry_run = options.get("dry_run", false);
+	bool fail_on_parse_error = options.get("fail_on_parse_error", false);
+
+	TypedArray<Dictionary> text_edits;
+	if (!resolve_node_edits(file_path, edits, options, text_edits, result)) {
+		return result;
+	}
+
+	// One staged parse serves both the parse-error check and the commit.
+	Dictionary stage_result;
+	Ref<StagedEdit> staged = stage_edits_internal(file_path, text_edits, stage_result);
+	if (staged.is_null()) {
+		result["error"] = stage_result["error"];
+		return result;
+	}
+
+	if (fail_on_parse_error && staged->has_error) {
+		staged->discard();
+		result["error"] = "Edit produces parse error, rolled back";
+		return result;
+	}
+
+	result["new_source"] = staged->get_new_source();
+	result["has_error"] = staged->has_error;
+	result["error_count"] = staged->error_ranges.size();
+
+	if (dry_run) {
+		staged->discard();
+	} else {
+		staged->commit();
+	}
+
+	result["success"] = true;
+	result["edits_applied"] = text_edits.size();
+	return result;
+}
+
+Dictionary ASTManager::apply_workspace_edits(const Dictionary &file_edits, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["error"] = "";
+	result["committed"] = false;
+
+	bool dry_run = options.get("dry_run", false);
+	int max_threads = options.get("max_threads", 0);
+	String error_policy = options.get("error_policy", "no_new_errors");
+	if (options.get("fail_on_parse_error", false)) {
+		error_policy = "no_errors";
+	}
+	if (error_policy != "ignore" && error_policy != "no_errors" && error_policy != "no_new_errors") {
+		result["error"] = "Unknown error_policy: " + error_policy;
+		return result;
+	}
+	bool check_new_errors = error_policy == "no_new_errors";
+
+	struct WorkspaceJob {
+		String file_path;
+		int edits_applied = 0;
+		Vector<ByteEdit> byte_edits;
+		PackedByteArray bytes;
+		const char *data = nullptr;
+		uint32_t length = 0;
+		TSTree *edited_tree = nullptr;
+		// A copy: staging the next file may evict this one's tree.
+		TSTree *base_tree = nullptr;
+		TSTree *new_tree = nullptr;
+		int old_error_count = 0;
+		int new_error_count = 0;
+	};
+
+	Dictionary files;
+	PackedStringArray failed_files;
+	std::vector<WorkspaceJob> jobs;
+	jobs.reserve(file_edits.size());
+
+	// Validate and splice every file up front; nothing is parsed unless all
+	// files accept their edits.
+	Array paths = file_edits.keys();
+	for (int i = 0; i < paths.size(); i++) {
+		String path = paths[i];
+		Array edit_list = file_edits[path];
+		TypedArray<Dictionary> edits = edit_list;
+
+		Dictionary file_result;
+		file_result["success"] = false;
+		file_result["error"] = "";
+
+		TypedArray<Dictionary> text_edits = edits;
+		bool prepared = true;
+		if (edits.size() > 0 && Dictionary(edits[0]).has("old_text")) {
+			text_edits = TypedArray<Dictionary>();
+			prepared = resolve_node_edits(path, edits, options, text_edits, file_result);
+		}
+
+		WorkspaceJob job;
+		job.file_path = path;
+		if (prepared) {
+			prepared = prepare_staged_buffer(path, text_edits, job.byte_edits, job.bytes, job.edited_tree, file_result);
+		}
+		if (!prepared) {
+			failed_files.push_back(path);
+			files[path] = file_result;
+			continue;
+		}
+
+		job.edits_applied = text_edits.size();
+		job.data = reinterpret_cast<const char *>(job.bytes.ptr());
+		job.length = job.bytes.size();
+		const TSTree *base_tree = open_files[path].tree;
+		job.base_tree = base_tree ? ts_tree_copy(base_tree) : nullptr;
+		jobs.push_back(job);
+	}
+
+	if (failed_files.is_empty()) {
+		parser_pool.run(jobs.size(), max_threads, [&](int index, TSParser *worker_parser) {
+			WorkspaceJob &job = jobs[index];
+			job.new_tree = parse_source(worker_parser, job.edited_tree, job.data, job.length);
+			if (job.new_tree) {
+				job.new_error_count = count_error_nodes(ts_tree_root_node(job.new_tree));
+			}
+			if (check_new_errors && job.base_tree) {
+				job.old_error_count = count_error_nodes(ts_tree_root_node(job.base_tree));
+			}
+		});
+	}
+
+	Vector<Ref<StagedEdit>> staged_edits;
+	for (WorkspaceJob &job : jobs) {
+		if (job.edited_tree) {
+			ts_tree_delete(job.edited_tree);
+			job.edited_tree = nullptr;
+		}
+		if (job.base_tree) {
+			ts_tree_delete(job.base_tree);
+			job.base_tree = nullptr;
+		}
+		if (!failed_files.is_empty() && !job.new_tree) {
+			continue;
+		}
+
+		Dictionary file_result;
+		file_result["success"] = false;
+		file_result["error"] = "";
+		if (!job.new_tree) {
+			file_result["error"] = "Failed to parse after edits";
+			failed_files.push_back(job.file_path);
+			files[job.file_path] = file_result;
+			continue;
+		}
+
+		Ref<StagedEdit> staged = make_staged_edit(job.file_path, job.byte_edits, job.bytes, job.new_tree, job.edits_applied);
+		staged_edits.push_back(staged);
+
+		bool allowed = true;
+		if (error_policy == "no_errors") {
+			allowed = job.new_error_count == 0;
+		} else if (check_new_errors) {
+			allowed = job.new_error_count <= job.old_error_count;
+		}
+
+		file_result["success"] = allowed;
+		file_result["has_error"] = staged->has_error;
+		file_result["error_count"] = job.new_error_count;
+		file_result["error_ranges"] = staged->error_ranges;
+		file_result["edits_applied"] = job.edits_applied;
+		if (check_new_errors) {
+			file_result["previous_error_count"] = job.old_error_count;
+		}
+		if (dry_run) {
+			file_result["new_source"] = staged->get_new_source();
+		}
+		if (!allowed) {
+			file_result["error"] = "Edit violates error policy '" + error_policy + "'";
+			failed_files.push_back(job.file_path);
+		}
+		files[job.file_path] = file_result;
+	}
+
+	bool all_passed = failed_files.is_empty();
+	bool commit = all_passed && !dry_run;
+	for (int i = 0; i < staged_edits.size(); i++) {
+		if (commit) {
+			staged_edits[i]->commit();
+		} else {
+			staged_edits[i]->discard();
+		}
+	}
+
+	result["success"] = all_passed;
+	result["committed"] = commit;
+	result["files"] = files;
+	result["failed_files"] = failed_files;
+	result["file_count"] = paths.size();
+	if (!all_passed) {
+		result["error"] = String::num_int64(failed_files.size()) + " file(s) failed, no edits were applied";
+	}
+	return result;
+}
+
+void ASTManager::enforce_history_budget() {
+	// Trim the largest histories first so one heavily edited file cannot
+	// push every other file's undo steps out.
+	while (history_bytes > history_max_bytes) {
+		FileState *largest = nullptr;
+		for (KeyValue<String, FileState> &kv : open_files) {
+			if (!largest || kv.value.history.get_memory_bytes() > largest->history.get_memory_bytes()) {
+				largest = &kv.value;
+			}
+		}
+		int64_t released = largest ? largest->history.trim_oldest() : 0;
+		if (released <= 0) {
+			break;
+		}
+		history_bytes -= released;
+	}
+}
+
+void ASTManager::set_file_tree(FileState &state, TSTree *tree) {
+	file_tree_bytes -= state.tree_cost;
+	state.tree = tree;
+	state.tree_cost = estimate_tree_cost(tree);
+	state.evicted = false;
+	// A file access_open_file() just stamped keeps its tick: a second one
+	// would age the file used before it past enforce_file_budget()'s
+	// most recently used pair.
+	if (state.last_access != file_access_clock) {
+		state.last_access = ++file_access_clock;
+	}
+	file_tree_bytes += state.tree_cost;
+}
+
+FileState *ASTManager::access_open_file(const String &file_path) {
+	FileState *state = open_files.getptr(file_path);
+	if (!state) {
+		return nullptr;
+	}
+	state->last_access = ++file_access_clock;
+	if (!state->evicted) {
+		return state;
+	}
+
+	// The content is unchanged, so another manager may still share its tree.
+	const uint8_t *data = state->source_bytes.ptr();
+	uint32_t length = state->source_bytes.size();
+	TSTree *tree = TreeCache::get_singleton().acquire(content_hash::hash_bytes(data, length), data, length, nullptr);
+	if (!tree) {
+		tree = parse_source(parser, nullptr, reinterpret_cast<const char *>(data), length);
+	}
+	set_file_tree(*state, tree);
+	file_reparse_count++;
+	enforce_file_budget();
+	return state;
+}
+
+void ASTManager::evict_file_tree(FileState &state) {
+	ts_tree_delete(state.tree);
+	file_tree_bytes -= state.tree_cost;
+	state.tree = nullptr;
+	state.tree_cost = 0;
+	state.evicted = true;
+	// Everything derived from the tree goes too; it is rebuilt on demand.
+	state.line_index = std::vector<LineDiff::Line>();
+	state.line_index_version = 0;
+	state.highlights = HighlightCache();
+	state.outline.clear();
+	state.lint.clear();
+	file_eviction_count++;
+}
+
+void ASTManager::enforce_file_budget() {
+	if (file_tree_max_bytes <= 0 || file_tree_bytes <= file_tree_max_bytes) {
+		return;
+	}
+
+	// Evicting down to three quarters of the budget keeps a file that is
+	// accessed right after from triggering another scan at once. The two
+	// most recently used files stay, so a call working on a pair of files
+	// (diff_ast) keeps both trees.
+	std::vector<std::pair<uint64_t, FileState *>> candidates;
+	for (KeyValue<String, FileState> &kv : open_files) {
+		FileState &state = kv.value;
+		if (state.tree && !state.pinned && state.last_access + 2 <= file_access_clock) {
+			candidates.push_back({ state.last_access, &state });
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const std::pair<uint64_t, FileState *> &a, const std::pair<uint64_t, FileState *> &b) { return a.first < b.first; });
+
+	int64_t target = file_tree_max_bytes - file_tree_max_bytes / 4;
+	for (const std::pair<uint64_t, FileState *> &candidate : candidates) {
+		if (file_tree_bytes <= target) {
+			break;
+		}
+		evict_file_tree(*candidate.second);
+	}
+}
+
+Dictionary ASTManager::step_history(const String &file_path, bool redo) {
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = open_files.getptr(file_path);
+	if (!state) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+	if (redo ? !state->history.can_redo() : !state->history.can_undo()) {
+		result["error"] = redo ? "Nothing to redo" : "Nothing to undo";
+		return result;
+	}
+
+	const FileHistory::Entry &entry = redo ? state->history.get_redo_entry() : state->history.get_undo_entry();
+	uint64_t target_version = redo ? entry.to_version : entry.from_version;
+
+	Vector<ByteEdit> byte_edits = make_history_step_edits(entry, redo);
+
+	PackedByteArray restored_bytes;
+	TSTree *restored_tree = state->history.copy_snapshot(target_version);
+	bool from_snapshot = restored_tree != nullptr;
+	if (from_snapshot) {
+		Vector<TSInputEdit> input_edits;
+		restored_bytes = splice_byte_edits(state->source_bytes, byte_edits, input_edits);
+	} else {
+		TSTree *edited_tree = nullptr;
+		build_staged_buffer(*state, byte_edits, restored_bytes, edited_tree);
+		const char *parse_data = reinterpret_cast<const char *>(restored_bytes.ptr());
+		restored_tree = parse_source(parser, edited_tree, parse_data, restored_bytes.size());
+		if (edited_tree) {
+			ts_tree_delete(edited_tree);
+		}
+		if (!restored_tree) {
+			result["error"] = "Failed to parse restored content";
+			return result;
+		}
+	}
+
+	update_caches_for_edit(*state, byte_edits, restored_tree, target_version);
+
+	TSTree *left_tree = state->tree;
+	state->source_bytes = restored_bytes;
+	set_file_tree(*state, restored_tree);
+	state->version = target_version;
+	history_bytes -= state->history.get_memory_bytes();
+	if (redo) {
+		state->history.step_redo(left_tree);
+	} else {
+		state->history.step_undo(left_tree);
+	}
+	history_bytes += state->history.get_memory_bytes();
+	enforce_history_budget();
+	index_open_file(file_path, *state);
+	enforce_file_budget();
+
+	result = make_parse_result_dict(file_path, restored_tree);
+	result["version"] = (int64_t)target_version;
+	result["restored_from_snapshot"] = from_snapshot;
+	result["undo_count"] = state->history.get_undo_count();
+	result["redo_count"] = state->history.get_redo_count();
+	return result;
+}
+
+bool ASTManager::restore_version(const FileState &state, uint64_t version, PackedByteArray &r_bytes, TSTree **r_tree, uint32_t *r_unchanged_prefix, uint32_t *r_unchanged_suffix) {
+	r_bytes = state.source_bytes;
+	TSTree *edited_tree = (r_tree && state.tree) ? ts_tree_copy(state.tree) : nullptr;
+	// Bytes before the first and after the last edit of every step are the
+	// same in both versions.
+	uint32_t unchanged_prefix = r_bytes.size();
+	uint32_t unchanged_suffix = r_bytes.size();
+
+	if (version != state.version) {
+		const FileHistory &history = state.history;
+		int undo_count = history.get_undo_count();
+		int target = -1;
+		bool redo = false;
+		for (int i = undo_count - 1; i >= 0 && target < 0; i--) {
+			if (history.get_entry(i).from_version == version) {
+				target = i;
+			}
+		}
+		for (int i = undo_count; i < history.get_entry_count() && target < 0; i++) {
+			if (history.get_entry(i).to_version == version) {
+				target = i;
+				redo = true;
+			}
+		}
+		if (target < 0) {
+			if (edited_tree) {
+				ts_tree_delete(edited_tree);
+			}
+			return false;
+		}
+
+		int step = redo ? 1 : -1;
+		for (int i = redo ? undo_count : undo_count - 1; i != target + step; i += step) {
+			Vector<ByteEdit> byte_edits = make_history_step_edits(history.get_entry(i), redo);
+			if (!byte_edits.is_empty()) {
+				unchanged_prefix = MIN(unchanged_prefix, byte_edits[0].start_byte);
+				unchanged_suffix = MIN(unchanged_suffix, (uint32_t)r_bytes.size() - byte_edits[byte_edits.size() - 1].end_byte);
+			}
+			Vector<TSInputEdit> input_edits;
+			r_bytes = splice_byte_edits(r_bytes, byte_edits, input_edits);
+			if (edited_tree) {
+				for (int j = input_edits.size() - 1; j >= 0; j--) {
+					ts_tree_edit(edited_tree, &input_edits[j]);
+				}
+			}
+		}
+	}
+
+	if (r_unchanged_prefix) {
+		*r_unchanged_prefix = MIN(unchanged_prefix, (uint32_t)r_bytes.size());
+	}
+	if (r_unchanged_suffix) {
+		*r_unchanged_suffix = MIN(unchanged_suffix, (uint32_t)r_bytes.size());
+	}
+	if (!r_tree) {
+		return true;
+	}
+	if (version == state.version) {
+		*r_tree = edited_tree;
+		return edited_tree != nullptr;
+	}
+	*r_tree = state.history.copy_snapshot(version);
+	if (!*r_tree) {
+		*r_tree = parse_source(parser, edited_tree, reinterpret_cast<const char *>(r_bytes.ptr()), r_bytes.size());
+	}
+	if (edited_tree) {
+		ts_tree_delete(edited_tree);
+	}
+	return *r_tree != nullptr;
+}
+
+const std::vector<LineDiff::Line> &ASTManager::get_line_index(FileState &state) {
+	if (state.line_index_version != state.version) {
+		LineDiff::split_lines(reinterpret_cast<const char *>(state.source_bytes.ptr()), state.source_bytes.size(), state.line_index);
+		state.line_index_version = state.version;
+	}
+	return state.line_index;
+}
+
+void ASTManager::update_caches_for_edit(FileState &state, const Vector<ByteEdit> &byte_edits, TSTree *new_tree, uint64_t new_version) {
+	bool outline = state.outline.get_version() != 0 && state.outline.get_version() == state.version;
+	if (!outline) {
+		state.outline.clear();
+	}
+	bool lint = state.lint.get_version() != 0 && state.lint.get_version() == state.version;
+	if (!lint) {
+		state.lint.clear();
+	}
+	if (!outline && !lint && state.highlights.get_line_count() == 0) {
+		return;
+	}
+	const std::vector<LineDiff::Line> &lines = get_line_index(state);
+	bool highlights = state.highlights.is_current(highlight_generation, count_editor_lines(lines));
+
+	const uint8_t *data = state.source_bytes.ptr();
+	uint32_t length = state.source_bytes.size();
+	auto point_of = [&](uint32_t byte, uint32_t row) {
+		uint32_t line_start = row < lines.size() ? lines[row].start : length;
+		return TSPoint{ row, byte - line_start };
+	};
+
+	// Back to front so the rows of earlier edits stay valid.
+	Vector<TSInputEdit> input_edits;
+	input_edits.resize(byte_edits.size());
+	for (int i = byte_edits.size() - 1; i >= 0; i--) {
+		const ByteEdit &edit = byte_edits[i];
+		uint32_t first = row_of_byte(lines, edit.start_byte);
+		uint32_t last = row_of_byte(lines, edit.end_byte);
+		uint32_t removed = count_newlines(data + edit.start_byte, edit.end_byte - edit.start_byte);
+		uint32_t inserted = count_newlines(edit.new_bytes.ptr(), edit.new_bytes.size());
+		if (highlights) {
+			state.highlights.splice(first, last - first + 1, last - first + 1 - removed + inserted);
+		}
+
+		TSInputEdit &input_edit = input_edits.write[i];
+		input_edit.start_byte = edit.start_byte;
+		input_edit.old_end_byte = edit.end_byte;
+		input_edit.new_end_byte = edit.start_byte + edit.new_bytes.size();
+		input_edit.start_point = point_of(edit.start_byte, first);
+		input_edit.old_end_point = point_of(edit.end_byte, last);
+		input_edit.new_end_point = advance_point(input_edit.start_point, reinterpret_cast<const char *>(edit.new_bytes.ptr()), edit.new_bytes.size());
+		if (outline) {
+			state.outline.apply_edit(input_edit);
+		}
+		if (lint) {
+			state.lint.apply_edit(input_edit);
+		}
+	}
+
+	// Text outside the edits can change meaning too, e.g. after an opening
+	// quote; the tree's changed ranges cover that.
+	if (!state.tree || !new_tree) {
+		return;
+	}
+	TSTree *edited_tree = ts_tree_copy(state.tree);
+	for (int i = input_edits.size() - 1; i >= 0; i--) {
+		ts_tree_edit(edited_tree, &input_edits[i]);
+	}
+	uint32_t range_count = 0;
+	TSRange *ranges = ts_tree_get_changed_ranges(edited_tree, new_tree, &range_count);
+	for (uint32_t i = 0; i < range_count; i++) {
+		if (highlights) {
+			state.highlights.invalidate(ranges[i].start_point.row, ranges[i].end_point.row);
+		}
+		if (outline) {
+			state.outline.invalidate(ranges[i].start_byte, ranges[i].end_byte);
+		}
+		if (lint) {
+			state.lint.invalidate(ranges[i].start_byte, ranges[i].end_byte);
+		}
+	}
+	ts_allocator::free(ranges);
+	ts_tree_delete(edited_tree);
+	if (lint) {
+		state.lint.set_version(new_version);
+	}
+}
+
+Dictionary ASTManager::undo(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	return step_history(file_path, false);
+}
+
+Dictionary ASTManager::redo(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	return step_history(file_path, true);
+}
+
+void ASTManager::configure_history(const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	history_max_bytes = options.get("max_bytes", history_max_bytes);
+	history_snapshot_interval = options.get("snapshot_interval", history_snapshot_interval);
+	history_enabled = options.get("enabled", history_enabled);
+
+	if (!history_enabled) {
+		for (KeyValue<String, FileState> &kv : open_files) {
+			kv.value.history.clear();
+		}
+		history_bytes = 0;
+	}
+	enforce_history_budget();
+}
+
+void ASTManager::configure_file_budget(const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	file_tree_max_bytes = MAX((int64_t)options.get("max_tree_bytes", file_tree_max_bytes), (int64_t)0);
+	enforce_file_budget();
+}
+
+Dictionary ASTManager::get_file_budget_info() {
+	PERF_METHOD_SCOPE();
+	int resident_count = 0;
+	int evicted_count = 0;
+	int pinned_count = 0;
+	int64_t source_bytes = 0;
+	for (const KeyValue<String, FileState> &kv : open_files) {
+		resident_count += kv.value.tree != nullptr;
+		evicted_count += kv.value.evicted;
+		pinned_count += kv.value.pinned;
+		source_bytes += kv.value.source_bytes.size();
+	}
+
+	Dictionary result;
+	result["file_count"] = open_files.size();
+	result["resident_count"] = resident_count;
+	result["evicted_count"] = evicted_count;
+	result["pinned_count"] = pinned_count;
+	result["tree_bytes"] = file_tree_bytes;
+	result["source_bytes"] = source_bytes;
+	result["max_tree_bytes"] = file_tree_max_bytes;
+	result["eviction_count"] = (int64_t)file_eviction_count;
+	result["reparse_count"] = (int64_t)file_reparse_count;
+	return result;
+}
+
+bool ASTManager::set_file_pinned(const String &file_path, bool pinned) {
+	PERF_METHOD_SCOPE();
+	FileState *state = pinned ? access_open_file(file_path) : open_files.getptr(file_path);
+	if (!state) {
+		return false;
+	}
+	state->pinned = pinned;
+	enforce_file_budget();
+	return true;
+}
+
+int64_t ASTManager::get_index_memory_bytes() const {
+	return symbol_index.get_memory_bytes() + reference_index.get_memory_bytes() + dependency_graph.get_memory_bytes() + global_names.get_memory_bytes() +
+			memory_usage::of(overlay_name_masks) + memory_usage::of(mapped_name_masks);
+}
+
+Dictionary ASTManager::get_memory_stats(const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	int top_count = options.get("top_files", 10);
+
+	std::vector<FileMemory> file_memory;
+	file_memory.reserve(open_files.size());
+	FileMemory totals;
+	for (const KeyValue<String, FileState> &kv : open_files) {
+		file_memory.push_back(measure_file(kv.key, kv.value));
+		const FileMemory &memory = file_memory.back();
+		totals.source_bytes += memory.source_bytes;
+		totals.tree_bytes += memory.tree_bytes;
+		totals.history_bytes += memory.history_bytes;
+		totals.cache_bytes += memory.cache_bytes;
+	}
+	size_t top = MIN((size_t)MAX(top_count, 0), file_memory.size());
+	std::partial_sort(file_memory.begin(), file_memory.begin() + top, file_memory.end(), [](const FileMemory &a, const FileMemory &b) {
+		return a.get_total() > b.get_total();
+	});
+	Array top_files;
+	for (size_t i = 0; i < top; i++) {
+		const FileMemory &memory = file_memory[i];
+		Dictionary entry;
+		entry["file_path"] = memory.file_path;
+		entry["total_bytes"] = memory.get_total();
+		entry["source_bytes"] = memory.source_bytes;
+		entry["tree_bytes"] = memory.tree_bytes;
+		entry["history_bytes"] = memory.history_bytes;
+		entry["cache_bytes"] = memory.cache_bytes;
+		top_files.push_back(entry);
+	}
+
+	Dictionary files;
+	files["count"] = (int)open_files.size();
+	files["source_bytes"] = totals.source_bytes;
+	files["tree_bytes"] = totals.tree_bytes;
+	files["history_bytes"] = totals.history_bytes;
+	files["cache_bytes"] = totals.cache_bytes;
+
+	Dictionary queries;
+	queries["highlight_bytes"] = highlight_query_bytes;
+	queries["lint_bytes"] = lint_query_bytes;
+
+	Dictionary indexes;
+	indexes["symbol_bytes"] = (int64_t)symbol_index.get_memory_bytes();
+	indexes["reference_bytes"] = (int64_t)reference_index.get_memory_bytes();
+	indexes["dependency_bytes"] = (int64_t)dependency_graph.get_memory_bytes();
+	indexes["global_name_bytes"] = (int64_t)global_names.get_memory_bytes();
+	indexes["mapped_bytes"] = (int64_t)symbol_index_file.get_mapped_bytes();
+
+	// Process-wide: every manager, the shared tree cache and the parsers.
+	ts_allocator::Stats allocator = ts_allocator::get_stats();
+	Dictionary tree_sitter;
+	tree_sitter["counting"] = ts_allocator::is_installed();
+	tree_sitter["bytes"] = allocator.bytes;
+	tree_sitter["peak_bytes"] = allocator.peak_bytes;
+	tree_sitter["block_count"] = allocator.block_count;
+	tree_sitter["allocation_count"] = (int64_t)allocator.allocation_count;
+	tree_sitter["backend"] = ALLOCATOR_BACKEND_NAMES[ts_allocator::get_backend()];
+	tree_sitter["pool_reserved_bytes"] = allocator.pool_reserved_bytes;
+	tree_sitter["pool_free_bytes"] = allocator.pool_free_bytes;
+	tree_sitter["tree_cache_source_bytes"] = (int64_t)TreeCache::get_singleton().get_stats().source_bytes;
+
+	Dictionary result;
+	result["total_bytes"] = totals.get_total() + highlight_query_bytes + lint_query_bytes + get_index_memory_bytes();
+	result["files"] = files;
+	result["top_files"] = top_files;
+	result["queries"] = queries;
+	result["indexes"] = indexes;
+	result["tree_sitter"] = tree_sitter;
+	return result;
+}
+
+Variant ASTManager::get_memory_monitor(const String &key) {
+	PERF_METHOD_SCOPE();
+	if (key == "index_bytes") {
+		return get_index_memory_bytes();
+	}
+	if (key == "query_bytes") {
+		return highlight_query_bytes + lint_query_bytes;
+	}
+	FileMemory totals;
+	for (const KeyValue<String, FileState> &kv : open_files) {
+		FileMemory memory = measure_file(kv.key, kv.value);
+		totals.source_bytes += memory.source_bytes;
+		totals.tree_bytes += memory.tree_bytes;
+		totals.history_bytes += memory.history_bytes;
+		totals.cache_bytes += memory.cache_bytes;
+	}
+	if (key == "source_bytes") {
+		return totals.source_bytes;
+	}
+	if (key == "tree_bytes") {
+		return totals.tree_bytes;
+	}
+	if (key == "history_bytes") {
+		return totals.history_bytes;
+	}
+	if (key == "cache_bytes") {
+		return totals.cache_bytes;
+	}
+	return totals.get_total() + highlight_query_bytes + lint_query_bytes + get_index_memory_bytes();
+}
+
+bool ASTManager::add_memory_monitors(const String &prefix) {
+	PERF_METHOD_SCOPE();
+	Performance *performance = Performance::get_singleton();
+	if (!performance || !memory_monitors.is_empty()) {
+		return false;
+	}
+	static const char *const MONITOR_KEYS[] = { "total_bytes", "source_bytes", "tree_bytes", "history_bytes", "cache_bytes", "index_bytes", "query_bytes" };
+	for (const char *key : MONITOR_KEYS) {
+		String id = prefix + "/" + key;
+		if (performance->has_custom_monitor(id)) {
+			remove_memory_monitors();
+			return false;
+		}
+		Array arguments;
+		arguments.push_back(String(key));
+		performance->add_custom_monitor(id, callable_mp(this, &ASTManager::get_memory_monitor), arguments);
+		memory_monitors.push_back(id);
+	}
+	return true;
+}
+
+void ASTManager::remove_memory_monitors() {
+	PERF_METHOD_SCOPE();
+	Performance *performance = Performance::get_singleton();
+	for (int i = 0; performance && i < memory_monitors.size(); i++) {
+		if (performance->has_custom_monitor(memory_monitors[i])) {
+			performance->remove_custom_monitor(memory_monitors[i]);
+		}
+	}
+	memory_monitors.clear();
+}
+
+Dictionary ASTManager::configure_allocator(const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	if (!ts_allocator::is_installed()) {
+		result["error"] = "The tree-sitter allocator is not installed";
+		return result;
+	}
+	if (options.has("backend")) {
+		String backend = options["backend"];
+		if (backend == "system") {
+			ts_allocator::set_backend(ts_allocator::BACKEND_SYSTEM);
+		} else if (backend == "pool") {
+			ts_allocator::set_backend(ts_allocator::BACKEND_POOL);
+		} else {
+			result["error"] = "Unknown allocator backend: " + backend;
+			return result;
+		}
+	}
+	result["success"] = true;
+	result["backend"] = ALLOCATOR_BACKEND_NAMES[ts_allocator::get_backend()];
+	return result;
+}
+
+Dictionary ASTManager::benchmark_allocators(const PackedStringArray &sources, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	int rounds = MAX((int)options.get("rounds", 5), 1);
+	int max_threads = options.get("max_threads", 0);
+	if (!ts_allocator::is_installed()) {
+		result["error"] = "The tree-sitter allocator is not installed";
+		return result;
+	}
+
+	std::vector<CharString> utf8_sources;
+	int64_t source_bytes = 0;
+	for (int i = 0; i < sources.size(); i++) {
+		utf8_sources.push_back(sources[i].utf8());
+		source_bytes += utf8_sources.back().length();
+	}
+
+	// Each round parses every source on the worker threads and frees all
+	// the trees at once on this one, the way indexing a project does.
+	// The backends run one after the other in the same process, so the
+	// RSS growth of each is the figure to compare; the RSS after the pool
+	// run also holds what malloc kept from the system run.
+	ts_allocator::Backend previous = ts_allocator::get_backend();
+	const ts_allocator::Backend backends[] = { ts_allocator::BACKEND_SYSTEM, ts_allocator::BACKEND_POOL };
+	std::vector<TSTree *> trees(utf8_sources.size(), nullptr);
+	for (ts_allocator::Backend backend : backends) {
+		ts_allocator::set_backend(backend);
+		ts_allocator::reset_peak();
+		int64_t live_before = ts_allocator::get_stats().bytes;
+		int64_t rss_before = get_resident_bytes();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int round = 0; round < rounds; round++) {
+			parser_pool.run(utf8_sources.size(), max_threads, [&](int index, TSParser *worker_parser) {
+				trees[index] = ts_parser_parse_string(worker_parser, nullptr, utf8_sources[index].get_data(), utf8_sources[index].length());
+			});
+			for (TSTree *&tree : trees) {
+				if (tree) {
+					ts_tree_delete(tree);
+					tree = nullptr;
+				}
+			}
+		}
+		double msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		int64_t rss_after = get_resident_bytes();
+		ts_allocator::Stats stats = ts_allocator::get_stats();
+
+		Dictionary entry;
+		entry["msec"] = msec;
+		entry["megabytes_per_second"] = msec > 0.0 ? (double)source_bytes * rounds / (1024.0 * 1024.0) / (msec / 1000.0) : 0.0;
+		entry["peak_bytes"] = stats.peak_bytes - live_before;
+		entry["rss_bytes"] = rss_after;
+		entry["rss_growth_bytes"] = rss_before >= 0 && rss_after >= 0 ? rss_after - rss_before : (int64_t)-1;
+		entry["pool_reserved_bytes"] = stats.pool_reserved_bytes;
+		result[ALLOCATOR_BACKEND_NAMES[backend]] = entry;
+	}
+	ts_allocator::set_backend(previous);
+
+	result["success"] = true;
+	result["file_count"] = (int)utf8_sources.size();
+	result["source_bytes"] = source_bytes;
+	result["rounds"] = rounds;
+	return result;
+}
+
+// The two perf_stats entry points are not timed themselves: their calls
+// would land right after the reset they may have just done.
+void ASTManager::configure_perf_stats(const Dictionary &options) {
+	if (options.has("enabled")) {
+		perf_stats::set_enabled(options["enabled"]);
+	}
+	if (options.get("reset", false)) {
+		perf_stats::reset();
+	}
+}
+
+Dictionary ASTManager::get_perf_stats(bool reset) {
+	std::vector<perf_stats::ProbeStats> probes = perf_stats::snapshot();
+	if (reset) {
+		perf_stats::reset();
+	}
+	// Methods by total time, the costliest first; phases in pipeline order.
+	std::stable_sort(probes.begin(), probes.end(), [](const perf_stats::ProbeStats &a, const perf_stats::ProbeStats &b) {
+		if (a.phase != b.phase) {
+			return a.phase;
+		}
+		return !a.phase && a.total_nsec > b.total_nsec;
+	});
+	Array methods;
+	Array phases;
+	for (const perf_stats::ProbeStats &stats : probes) {
+		(stats.phase ? phases : methods).push_back(make_probe_dict(stats));
+	}
+
+	Dictionary result;
+	result["enabled"] = perf_stats::is_enabled();
+	result["methods"] = methods;
+	result["phases"] = phases;
+	return result;
+}
+
+void ASTManager::configure_tree_cache(const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	TreeCache &cache = TreeCache::get_singleton();
+	if (options.has("enabled")) {
+		cache.set_enabled(options["enabled"]);
+	}
+	if (options.has("max_bytes")) {
+		cache.set_max_bytes(MAX((int64_t)options["max_bytes"], (int64_t)0));
+	}
+	if (options.get("clear", false)) {
+		cache.clear();
+	}
+}
+
+Dictionary ASTManager::get_tree_cache_stats(bool reset) {
+	PERF_METHOD_SCOPE();
+	TreeCache &cache = TreeCache::get_singleton();
+	TreeCache::Stats stats = cache.get_stats();
+	if (reset) {
+		cache.reset_stats();
+	}
+	Dictionary result;
+	uint64_t lookups = stats.hits + stats.misses;
+	result["enabled"] = cache.is_enabled();
+	result["hits"] = (int64_t)stats.hits;
+	result["misses"] = (int64_t)stats.misses;
+	result["hit_rate"] = lookups > 0 ? (double)stats.hits / lookups : 0.0;
+	result["stores"] = (int64_t)stats.stores;
+	result["evictions"] = (int64_t)stats.evictions;
+	result["entry_count"] = (int)stats.entry_count;
+	result["source_bytes"] = (int64_t)stats.source_bytes;
+	result["max_bytes"] = (int64_t)cache.get_max_bytes();
+	return result;
+}
+
+Dictionary ASTManager::get_history_info(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+
+	const FileState *state = open_files.getptr(file_path);
+	if (!state) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+
+	result["success"] = true;
+	result["version"] = (int64_t)state->version;
+	result["undo_count"] = state->history.get_undo_count();
+	result["redo_count"] = state->history.get_redo_count();
+	result["snapshot_count"] = state->history.get_snapshot_count();
+	result["memory_bytes"] = state->history.get_memory_bytes();
+	result["total_memory_bytes"] = history_bytes;
+	result["max_bytes"] = history_max_bytes;
+	return result;
+}
+
+String ASTManager::generate_diff(const String &old_text, const String &new_text, const String &file_name, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	if (old_text == new_text) {
+		return "";
+	}
+
+	CharString old_utf8 = source_to_utf8(old_text);
+	CharString new_utf8 = source_to_utf8(new_text);
+	CharString name_utf8 = file_name.utf8();
+
+	std::vector<LineDiff::Line> old_lines;
+	std::vector<LineDiff::Line> new_lines;
+	LineDiff::split_lines(old_utf8.get_data(), old_utf8.length(), old_lines);
+	LineDiff::split_lines(new_utf8.get_data(), new_utf8.length(), new_lines);
+
+	LineDiff diff;
+	diff.compute(old_utf8.get_data(), old_lines.data(), old_lines.size(),
+			new_utf8.get_data(), new_lines.data(), new_lines.size(),
+			parse_diff_algorithm(options));
+
+	std::string output;
+	diff.write_unified(std::string("a/") + name_utf8.get_data(), std::string("b/") + name_utf8.get_data(),
+			parse_diff_context(options), output);
+	return source_from_utf8(output.data(), output.size());
+}
+
+Dictionary ASTManager::generate_structured_diff(const String &old_text, const String &new_text, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	CharString old_utf8 = source_to_utf8(old_text);
+	CharString new_utf8 = source_to_utf8(new_text);
+
+	std::vector<LineDiff::Line> old_lines;
+	std::vector<LineDiff::Line> new_lines;
+	LineDiff::split_lines(old_utf8.get_data(), old_utf8.length(), old_lines);
+	LineDiff::split_lines(new_utf8.get_data(), new_utf8.length(), new_lines);
+
+	LineDiff diff;
+	diff.compute(old_utf8.get_data(), old_lines.data(), old_lines.size(),
+			new_utf8.get_data(), new_lines.data(), new_lines.size(),
+			parse_diff_algorithm(options));
+
+	String inline_mode = options.get("inline", "none");
+	TSTree *old_tree = nullptr;
+	TSTree *new_tree = nullptr;
+	if (inline_mode == "token" && !diff.get_changes().empty()) {
+		old_tree = parse_source(parser, nullptr, old_utf8.get_data(), old_utf8.length());
+		new_tree = parse_source(parser, nullptr, new_utf8.get_data(), new_utf8.length());
+	}
+
+	Dictionary result = make_structured_diff(diff, old_utf8.get_data(), old_lines, new_utf8.get_data(), new_lines,
+			parse_diff_context(options), inline_mode, old_tree, new_tree);
+
+	if (old_tree) {
+		ts_tree_delete(old_tree);
+	}
+	if (new_tree) {
+		ts_tree_delete(new_tree);
+	}
+	return result;
+}
+
+Dictionary ASTManager::diff_ast(const String &old_file_path, const String &new_file_path, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+
+	const FileState *old_state = access_open_file(old_file_path);
+	if (!old_state) {
+		result["error"] = "File not open: " + old_file_path;
+		return result;
+	}
+	const FileState *new_state = access_open_file(new_file_path);
+	if (!new_state) {
+		result["error"] = "File not open: " + new_file_path;
+		return result;
+	}
+
+	uint64_t old_version = (int64_t)options.get("old_version", (int64_t)old_state->version);
+	uint64_t new_version = (int64_t)options.get("new_version", (int64_t)new_state->version);
+
+	PackedByteArray old_bytes;
+	PackedByteArray new_bytes;
+	TSTree *old_tree = nullptr;
+	TSTree *new_tree = nullptr;
+	if (!restore_version(*old_state, old_version, old_bytes, &old_tree)) {
+		result["error"] = "Version " + String::num_int64(old_version) + " of " + old_file_path + " is not available";
+		return result;
+	}
+	if (!restore_version(*new_state, new_version, new_bytes, &new_tree)) {
+		ts_tree_delete(old_tree);
+		result["error"] = "Version " + String::num_int64(new_version) + " of " + new_file_path + " is not available";
+		return result;
+	}
+
+	TreeDiff::Options diff_options;
+	diff_options.min_height = (int)options.get("min_height", (int)diff_options.min_height);
+	diff_options.min_dice = (float)options.get("min_dice", diff_options.min_dice);
+
+	TreeDiff diff;
+	diff.compute(old_tree, reinterpret_cast<const char *>(old_bytes.ptr()),
+			new_tree, reinterpret_cast<const char *>(new_bytes.ptr()), diff_options);
+
+	static const char *type_names[] = { "insert", "delete", "update", "move" };
+	const std::vector<TreeDiff::Node> &old_nodes = diff.get_old_nodes();
+	const std::vector<TreeDiff::Node> &new_nodes = diff.get_new_nodes();
+	Array operations;
+	for (const TreeDiff::Operation &operation : diff.get_operations()) {
+		Dictionary op;
+		op["type"] = type_names[operation.type];
+		bool has_old = operation.old_node != TreeDiff::NONE;
+		TSNode node = has_old ? old_nodes[operation.old_node].node : new_nodes[operation.new_node].node;
+		op["node_type"] = ts_node_type(node);
+
+		TSNode name = ts_node_child_by_field_name(node, "name", 4);
+		if (!ts_node_is_null(name)) {
+			op["name"] = node_text(name, has_old ? old_bytes : new_bytes);
+		}
+		if (has_old) {
+			add_tree_diff_range(op, "old_", old_nodes[operation.old_node].node);
+		}
+		if (operation.new_node != TreeDiff::NONE) {
+			add_tree_diff_range(op, "new_", new_nodes[operation.new_node].node);
+		}
+		if (operation.type == TreeDiff::OP_UPDATE) {
+			op["old_text"] = node_text(old_nodes[operation.old_node].node, old_bytes);
+			op["new_text"] = node_text(new_nodes[operation.new_node].node, new_bytes);
+		}
+		operations.push_back(op);
+	}
+
+	ts_tree_delete(old_tree);
+	ts_tree_delete(new_tree);
+
+	result["success"] = true;
+	result["old_version"] = (int64_t)old_version;
+	result["new_version"] = (int64_t)new_version;
+	result["operations"] = operations;
+	result["matched_count"] = (int)diff.get_match_count();
+	result["old_node_count"] = (int)old_nodes.size();
+	result["new_node_count"] = (int)new_nodes.size();
+	return result;
+}
+
+Dictionary ASTManager::diff_file(const String &file_path, const Variant &target, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = access_open_file(file_path);
+	if (!state) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+
+	String format = options.get("format", "unified");
+	bool want_trees = format == "structured" && String(options.get("inline", "none")) == "token";
+	const std::vector<LineDiff::Line> &current_lines = get_line_index(*state);
+	const char *current_data = reinterpret_cast<const char *>(state->source_bytes.ptr());
+	uint32_t current_length = state->source_bytes.size();
+
+	// The other side is either proposed content (new) or a retained version
+	// (old); the file's current state is the opposite side.
+	CharString proposed_utf8;
+	PackedByteArray version_bytes;
+	std::vector<LineDiff::Line> other_lines;
+	TSTree *other_tree = nullptr;
+	uint32_t unchanged_prefix = 0;
+	uint32_t unchanged_suffix = 0;
+	bool target_is_version = false;
+
+	if (target.get_type() == Variant::STRING) {
+		proposed_utf8 = source_to_utf8(target);
+		find_common_ends(reinterpret_cast<const uint8_t *>(current_data), current_length,
+				reinterpret_cast<const uint8_t *>(proposed_utf8.get_data()), proposed_utf8.length(),
+				unchanged_prefix, unchanged_suffix);
+		LineDiff::split_lines(proposed_utf8.get_data(), proposed_utf8.length(), other_lines);
+		if (want_trees) {
+			other_tree = parse_source(parser, nullptr, proposed_utf8.get_data(), proposed_utf8.length());
+		}
+	} else if (target.get_type() == Variant::INT) {
+		target_is_version = true;
+		uint64_t version = (int64_t)target;
+		if (!restore_version(*state, version, version_bytes, want_trees ? &other_tree : nullptr, &unchanged_prefix, &unchanged_suffix)) {
+			result["error"] = "Version " + String::num_int64(version) + " of " + file_path + " is not available";
+			return result;
+		}
+		LineDiff::split_lines(reinterpret_cast<const char *>(version_bytes.ptr()), version_bytes.size(), other_lines);
+	} else {
+		result["error"] = "Target must be new content (String) or a version (int)";
+		return result;
+	}
+
+	const char *old_data = current_data;
+	const char *new_data = proposed_utf8.get_data();
+	const std::vector<LineDiff::Line> *old_lines = &current_lines;
+	const std::vector<LineDiff::Line> *new_lines = &other_lines;
+	uint32_t old_length = current_length;
+	TSTree *old_tree = state->tree;
+	TSTree *new_tree = other_tree;
+	if (target_is_version) {
+		old_data = reinterpret_cast<const char *>(version_bytes.ptr());
+		new_data = current_data;
+		old_lines = &other_lines;
+		new_lines = &current_lines;
+		old_length = version_bytes.size();
+		old_tree = other_tree;
+		new_tree = state->tree;
+	}
+
+	uint32_t equal_prefix = count_leading_lines(*old_lines, unchanged_prefix);
+	uint32_t equal_suffix = count_trailing_lines(*old_lines, old_length, unchanged_suffix);
+
+	LineDiff diff;
+	diff.compute(old_data, old_lines->data(), old_lines->size(), new_data, new_lines->data(), new_lines->size(),
+			parse_diff_algorithm(options), equal_prefix, equal_suffix);
+
+	uint32_t context = parse_diff_context(options);
+	if (format == "structured") {
+		result = make_structured_diff(diff, old_data, *old_lines, new_data, *new_lines, context,
+				options.get("inline", "none"), old_tree, new_tree);
+		result["file_path"] = file_path;
+	} else {
+		std::string output;
+		if (!diff.get_changes().empty()) {
+			CharString name_utf8 = String(options.get("file_name", file_path)).utf8();
+			diff.write_unified(std::string("a/") + name_utf8.get_data(), std::string("b/") + name_utf8.get_data(), context, output);
+		}
+		result["success"] = true;
+		result["diff"] = source_from_utf8(output.data(), output.size());
+	}
+	if (other_tree) {
+		ts_tree_delete(other_tree);
+	}
+
+	result["changed"] = !diff.get_changes().empty();
+	result["old_version"] = target_is_version ? (int64_t)target : (int64_t)state->version;
+	if (target_is_version) {
+		result["new_version"] = (int64_t)state->version;
+	}
+	result["skipped_lines"] = (int)(equal_prefix + equal_suffix);
+	return result;
+}
+
+Dictionary ASTManager::merge_text(const String &base_text, const String &ours_text, const String &theirs_text, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	CharString base_utf8 = source_to_utf8(base_text);
+	CharString ours_utf8 = source_to_utf8(ours_text);
+	CharString theirs_utf8 = source_to_utf8(theirs_text);
+
+	std::vector<LineDiff::Line> base_lines;
+	std::vector<LineDiff::Line> ours_lines;
+	std::vector<LineDiff::Line> theirs_lines;
+	LineDiff::split_lines(base_utf8.get_data(), base_utf8.length(), base_lines);
+	LineDiff::split_lines(ours_utf8.get_data(), ours_utf8.length(), ours_lines);
+	LineDiff::split_lines(theirs_utf8.get_data(), theirs_utf8.length(), theirs_lines);
+
+	LineMerge::Side ours = make_merge_side(ours_utf8.get_data(), ours_utf8.length(), ours_lines);
+	std::vector<LineMerge::Replacement> replacements;
+	std::vector<LineMerge::Conflict> conflicts;
+	LineMerge::merge(make_merge_side(base_utf8.get_data(), base_utf8.length(), base_lines), ours,
+			make_merge_side(theirs_utf8.get_data(), theirs_utf8.length(), theirs_lines),
+			parse_merge_options(options), replacements, conflicts);
+
+	std::string merged;
+	LineMerge::apply(ours, replacements, merged);
+
+	Dictionary result;
+	result["success"] = true;
+	result["merged"] = source_from_utf8(merged.data(), merged.size());
+	result["clean"] = conflicts.empty();
+	result["conflict_count"] = (int)conflicts.size();
+	result["conflicts"] = make_conflict_array(conflicts);
+	return result;
+}
+
+Dictionary ASTManager::merge_file(const String &file_path, int64_t base_version, const String &theirs_text, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = access_open_file(file_path);
+	if (!state) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+
+	PackedByteArray base_bytes;
+	if (!restore_version(*state, base_version, base_bytes, nullptr)) {
+		result["error"] = "Version " + String::num_int64(base_version) + " of " + file_path + " is not available";
+		return result;
+	}
+	CharString theirs_utf8 = source_to_utf8(theirs_text);
+
+	std::vector<LineDiff::Line> base_lines;
+	std::vector<LineDiff::Line> theirs_lines;
+	LineDiff::split_lines(reinterpret_cast<const char *>(base_bytes.ptr()), base_bytes.size(), base_lines);
+	LineDiff::split_lines(theirs_utf8.get_data(), theirs_utf8.length(), theirs_lines);
+
+	// Ours is the file as it is now, so the merge comes out as edits of the
+	// cached buffer and is reparsed incrementally.
+	LineMerge::Side ours = make_merge_side(reinterpret_cast<const char *>(state->source_bytes.ptr()), state->source_bytes.size(), get_line_index(*state));
+	std::vector<LineMerge::Replacement> replacements;
+	std::vector<LineMerge::Conflict> conflicts;
+	LineMerge::merge(make_merge_side(reinterpret_cast<const char *>(base_bytes.ptr()), base_bytes.size(), base_lines), ours,
+			make_merge_side(theirs_utf8.get_data(), theirs_utf8.length(), theirs_lines),
+			parse_merge_options(options), replacements, conflicts);
+
+	bool dry_run = options.get("dry_run", false);
+	bool apply_conflicts = options.get("apply_conflicts", false);
+	bool apply = !dry_run && (conflicts.empty() || apply_conflicts);
+
+	Vector<ByteEdit> byte_edits = make_byte_edits(replacements);
 
-		Array captures;
-		for (uint16_t i = 0; i < match.capture_count; i++) {
-			TSQueryCapture capture = match.captures[i];
-			TSNode node = capture.node;
+	if (apply && !byte_edits.is_empty()) {
+		Dictionary stage_result;
+		Ref<StagedEdit> staged = stage_byte_edits(file_path, byte_edits, byte_edits.size(), stage_result);
+		if (staged.is_null()) {
+			result["error"] = "Failed to parse merged content";
+			return result;
+		}
+		staged->commit();
+		result = make_parse_result_dict(file_path, open_files[file_path].tree);
+	} else {
+		std::string merged;
+		LineMerge::apply(ours, replacements, merged);
+		result = make_parse_result_dict(file_path, state->tree);
+		result["merged"] = source_from_utf8(merged.data(), merged.size());
+	}
 
-			uint32_t capture_name_len = 0;
-			const char *capture_name = ts_query_capture_name_for_id(query, capture.index, &capture_name_len);
+	result["applied"] = apply;
+	result["version"] = (int64_t)open_files[file_path].version;
+	result["clean"] = conflicts.empty();
+	result["conflict_count"] = (int)conflicts.size();
+	result["conflicts"] = make_conflict_array(conflicts);
+	result["changed_regions"] = (int)byte_edits.size();
+	return result;
+}
 
-			uint32_t start_byte = ts_node_start_byte(node);
-			uint32_t end_byte = ts_node_end_byte(node);
-			TSPoint start_point = ts_node_start_point(node);
-			TSPoint end_point = ts_node_end_point(node);
+Dictionary ASTManager::apply_patch(const String &file_path, const String &unified_diff, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
 
-			String text = "";
-			if (start_byte < state.source_bytes.size() && end_byte <= state.source_bytes.size()) {
-				uint32_t text_len = end_byte - start_byte;
-				const char *text_start = reinterpret_cast<const char *>(state.source_bytes.ptr()) + start_byte;
-				text = String::utf8(text_start, text_len);
+	FileState *state = access_open_file(file_path);
+	if (!state) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+
+	CharString patch_utf8 = source_to_utf8(unified_diff);
+	UnifiedPatch patch;
+	std::string parse_error;
+	if (!patch.parse(patch_utf8.get_data(), patch_utf8.length(), parse_error)) {
+		result["error"] = String::utf8(parse_error.c_str());
+		return result;
+	}
+	int section = patch.find_section(file_path.utf8().get_data());
+	if (section < 0) {
+		result["error"] = "Patch does not touch " + file_path;
+		return result;
+	}
+
+	UnifiedPatch::Options patch_options;
+	patch_options.max_fuzz = MAX(0, (int)options.get("max_fuzz", 2));
+	patch_options.max_offset = options.get("max_offset", -1);
+	patch_options.ignore_whitespace = options.get("ignore_whitespace", false);
+	bool dry_run = options.get("dry_run", false);
+	bool partial = options.get("partial", false);
+
+	// Hunks are located in the cached line table, so the file is never
+	// converted to a String.
+	LineMerge::Side target = make_merge_side(reinterpret_cast<const char *>(state->source_bytes.ptr()), state->source_bytes.size(), get_line_index(*state));
+	std::vector<LineMerge::Replacement> replacements;
+	std::vector<UnifiedPatch::HunkResult> hunk_results;
+	bool all_applied = patch.apply(section, target, patch_options, replacements, hunk_results);
+
+	const UnifiedPatch::FileSection &file_section = patch.get_sections()[section];
+	Array hunks;
+	int rejected_count = 0;
+	int first_rejected = -1;
+	for (uint32_t i = 0; i < hunk_results.size(); i++) {
+		const UnifiedPatch::HunkResult &hunk_result = hunk_results[i];
+		Dictionary entry;
+		entry["applied"] = hunk_result.applied;
+		entry["line"] = (int)hunk_result.line;
+		entry["offset"] = hunk_result.offset;
+		entry["fuzz"] = (int)hunk_result.fuzz;
+		entry["patch_line"] = (int)patch.get_hunks()[file_section.first_hunk + i].header_line;
+		hunks.push_back(entry);
+		if (!hunk_result.applied) {
+			rejected_count++;
+			if (first_rejected < 0) {
+				first_rejected = i;
 			}
+		}
+	}
+	result["hunks"] = hunks;
+	result["hunks_applied"] = (int)hunk_results.size() - rejected_count;
+	result["rejected_count"] = rejected_count;
 
-			Dictionary capture_dict;
-			capture_dict["name"] = String::utf8(capture_name, capture_name_len);
-			capture_dict["node_kind"] = String(ts_node_type(node));
-			capture_dict["text"] = text;
-			capture_dict["start_byte"] = (int)start_byte;
-			capture_dict["end_byte"] = (int)end_byte;
-			capture_dict["start_row"] = (int)start_point.row;
-			capture_dict["start_col"] = (int)start_point.column;
-			capture_dict["end_row"] = (int)end_point.row;
-			capture_dict["end_col"] = (int)end_point.column;
+	if (!all_applied && !partial) {
+		result["error"] = "Hunk #" + String::num_int64(first_rejected + 1) + " does not apply";
+		return result;
+	}
+
+	Vector<ByteEdit> byte_edits = make_byte_edits(replacements);
+	bool has_error = ts_node_has_error(ts_tree_root_node(state->tree));
+	if (!byte_edits.is_empty()) {
+		Dictionary stage_result;
+		Ref<StagedEdit> staged = stage_byte_edits(file_path, byte_edits, byte_edits.size(), stage_result);
+		if (staged.is_null()) {
+			result["error"] = "Failed to parse patched content";
+			return result;
+		}
+		has_error = staged->has_error;
+		result["error_count"] = staged->error_ranges.size();
+		if (dry_run) {
+			result["new_source"] = staged->get_new_source();
+			staged->discard();
+		} else {
+			staged->commit();
+		}
+	} else if (dry_run) {
+		result["new_source"] = get_file_source(file_path);
+	}
+
+	result["success"] = true;
+	result["applied"] = !dry_run && !byte_edits.is_empty();
+	result["has_error"] = has_error;
+	result["version"] = (int64_t)open_files[file_path].version;
+	result["changed_regions"] = (int)byte_edits.size();
+	return result;
+}
+
+Dictionary ASTManager::format_file(const String &file_path, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = access_open_file(file_path);
+	if (!state) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+
+	uint32_t source_length = state->source_bytes.size();
+	std::vector<GDScriptFormatter::Range> ranges;
+	if (options.get("changed_only", false)) {
+		if (!get_last_edit_ranges(*state, ranges)) {
+			result["error"] = "No recorded edit leads to the current version of " + file_path;
+			return result;
+		}
+	} else if (options.has("start_byte") || options.has("end_byte")) {
+		int64_t start = options.get("start_byte", 0);
+		int64_t end = options.get("end_byte", (int64_t)source_length);
+		if (start < 0 || end < start || end > source_length) {
+			result["error"] = "Invalid range: " + String::num_int64(start) + ".." + String::num_int64(end);
+			return result;
+		}
+		ranges.push_back({ (uint32_t)start, (uint32_t)end });
+	}
+	bool dry_run = options.get("dry_run", false);
+
+	GDScriptFormatter formatter;
+	std::vector<LineMerge::Replacement> replacements;
+	formatter.format(state->tree, reinterpret_cast<const char *>(state->source_bytes.ptr()), source_length, get_line_index(*state),
+			ranges, parse_format_options(options), replacements);
+
+	Array edits;
+	int64_t growth = 0;
+	for (const LineMerge::Replacement &replacement : replacements) {
+		Dictionary edit;
+		edit["start_byte"] = (int)replacement.start_byte;
+		edit["end_byte"] = (int)replacement.end_byte;
+		edit["new_text"] = String::utf8(replacement.bytes.data(), replacement.bytes.size());
+		edits.push_back(edit);
+		growth += (int64_t)replacement.bytes.size() - (replacement.end_byte - replacement.start_byte);
+	}
+	result["edits"] = edits;
+	result["edit_count"] = edits.size();
+
+	TSNode old_root = ts_tree_root_node(state->tree);
+	bool has_error = ts_node_has_error(old_root);
+	bool applied = false;
+	if (!replacements.empty()) {
+		Dictionary stage_result;
+		Ref<StagedEdit> staged = stage_byte_edits(file_path, make_byte_edits(replacements), replacements.size(), stage_result);
+		if (staged.is_null()) {
+			result["error"] = "Failed to parse formatted content";
+			return result;
+		}
+
+		// Whitespace changes must not change the tree.
+		uint32_t span_start = replacements.front().start_byte;
+		uint32_t span_end = MAX(replacements.back().end_byte, span_start + 1);
+		uint64_t old_hash = GDScriptFormatter::structure_hash(old_root, span_start, span_end);
+		uint64_t new_hash = GDScriptFormatter::structure_hash(ts_tree_root_node(staged->tree), span_start, span_end + growth);
+		if (old_hash != new_hash || (staged->has_error && !has_error)) {
+			staged->discard();
+			result["error"] = "Formatting would change the structure of " + file_path + "; nothing was applied";
+			return result;
+		}
+
+		has_error = staged->has_error;
+		if (dry_run) {
+			result["new_source"] = staged->get_new_source();
+			staged->discard();
+		} else {
+			staged->commit();
+			applied = true;
+		}
+	} else if (dry_run) {
+		result["new_source"] = get_file_source(file_path);
+	}
+
+	result["success"] = true;
+	result["applied"] = applied;
+	result["has_error"] = has_error;
+	result["version"] = (int64_t)open_files[file_path].version;
+	return result;
+}
+
+Dictionary ASTManager::configure_highlighting(const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+
+	String query_source = options.get("query", "");
+	std::string source;
+	if (query_source.is_empty()) {
+		source = make_default_highlight_query();
+	} else {
+		CharString query_utf8 = query_source.utf8();
+		source.assign(query_utf8.get_data(), query_utf8.length());
+	}
+
+	uint32_t error_offset = 0;
+	TSQueryError error_type = TSQueryErrorNone;
+	int64_t allocated_before = ts_allocator::get_thread_bytes();
+	TSQuery *query = nullptr;
+	{
+		perf_stats::Scope scope(perf_stats::PHASE_QUERY_COMPILE);
+		scope.add_amount(source.size());
+		query = ts_query_new(tree_sitter_gdscript(), source.data(), source.size(), &error_offset, &error_type);
+	}
+	if (!query) {
+		result["error"] = make_query_error(error_offset, error_type);
+		return result;
+	}
+	highlight_query_bytes = ts_allocator::get_thread_bytes() - allocated_before;
+	if (!highlight_cursor) {
+		highlight_cursor = ts_query_cursor_new();
+	}
+	if (highlight_query) {
+		ts_query_delete(highlight_query);
+	}
+	highlight_query = query;
+	highlight_generation++;
+
+	Dictionary colors = options.get("colors", Dictionary());
+	highlight_default_color = options.get("default_color", Color(0.8f, 0.81f, 0.82f, 1.0f));
+	uint32_t capture_count = ts_query_capture_count(query);
+	highlight_capture_enabled.assign(capture_count, false);
+	highlight_colors.resize(capture_count);
+	PackedStringArray capture_names;
+	for (uint32_t i = 0; i < capture_count; i++) {
+		uint32_t name_length = 0;
+		const char *name = ts_query_capture_name_for_id(query, i, &name_length);
+		String capture_name = String::utf8(name, name_length);
+		capture_names.push_back(capture_name);
+		Color color;
+		if (find_highlight_color(colors, capture_name, color)) {
+			highlight_capture_enabled[i] = true;
+			highlight_colors.write[i] = color;
+		}
+	}
+
+	result["success"] = true;
+	result["pattern_count"] = (int)ts_query_pattern_count(query);
+	result["capture_names"] = capture_names;
+	return result;
+}
+
+bool ASTManager::prepare_highlights(FileState &state, uint32_t first, uint32_t last) {
+	if (!highlight_query) {
+		configure_highlighting();
+	}
+	if (!highlight_query || !state.tree) {
+		return false;
+	}
+
+	const std::vector<LineDiff::Line> &lines = get_line_index(state);
+	uint32_t line_count = count_editor_lines(lines);
+	if (first >= line_count) {
+		return false;
+	}
+	if (!state.highlights.is_current(highlight_generation, line_count)) {
+		state.highlights.reset(line_count, highlight_generation);
+	}
+
+	// The editor asks for visible lines top to bottom, so runs of invalid
+	// lines are filled ahead in batches, each with a single query pass.
+	const uint32_t batch_lines = 64;
+	last = MIN(last, line_count - 1);
+	for (uint32_t row = first; row <= last; row++) {
+		if (state.highlights.is_valid(row)) {
+			continue;
+		}
+		uint32_t limit = MIN(MAX(last, row + batch_lines - 1), line_count - 1);
+		uint32_t end = row;
+		while (end < limit && !state.highlights.is_valid(end + 1)) {
+			end++;
+		}
+		state.highlights.refresh(highlight_cursor, highlight_query, ts_tree_root_node(state.tree),
+				reinterpret_cast<const char *>(state.source_bytes.ptr()), state.source_bytes.size(), lines,
+				highlight_capture_enabled, row, end);
+		row = end;
+	}
+	return true;
+}
+
+Dictionary ASTManager::get_line_highlighting(const String &file_path, int line) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	FileState *state = access_open_file(file_path);
+	if (!state || line < 0 || !prepare_highlights(*state, line, line)) {
+		return result;
+	}
+
+	// Same layout as SyntaxHighlighter._get_line_syntax_highlighting(): a
+	// color applies from its column up to the next entry.
+	const std::vector<HighlightCache::Span> &spans = state->highlights.get_spans(line);
+	perf_stats::Scope scope(perf_stats::PHASE_MARSHAL);
+	scope.add_amount(spans.size());
+	for (size_t i = 0; i < spans.size(); i++) {
+		Dictionary entry;
+		entry["color"] = highlight_colors[spans[i].capture];
+		result[(int)spans[i].start_column] = entry;
+		if (i + 1 == spans.size() || spans[i + 1].start_column != spans[i].end_column) {
+			Dictionary plain;
+			plain["color"] = highlight_default_color;
+			result[(int)spans[i].end_column] = plain;
+		}
+	}
+	return result;
+}
+
+PackedInt32Array ASTManager::get_highlight_spans(const String &file_path, int first_line, int last_line) {
+	PERF_METHOD_SCOPE();
+	PackedInt32Array result;
+	FileState *state = access_open_file(file_path);
+	if (!state || first_line < 0 || last_line < first_line || !prepare_highlights(*state, first_line, last_line)) {
+		return result;
+	}
+
+	uint32_t last = MIN((uint32_t)last_line, state->highlights.get_line_count() - 1);
+	for (uint32_t row = first_line; row <= last; row++) {
+		for (const HighlightCache::Span &span : state->highlights.get_spans(row)) {
+			result.push_back(row);
+			result.push_back(span.start_column);
+			result.push_back(span.end_column);
+			result.push_back(span.capture);
+		}
+	}
+	return result;
+}
+
+Dictionary ASTManager::get_document_outline(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = access_open_file(file_path);
+	if (!state || !state->tree) {
+		result["error"] = state ? "No tree available for file: " + file_path : "File not open: " + file_path;
+		return result;
+	}
+
+	state->outline.update(ts_tree_root_node(state->tree), reinterpret_cast<const char *>(state->source_bytes.ptr()), state->version);
+	std::vector<DocumentOutline::Symbol> symbols;
+	state->outline.get_symbols(symbols);
+
+	perf_stats::Scope scope(perf_stats::PHASE_MARSHAL);
+	scope.add_amount(symbols.size());
+	// Parents come before their members, so each dictionary can be added to
+	// its parent's (shared) children array as soon as it is built.
+	Array roots;
+	std::vector<Array> children(symbols.size());
+	for (size_t i = 0; i < symbols.size(); i++) {
+		const DocumentOutline::Symbol &symbol = symbols[i];
+		Dictionary entry;
+		entry["name"] = String::utf8(symbol.name.data(), symbol.name.size());
+		entry["kind"] = SYMBOL_KIND_NAMES[symbol.kind];
+		entry["start_byte"] = (int)symbol.start_byte;
+		entry["end_byte"] = (int)symbol.end_byte;
+		entry["start_row"] = (int)symbol.start_row;
+		entry["end_row"] = (int)symbol.end_row;
+		entry["name_start_byte"] = (int)symbol.name_start_byte;
+		entry["name_end_byte"] = (int)symbol.name_end_byte;
+		entry["children"] = children[i];
+		if (symbol.parent == DocumentOutline::NONE) {
+			roots.push_back(entry);
+		} else {
+			children[symbol.parent].push_back(entry);
+		}
+	}
+
+	result["success"] = true;
+	result["symbols"] = roots;
+	result["symbol_count"] = (int)symbols.size();
+	result["version"] = (int64_t)state->version;
+	return result;
+}
+
+Dictionary ASTManager::get_folding_ranges(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = access_open_file(file_path);
+	if (!state || !state->tree) {
+		result["error"] = state ? "No tree available for file: " + file_path : "File not open: " + file_path;
+		return result;
+	}
+
+	state->outline.update(ts_tree_root_node(state->tree), reinterpret_cast<const char *>(state->source_bytes.ptr()), state->version);
+	std::vector<DocumentOutline::Fold> folds;
+	state->outline.get_folds(folds);
+
+	perf_stats::Scope scope(perf_stats::PHASE_MARSHAL);
+	scope.add_amount(folds.size());
+	Array ranges;
+	for (const DocumentOutline::Fold &fold : folds) {
+		Dictionary range;
+		range["start_row"] = (int)fold.start_row;
+		range["end_row"] = (int)fold.end_row;
+		range["kind"] = FOLD_KIND_NAMES[fold.kind];
+		ranges.push_back(range);
+	}
+
+	result["success"] = true;
+	result["ranges"] = ranges;
+	result["version"] = (int64_t)state->version;
+	return result;
+}
+
+Dictionary ASTManager::get_selection_ranges(const String &file_path, const PackedInt32Array &positions) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = access_open_file(file_path);
+	if (!state || !state->tree) {
+		result["error"] = state ? "No tree available for file: " + file_path : "File not open: " + file_path;
+		return result;
+	}
+
+	TSNode root = ts_tree_root_node(state->tree);
+	Array selections;
+	std::vector<DocumentOutline::Range> ranges;
+	for (int i = 0; i < positions.size(); i++) {
+		if (positions[i] < 0 || positions[i] > state->source_bytes.size()) {
+			result["error"] = "Position out of range: " + String::num_int64(positions[i]);
+			return result;
+		}
+		DocumentOutline::get_selection_ranges(root, positions[i], ranges);
+		Array chain;
+		for (const DocumentOutline::Range &range : ranges) {
+			Dictionary entry;
+			entry["start_byte"] = (int)range.start_byte;
+			entry["end_byte"] = (int)range.end_byte;
+			entry["start_row"] = (int)range.start_row;
+			entry["end_row"] = (int)range.end_row;
+			chain.push_back(entry);
+		}
+		selections.push_back(chain);
+	}
+
+	result["success"] = true;
+	result["selections"] = selections;
+	return result;
+}
+
+void ASTManager::index_open_file(const String &file_path, FileState &state) {
+	if (!state.tree) {
+		return;
+	}
+	const char *data = reinterpret_cast<const char *>(state.source_bytes.ptr());
+	state.outline.update(ts_tree_root_node(state.tree), data, state.version);
+	update_index_entry(file_path.utf8().get_data(), state.outline, data);
+}
+
+void ASTManager::update_index_entry(const std::string &path, const DocumentOutline &outline, const char *data) {
+	std::vector<DocumentOutline::Symbol> symbols;
+	std::vector<DocumentOutline::Identifier> identifiers;
+	outline.get_symbols(symbols);
+	outline.get_identifiers(identifiers);
+
+	uint32_t file = symbol_index.find_file(path);
+	if (file != SymbolIndex::NONE) {
+		count_global_names(file, false);
+	}
+	symbol_index.update_file(path, symbols);
+	file = symbol_index.find_file(path);
+	symbol_index.set_file_extends(file, outline.get_extends());
+	std::vector<DocumentOutline::Load> loads;
+	outline.get_loads(loads);
+	std::vector<std::string> preload_paths;
+	std::vector<std::string> load_paths;
+	for (const DocumentOutline::Load &load : loads) {
+		(load.preload ? preload_paths : load_paths).push_back(load.path);
+	}
+	symbol_index.set_file_loads(file, std::move(preload_paths), std::move(load_paths));
+	count_global_names(file, true);
+	reference_index.update_file(path, data, identifiers);
+
+	uint32_t mapped = symbol_index_file.find_file(path);
+	if (mapped != SymbolIndexFile::NONE) {
+		hide_mapped_file(mapped);
+		// Part of the saved project: closing the file must not lose it.
+		symbol_index.set_persistent(path, true);
+	}
+	update_dependency_entry(path);
+}
+
+bool ASTManager::remove_index_entry(const std::string &path) {
+	uint32_t file = symbol_index.find_file(path);
+	if (file != SymbolIndex::NONE) {
+		count_global_names(file, false);
+	}
+	bool removed = symbol_index.remove_file(path);
+	reference_index.remove_file(path);
+	uint32_t mapped = symbol_index_file.find_file(path);
+	if (mapped != SymbolIndexFile::NONE && !symbol_index_file.is_hidden(mapped)) {
+		hide_mapped_file(mapped);
+		removed = true;
+	}
+	dependency_graph.remove_file(path);
+	return removed;
+}
+
+void ASTManager::hide_shadowed_index_files() {
+	std::vector<uint32_t> files;
+	symbol_index.get_files(files);
+	for (uint32_t file : files) {
+		uint32_t mapped = symbol_index_file.find_file(symbol_index.get_file_path(file));
+		if (mapped != SymbolIndexFile::NONE) {
+			hide_mapped_file(mapped);
+		}
+	}
+}
+
+void ASTManager::count_global_names(uint32_t file, bool add) {
+	for (const SymbolIndex::Symbol &symbol : symbol_index.get_file_symbols(file)) {
+		if (symbol.kind != DocumentOutline::SYMBOL_CLASS_NAME) {
+			continue;
+		}
+		if (add) {
+			global_names.add(symbol_index.get_name(symbol.name));
+		} else {
+			global_names.remove(symbol_index.get_name(symbol.name));
+		}
+	}
+}
+
+void ASTManager::hide_mapped_file(uint32_t file) {
+	if (symbol_index_file.is_hidden(file)) {
+		return;
+	}
+	const SymbolIndexFile::FileRecord &record = symbol_index_file.get_file(file);
+	for (uint32_t i = record.first_symbol; i < record.first_symbol + record.symbol_count; i++) {
+		const SymbolIndexFile::SymbolRecord &symbol = symbol_index_file.get_symbol(i);
+		if (symbol.kind == DocumentOutline::SYMBOL_CLASS_NAME) {
+			global_names.remove(symbol_index_file.get_name(symbol.name));
+		}
+	}
+	symbol_index_file.hide(file);
+}
+
+void ASTManager::update_dependency_entry(const std::string &path) {
+	uint32_t file = symbol_index.find_file(path);
+	if (file == SymbolIndex::NONE) {
+		dependency_graph.remove_file(path);
+		return;
+	}
+	std::vector<std::string> class_names;
+	for (const SymbolIndex::Symbol &symbol : symbol_index.get_file_symbols(file)) {
+		if (symbol.kind == DocumentOutline::SYMBOL_CLASS_NAME) {
+			class_names.push_back(symbol_index.get_name(symbol.name));
+		}
+	}
+	std::vector<DependencyGraph::Dependency> dependencies;
+	add_script_dependencies(path, symbol_index.get_file_extends(file), symbol_index.get_file_preloads(file), symbol_index.get_file_loads(file), dependencies);
+	// Every name used is a potential class reference: whether it is one
+	// depends on the other files, which the graph resolves when queried.
+	uint32_t reference_file = reference_index.find_file(path);
+	if (reference_file != ReferenceIndex::NONE) {
+		for (uint32_t i = 0; i < reference_index.get_file_name_count(reference_file); i++) {
+			dependencies.push_back({ reference_index.get_name(reference_index.get_file_name(reference_file, i)), DependencyGraph::KIND_CLASS_REFERENCE });
+		}
+	}
+	dependency_graph.set_file(path, class_names, dependencies);
+}
+
+void ASTManager::rebuild_dependency_graph() {
+	dependency_graph.clear();
+	std::vector<uint32_t> files;
+	symbol_index.get_files(files);
+	for (uint32_t file : files) {
+		update_dependency_entry(symbol_index.get_file_path(file));
+	}
+
+	// Mapped names are grouped by file once for all files.
+	uint32_t mapped_count = symbol_index_file.get_file_count();
+	std::vector<std::vector<uint32_t>> file_names(mapped_count);
+	for (uint32_t name = 0; name < symbol_index_file.get_name_count(); name++) {
+		uint32_t count = 0;
+		const SymbolIndexFile::ReferenceRecord *references = symbol_index_file.get_references(name, count);
+		for (uint32_t i = 0; i < count; i++) {
+			file_names[references[i].file].push_back(name);
+		}
+	}
+	std::vector<std::string> class_names;
+	std::vector<std::string> preloads;
+	std::vector<std::string> loads;
+	std::vector<DependencyGraph::Dependency> dependencies;
+	for (uint32_t file = 0; file < mapped_count; file++) {
+		if (symbol_index_file.is_hidden(file)) {
+			continue;
+		}
+		std::string path(symbol_index_file.get_file_path(file));
+		const SymbolIndexFile::FileRecord &record = symbol_index_file.get_file(file);
+		class_names.clear();
+		for (uint32_t i = record.first_symbol; i < record.first_symbol + record.symbol_count; i++) {
+			const SymbolIndexFile::SymbolRecord &symbol = symbol_index_file.get_symbol(i);
+			if (symbol.kind == DocumentOutline::SYMBOL_CLASS_NAME) {
+				class_names.emplace_back(symbol_index_file.get_name(symbol.name));
+			}
+		}
+		split_lines(symbol_index_file.get_file_preloads(file), preloads);
+		split_lines(symbol_index_file.get_file_loads(file), loads);
+		dependencies.clear();
+		add_script_dependencies(path, symbol_index_file.get_file_extends(file), preloads, loads, dependencies);
+		for (uint32_t name : file_names[file]) {
+			dependencies.push_back({ std::string(symbol_index_file.get_name(name)), DependencyGraph::KIND_CLASS_REFERENCE });
+		}
+		dependency_graph.set_file(path, class_names, dependencies);
+	}
+}
+
+void ASTManager::rebuild_global_names() {
+	global_names.clear();
+	std::vector<uint32_t> files;
+	symbol_index.get_files(files);
+	for (uint32_t file : files) {
+		count_global_names(file, true);
+	}
+	for (uint32_t i = 0; i < symbol_index_file.get_symbol_count(); i++) {
+		const SymbolIndexFile::SymbolRecord &symbol = symbol_index_file.get_symbol(i);
+		if (symbol.kind == DocumentOutline::SYMBOL_CLASS_NAME && !symbol_index_file.is_hidden(symbol.file)) {
+			global_names.add(symbol_index_file.get_name(symbol.name));
+		}
+	}
+}
+
+Dictionary ASTManager::index_file(const String &file_path, const String &content) {
+	PERF_METHOD_SCOPE();
+	Dictionary files;
+	files[file_path] = content;
+	Dictionary result = index_files(files);
+	result["file_path"] = file_path;
+	return result;
+}
+
+Dictionary ASTManager::index_files(const Dictionary &file_contents, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	int max_threads = options.get("max_threads", 0);
+
+	// Open files are indexed from their buffer, which is newer than content.
+	std::vector<IndexJob> jobs;
+	Array paths = file_contents.keys();
+	jobs.reserve(paths.size());
+	for (int i = 0; i < paths.size(); i++) {
+		String path = paths[i];
+		if (open_files.has(path)) {
+			symbol_index.set_persistent(path.utf8().get_data(), true);
+			continue;
+		}
+		IndexJob job;
+		job.path = path.utf8().get_data();
+		CharString utf8 = source_to_utf8(file_contents[path]);
+		job.source.assign(utf8.get_data(), utf8.length());
+		job.content_hash = content_hash::hash_bytes(job.source.data(), job.source.size());
+		jobs.push_back(std::move(job));
+	}
+
+	parse_index_jobs(parser_pool, jobs, max_threads);
+
+	PackedStringArray failed_files;
+	int symbol_count = 0;
+	for (const IndexJob &job : jobs) {
+		if (!job.parsed) {
+			failed_files.push_back(String::utf8(job.path.data(), job.path.size()));
+			continue;
+		}
+		update_index_entry(job.path, job.outline, job.source.data());
+		symbol_index.set_persistent(job.path, true);
+		// No mtime: the next refresh compares the content.
+		uint32_t file = symbol_index.find_file(job.path);
+		symbol_index.set_file_stamp(file, job.content_hash, 0);
+		symbol_count += symbol_index.get_file_symbols(file).size();
+	}
+
+	result["success"] = failed_files.is_empty();
+	if (!failed_files.is_empty()) {
+		result["error"] = "Failed to parse " + String::num_int64(failed_files.size()) + " file(s)";
+	}
+	result["indexed_count"] = (int)(paths.size() - failed_files.size());
+	result["symbol_count"] = symbol_count;
+	result["failed_files"] = failed_files;
+	return result;
+}
 
-			captures.push_back(capture_dict);
+bool ASTManager::unindex_file(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	std::string path = file_path.utf8().get_data();
+	if (open_files.has(file_path)) {
+		// Dropped when the file is closed.
+		symbol_index.set_persistent(path, false);
+		uint32_t mapped = symbol_index_file.find_file(path);
+		if (mapped != SymbolIndexFile::NONE) {
+			hide_mapped_file(mapped);
 		}
+		return symbol_index.has_file(path);
+	}
+	return remove_index_entry(path);
+}
 
-		match_dict["captures"] = captures;
-		matches.push_back(match_dict);
+void ASTManager::collect_named_symbols(std::string_view name, int kind, Array &r_symbols) {
+	std::vector<SymbolIndex::Location> locations;
+	symbol_index.find(symbol_index.find_name(name), locations);
+	for (const SymbolIndex::Location &location : locations) {
+		if (kind < 0 || symbol_index.get_symbol(location).kind == kind) {
+			r_symbols.push_back(make_symbol_dict(symbol_index, location));
+		}
 	}
 
-	ts_query_cursor_delete(cursor);
-	ts_query_delete(query);
+	uint32_t mapped_name = symbol_index_file.find_name(name);
+	if (mapped_name == SymbolIndexFile::NONE) {
+		return;
+	}
+	uint32_t count = 0;
+	const uint32_t *postings = symbol_index_file.get_postings(mapped_name, count);
+	for (uint32_t i = 0; i < count; i++) {
+		const SymbolIndexFile::SymbolRecord &symbol = symbol_index_file.get_symbol(postings[i]);
+		if (!symbol_index_file.is_hidden(symbol.file) && (kind < 0 || (int)symbol.kind == kind)) {
+			r_symbols.push_back(make_mapped_symbol_dict(symbol_index_file, postings[i]));
+		}
+	}
+}
+
+Dictionary ASTManager::find_symbols(const String &name, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+
+	int kind = -1;
+	if (!parse_symbol_kind(options, kind, result)) {
+		return result;
+	}
+
+	CharString name_utf8 = name.utf8();
+	Array symbols;
+	collect_named_symbols(std::string_view(name_utf8.get_data(), name_utf8.length()), kind, symbols);
 
 	result["success"] = true;
-	result["matches"] = matches;
+	result["symbols"] = symbols;
 	return result;
 }
 
-String ASTManager::get_node_text(const String &file_path, int start_byte, int end_byte) {
-	if (!open_files.has(file_path)) {
-		return "";
-	}
+Dictionary ASTManager::find_symbols_by_prefix(const String &prefix, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
 
-	const FileState &state = open_files[file_path];
-	if (start_byte < 0 || end_byte < 0 || start_byte > end_byte) {
-		return "";
+	int kind = -1;
+	if (!parse_symbol_kind(options, kind, result)) {
+		return result;
 	}
-
-	uint32_t start = static_cast<uint32_t>(start_byte);
-	uint32_t end = static_cast<uint32_t>(end_byte);
-
-	if (start >= state.source_bytes.size() || end > state.source_bytes.size()) {
-		return "";
+	int limit = options.get("limit", 100);
+
+	// Candidate names come from both layers, merged in byte order. A name
+	// may have no visible declaration (hidden file, kind filter), so keep
+	// asking for more until limit names match or the prefix is exhausted.
+	CharString prefix_utf8 = prefix.utf8();
+	std::string_view prefix_view(prefix_utf8.get_data(), prefix_utf8.length());
+	std::vector<uint32_t> name_ids;
+	std::vector<std::string_view> candidates;
+	PackedStringArray names;
+	Array symbols;
+	uint32_t requested = MAX(limit, 0);
+	size_t scanned = 0;
+	while (names.size() < limit) {
+		symbol_index.find_prefix(prefix_view, requested, name_ids);
+		candidates.clear();
+		for (uint32_t id : name_ids) {
+			candidates.push_back(symbol_index.get_name(id));
+		}
+		uint32_t mapped_count = 0;
+		for (uint32_t id = symbol_index_file.lower_bound_name(prefix_view); id < symbol_index_file.get_name_count() && mapped_count < requested; id++, mapped_count++) {
+			std::string_view text = symbol_index_file.get_name(id);
+			if (text.compare(0, prefix_view.size(), prefix_view) != 0) {
+				break;
+			}
+			candidates.push_back(text);
+		}
+		// A layer cut off at requested names only vouches for candidates up
+		// to its last one; later rounds fill in the rest.
+		bool overlay_exhausted = name_ids.size() < requested;
+		bool mapped_exhausted = mapped_count < requested;
+		std::string_view bound;
+		if (!overlay_exhausted) {
+			bound = candidates[name_ids.size() - 1];
+		}
+		if (!mapped_exhausted && (overlay_exhausted || candidates.back() < bound)) {
+			bound = candidates.back();
+		}
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+		bool bounded = !overlay_exhausted || !mapped_exhausted;
+		for (; scanned < candidates.size() && names.size() < limit && (!bounded || candidates[scanned] <= bound); scanned++) {
+			int found = symbols.size();
+			collect_named_symbols(candidates[scanned], kind, symbols);
+			if (symbols.size() > found) {
+				names.push_back(String::utf8(candidates[scanned].data(), candidates[scanned].size()));
+			}
+		}
+		if (!bounded) {
+			break;
+		}
+		requested *= 2;
 	}
 
-	uint32_t length = end - start;
-	const char *text_start = reinterpret_cast<const char *>(state.source_bytes.ptr()) + start;
-	return String::utf8(text_start, length);
+	result["success"] = true;
+	result["names"] = names;
+	result["symbols"] = symbols;
+	return result;
 }
 
-String ASTManager::get_sexp(const String &file_path) {
-	if (!open_files.has(file_path)) {
-		return "";
+void ASTManager::update_name_masks() {
+	for (uint32_t i = overlay_name_masks.size(); i < symbol_index.get_name_count(); i++) {
+		overlay_name_masks.push_back(FuzzyMatcher::char_mask(symbol_index.get_name(i)));
+	}
+	for (uint32_t i = mapped_name_masks.size(); i < symbol_index_file.get_name_count(); i++) {
+		mapped_name_masks.push_back(FuzzyMatcher::char_mask(symbol_index_file.get_name(i)));
 	}
+}
 
-	const FileState &state = open_files[file_path];
-	if (!state.tree) {
-		return "";
+Dictionary ASTManager::search_workspace_symbols(const String &query, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+
+	int kind = -1;
+	if (!parse_symbol_kind(options, kind, result)) {
+		return result;
+	}
+	int limit = options.get("limit", 100);
+
+	CharString query_utf8 = query.utf8();
+	FuzzyMatcher matcher;
+	matcher.set_pattern(std::string_view(query_utf8.get_data(), query_utf8.length()));
+	update_name_masks();
+
+	// Names are scored once however many files declare them; the masks
+	// reject most of them before any scoring.
+	std::vector<FuzzyHit> hits;
+	std::vector<uint32_t> ids;
+	prefilter_names(matcher, overlay_name_masks, ids);
+	for (uint32_t id : ids) {
+		int score = 0;
+		const std::string &text = symbol_index.get_name(id);
+		if (symbol_index.is_name_declared(id) && matcher.match(text, score)) {
+			hits.push_back({ score, text, id, false });
+		}
+	}
+	prefilter_names(matcher, mapped_name_masks, ids);
+	for (uint32_t id : ids) {
+		int score = 0;
+		std::string_view text = symbol_index_file.get_name(id);
+		uint32_t posting_count = 0;
+		symbol_index_file.get_postings(id, posting_count);
+		if (posting_count > 0 && matcher.match(text, score)) {
+			hits.push_back({ score, text, id, true });
+		}
 	}
 
-	TSNode root_node = ts_tree_root_node(state.tree);
-	char *sexp_str = ts_node_string(root_node);
-	if (!sexp_str) {
-		return "";
+	// Only the best few are wanted: heapify in linear time and pop names
+	// until limit visible declarations are found.
+	std::make_heap(hits.begin(), hits.end(), fuzzy_hit_less);
+	PackedStringArray names;
+	PackedStringArray containers;
+	PackedStringArray file_paths;
+	PackedInt32Array symbols;
+	std::unordered_map<std::string_view, int> file_slots;
+	std::vector<SymbolIndex::Location> locations;
+	for (auto end = hits.end(); end != hits.begin() && names.size() < limit; --end) {
+		std::pop_heap(hits.begin(), end, fuzzy_hit_less);
+		const FuzzyHit &hit = *(end - 1);
+		String name = String::utf8(hit.text.data(), hit.text.size());
+		if (!hit.mapped) {
+			locations.clear();
+			symbol_index.find(hit.name, locations);
+			for (const SymbolIndex::Location &location : locations) {
+				const SymbolIndex::Symbol &symbol = symbol_index.get_symbol(location);
+				if ((kind >= 0 && (int)symbol.kind != kind) || names.size() >= limit) {
+					continue;
+				}
+				const std::string &container = symbol.container != SymbolIndex::NONE ? symbol_index.get_name(symbol.container) : std::string();
+				names.push_back(name);
+				containers.push_back(String::utf8(container.data(), container.size()));
+				int file = add_result_path(symbol_index.get_file_path(location.file), file_slots, file_paths);
+				append_search_result(symbols, hit.score, symbol.kind, file, symbol.name_start_byte, symbol.name_end_byte, symbol.start_row, symbol.end_row);
+			}
+			continue;
+		}
+		uint32_t count = 0;
+		const uint32_t *postings = symbol_index_file.get_postings(hit.name, count);
+		for (uint32_t i = 0; i < count && names.size() < limit; i++) {
+			const SymbolIndexFile::SymbolRecord &symbol = symbol_index_file.get_symbol(postings[i]);
+			if (symbol_index_file.is_hidden(symbol.file) || (kind >= 0 && (int)symbol.kind != kind)) {
+				continue;
+			}
+			std::string_view container = symbol.container != SymbolIndexFile::NONE ? symbol_index_file.get_name(symbol.container) : std::string_view();
+			names.push_back(name);
+			containers.push_back(String::utf8(container.data(), container.size()));
+			int file = add_result_path(symbol_index_file.get_file_path(symbol.file), file_slots, file_paths);
+			append_search_result(symbols, hit.score, symbol.kind, file, symbol.name_start_byte, symbol.name_end_byte, symbol.start_row, symbol.end_row);
+		}
 	}
 
-	String result = String(sexp_str);
-	::free(sexp_str);
+	result["success"] = true;
+	result["names"] = names;
+	result["containers"] = containers;
+	result["file_paths"] = file_paths;
+	result["symbols"] = symbols;
+	result["matched_name_count"] = (int)hits.size();
 	return result;
 }
 
-static bool edits_overlap(int start1, int end1, int start2, int end2) {
-	return end1 > start2;
+bool ASTManager::resolve_local_definition(const std::string &path, std::string_view name, TSNode root, TSNode node, TSNode &r_definition, TSNode &r_scope) {
+	uint32_t file = reference_index.find_file(path);
+	uint32_t name_id = reference_index.find_name(name);
+	if (file == ReferenceIndex::NONE || name_id == ReferenceIndex::NONE) {
+		return false;
+	}
+	std::vector<ReferenceIndex::Occurrence> occurrences;
+	reference_index.get_occurrences(file, name_id, occurrences);
+
+	uint32_t position = ts_node_start_byte(node);
+	for (TSNode scope = enclosing_scope(node); !ts_node_is_null(scope); scope = enclosing_scope(scope)) {
+		// Inside functions a name exists from its declaration on and a later
+		// one shadows it; class members are visible throughout.
+		const char *scope_type = ts_node_type(scope);
+		bool ordered = strcmp(scope_type, "class_definition") != 0 && strcmp(scope_type, "source") != 0;
+		uint32_t scope_start = ts_node_start_byte(scope);
+		uint32_t scope_end = ts_node_end_byte(scope);
+		TSNode found;
+		for (const ReferenceIndex::Occurrence &occurrence : occurrences) {
+			if (ordered && occurrence.start_byte > position) {
+				break;
+			}
+			if (occurrence.role != DocumentOutline::ROLE_DEFINITION || occurrence.start_byte < scope_start || occurrence.end_byte > scope_end) {
+				continue;
+			}
+			TSNode candidate = ts_node_descendant_for_byte_range(root, occurrence.start_byte, occurrence.end_byte);
+			if (!ts_node_eq(enclosing_scope(candidate), scope)) {
+				continue;
+			}
+			found = candidate;
+			if (!ordered) {
+				break;
+			}
+		}
+		if (!ts_node_is_null(found)) {
+			r_definition = found;
+			r_scope = scope;
+			return true;
+		}
+	}
+	return false;
 }
 
-static PackedByteArray apply_single_edit_to_bytes(
-	const PackedByteArray &original, 
-	int start_byte, 
-	int end_byte, 
-	const String &new_text
-) {
-	CharString new_text_utf8 = new_text.utf8();
-	const char *new_text_data = new_text_utf8.get_data();
-	uint32_t new_text_len = new_text_utf8.length();
-	
-	PackedByteArray result;
-	result.resize(start_byte + new_text_len + (original.size() - end_byte));
-	
-	for (int i = 0; i < start_byte; i++) {
-		result[i] = original[i];
+Dictionary ASTManager::find_definition(const String &file_path, int position) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+
+	FileState *state = access_open_file(file_path);
+	if (!state || !state->tree) {
+		result["error"] = state ? "No tree available for file: " + file_path : "File not open: " + file_path;
+		return result;
+	}
+	if (position < 0 || position > state->source_bytes.size()) {
+		result["error"] = "Position out of range: " + String::num_int64(position);
+		return result;
 	}
-	
-	for (uint32_t i = 0; i < new_text_len; i++) {
-		result[start_byte + i] = static_cast<uint8_t>(new_text_data[i]);
+	TSNode root = ts_tree_root_node(state->tree);
+	TSNode node = identifier_at(root, position);
+	if (ts_node_is_null(node)) {
+		result["error"] = "No identifier at position " + String::num_int64(position);
+		return result;
 	}
-	
-	for (uint32_t i = end_byte; i < original.size(); i++) {
-		result[start_byte + new_text_len + (i - end_byte)] = original[i];
+	const char *data = reinterpret_cast<const char *>(state->source_bytes.ptr());
+	std::string_view name(data + ts_node_start_byte(node), ts_node_end_byte(node) - ts_node_start_byte(node));
+	result["name"] = String::utf8(name.data(), name.size());
+
+	// Declarations in the file itself first, then anywhere in the project.
+	std::string path = file_path.utf8().get_data();
+	Array definitions;
+	TSNode definition;
+	TSNode scope;
+	if (resolve_local_definition(path, name, root, node, definition, scope)) {
+		const char *scope_type = ts_node_type(scope);
+		bool member = strcmp(scope_type, "class_definition") == 0 || strcmp(scope_type, "source") == 0;
+		// Members are in the symbol index with their kind and container.
+		uint32_t file = member ? symbol_index.find_file(path) : SymbolIndex::NONE;
+		if (file != SymbolIndex::NONE) {
+			const std::vector<SymbolIndex::Symbol> &symbols = symbol_index.get_file_symbols(file);
+			for (uint32_t i = 0; i < symbols.size(); i++) {
+				if (symbols[i].name_start_byte == ts_node_start_byte(definition)) {
+					definitions.push_back(make_symbol_dict(symbol_index, { file, i }));
+					break;
+				}
+			}
+		}
+		if (definitions.is_empty()) {
+			definitions.push_back(make_local_definition_dict(file_path, name, definition));
+		}
+		result["resolution"] = member ? "file" : "local";
+	} else {
+		collect_named_symbols(name, -1, definitions);
+		result["resolution"] = "project";
 	}
-	
+
+	result["success"] = true;
+	result["definitions"] = definitions;
 	return result;
 }
 
-Dictionary ASTManager::apply_text_edits(const String &file_path, const TypedArray<Dictionary> &edits, bool dry_run) {
+Dictionary ASTManager::find_references(const Variant &target, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
 	Dictionary result;
 	result["success"] = false;
-	result["error"] = "";
-	result["new_source"] = "";
-	result["has_error"] = false;
-	result["error_count"] = 0;
-	result["edits_applied"] = 0;
-
-	if (!open_files.has(file_path)) {
-		result["error"] = "File not open: " + file_path;
+	bool include_definitions = options.get("include_definitions", true);
+
+	// From a position, a local's references stay within its scope; any
+	// other name is matched project-wide.
+	CharString name_utf8;
+	std::string_view name;
+	std::string scope_path;
+	uint32_t scope_start = 0;
+	uint32_t scope_end = 0;
+	bool scoped = false;
+	if (target.get_type() == Variant::STRING || target.get_type() == Variant::STRING_NAME) {
+		name_utf8 = String(target).utf8();
+		name = std::string_view(name_utf8.get_data(), name_utf8.length());
+	} else if (target.get_type() == Variant::DICTIONARY) {
+		Dictionary location = target;
+		String file_path = location.get("file_path", "");
+		int position = location.get("position", -1);
+		FileState *state = access_open_file(file_path);
+		if (!state || !state->tree) {
+			result["error"] = state ? "No tree available for file: " + file_path : "File not open: " + file_path;
+			return result;
+		}
+		if (position < 0 || position > state->source_bytes.size()) {
+			result["error"] = "Position out of range: " + String::num_int64(position);
+			return result;
+		}
+		TSNode root = ts_tree_root_node(state->tree);
+		TSNode node = identifier_at(root, position);
+		if (ts_node_is_null(node)) {
+			result["error"] = "No identifier at position " + String::num_int64(position);
+			return result;
+		}
+		const char *data = reinterpret_cast<const char *>(state->source_bytes.ptr());
+		name = std::string_view(data + ts_node_start_byte(node), ts_node_end_byte(node) - ts_node_start_byte(node));
+		scope_path = file_path.utf8().get_data();
+		TSNode definition;
+		TSNode scope;
+		if (resolve_local_definition(scope_path, name, root, node, definition, scope)) {
+			const char *scope_type = ts_node_type(scope);
+			scoped = strcmp(scope_type, "class_definition") != 0 && strcmp(scope_type, "source") != 0;
+			scope_start = ts_node_start_byte(scope);
+			scope_end = ts_node_end_byte(scope);
+		}
+	} else {
+		result["error"] = "Target must be a name (String) or a location ({file_path, position})";
 		return result;
 	}
 
-	FileState &state = open_files[file_path];
-	uint32_t source_length = state.source_bytes.size();
+	struct Reference {
+		std::string_view path;
+		ReferenceIndex::Occurrence occurrence;
+	};
+	std::vector<Reference> found;
+	std::vector<ReferenceIndex::Occurrence> occurrences;
+	auto add_occurrences = [&](std::string_view path) {
+		for (const ReferenceIndex::Occurrence &occurrence : occurrences) {
+			if ((include_definitions || occurrence.role != DocumentOutline::ROLE_DEFINITION) &&
+					(!scoped || (occurrence.start_byte >= scope_start && occurrence.end_byte <= scope_end))) {
+				found.push_back({ path, occurrence });
+			}
+		}
+		occurrences.clear();
+	};
 
-	if (dry_run) {
-		result["old_source"] = String::utf8(reinterpret_cast<const char *>(state.source_bytes.ptr()), source_length);
+	uint32_t name_id = reference_index.find_name(name);
+	if (scoped) {
+		uint32_t file = reference_index.find_file(scope_path);
+		if (file != ReferenceIndex::NONE && name_id != ReferenceIndex::NONE) {
+			reference_index.get_occurrences(file, name_id, occurrences);
+			add_occurrences(reference_index.get_file_path(file));
+		}
+	} else {
+		if (name_id != ReferenceIndex::NONE) {
+			for (uint32_t file : reference_index.get_name_files(name_id)) {
+				reference_index.get_occurrences(file, name_id, occurrences);
+				add_occurrences(reference_index.get_file_path(file));
+			}
+		}
+		uint32_t mapped_name = symbol_index_file.find_name(name);
+		if (mapped_name != SymbolIndexFile::NONE) {
+			uint32_t count = 0;
+			const SymbolIndexFile::ReferenceRecord *references = symbol_index_file.get_references(mapped_name, count);
+			for (uint32_t i = 0; i < count; i++) {
+				if (symbol_index_file.is_hidden(references[i].file)) {
+					continue;
+				}
+				ReferenceIndex::decode(symbol_index_file.get_reference_data(references[i]), references[i].data_size, name.size(), occurrences);
+				add_occurrences(symbol_index_file.get_file_path(references[i].file));
+			}
+		}
 	}
 
-	struct EditInfo {
-		int start_byte;
-		int end_byte;
-		String new_text;
-	};
+	std::sort(found.begin(), found.end(), [](const Reference &a, const Reference &b) {
+		return a.path != b.path ? a.path < b.path : a.occurrence.start_byte < b.occurrence.start_byte;
+	});
+	perf_stats::Scope scope(perf_stats::PHASE_MARSHAL);
+	scope.add_amount(found.size());
+	Array references;
+	for (const Reference &reference : found) {
+		Dictionary entry;
+		entry["file_path"] = String::utf8(reference.path.data(), reference.path.size());
+		entry["start_byte"] = (int)reference.occurrence.start_byte;
+		entry["end_byte"] = (int)reference.occurrence.end_byte;
+		entry["role"] = reference.occurrence.role == DocumentOutline::ROLE_DEFINITION ? "definition" : "reference";
+		references.push_back(entry);
+	}
+
+	result["success"] = true;
+	result["name"] = String::utf8(name.data(), name.size());
+	result["scoped"] = scoped;
+	result["references"] = references;
+	return result;
+}
+
+Dictionary ASTManager::complete_at(const String &file_path, int row, int column, const String &prefix, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+	int limit = options.get("limit", 50);
+
+	FileState *state = access_open_file(file_path);
+	if (!state || !state->tree) {
+		result["error"] = state ? "No tree available for file: " + file_path : "File not open: " + file_path;
+		return result;
+	}
+	const std::vector<LineDiff::Line> &lines = get_line_index(*state);
+	if (row < 0 || (uint32_t)row >= count_editor_lines(lines)) {
+		result["error"] = "Row out of range: " + String::num_int64(row);
+		return result;
+	}
+	uint32_t length = state->source_bytes.size();
+	uint32_t line_start = (uint32_t)row < lines.size() ? lines[row].start : length;
+	uint32_t line_length = (uint32_t)row < lines.size() ? lines[row].length : 0;
+	if (column < 0 || (uint32_t)column > line_length) {
+		result["error"] = "Column out of range: " + String::num_int64(column);
+		return result;
+	}
+	uint32_t position = line_start + column;
+	const char *data = reinterpret_cast<const char *>(state->source_bytes.ptr());
+
+	// Without an explicit prefix, complete the word before the cursor.
+	std::string prefix_text;
+	if (prefix.is_empty()) {
+		uint32_t start = position;
+		while (start > line_start && is_identifier_byte(data[start - 1])) {
+			start--;
+		}
+		prefix_text.assign(data + start, position - start);
+	} else {
+		prefix_text = prefix.utf8().get_data();
+	}
+	std::string_view prefix_view(prefix_text);
 
-	struct EditInfoComparator {
-		bool operator()(const EditInfo &a, const EditInfo &b) const {
-			return a.start_byte < b.start_byte;
+	struct Candidate {
+		std::string name;
+		int source;
+		const char *kind;
+		std::string file_path;
+	};
+	enum {
+		SOURCE_LOCAL,
+		SOURCE_MEMBER,
+		SOURCE_INHERITED,
+		SOURCE_GLOBAL,
+	};
+	// Sources are visited from the innermost out, so the first candidate
+	// of a name is the one that shadows the others.
+	std::vector<Candidate> candidates;
+	std::unordered_set<std::string> seen;
+	auto add = [&](std::string_view name, int source, const char *kind, std::string_view path) {
+		if (has_prefix(name, prefix_view) && seen.insert(std::string(name)).second) {
+			candidates.push_back({ std::string(name), source, kind, std::string(path) });
 		}
 	};
 
-	Vector<EditInfo> validated_edits;
-	validated_edits.resize(edits.size());
+	std::string path = file_path.utf8().get_data();
+	TSNode root = ts_tree_root_node(state->tree);
+	TSNode node = ts_node_descendant_for_byte_range(root, position, position);
+	TSNode scope = is_scope_node(node) ? node : enclosing_scope(node);
+
+	// Locals and parameters: declarations before the cursor whose own
+	// scope is one of the functions around it.
+	uint32_t reference_file = reference_index.find_file(path);
+	std::vector<std::pair<uint32_t, ReferenceIndex::Occurrence>> definitions;
+	if (reference_file != ReferenceIndex::NONE) {
+		std::vector<ReferenceIndex::Occurrence> occurrences;
+		for (uint32_t i = 0; i < reference_index.get_file_name_count(reference_file); i++) {
+			uint32_t name = reference_index.get_file_name(reference_file, i);
+			if (!has_prefix(reference_index.get_name(name), prefix_view)) {
+				continue;
+			}
+			occurrences.clear();
+			reference_index.get_occurrences(reference_file, name, occurrences);
+			for (const ReferenceIndex::Occurrence &occurrence : occurrences) {
+				if (occurrence.role == DocumentOutline::ROLE_DEFINITION && occurrence.end_byte < position) {
+					definitions.push_back({ name, occurrence });
+				}
+			}
+		}
+	}
+	TSNode class_scope = root;
+	for (TSNode current = scope; !ts_node_is_null(current); current = enclosing_scope(current)) {
+		const char *type = ts_node_type(current);
+		if (strcmp(type, "class_definition") == 0 || strcmp(type, "source") == 0) {
+			class_scope = current;
+			break;
+		}
+		uint32_t scope_start = ts_node_start_byte(current);
+		uint32_t scope_end = ts_node_end_byte(current);
+		for (const std::pair<uint32_t, ReferenceIndex::Occurrence> &definition : definitions) {
+			if (definition.second.start_byte < scope_start || definition.second.end_byte > scope_end) {
+				continue;
+			}
+			TSNode declared = ts_node_descendant_for_byte_range(root, definition.second.start_byte, definition.second.end_byte);
+			if (ts_node_eq(enclosing_scope(declared), current)) {
+				add(reference_index.get_name(definition.first), SOURCE_LOCAL, local_definition_kind(declared), path);
+			}
+		}
+	}
 
-	for (int i = 0; i < edits.size(); i++) {
-		Dictionary edit_dict = edits[i];
-		
-		if (!edit_dict.has("start_byte") || !edit_dict.has("end_byte") || !edit_dict.has("new_text")) {
-			result["error"] = "Edit " + String::num_int64(i) + " missing required fields";
-			return result;
+	// Members of the enclosing class: the script itself or an inner class.
+	uint32_t file = symbol_index.find_file(path);
+	uint32_t container = SymbolIndex::NONE;
+	bool in_inner_class = strcmp(ts_node_type(class_scope), "class_definition") == 0;
+	if (in_inner_class) {
+		TSNode class_name = ts_node_child_by_field_name(class_scope, "name", 4);
+		if (!ts_node_is_null(class_name)) {
+			container = symbol_index.find_name(std::string_view(data + ts_node_start_byte(class_name), ts_node_end_byte(class_name) - ts_node_start_byte(class_name)));
+		}
+	}
+	if (file != SymbolIndex::NONE && (!in_inner_class || container != SymbolIndex::NONE)) {
+		for (const SymbolIndex::Symbol &symbol : symbol_index.get_file_symbols(file)) {
+			if (symbol.container == container && symbol.kind != DocumentOutline::SYMBOL_CLASS_NAME) {
+				add(symbol_index.get_name(symbol.name), SOURCE_MEMBER, SYMBOL_KIND_NAMES[symbol.kind], path);
+			}
+		}
+	}
+
+	// Inherited members along the script's extends chain, through either
+	// index layer. A base may be a class_name or a script path.
+	std::string base = (file != SymbolIndex::NONE && !in_inner_class) ? symbol_index.get_file_extends(file) : std::string();
+	std::unordered_set<std::string> visited;
+	visited.insert(path);
+	while (!base.empty()) {
+		std::string base_path;
+		if (base.find("://") != std::string::npos || (base.size() > 3 && base.compare(base.size() - 3, 3, ".gd") == 0)) {
+			base_path = base;
+		} else {
+			Array declarations;
+			collect_named_symbols(base, DocumentOutline::SYMBOL_CLASS_NAME, declarations);
+			if (declarations.is_empty()) {
+				break;
+			}
+			base_path = String(Dictionary(declarations[0])["file_path"]).utf8().get_data();
+		}
+		if (!visited.insert(base_path).second) {
+			break;
+		}
+		base.clear();
+		uint32_t base_file = symbol_index.find_file(base_path);
+		uint32_t mapped = base_file == SymbolIndex::NONE ? symbol_index_file.find_file(base_path) : SymbolIndexFile::NONE;
+		if (base_file != SymbolIndex::NONE) {
+			for (const SymbolIndex::Symbol &symbol : symbol_index.get_file_symbols(base_file)) {
+				if (symbol.container == SymbolIndex::NONE && symbol.kind != DocumentOutline::SYMBOL_CLASS_NAME) {
+					add(symbol_index.get_name(symbol.name), SOURCE_INHERITED, SYMBOL_KIND_NAMES[symbol.kind], base_path);
+				}
+			}
+			base = symbol_index.get_file_extends(base_file);
+		} else if (mapped != SymbolIndexFile::NONE && !symbol_index_file.is_hidden(mapped)) {
+			const SymbolIndexFile::FileRecord &record = symbol_index_file.get_file(mapped);
+			for (uint32_t i = record.first_symbol; i < record.first_symbol + record.symbol_count; i++) {
+				const SymbolIndexFile::SymbolRecord &symbol = symbol_index_file.get_symbol(i);
+				if (symbol.container == SymbolIndexFile::NONE && symbol.kind != DocumentOutline::SYMBOL_CLASS_NAME) {
+					add(symbol_index_file.get_name(symbol.name), SOURCE_INHERITED, SYMBOL_KIND_NAMES[symbol.kind], base_path);
+				}
+			}
+			base = symbol_index_file.get_file_extends(mapped);
 		}
+	}
 
-		EditInfo &edit = validated_edits.write[i];
-		edit.start_byte = edit_dict["start_byte"];
-		edit.end_byte = edit_dict["end_byte"];
-		edit.new_text = edit_dict["new_text"];
+	// Global class names from the trie; some may already be shadowed.
+	std::vector<std::string> globals;
+	global_names.find_prefix(prefix_view, MAX(limit, 0) + candidates.size(), globals);
+	for (const std::string &name : globals) {
+		add(name, SOURCE_GLOBAL, SYMBOL_KIND_NAMES[DocumentOutline::SYMBOL_CLASS_NAME], "");
+	}
 
-		if (edit.start_byte < 0) {
-			result["error"] = "Edit " + String::num_int64(i) + " has negative start_byte";
-			return result;
+	// Closest source first, then shorter names.
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+		if (a.source != b.source) {
+			return a.source < b.source;
 		}
-		if (edit.end_byte < 0) {
-			result["error"] = "Edit " + String::num_int64(i) + " has negative end_byte";
-			return result;
+		return a.name.size() != b.name.size() ? a.name.size() < b.name.size() : a.name < b.name;
+	});
+	perf_stats::Scope marshal_scope(perf_stats::PHASE_MARSHAL);
+	marshal_scope.add_amount(MIN((int)candidates.size(), limit));
+	Array items;
+	for (int i = 0; i < (int)candidates.size() && i < limit; i++) {
+		const Candidate &candidate = candidates[i];
+		Dictionary item;
+		item["name"] = String::utf8(candidate.name.data(), candidate.name.size());
+		item["kind"] = candidate.kind;
+		item["source"] = COMPLETION_SOURCE_NAMES[candidate.source];
+		item["file_path"] = String::utf8(candidate.file_path.data(), candidate.file_path.size());
+		items.push_back(item);
+	}
+
+	result["success"] = true;
+	result["prefix"] = String::utf8(prefix_text.data(), prefix_text.size());
+	result["replace_start_byte"] = (int)(position - MIN((uint32_t)prefix_text.size(), position - line_start));
+	result["items"] = items;
+	result["is_incomplete"] = (int)candidates.size() > limit;
+	return result;
+}
+
+Dictionary ASTManager::get_symbol_index_stats() {
+	PERF_METHOD_SCOPE();
+	uint32_t mapped_files = 0;
+	uint32_t mapped_symbols = 0;
+	for (uint32_t i = 0; i < symbol_index_file.get_file_count(); i++) {
+		if (!symbol_index_file.is_hidden(i)) {
+			mapped_files++;
+			mapped_symbols += symbol_index_file.get_file(i).symbol_count;
 		}
-		if (edit.start_byte > edit.end_byte) {
-			result["error"] = "Edit " + String::num_int64(i) + " has start_byte > end_byte";
+	}
+
+	Dictionary result;
+	result["file_count"] = (int)(symbol_index.get_file_count() + mapped_files);
+	result["symbol_count"] = (int)(symbol_index.get_symbol_count() + mapped_symbols);
+	result["name_count"] = (int)symbol_index.get_name_count();
+	result["mapped_file_count"] = (int)mapped_files;
+	result["mapped_name_count"] = (int)symbol_index_file.get_name_count();
+	result["reference_file_count"] = (int)reference_index.get_file_count();
+	result["occurrence_count"] = (int64_t)reference_index.get_occurrence_count();
+	result["occurrence_bytes"] = (int64_t)reference_index.get_posting_bytes();
+	result["mapped_reference_count"] = (int)symbol_index_file.get_reference_count();
+	result["global_name_count"] = (int)global_names.get_name_count();
+	result["dependency_file_count"] = (int)dependency_graph.get_file_count();
+	result["dependency_target_count"] = (int)dependency_graph.get_target_count();
+	return result;
+}
+
+Dictionary ASTManager::query_dependencies(const String &file_path, const Dictionary &options, bool reverse) {
+	Dictionary result;
+	result["success"] = false;
+	result["file_path"] = file_path;
+	uint32_t kinds = 0;
+	if (!parse_dependency_kinds(options, kinds, result)) {
+		return result;
+	}
+	uint32_t file = dependency_graph.find_file(file_path.utf8().get_data());
+	if (file == DependencyGraph::NONE) {
+		result["error"] = "File is not indexed: " + file_path;
+		return result;
+	}
+
+	std::vector<DependencyGraph::Edge> edges;
+	if (options.get("transitive", false)) {
+		dependency_graph.get_closure({ file }, kinds, reverse, edges);
+	} else if (reverse) {
+		dependency_graph.get_dependents(file, kinds, edges);
+	} else {
+		dependency_graph.get_dependencies(file, kinds, edges);
+	}
+	PackedStringArray file_paths;
+	PackedInt32Array edge_kinds;
+	append_dependency_edges(dependency_graph, edges, file_paths, edge_kinds);
+	result["success"] = true;
+	result["file_paths"] = file_paths;
+	result["kinds"] = edge_kinds;
+	return result;
+}
+
+Dictionary ASTManager::get_script_dependencies(const String &file_path, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	return query_dependencies(file_path, options, false);
+}
+
+Dictionary ASTManager::get_script_dependents(const String &file_path, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	return query_dependencies(file_path, options, true);
+}
+
+Dictionary ASTManager::sort_scripts_by_dependencies(const PackedStringArray &file_paths, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	uint32_t kinds = 0;
+	if (!parse_dependency_kinds(options, kinds, result)) {
+		return result;
+	}
+	std::vector<uint32_t> files;
+	for (int i = 0; i < file_paths.size(); i++) {
+		const String &file_path = file_paths[i];
+		uint32_t file = dependency_graph.find_file(file_path.utf8().get_data());
+		if (file == DependencyGraph::NONE) {
+			result["error"] = "File is not indexed: " + file_path;
 			return result;
 		}
-		if (static_cast<uint32_t>(edit.end_byte) > source_length) {
-			result["error"] = "Edit " + String::num_int64(i) + " end_byte exceeds source length";
-			return result;
+		files.push_back(file);
+	}
+	// Duplicates would count their edges twice.
+	std::vector<uint32_t> unique_files;
+	std::unordered_set<uint32_t> seen;
+	for (uint32_t file : files) {
+		if (seen.insert(file).second) {
+			unique_files.push_back(file);
 		}
 	}
 
-	validated_edits.sort_custom<EditInfoComparator>();
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> cyclic;
+	dependency_graph.sort(unique_files, kinds, order, cyclic);
+	auto to_paths = [&](const std::vector<uint32_t> &ids) {
+		PackedStringArray paths;
+		for (uint32_t file : ids) {
+			const std::string &path = dependency_graph.get_file_path(file);
+			paths.push_back(String::utf8(path.data(), path.size()));
+		}
+		return paths;
+	};
+	result["success"] = true;
+	result["file_paths"] = to_paths(order);
+	result["cyclic_files"] = to_paths(cyclic);
+	return result;
+}
 
-	for (int i = 0; i < validated_edits.size() - 1; i++) {
-		const EditInfo &edit1 = validated_edits[i];
-		const EditInfo &edit2 = validated_edits[i + 1];
-		
-		if (edits_overlap(edit1.start_byte, edit1.end_byte, edit2.start_byte, edit2.end_byte)) {
-			result["error"] = "Edits overlap: edit at byte " + String::num_int64(edit1.start_byte) + 
-				" and edit at byte " + String::num_int64(edit2.start_byte);
-			return result;
+Dictionary ASTManager::save_symbol_index(const String &path) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	String target = path.is_empty() ? String(DEFAULT_SYMBOL_INDEX_PATH) : path;
+	result["path"] = target;
+	String native = ProjectSettings::get_singleton()->globalize_path(target);
+	DirAccess::make_dir_recursive_absolute(native.get_base_dir());
+
+	// Everything visible, from both layers. Open buffers may differ from
+	// the disk, so they are saved with no mtime and get compared by hash.
+	std::vector<SymbolIndexFile::FileData> files;
+	std::vector<uint32_t> file_ids;
+	symbol_index.get_files(file_ids);
+	int symbol_count = 0;
+	for (uint32_t file : file_ids) {
+		SymbolIndexFile::FileData data;
+		data.path = symbol_index.get_file_path(file);
+		data.extends = symbol_index.get_file_extends(file);
+		data.preloads = symbol_index.get_file_preloads(file);
+		data.loads = symbol_index.get_file_loads(file);
+		FileState *state = open_files.getptr(String::utf8(data.path.data(), data.path.size()));
+		if (state) {
+			data.content_hash = content_hash::hash_bytes(state->source_bytes.ptr(), state->source_bytes.size());
+		} else {
+			data.content_hash = symbol_index.get_file_hash(file);
+			data.mtime = symbol_index.get_file_mtime(file);
+		}
+		for (const SymbolIndex::Symbol &symbol : symbol_index.get_file_symbols(file)) {
+			SymbolIndexFile::SymbolData entry;
+			entry.name = symbol_index.get_name(symbol.name);
+			if (symbol.container != SymbolIndex::NONE) {
+				entry.container = symbol_index.get_name(symbol.container);
+			}
+			entry.kind = symbol.kind;
+			entry.start_byte = symbol.start_byte;
+			entry.end_byte = symbol.end_byte;
+			entry.start_row = symbol.start_row;
+			entry.end_row = symbol.end_row;
+			entry.name_start_byte = symbol.name_start_byte;
+			entry.name_end_byte = symbol.name_end_byte;
+			data.symbols.push_back(std::move(entry));
+		}
+		uint32_t reference_file = reference_index.find_file(data.path);
+		if (reference_file != ReferenceIndex::NONE) {
+			for (uint32_t i = 0; i < reference_index.get_file_name_count(reference_file); i++) {
+				uint32_t size = 0;
+				const uint8_t *occurrences = reference_index.get_file_postings(reference_file, i, size);
+				data.references.push_back({ reference_index.get_name(reference_index.get_file_name(reference_file, i)), std::vector<uint8_t>(occurrences, occurrences + size) });
+			}
+		}
+		symbol_count += data.symbols.size();
+		files.push_back(std::move(data));
+	}
+	std::vector<uint32_t> mapped_slots(symbol_index_file.get_file_count(), SymbolIndexFile::NONE);
+	for (uint32_t file = 0; file < symbol_index_file.get_file_count(); file++) {
+		if (symbol_index_file.is_hidden(file)) {
+			continue;
+		}
+		mapped_slots[file] = files.size();
+		const SymbolIndexFile::FileRecord &record = symbol_index_file.get_file(file);
+		SymbolIndexFile::FileData data;
+		data.path = symbol_index_file.get_file_path(file);
+		data.extends = symbol_index_file.get_file_extends(file);
+		split_lines(symbol_index_file.get_file_preloads(file), data.preloads);
+		split_lines(symbol_index_file.get_file_loads(file), data.loads);
+		data.content_hash = record.content_hash;
+		data.mtime = record.mtime;
+		for (uint32_t i = record.first_symbol; i < record.first_symbol + record.symbol_count; i++) {
+			const SymbolIndexFile::SymbolRecord &symbol = symbol_index_file.get_symbol(i);
+			SymbolIndexFile::SymbolData entry;
+			entry.name = symbol_index_file.get_name(symbol.name);
+			if (symbol.container != SymbolIndexFile::NONE) {
+				entry.container = symbol_index_file.get_name(symbol.container);
+			}
+			entry.kind = symbol.kind;
+			entry.start_byte = symbol.start_byte;
+			entry.end_byte = symbol.end_byte;
+			entry.start_row = symbol.start_row;
+			entry.end_row = symbol.end_row;
+			entry.name_start_byte = symbol.name_start_byte;
+			entry.name_end_byte = symbol.name_end_byte;
+			data.symbols.push_back(std::move(entry));
+		}
+		symbol_count += data.symbols.size();
+		files.push_back(std::move(data));
+	}
+	// Mapped occurrences are grouped by name; regroup them by file.
+	for (uint32_t name = 0; name < symbol_index_file.get_name_count(); name++) {
+		uint32_t count = 0;
+		const SymbolIndexFile::ReferenceRecord *references = symbol_index_file.get_references(name, count);
+		for (uint32_t i = 0; i < count; i++) {
+			uint32_t slot = mapped_slots[references[i].file];
+			if (slot == SymbolIndexFile::NONE) {
+				continue;
+			}
+			const uint8_t *occurrences = symbol_index_file.get_reference_data(references[i]);
+			files[slot].references.push_back({ std::string(symbol_index_file.get_name(name)), std::vector<uint8_t>(occurrences, occurrences + references[i].data_size) });
 		}
 	}
-
-	PackedByteArray modified_bytes = state.source_bytes;
-	
-	for (int i = validated_edits.size() - 1; i >= 0; i--) {
-		const EditInfo &edit = validated_edits[i];
-		modified_bytes = apply_single_edit_to_bytes(modified_bytes, edit.start_byte, edit.end_byte, edit.new_text);
+	int file_count = files.size();
+
+	// The mapping may be the file being replaced.
+	std::string native_utf8 = native.utf8().get_data();
+	symbol_index_file.close();
+	std::string error;
+	bool written = SymbolIndexFile::write(native_utf8, files, error);
+	std::string open_error;
+	bool opened = symbol_index_file.open(native_utf8, open_error);
+	mapped_name_masks.clear();
+	if (written && opened) {
+		// The saved file now serves every closed script.
+		for (uint32_t file : file_ids) {
+			std::string file_path = symbol_index.get_file_path(file);
+			if (!open_files.has(String::utf8(file_path.data(), file_path.size()))) {
+				symbol_index.remove_file(file_path);
+				reference_index.remove_file(file_path);
+			}
+		}
 	}
+	hide_shadowed_index_files();
+	rebuild_global_names();
+	rebuild_dependency_graph();
 
-	String new_source = String::utf8(reinterpret_cast<const char *>(modified_bytes.ptr()), modified_bytes.size());
-	result["new_source"] = new_source;
-
-	const char *parse_data = reinterpret_cast<const char *>(modified_bytes.ptr());
-	uint32_t parse_len = modified_bytes.size();
-	
-	TSTree *new_tree = ts_parser_parse_string(parser, nullptr, parse_data, parse_len);
-	if (!new_tree) {
-		result["error"] = "Failed to parse after edits";
+	if (!written) {
+		result["error"] = String::utf8(error.c_str());
 		return result;
 	}
-
-	TSNode root = ts_tree_root_node(new_tree);
-	bool has_error = ts_node_has_error(root);
-	result["has_error"] = has_error;
-	
-	Array error_ranges;
-	if (has_error) {
-		collect_error_nodes(root, error_ranges);
+	if (!opened) {
+		result["error"] = "Index saved but could not be mapped: " + String::utf8(open_error.c_str());
+		return result;
 	}
-	result["error_count"] = error_ranges.size();
+	result["success"] = true;
+	result["file_count"] = file_count;
+	result["symbol_count"] = symbol_count;
+	return result;
+}
 
-	if (!dry_run) {
-		if (state.tree) {
-			ts_tree_delete(state.tree);
-		}
-		state.source_bytes = modified_bytes;
-		state.tree = new_tree;
-	} else {
-		ts_tree_delete(new_tree);
+Dictionary ASTManager::load_symbol_index(const String &path) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	String target = path.is_empty() ? String(DEFAULT_SYMBOL_INDEX_PATH) : path;
+	result["path"] = target;
+
+	std::string error;
+	bool opened = symbol_index_file.open(ProjectSettings::get_singleton()->globalize_path(target).utf8().get_data(), error);
+	// A failed open still drops the previous mapping.
+	mapped_name_masks.clear();
+	if (!opened) {
+		rebuild_global_names();
+		rebuild_dependency_graph();
+		result["error"] = String::utf8(error.c_str());
+		return result;
 	}
+	hide_shadowed_index_files();
+	rebuild_global_names();
+	rebuild_dependency_graph();
 
 	result["success"] = true;
-	result["edits_applied"] = edits.size();
+	result["file_count"] = (int)symbol_index_file.get_file_count();
+	result["symbol_count"] = (int)symbol_index_file.get_symbol_count();
 	return result;
 }
 
-Dictionary ASTManager::apply_node_edits(const String &file_path, const TypedArray<Dictionary> &edits, const Dictionary &options) {
+Dictionary ASTManager::refresh_symbol_index(const PackedStringArray &file_paths, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
 	Dictionary result;
 	result["success"] = false;
-	result["error"] = "";
-	result["new_source"] = "";
-	result["has_error"] = false;
-	result["error_count"] = 0;
-	result["edits_applied"] = 0;
+	bool remove_missing = options.get("remove_missing", true);
+	int max_threads = options.get("max_threads", 0);
+
+	// A file is reparsed only when both its mtime and its content hash
+	// differ from the stamp it was indexed with. Mtimes have a resolution
+	// of a second: one from the current second could still change without
+	// moving, so it is not recorded and the next refresh compares hashes.
+	int64_t now = (int64_t)Time::get_singleton()->get_unix_time_from_system();
+	std::unordered_set<std::string> listed;
+	std::vector<IndexJob> jobs;
+	int unchanged_count = 0;
+	for (int i = 0; i < file_paths.size(); i++) {
+		const String &path = file_paths[i];
+		if (!FileAccess::file_exists(path)) {
+			continue;
+		}
+		std::string key = path.utf8().get_data();
+		listed.insert(key);
+		if (open_files.has(path)) {
+			symbol_index.set_persistent(key, true);
+			unchanged_count++;
+			continue;
+		}
 
-	if (!open_files.has(file_path)) {
-		result["error"] = "File not open: " + file_path;
-		return result;
+		int64_t mtime = FileAccess::get_modified_time(path);
+		uint32_t file = symbol_index.find_file(key);
+		uint32_t mapped = file == SymbolIndex::NONE ? symbol_index_file.find_file(key) : SymbolIndexFile::NONE;
+		if (mapped != SymbolIndexFile::NONE && symbol_index_file.is_hidden(mapped)) {
+			mapped = SymbolIndexFile::NONE;
+		}
+		bool known = file != SymbolIndex::NONE || mapped != SymbolIndexFile::NONE;
+		uint64_t known_hash = 0;
+		int64_t known_mtime = 0;
+		if (file != SymbolIndex::NONE) {
+			known_hash = symbol_index.get_file_hash(file);
+			known_mtime = symbol_index.get_file_mtime(file);
+		} else if (mapped != SymbolIndexFile::NONE) {
+			known_hash = symbol_index_file.get_file(mapped).content_hash;
+			known_mtime = symbol_index_file.get_file(mapped).mtime;
+		}
+		if (known && known_mtime != 0 && known_mtime == mtime) {
+			unchanged_count++;
+			continue;
+		}
+
+		PackedByteArray bytes = FileAccess::get_file_as_bytes(path);
+		uint64_t hash = content_hash::hash_bytes(bytes.ptr(), bytes.size());
+		if (mtime >= now) {
+			mtime = 0;
+		}
+		if (known && known_hash == hash) {
+			// Touched but not changed: remember the new mtime only.
+			if (file != SymbolIndex::NONE) {
+				symbol_index.set_file_stamp(file, hash, mtime);
+			} else {
+				symbol_index_file.get_file(mapped).mtime = mtime;
+			}
+			unchanged_count++;
+			continue;
+		}
+		IndexJob job;
+		job.path = key;
+		job.source.assign(reinterpret_cast<const char *>(bytes.ptr()), bytes.size());
+		job.content_hash = hash;
+		job.mtime = mtime;
+		jobs.push_back(std::move(job));
 	}
 
-	bool dry_run = options.get("dry_run", false);
-	bool auto_indent = options.get("auto_indent", true);
-	bool fail_on_parse_error = options.get("fail_on_parse_error", false);
+	parse_index_jobs(parser_pool, jobs, max_threads);
 
-	FileState &state = open_files[file_path];
-	uint32_t source_length = state.source_bytes.size();
-	String source = String::utf8(reinterpret_cast<const char *>(state.source_bytes.ptr()), source_length);
+	PackedStringArray failed_files;
+	int reparsed_count = 0;
+	for (const IndexJob &job : jobs) {
+		if (!job.parsed) {
+			failed_files.push_back(String::utf8(job.path.data(), job.path.size()));
+			continue;
+		}
+		update_index_entry(job.path, job.outline, job.source.data());
+		symbol_index.set_persistent(job.path, true);
+		symbol_index.set_file_stamp(symbol_index.find_file(job.path), job.content_hash, job.mtime);
+		reparsed_count++;
+	}
 
-	struct MatchInfo {
-		int edit_index;
-		int match_start;
-		int match_end;
-		String old_text;
-		String new_text;
-		String node_kind;
-	};
+	int removed_count = 0;
+	if (remove_missing) {
+		std::vector<uint32_t> file_ids;
+		symbol_index.get_files(file_ids);
+		for (uint32_t file : file_ids) {
+			std::string file_path = symbol_index.get_file_path(file);
+			if (!listed.count(file_path) && !open_files.has(String::utf8(file_path.data(), file_path.size()))) {
+				remove_index_entry(file_path);
+				removed_count++;
+			}
+		}
+		for (uint32_t file = 0; file < symbol_index_file.get_file_count(); file++) {
+			if (!symbol_index_file.is_hidden(file) && !listed.count(std::string(symbol_index_file.get_file_path(file)))) {
+				hide_mapped_file(file);
+				dependency_graph.remove_file(std::string(symbol_index_file.get_file_path(file)));
+				removed_count++;
+			}
+		}
+	}
 
-	Vector<MatchInfo> matches;
-	matches.resize(edits.size());
+	result["success"] = failed_files.is_empty();
+	if (!failed_files.is_empty()) {
+		result["error"] = "Failed to parse " + String::num_int64(failed_files.size()) + " file(s)";
+	}
+	result["unchanged_count"] = unchanged_count;
+	result["reparsed_count"] = reparsed_count;
+	result["removed_count"] = removed_count;
+	result["failed_files"] = failed_files;
+	return result;
+}
 
-	for (int i = 0; i < edits.size(); i++) {
-		Dictionary edit_dict = edits[i];
+Dictionary ASTManager::load_lint_rules(const Array &rules) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
 
-		if (!edit_dict.has("old_text") || !edit_dict.has("new_text")) {
-			result["error"] = "Edit #" + String::num_int64(i) + ": missing required fields";
+	std::vector<LintEngine::RuleSource> sources;
+	std::unordered_set<std::string> ids;
+	for (int i = 0; i < rules.size(); i++) {
+		Dictionary rule = rules[i];
+		String id = rule.get("id", "");
+		String query_source = rule.get("query", "");
+		if (id.is_empty() || query_source.is_empty()) {
+			result["error"] = "Rule " + String::num_int64(i) + " needs an id and a query";
 			return result;
 		}
-
-		String old_text = edit_dict["old_text"];
-		String new_text = edit_dict["new_text"];
-		String node_kind = edit_dict.get("node_kind", "");
-
-		int match_start = source.find(old_text);
-		if (match_start == -1) {
-			result["error"] = "Edit #" + String::num_int64(i) + ": old_text not found in source";
+		LintEngine::RuleSource source;
+		source.id = id.utf8().get_data();
+		if (!ids.insert(source.id).second) {
+			result["error"] = "Duplicate rule id: " + id;
 			return result;
 		}
-
-		int second_match = source.find(old_text, match_start + 1);
-		if (second_match != -1) {
-			int match_count = 2;
-			int search_pos = second_match + 1;
-			while (source.find(old_text, search_pos) != -1) {
-				match_count++;
-				search_pos = source.find(old_text, search_pos) + 1;
+		String severity = rule.get("severity", "warning");
+		int severity_index = -1;
+		for (int s = 0; s < (int)(sizeof(LINT_SEVERITY_NAMES) / sizeof(LINT_SEVERITY_NAMES[0])); s++) {
+			if (severity == LINT_SEVERITY_NAMES[s]) {
+				severity_index = s;
 			}
-			result["error"] = "Edit #" + String::num_int64(i) + ": old_text matches " + String::num_int64(match_count) + " locations, must be unique";
+		}
+		if (severity_index < 0) {
+			result["error"] = "Unknown severity for rule " + id + ": " + severity;
 			return result;
 		}
+		source.severity = (LintEngine::Severity)severity_index;
+		CharString query_utf8 = query_source.utf8();
+		source.query.assign(query_utf8.get_data(), query_utf8.length());
+		source.message = String(rule.get("message", "")).utf8().get_data();
+		source.capture = String(rule.get("capture", "")).utf8().get_data();
+		sources.push_back(std::move(source));
+	}
 
-		int match_end = match_start + old_text.length();
+	// Cached diagnostics of the old pack go stale with the generation.
+	std::string error;
+	// Frees the old pack's query and compiles the new one.
+	int64_t allocated_before = ts_allocator::get_thread_bytes();
+	bool loaded = lint_engine.load(sources, error);
+	lint_query_bytes += ts_allocator::get_thread_bytes() - allocated_before;
+	lint_generation++;
+	lint_stats.assign(lint_engine.get_rule_count(), LintEngine::RuleStats());
+	lint_file_count = 0;
+	lint_scanned_bytes = 0;
+	if (!loaded) {
+		result["error"] = String::utf8(error.c_str());
+		return result;
+	}
 
-		if (!node_kind.is_empty()) {
-			CharString old_text_utf8 = old_text.utf8();
-			int match_start_byte = source.substr(0, match_start).utf8().length();
-			int match_end_byte = match_start_byte + old_text_utf8.length();
+	result["success"] = true;
+	result["rule_count"] = (int)lint_engine.get_rule_count();
+	result["pattern_count"] = (int)lint_engine.get_pattern_count();
+	return result;
+}
 
-			TSNode root = ts_tree_root_node(state.tree);
-			TSNode covering_node = ts_node_descendant_for_byte_range(root, match_start_byte, match_end_byte - 1);
+Dictionary ASTManager::lint_file(const String &file_path) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
 
-			bool found_kind = false;
-			TSNode current = covering_node;
-			while (!ts_node_is_null(current)) {
-				const char *node_type = ts_node_type(current);
-				if (String(node_type) == node_kind) {
-					found_kind = true;
-					break;
-				}
-				current = ts_node_parent(current);
-			}
+	if (!lint_engine.is_loaded()) {
+		result["error"] = "No lint rules loaded";
+		return result;
+	}
+	FileState *state = access_open_file(file_path);
+	if (!state) {
+		result["error"] = "File not open: " + file_path;
+		return result;
+	}
+	if (!state->tree) {
+		result["error"] = "No tree available for file: " + file_path;
+		return result;
+	}
 
-			if (!found_kind) {
-				const char *actual_type = ts_node_type(covering_node);
-				result["error"] = "Edit #" + String::num_int64(i) + ": matched text is inside '" + String(actual_type) + "', expected '" + node_kind + "'";
-				return result;
-			}
-		}
+	TSQueryCursor *cursor = ts_query_cursor_new();
+	state->lint.update(lint_engine, lint_generation, cursor, ts_tree_root_node(state->tree), reinterpret_cast<const char *>(state->source_bytes.ptr()),
+			state->source_bytes.size(), state->version, lint_stats);
+	ts_query_cursor_delete(cursor);
+	lint_file_count++;
+	lint_scanned_bytes += state->lint.get_scanned_bytes();
 
-		MatchInfo &match = matches.write[i];
-		match.edit_index = i;
-		match.match_start = match_start;
-		match.match_end = match_end;
-		match.old_text = old_text;
-		match.new_text = new_text;
-		match.node_kind = node_kind;
+	result["success"] = true;
+	result["diagnostics"] = make_diagnostic_array(lint_engine, state->lint.get_diagnostics(), get_line_index(*state));
+	result["scanned_bytes"] = (int)state->lint.get_scanned_bytes();
+	return result;
+}
+
+Dictionary ASTManager::lint_files(const PackedStringArray &file_paths, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	int max_threads = options.get("max_threads", 0);
+
+	if (!lint_engine.is_loaded()) {
+		result["error"] = "No lint rules loaded";
+		return result;
 	}
 
-	for (int i = 0; i < matches.size() - 1; i++) {
-		for (int j = i + 1; j < matches.size(); j++) {
-			const MatchInfo &m1 = matches[i];
-			const MatchInfo &m2 = matches[j];
-			if (m1.match_start < m2.match_end && m2.match_start < m1.match_end) {
-				result["error"] = "Edit #" + String::num_int64(m1.edit_index) + " and #" + String::num_int64(m2.edit_index) + " have overlapping match ranges";
-				return result;
+	// One job per distinct file: a job updates the cache of an open file,
+	// so two must never share one.
+	std::unordered_set<std::string> listed;
+	std::vector<LintJob> jobs;
+	PackedStringArray failed_files;
+	for (int i = 0; i < file_paths.size(); i++) {
+		const String &path = file_paths[i];
+		if (!listed.insert(path.utf8().get_data()).second) {
+			continue;
+		}
+		LintJob job;
+		job.path = path;
+		job.state = open_files.getptr(path);
+		if (job.state && job.state->evicted) {
+			// Linted from its source like a closed file rather than parsed
+			// back in, so a project-wide run stays within the tree budget.
+			job.source.assign(reinterpret_cast<const char *>(job.state->source_bytes.ptr()), job.state->source_bytes.size());
+			job.state = nullptr;
+		} else if (job.state && !job.state->tree) {
+			failed_files.push_back(path);
+			continue;
+		} else if (!job.state) {
+			if (!FileAccess::file_exists(path)) {
+				failed_files.push_back(path);
+				continue;
 			}
+			PackedByteArray bytes = FileAccess::get_file_as_bytes(path);
+			job.source.assign(reinterpret_cast<const char *>(bytes.ptr()), bytes.size());
 		}
+		job.stats.resize(lint_engine.get_rule_count());
+		jobs.push_back(std::move(job));
 	}
 
-	if (auto_indent) {
-		for (int i = 0; i < matches.size(); i++) {
-			MatchInfo &match = matches.write[i];
-
-			int old_first_newline = match.old_text.find("\n");
-			String old_first_line = old_first_newline == -1 ? match.old_text : match.old_text.substr(0, old_first_newline);
-			String base_indent = "";
-			for (int j = 0; j < old_first_line.length(); j++) {
-				char32_t c = old_first_line[j];
-				if (c == ' ' || c == '\t') {
-					base_indent += String::chr(c);
-				} else {
-					break;
-				}
-			}
+	parser_pool.run(jobs.size(), max_threads, [&](int index, TSParser *worker_parser) {
+		LintJob &job = jobs[index];
+		TSQueryCursor *cursor = ts_query_cursor_new();
+		if (job.state) {
+			FileState &state = *job.state;
+			state.lint.update(lint_engine, lint_generation, cursor, ts_tree_root_node(state.tree), reinterpret_cast<const char *>(state.source_bytes.ptr()),
+					state.source_bytes.size(), state.version, job.stats);
+			job.scanned_bytes = state.lint.get_scanned_bytes();
+			job.linted = true;
+		} else if (TSTree *tree = parse_source(worker_parser, nullptr, job.source.data(), job.source.size())) {
+			lint_engine.run(cursor, ts_tree_root_node(tree), job.source.data(), 0, UINT32_MAX, job.diagnostics, job.stats);
+			ts_tree_delete(tree);
+			job.scanned_bytes = job.source.size();
+			job.linted = true;
+		}
+		ts_query_cursor_delete(cursor);
+	});
+
+	Dictionary files;
+	int diagnostic_count = 0;
+	std::vector<LineDiff::Line> lines;
+	for (LintJob &job : jobs) {
+		if (!job.linted) {
+			failed_files.push_back(job.path);
+			continue;
+		}
+		add_lint_stats(lint_stats, job.stats);
+		lint_file_count++;
+		lint_scanned_bytes += job.scanned_bytes;
+		Array diagnostics;
+		if (job.state) {
+			diagnostics = make_diagnostic_array(lint_engine, job.state->lint.get_diagnostics(), get_line_index(*job.state));
+		} else {
+			LineDiff::split_lines(job.source.data(), job.source.size(), lines);
+			diagnostics = make_diagnostic_array(lint_engine, job.diagnostics, lines);
+		}
+		diagnostic_count += diagnostics.size();
+		files[job.path] = diagnostics;
+	}
 
-			int new_first_newline = match.new_text.find("\n");
-			String new_first_line = new_first_newline == -1 ? match.new_text : match.new_text.substr(0, new_first_newline);
-			String new_indent = "";
-			for (int j = 0; j < new_first_line.length(); j++) {
-				char32_t c = new_first_line[j];
-				if (c == ' ' || c == '\t') {
-					new_indent += String::chr(c);
-				} else {
-					break;
-				}
-			}
+	result["success"] = failed_files.is_empty();
+	if (!failed_files.is_empty()) {
+		result["error"] = "Failed to lint " + String::num_int64(failed_files.size()) + " file(s)";
+	}
+	result["files"] = files;
+	result["diagnostic_count"] = diagnostic_count;
+	result["failed_files"] = failed_files;
+	return result;
+}
 
-			if (!base_indent.is_empty() && new_indent.is_empty()) {
-				PackedStringArray lines = match.new_text.split("\n", true);
-				String indented_result = "";
-				for (int line_idx = 0; line_idx < lines.size(); line_idx++) {
-					String line = lines[line_idx];
-					if (line.is_empty()) {
-						indented_result += line;
-					} else {
-						indented_result += base_indent + line;
-					}
-					if (line_idx < lines.size() - 1) {
-						indented_result += "\n";
-					}
-				}
-				match.new_text = indented_result;
-			}
-		}
+Dictionary ASTManager::get_lint_stats(bool reset) {
+	PERF_METHOD_SCOPE();
+	Array rules;
+	uint64_t total_nsec = 0;
+	for (uint32_t i = 0; i < lint_stats.size(); i++) {
+		const LintEngine::RuleStats &stats = lint_stats[i];
+		const std::string &id = lint_engine.get_rule_id(i);
+		Dictionary entry;
+		entry["id"] = String::utf8(id.data(), id.size());
+		entry["match_count"] = (int64_t)stats.match_count;
+		entry["diagnostic_count"] = (int64_t)stats.diagnostic_count;
+		entry["usec"] = (int64_t)(stats.nsec / 1000);
+		rules.push_back(entry);
+		total_nsec += stats.nsec;
 	}
 
-	TypedArray<Dictionary> text_edits;
-	for (int i = 0; i < matches.size(); i++) {
-		const MatchInfo &match = matches[i];
-		CharString old_utf8 = match.old_text.utf8();
-		int start_byte = source.substr(0, match.match_start).utf8().length();
-		int end_byte = start_byte + old_utf8.length();
+	Dictionary result;
+	result["rules"] = rules;
+	result["file_count"] = (int64_t)lint_file_count;
+	result["scanned_bytes"] = (int64_t)lint_scanned_bytes;
+	result["total_usec"] = (int64_t)(total_nsec / 1000);
+	if (reset) {
+		lint_stats.assign(lint_stats.size(), LintEngine::RuleStats());
+		lint_file_count = 0;
+		lint_scanned_bytes = 0;
+	}
+	return result;
+}
 
-		Dictionary text_edit;
-		text_edit["start_byte"] = start_byte;
-		text_edit["end_byte"] = end_byte;
-		text_edit["new_text"] = match.new_text;
-		text_edits.push_back(text_edit);
+void ASTManager::schedule_watch_poll() {
+	if (!watch_poll_scheduled.exchange(true)) {
+		call_deferred("poll_file_watcher");
 	}
+}
 
-	if (fail_on_parse_error) {
-		Dictionary preview_result = apply_text_edits(file_path, text_edits, true);
-		
-		if (!preview_result["success"]) {
-			result["error"] = preview_result["error"];
-			return result;
+void ASTManager::finish_watch_job(PackedStringArray *r_changed) {
+	watch_job_thread.join();
+	std::vector<std::string> stale;
+	for (WatchJob &job : watch_jobs) {
+		FileState *state = r_changed ? open_files.getptr(job.file_path) : nullptr;
+		if (state && job.changed && state->version == job.base_version) {
+			// Commits like update_file(): history, caches and index follow,
+			// and the buffer and tree are swapped in one step.
+			Ref<StagedEdit> staged = make_staged_edit(job.file_path, job.byte_edits, job.new_bytes, job.new_tree, 1);
+			job.new_tree = nullptr;
+			staged->commit();
+			r_changed->push_back(job.file_path);
+			watch_reload_count++;
+		} else if (state && job.changed) {
+			// Edited meanwhile: read it again against the new buffer.
+			stale.push_back(job.native_path);
+		} else if (r_changed && !job.changed) {
+			watch_unchanged_count++;
 		}
-		
-		if (preview_result["has_error"]) {
-			result["error"] = "Edit produces parse error, rolled back";
-			return result;
+		if (job.base_tree) {
+			ts_tree_delete(job.base_tree);
 		}
+		if (job.new_tree) {
+			ts_tree_delete(job.new_tree);
+		}
+	}
+	watch_jobs.clear();
+	if (!stale.empty()) {
+		std::lock_guard<std::mutex> lock(watch_mutex);
+		watch_pending.insert(watch_pending.end(), stale.begin(), stale.end());
 	}
+}
 
-	Dictionary text_result = apply_text_edits(file_path, text_edits, dry_run);
+Dictionary ASTManager::start_file_watcher(const String &root, const Dictionary &options) {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	result["success"] = false;
+	stop_file_watcher();
+
+	watch_root = root.ends_with("/") ? root : root + "/";
+	watch_max_threads = options.get("max_threads", 0);
+	FileWatcher::Options watch_options;
+	watch_options.debounce_msec = MAX((int)options.get("debounce_msec", 100), 0);
+	watch_options.max_delay_msec = MAX((int)options.get("max_delay_msec", 1000), (int)watch_options.debounce_msec);
+	PackedStringArray extensions;
+	extensions.push_back("gd");
+	if (options.has("extensions")) {
+		extensions = options["extensions"];
+	}
+	for (int i = 0; i < extensions.size(); i++) {
+		watch_options.extensions.push_back(("." + extensions[i]).utf8().get_data());
+	}
 
-	if (!text_result["success"]) {
-		result["error"] = text_result["error"];
+	std::string native_root = ProjectSettings::get_singleton()->globalize_path(watch_root).utf8().get_data();
+	std::string error;
+	bool started = file_watcher.start(native_root, watch_options, [this](std::vector<std::string> &&paths, bool overflowed) {
+		{
+			std::lock_guard<std::mutex> lock(watch_mutex);
+			watch_pending.insert(watch_pending.end(), paths.begin(), paths.end());
+			watch_overflowed = watch_overflowed || overflowed;
+		}
+		schedule_watch_poll();
+	},
+			error);
+	result["root"] = watch_root;
+	if (!started) {
+		result["error"] = String::utf8(error.c_str());
 		return result;
 	}
-
 	result["success"] = true;
-	result["new_source"] = text_result["new_source"];
-	result["has_error"] = text_result["has_error"];
-	result["error_count"] = text_result["error_count"];
-	result["edits_applied"] = text_result["edits_applied"];
-
 	return result;
 }
 
-String ASTManager::generate_diff(const String &old_text, const String &new_text, const String &file_name) {
-	if (old_text == new_text) {
-		return "";
+bool ASTManager::stop_file_watcher() {
+	PERF_METHOD_SCOPE();
+	bool was_running = file_watcher.is_running();
+	file_watcher.stop();
+	if (watch_job_thread.joinable()) {
+		// Let the job end; its results are dropped.
+		finish_watch_job(nullptr);
 	}
+	std::lock_guard<std::mutex> lock(watch_mutex);
+	watch_pending.clear();
+	watch_overflowed = false;
+	return was_running;
+}
 
-	std::string old_str = old_text.utf8().get_data();
-	std::string new_str = new_text.utf8().get_data();
-
-	std::vector<std::string> old_lines;
-	std::vector<std::string> new_lines;
+Dictionary ASTManager::poll_file_watcher() {
+	PERF_METHOD_SCOPE();
+	Dictionary result;
+	watch_poll_scheduled = false;
+	PackedStringArray changed;
+	if (watch_job_thread.joinable() && watch_job_done) {
+		finish_watch_job(&changed);
+	}
 
-	std::stringstream old_stream(old_str);
-	std::stringstream new_stream(new_str);
-	std::string line;
+	if (!watch_job_thread.joinable()) {
+		std::vector<std::string> paths;
+		bool overflowed = false;
+		{
+			std::lock_guard<std::mutex> lock(watch_mutex);
+			paths.swap(watch_pending);
+			overflowed = watch_overflowed;
+			watch_overflowed = false;
+		}
+		std::string native_root = file_watcher.get_root();
+		if (overflowed) {
+			// Events were lost: check every open file under the root.
+			for (const KeyValue<String, FileState> &kv : open_files) {
+				if (kv.key.begins_with(watch_root)) {
+					paths.push_back(native_root + "/" + kv.key.substr(watch_root.length()).utf8().get_data());
+				}
+			}
+		}
+		std::sort(paths.begin(), paths.end());
+		paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+		// Only open files are reloaded; the rest are for
+		// refresh_symbol_index().
+		for (const std::string &native_path : paths) {
+			if (native_path.size() <= native_root.size() || native_path.compare(0, native_root.size(), native_root) != 0) {
+				continue;
+			}
+			String file_path = watch_root + String::utf8(native_path.c_str() + native_root.size() + 1);
+			FileState *state = open_files.getptr(file_path);
+			if (!state) {
+				continue;
+			}
+			WatchJob job;
+			job.file_path = file_path;
+			job.native_path = native_path;
+			job.base_version = state->version;
+			job.base_bytes = state->source_bytes;
+			job.base_tree = state->tree ? ts_tree_copy(state->tree) : nullptr;
+			watch_jobs.push_back(std::move(job));
+		}
+		if (!watch_jobs.empty()) {
+			watch_job_done = false;
+			watch_job_thread = std::thread([this]() {
+				watch_parser_pool.run(watch_jobs.size(), watch_max_threads, [this](int index, TSParser *worker_parser) {
+					reload_watch_job(watch_jobs[index], worker_parser);
+				});
+				watch_job_done = true;
+				schedule_watch_poll();
+			});
+		}
+	}
 
-	while (std::getline(old_stream, line)) {
-		old_lines.push_back(line);
+	if (!changed.is_empty()) {
+		emit_signal("files_changed_on_disk", changed);
 	}
-	while (std::getline(new_stream, line)) {
-		new_lines.push_back(line);
+	bool busy = watch_job_thread.joinable();
+	if (!busy) {
+		std::lock_guard<std::mutex> lock(watch_mutex);
+		busy = !watch_pending.empty() || watch_overflowed;
 	}
-
-	dtl::Diff<std::string, std::vector<std::string>> diff(old_lines, new_lines);
-	diff.compose();
-
-	std::stringstream result;
-	result << "--- a/" << file_name.utf8().get_data() << "\n";
-	result << "+++ b/" << file_name.utf8().get_data() << "\n";
-
-	diff.composeUnifiedHunks();
-	diff.printUnifiedFormat(result);
-
-	return String::utf8(result.str().c_str());
+	result["success"] = true;
+	result["changed_files"] = changed;
+	result["busy"] = busy;
+	result["watching"] = file_watcher.is_running();
+	result["reload_count"] = (int64_t)watch_reload_count;
+	result["unchanged_count"] = (int64_t)watch_unchanged_count;
+	result["batch_count"] = (int64_t)file_watcher.get_batch_count();
+	return result;
 }
 
 Dictionary ASTManager::validate(const String &source_code) {
+	PERF_METHOD_SCOPE();
 	Dictionary result;
 	Array errors;
 
-	CharString utf8 = source_code.utf8();
+	CharString utf8 = source_to_utf8(source_code);
 	const char *source = utf8.get_data();
 	uint32_t source_len = utf8.length();
-	
-	TSTree *temp_tree = ts_parser_parse_string(parser, nullptr, source, source_len);
+
+	uint64_t hash = content_hash::hash_bytes(source, source_len);
+	TSTree *temp_tree = TreeCache::get_singleton().acquire(hash, reinterpret_cast<const uint8_t *>(source), source_len, nullptr);
+	if (!temp_tree) {
+		temp_tree = parse_source(parser, nullptr, source, source_len);
+		if (temp_tree) {
+			PackedByteArray bytes;
+			bytes.resize(source_len);
+			memcpy(bytes.ptrw(), source, source_len);
+			TreeCache::get_singleton().store(hash, bytes, temp_tree);
+		}
+	}
 
 	if (!temp_tree) {
 		result["valid"] = false;
@@ -823,6 +5476,7 @@ Dictionary ASTManager::validate(const String &source_code) {
 	uint32_t error_count = 0;
 
 	if (has_error) {
+		perf_stats::Scope scope(perf_stats::PHASE_ERROR_SCAN);
 		std::function<void(TSNode)> collect_errors = [&](TSNode node) {
 			if (ts_node_is_error(node) || ts_node_is_missing(node)) {
 				Dictionary error;
@@ -884,6 +5538,63 @@ void ASTManager::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("get_sexp", "file_path"), &ASTManager::get_sexp);
 	ClassDB::bind_method(D_METHOD("apply_text_edits", "file_path", "edits", "dry_run"), &ASTManager::apply_text_edits);
 	ClassDB::bind_method(D_METHOD("apply_node_edits", "file_path", "edits", "options"), &ASTManager::apply_node_edits);
-	ClassDB::bind_method(D_METHOD("generate_diff", "old_text", "new_text", "file_name"), &ASTManager::generate_diff);
+	ClassDB::bind_method(D_METHOD("stage_text_edits", "file_path", "edits"), &ASTManager::stage_text_edits);
+	ClassDB::bind_method(D_METHOD("stage_node_edits", "file_path", "edits", "options"), &ASTManager::stage_node_edits);
+	ClassDB::bind_method(D_METHOD("apply_workspace_edits", "file_edits", "options"), &ASTManager::apply_workspace_edits, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("undo", "file_path"), &ASTManager::undo);
+	ClassDB::bind_method(D_METHOD("redo", "file_path"), &ASTManager::redo);
+	ClassDB::bind_method(D_METHOD("configure_history", "options"), &ASTManager::configure_history);
+	ClassDB::bind_method(D_METHOD("get_history_info", "file_path"), &ASTManager::get_history_info);
+	ClassDB::bind_method(D_METHOD("configure_file_budget", "options"), &ASTManager::configure_file_budget);
+	ClassDB::bind_method(D_METHOD("get_file_budget_info"), &ASTManager::get_file_budget_info);
+	ClassDB::bind_method(D_METHOD("set_file_pinned", "file_path", "pinned"), &ASTManager::set_file_pinned, DEFVAL(true));
+	ClassDB::bind_method(D_METHOD("get_memory_stats", "options"), &ASTManager::get_memory_stats, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("add_memory_monitors", "prefix"), &ASTManager::add_memory_monitors, DEFVAL("AST Manager"));
+	ClassDB::bind_method(D_METHOD("remove_memory_monitors"), &ASTManager::remove_memory_monitors);
+	ClassDB::bind_method(D_METHOD("configure_allocator", "options"), &ASTManager::configure_allocator);
+	ClassDB::bind_method(D_METHOD("benchmark_allocators", "sources", "options"), &ASTManager::benchmark_allocators, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("configure_perf_stats", "options"), &ASTManager::configure_perf_stats);
+	ClassDB::bind_method(D_METHOD("get_perf_stats", "reset"), &ASTManager::get_perf_stats, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("configure_tree_cache", "options"), &ASTManager::configure_tree_cache);
+	ClassDB::bind_method(D_METHOD("get_tree_cache_stats", "reset"), &ASTManager::get_tree_cache_stats, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("generate_diff", "old_text", "new_text", "file_name", "options"), &ASTManager::generate_diff, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("generate_structured_diff", "old_text", "new_text", "options"), &ASTManager::generate_structured_diff, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("diff_ast", "old_file_path", "new_file_path", "options"), &ASTManager::diff_ast, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("diff_file", "file_path", "target", "options"), &ASTManager::diff_file, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("merge_text", "base_text", "ours_text", "theirs_text", "options"), &ASTManager::merge_text, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("merge_file", "file_path", "base_version", "theirs_text", "options"), &ASTManager::merge_file, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("apply_patch", "file_path", "unified_diff", "options"), &ASTManager::apply_patch, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("format_file", "file_path", "options"), &ASTManager::format_file, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("configure_highlighting", "options"), &ASTManager::configure_highlighting, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("get_line_highlighting", "file_path", "line"), &ASTManager::get_line_highlighting);
+	ClassDB::bind_method(D_METHOD("get_highlight_spans", "file_path", "first_line", "last_line"), &ASTManager::get_highlight_spans);
+	ClassDB::bind_method(D_METHOD("get_document_outline", "file_path"), &ASTManager::get_document_outline);
+	ClassDB::bind_method(D_METHOD("get_folding_ranges", "file_path"), &ASTManager::get_folding_ranges);
+	ClassDB::bind_method(D_METHOD("get_selection_ranges", "file_path", "positions"), &ASTManager::get_selection_ranges);
+	ClassDB::bind_method(D_METHOD("index_file", "file_path", "content"), &ASTManager::index_file);
+	ClassDB::bind_method(D_METHOD("index_files", "file_contents", "options"), &ASTManager::index_files, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("unindex_file", "file_path"), &ASTManager::unindex_file);
+	ClassDB::bind_method(D_METHOD("find_symbols", "name", "options"), &ASTManager::find_symbols, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("find_symbols_by_prefix", "prefix", "options"), &ASTManager::find_symbols_by_prefix, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("search_workspace_symbols", "query", "options"), &ASTManager::search_workspace_symbols, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("get_symbol_index_stats"), &ASTManager::get_symbol_index_stats);
+	ClassDB::bind_method(D_METHOD("find_definition", "file_path", "position"), &ASTManager::find_definition);
+	ClassDB::bind_method(D_METHOD("find_references", "target", "options"), &ASTManager::find_references, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("complete_at", "file_path", "row", "column", "prefix", "options"), &ASTManager::complete_at, DEFVAL(String()), DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("get_script_dependencies", "file_path", "options"), &ASTManager::get_script_dependencies, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("get_script_dependents", "file_path", "options"), &ASTManager::get_script_dependents, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("sort_scripts_by_dependencies", "file_paths", "options"), &ASTManager::sort_scripts_by_dependencies, DEFVAL(PackedStringArray()), DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("save_symbol_index", "path"), &ASTManager::save_symbol_index, DEFVAL(String()));
+	ClassDB::bind_method(D_METHOD("load_symbol_index", "path"), &ASTManager::load_symbol_index, DEFVAL(String()));
+	ClassDB::bind_method(D_METHOD("refresh_symbol_index", "file_paths", "options"), &ASTManager::refresh_symbol_index, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("load_lint_rules", "rules"), &ASTManager::load_lint_rules);
+	ClassDB::bind_method(D_METHOD("lint_file", "file_path"), &ASTManager::lint_file);
+	ClassDB::bind_method(D_METHOD("lint_files", "file_paths", "options"), &ASTManager::lint_files, DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("get_lint_stats", "reset"), &ASTManager::get_lint_stats, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("start_file_watcher", "root", "options"), &ASTManager::start_file_watcher, DEFVAL("res://"), DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("stop_file_watcher"), &ASTManager::stop_file_watcher);
+	ClassDB::bind_method(D_METHOD("poll_file_watcher"), &ASTManager::poll_file_watcher);
 	ClassDB::bind_method(D_METHOD("validate", "source_code"), &ASTManager::validate);
+
+	ADD_SIGNAL(MethodInfo("files_changed_on_disk", PropertyInfo(Variant::PACKED_STRING_ARRAY, "file_paths")));
 }
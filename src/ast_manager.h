@@ -4,27 +4,236 @@
 #include <godot_cpp/classes/ref_counted.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/variant/color.hpp>
 #include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
 #include <godot_cpp/variant/typed_array.hpp>
 #include <tree_sitter/api.h>
 
+#include "dependency_graph.h"
+#include "document_outline.h"
+#include "file_history.h"
+#include "file_watcher.h"
+#include "fuzzy_matcher.h"
+#include "highlight_cache.h"
+#include "line_diff.h"
+#include "lint_cache.h"
+#include "lint_engine.h"
+#include "name_trie.h"
+#include "parser_pool.h"
+#include "reference_index.h"
+#include "symbol_index.h"
+#include "symbol_index_file.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #define AST_MANAGER_VERSION "0.1.0"
 
 extern "C" const TSLanguage *tree_sitter_gdscript();
 
 using namespace godot;
 
+class StagedEdit;
+
+// Replaces [start_byte, end_byte) of a buffer with new_bytes.
+struct ByteEdit {
+	uint32_t start_byte = 0;
+	uint32_t end_byte = 0;
+	PackedByteArray new_bytes;
+};
+
 struct FileState {
 	PackedByteArray source_bytes;
 	TSTree *tree = nullptr;
+	// Identifies the content; changes on every edit and is restored by
+	// undo/redo. Staged edits compare against it.
+	uint64_t version = 0;
+	FileHistory history;
+	// Line table of source_bytes for line_index_version (0: not built yet).
+	// Rebuilt on demand once the version moves on.
+	std::vector<LineDiff::Line> line_index;
+	uint64_t line_index_version = 0;
+	// Filled on demand by the highlighting and outline APIs and carried
+	// over edits.
+	HighlightCache highlights;
+	DocumentOutline outline;
+	LintCache lint;
+	// Under a tree budget the tree of a file not used for a while is
+	// dropped along with the caches above and parsed again on the next
+	// access; the source stays. Pinned files are never evicted.
+	uint64_t last_access = 0;
+	int64_t tree_cost = 0;
+	bool evicted = false;
+	bool pinned = false;
+};
+
+// An open file the watcher saw change on disk, reloaded off the main thread
+// against a snapshot of its buffer and tree.
+struct WatchJob {
+	String file_path;
+	std::string native_path;
+	uint64_t base_version = 0;
+	PackedByteArray base_bytes;
+	// Copy owned by the job, edited in place for the reparse.
+	TSTree *base_tree = nullptr;
+	// Set when the file was read and differs from base_bytes.
+	bool changed = false;
+	Vector<ByteEdit> byte_edits;
+	PackedByteArray new_bytes;
+	TSTree *new_tree = nullptr;
 };
 
 class ASTManager : public RefCounted {
 	GDCLASS(ASTManager, RefCounted)
 
+	friend class StagedEdit;
+
 private:
 	TSParser *parser;
+	ParserPool parser_pool;
 	HashMap<String, FileState> open_files;
+	uint64_t version_counter = 0;
+
+	bool history_enabled = true;
+	int64_t history_max_bytes = 32 * 1024 * 1024;
+	int history_snapshot_interval = 4;
+	// Sum of the open files' history bytes, kept current wherever a history
+	// grows, shrinks or is cleared.
+	int64_t history_bytes = 0;
+
+	// Estimated bytes of the trees of the open files and their budget (0:
+	// unlimited); see access_open_file().
+	int64_t file_tree_bytes = 0;
+	int64_t file_tree_max_bytes = 0;
+	uint64_t file_access_clock = 0;
+	uint64_t file_eviction_count = 0;
+	uint64_t file_reparse_count = 0;
+
+	// tree-sitter bytes held by the compiled queries, measured when they
+	// were built.
+	int64_t highlight_query_bytes = 0;
+	int64_t lint_query_bytes = 0;
+	// Performance monitors added by add_memory_monitors().
+	PackedStringArray memory_monitors;
+
+	// Highlight query shared by every file; the generation changes with the
+	// configuration so stale per-file caches are dropped.
+	TSQuery *highlight_query = nullptr;
+	TSQueryCursor *highlight_cursor = nullptr;
+	uint64_t highlight_generation = 0;
+	std::vector<bool> highlight_capture_enabled;
+	Vector<Color> highlight_colors;
+	Color highlight_default_color;
+
+	// Declarations of the open files and of scripts added with
+	// index_file(s).
+	SymbolIndex symbol_index;
+	// Saved index of the project, mapped read-only. Entries of symbol_index
+	// shadow it: a file found in both is hidden here.
+	SymbolIndexFile symbol_index_file;
+	// Identifier occurrences of the same files.
+	ReferenceIndex reference_index;
+	// Names declared with class_name in either layer, for completion.
+	NameTrie global_names;
+	// Script dependencies of every file visible in either layer.
+	DependencyGraph dependency_graph;
+	// FuzzyMatcher::char_mask of every name of symbol_index and of
+	// symbol_index_file, by name id, filled in by update_name_masks().
+	std::vector<uint64_t> overlay_name_masks;
+	std::vector<uint64_t> mapped_name_masks;
+
+	// Lint rule pack; the generation changes with every load so cached
+	// diagnostics are rebuilt. Stats add up over lint_file(s) calls.
+	LintEngine lint_engine;
+	uint64_t lint_generation = 0;
+	std::vector<LintEngine::RuleStats> lint_stats;
+	uint64_t lint_file_count = 0;
+	uint64_t lint_scanned_bytes = 0;
+
+	// Reloads open files changed on disk. The watcher thread queues native
+	// paths and schedules poll_file_watcher(), which hands them to a job
+	// thread (reading and parsing with its own parsers) and commits what
+	// the previous job produced.
+	FileWatcher file_watcher;
+	String watch_root;
+	int watch_max_threads = 0;
+	std::mutex watch_mutex;
+	// Guarded by watch_mutex.
+	std::vector<std::string> watch_pending;
+	bool watch_overflowed = false;
+	std::atomic<bool> watch_poll_scheduled{ false };
+	ParserPool watch_parser_pool;
+	std::vector<WatchJob> watch_jobs;
+	std::thread watch_job_thread;
+	std::atomic<bool> watch_job_done{ false };
+	uint64_t watch_reload_count = 0;
+	uint64_t watch_unchanged_count = 0;
+
+	bool prepare_staged_buffer(const String &file_path, const TypedArray<Dictionary> &edits, Vector<ByteEdit> &r_byte_edits, PackedByteArray &r_bytes, TSTree *&r_edited_tree, Dictionary &result);
+	Ref<StagedEdit> make_staged_edit(const String &file_path, const Vector<ByteEdit> &byte_edits, const PackedByteArray &bytes, TSTree *new_tree, int edits_applied);
+	Ref<StagedEdit> stage_byte_edits(const String &file_path, const Vector<ByteEdit> &byte_edits, int edits_applied, Dictionary &result);
+	Ref<StagedEdit> stage_edits_internal(const String &file_path, const TypedArray<Dictionary> &edits, Dictionary &result);
+	Dictionary commit_staged_edit(StagedEdit *staged);
+	void enforce_history_budget();
+	// Replaces the tree of an open file in the budget's accounting; the old
+	// tree is the caller's.
+	void set_file_tree(FileState &state, TSTree *tree);
+	// The open file, its tree parsed again if it was evicted; null if not
+	// open. Marks the file as used and may evict others.
+	FileState *access_open_file(const String &file_path);
+	void evict_file_tree(FileState &state);
+	void enforce_file_budget();
+	Dictionary step_history(const String &file_path, bool redo);
+	// Rebuilds the source of a version still reachable through the file's
+	// history and, when r_tree is given, a tree for it (caller deletes).
+	// The optional counts are leading/trailing bytes no step in between
+	// touched, i.e. known to be equal in both versions.
+	bool restore_version(const FileState &state, uint64_t version, PackedByteArray &r_bytes, TSTree **r_tree,
+			uint32_t *r_unchanged_prefix = nullptr, uint32_t *r_unchanged_suffix = nullptr);
+	const std::vector<LineDiff::Line> &get_line_index(FileState &state);
+	// Carries line caches over byte_edits (in the current version's
+	// coordinates) before the file moves on to new_tree and new_version.
+	void update_caches_for_edit(FileState &state, const Vector<ByteEdit> &byte_edits, TSTree *new_tree, uint64_t new_version);
+	// Makes sure highlight lines [first, last] are computed; false if the
+	// file has no tree or the range is past its end.
+	bool prepare_highlights(FileState &state, uint32_t first, uint32_t last);
+	// Refreshes the outline of an open file and its entry in symbol_index.
+	void index_open_file(const String &file_path, FileState &state);
+	void update_index_entry(const std::string &path, const DocumentOutline &outline, const char *data);
+	bool remove_index_entry(const std::string &path);
+	// Hides the mapped copies of files symbol_index holds.
+	void hide_shadowed_index_files();
+	// Adds or removes the class_names of a symbol_index file in global_names.
+	void count_global_names(uint32_t file, bool add);
+	// Hides a mapped file along with its class_names.
+	void hide_mapped_file(uint32_t file);
+	void rebuild_global_names();
+	// Sets the dependencies of a symbol_index file from its entry and its
+	// names in reference_index.
+	void update_dependency_entry(const std::string &path);
+	void rebuild_dependency_graph();
+	Dictionary query_dependencies(const String &file_path, const Dictionary &options, bool reverse);
+	// Heap bytes of the symbol, reference and dependency indexes and the
+	// global name trie (the mapped index not included).
+	int64_t get_index_memory_bytes() const;
+	Variant get_memory_monitor(const String &key);
+	// Callable from any thread; at most one poll is queued at a time.
+	void schedule_watch_poll();
+	// Joins the job thread and commits its results into r_changed, or drops
+	// them if r_changed is null.
+	void finish_watch_job(PackedStringArray *r_changed);
+	// Computes the masks of names added since the last call. Names are
+	// never dropped from symbol_index; the mapped masks are cleared when
+	// another file is mapped.
+	void update_name_masks();
+	// Declarations of name from both index layers.
+	void collect_named_symbols(std::string_view name, int kind, Array &r_symbols);
+	// Finds the declaration of the identifier node in its own file: the
+	// innermost scope declaring the name wins. r_scope is the scope node.
+	bool resolve_local_definition(const std::string &path, std::string_view name, TSNode root, TSNode node, TSNode &r_definition, TSNode &r_scope);
+	bool resolve_node_edits(const String &file_path, const TypedArray<Dictionary> &edits, const Dictionary &options, TypedArray<Dictionary> &r_text_edits, Dictionary &result);
 
 protected:
 	static void _bind_methods();
@@ -50,8 +259,64 @@ public:
 
 	Dictionary apply_text_edits(const String &file_path, const TypedArray<Dictionary> &edits, bool dry_run);
 	Dictionary apply_node_edits(const String &file_path, const TypedArray<Dictionary> &edits, const Dictionary &options);
+	Dictionary stage_text_edits(const String &file_path, const TypedArray<Dictionary> &edits);
+	Dictionary stage_node_edits(const String &file_path, const TypedArray<Dictionary> &edits, const Dictionary &options);
+	Dictionary apply_workspace_edits(const Dictionary &file_edits, const Dictionary &options);
+
+	Dictionary undo(const String &file_path);
+	Dictionary redo(const String &file_path);
+	void configure_history(const Dictionary &options);
+	Dictionary get_history_info(const String &file_path);
+	void configure_file_budget(const Dictionary &options);
+	Dictionary get_file_budget_info();
+	bool set_file_pinned(const String &file_path, bool pinned = true);
+	Dictionary get_memory_stats(const Dictionary &options = Dictionary());
+	bool add_memory_monitors(const String &prefix = "AST Manager");
+	void remove_memory_monitors();
+	Dictionary configure_allocator(const Dictionary &options);
+	Dictionary benchmark_allocators(const PackedStringArray &sources, const Dictionary &options = Dictionary());
+	void configure_perf_stats(const Dictionary &options);
+	Dictionary get_perf_stats(bool reset = false);
+	void configure_tree_cache(const Dictionary &options);
+	Dictionary get_tree_cache_stats(bool reset = false);
 
-	String generate_diff(const String &old_text, const String &new_text, const String &file_name);
+	String generate_diff(const String &old_text, const String &new_text, const String &file_name, const Dictionary &options = Dictionary());
+	Dictionary generate_structured_diff(const String &old_text, const String &new_text, const Dictionary &options = Dictionary());
+	Dictionary diff_ast(const String &old_file_path, const String &new_file_path, const Dictionary &options = Dictionary());
+	Dictionary diff_file(const String &file_path, const Variant &target, const Dictionary &options = Dictionary());
+	Dictionary merge_text(const String &base_text, const String &ours_text, const String &theirs_text, const Dictionary &options = Dictionary());
+	Dictionary merge_file(const String &file_path, int64_t base_version, const String &theirs_text, const Dictionary &options = Dictionary());
+	Dictionary apply_patch(const String &file_path, const String &unified_diff, const Dictionary &options = Dictionary());
+	Dictionary format_file(const String &file_path, const Dictionary &options = Dictionary());
+	Dictionary configure_highlighting(const Dictionary &options = Dictionary());
+	Dictionary get_line_highlighting(const String &file_path, int line);
+	PackedInt32Array get_highlight_spans(const String &file_path, int first_line, int last_line);
+	Dictionary get_document_outline(const String &file_path);
+	Dictionary get_folding_ranges(const String &file_path);
+	Dictionary get_selection_ranges(const String &file_path, const PackedInt32Array &positions);
+	Dictionary index_file(const String &file_path, const String &content);
+	Dictionary index_files(const Dictionary &file_contents, const Dictionary &options = Dictionary());
+	bool unindex_file(const String &file_path);
+	Dictionary find_symbols(const String &name, const Dictionary &options = Dictionary());
+	Dictionary find_symbols_by_prefix(const String &prefix, const Dictionary &options = Dictionary());
+	Dictionary search_workspace_symbols(const String &query, const Dictionary &options = Dictionary());
+	Dictionary get_symbol_index_stats();
+	Dictionary find_definition(const String &file_path, int position);
+	Dictionary find_references(const Variant &target, const Dictionary &options = Dictionary());
+	Dictionary complete_at(const String &file_path, int row, int column, const String &prefix = String(), const Dictionary &options = Dictionary());
+	Dictionary get_script_dependencies(const String &file_path, const Dictionary &options = Dictionary());
+	Dictionary get_script_dependents(const String &file_path, const Dictionary &options = Dictionary());
+	Dictionary sort_scripts_by_dependencies(const PackedStringArray &file_paths = PackedStringArray(), const Dictionary &options = Dictionary());
+	Dictionary save_symbol_index(const String &path = String());
+	Dictionary load_symbol_index(const String &path = String());
+	Dictionary refresh_symbol_index(const PackedStringArray &file_paths, const Dictionary &options = Dictionary());
+	Dictionary load_lint_rules(const Array &rules);
+	Dictionary lint_file(const String &file_path);
+	Dictionary lint_files(const PackedStringArray &file_paths, const Dictionary &options = Dictionary());
+	Dictionary get_lint_stats(bool reset = false);
+	Dictionary start_file_watcher(const String &root = "res://", const Dictionary &options = Dictionary());
+	bool stop_file_watcher();
+	Dictionary poll_file_watcher();
 	Dictionary validate(const String &source_code);
 };
 
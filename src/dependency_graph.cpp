@@ -0,0 +1,350 @@
+#include "dependency_graph.h"
+
+#include "memory_usage.h"
+
+#include <algorithm>
+
+template <typename T, typename Predicate>
+static void erase_unordered(std::vector<T> &r_items, Predicate predicate) {
+	for (size_t i = 0; i < r_items.size(); i++) {
+		if (predicate(r_items[i])) {
+			r_items[i] = r_items.back();
+			r_items.pop_back();
+			return;
+		}
+	}
+}
+
+uint32_t DependencyGraph::intern(const std::string &text) {
+	auto found = key_ids.find(text);
+	if (found != key_ids.end()) {
+		return found->second;
+	}
+	uint32_t id = keys.size();
+	auto inserted = key_ids.emplace(text, id).first;
+	key_texts.push_back(&inserted->first);
+	keys.emplace_back();
+	return id;
+}
+
+void DependencyGraph::unlink(uint32_t file) {
+	File &entry = files[file];
+	for (uint32_t key : entry.class_keys) {
+		erase_unordered(keys[key].declarers, [&](uint32_t declarer) { return declarer == file; });
+	}
+	for (const Edge &target : entry.targets) {
+		erase_unordered(keys[target.file].dependents, [&](const Edge &dependent) { return dependent.file == file; });
+	}
+	target_count -= entry.targets.size();
+	entry.class_keys.clear();
+	entry.targets.clear();
+}
+
+void DependencyGraph::add_providers(uint32_t key, uint32_t kinds, uint32_t skip, std::vector<Edge> &r_edges) const {
+	const Key &entry = keys[key];
+	if (entry.file != NONE && entry.file != skip) {
+		r_edges.push_back({ entry.file, kinds });
+	}
+	for (uint32_t declarer : entry.declarers) {
+		if (declarer != skip) {
+			r_edges.push_back({ declarer, kinds });
+		}
+	}
+}
+
+void DependencyGraph::merge_edges(std::vector<Edge> &r_edges) {
+	std::sort(r_edges.begin(), r_edges.end(), [](const Edge &a, const Edge &b) { return a.file < b.file; });
+	size_t count = 0;
+	for (const Edge &edge : r_edges) {
+		if (count > 0 && r_edges[count - 1].file == edge.file) {
+			r_edges[count - 1].kinds |= edge.kinds;
+		} else {
+			r_edges[count++] = edge;
+		}
+	}
+	r_edges.resize(count);
+}
+
+uint32_t DependencyGraph::set_file(const std::string &path, const std::vector<std::string> &class_names, const std::vector<Dependency> &dependencies) {
+	uint32_t path_key = intern(path);
+	uint32_t file = keys[path_key].file;
+	if (file == NONE) {
+		if (free_files.empty()) {
+			file = files.size();
+			files.emplace_back();
+		} else {
+			file = free_files.back();
+			free_files.pop_back();
+		}
+		files[file].path_key = path_key;
+		keys[path_key].file = file;
+		file_count++;
+	} else {
+		unlink(file);
+	}
+
+	// Interning first: it may grow keys.
+	std::vector<uint32_t> class_keys;
+	for (const std::string &name : class_names) {
+		class_keys.push_back(intern(name));
+	}
+	std::sort(class_keys.begin(), class_keys.end());
+	class_keys.erase(std::unique(class_keys.begin(), class_keys.end()), class_keys.end());
+	std::vector<Edge> targets;
+	for (const Dependency &dependency : dependencies) {
+		if (!dependency.target.empty() && dependency.kinds != 0) {
+			targets.push_back({ intern(dependency.target), dependency.kinds });
+		}
+	}
+	merge_edges(targets);
+
+	for (uint32_t key : class_keys) {
+		keys[key].declarers.push_back(file);
+	}
+	for (const Edge &target : targets) {
+		keys[target.file].dependents.push_back({ file, target.kinds });
+	}
+	target_count += targets.size();
+	files[file].class_keys.swap(class_keys);
+	files[file].targets.swap(targets);
+	return file;
+}
+
+bool DependencyGraph::remove_file(const std::string &path) {
+	uint32_t file = find_file(path);
+	if (file == NONE) {
+		return false;
+	}
+	unlink(file);
+	keys[files[file].path_key].file = NONE;
+	files[file].path_key = NONE;
+	free_files.push_back(file);
+	file_count--;
+	return true;
+}
+
+void DependencyGraph::clear() {
+	key_ids.clear();
+	key_texts.clear();
+	keys.clear();
+	files.clear();
+	free_files.clear();
+	file_count = 0;
+	target_count = 0;
+}
+
+uint32_t DependencyGraph::find_file(const std::string &path) const {
+	auto found = key_ids.find(path);
+	return found != key_ids.end() ? keys[found->second].file : NONE;
+}
+
+void DependencyGraph::get_files(std::vector<uint32_t> &r_files) const {
+	r_files.clear();
+	r_files.reserve(file_count);
+	for (uint32_t file = 0; file < files.size(); file++) {
+		if (files[file].path_key != NONE) {
+			r_files.push_back(file);
+		}
+	}
+}
+
+void DependencyGraph::get_targets(uint32_t file, uint32_t kinds, std::vector<std::string> &r_targets) const {
+	r_targets.clear();
+	for (const Edge &target : files[file].targets) {
+		if (target.kinds & kinds) {
+			r_targets.push_back(*key_texts[target.file]);
+		}
+	}
+}
+
+void DependencyGraph::get_dependencies(uint32_t file, uint32_t kinds, std::vector<Edge> &r_edges) const {
+	r_edges.clear();
+	for (const Edge &target : files[file].targets) {
+		if (target.kinds & kinds) {
+			add_providers(target.file, target.kinds & kinds, file, r_edges);
+		}
+	}
+	merge_edges(r_edges);
+}
+
+void DependencyGraph::get_dependents(uint32_t file, uint32_t kinds, std::vector<Edge> &r_edges) const {
+	r_edges.clear();
+	auto add_dependents = [&](uint32_t key) {
+		for (const Edge &dependent : keys[key].dependents) {
+			if ((dependent.kinds & kinds) && dependent.file != file) {
+				r_edges.push_back({ dependent.file, dependent.kinds & kinds });
+			}
+		}
+	};
+	add_dependents(files[file].path_key);
+	for (uint32_t key : files[file].class_keys) {
+		add_dependents(key);
+	}
+	merge_edges(r_edges);
+}
+
+void DependencyGraph::get_closure(const std::vector<uint32_t> &roots, uint32_t kinds, bool reverse, std::vector<Edge> &r_edges) const {
+	r_edges.clear();
+	std::vector<uint8_t> visited(files.size(), 0);
+	for (uint32_t root : roots) {
+		visited[root] = 1;
+	}
+	std::vector<Edge> edges;
+	// r_edges doubles as the queue; roots are expanded first.
+	for (size_t next = 0; next < roots.size() + r_edges.size(); next++) {
+		uint32_t file = next < roots.size() ? roots[next] : r_edges[next - roots.size()].file;
+		if (reverse) {
+			get_dependents(file, kinds, edges);
+		} else {
+			get_dependencies(file, kinds, edges);
+		}
+		for (const Edge &edge : edges) {
+			if (!visited[edge.file]) {
+				visited[edge.file] = 1;
+				r_edges.push_back(edge);
+			}
+		}
+	}
+}
+
+bool DependencyGraph::sort(const std::vector<uint32_t> &file_ids, uint32_t kinds, std::vector<uint32_t> &r_order, std::vector<uint32_t> &r_cyclic) const {
+	r_order.clear();
+	r_cyclic.clear();
+	std::vector<uint32_t> all;
+	if (file_ids.empty()) {
+		get_files(all);
+	}
+	const std::vector<uint32_t> &nodes = file_ids.empty() ? all : file_ids;
+
+	std::vector<uint32_t> positions(files.size(), NONE);
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		positions[nodes[i]] = i;
+	}
+	// Edges run from a dependency to its dependent, within nodes.
+	std::vector<std::vector<uint32_t>> outgoing(nodes.size());
+	std::vector<std::vector<uint32_t>> incoming(nodes.size());
+	std::vector<Edge> edges;
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		get_dependencies(nodes[i], kinds, edges);
+		for (const Edge &edge : edges) {
+			uint32_t position = positions[edge.file];
+			if (position != NONE && position != i) {
+				outgoing[position].push_back(i);
+				incoming[i].push_back(position);
+			}
+		}
+	}
+
+	// Kahn's algorithm, taking ready files in input order.
+	std::vector<uint32_t> in_degree(nodes.size());
+	std::vector<uint32_t> ready;
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		in_degree[i] = incoming[i].size();
+		if (in_degree[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+	std::vector<uint8_t> placed(nodes.size(), 0);
+	for (size_t next = 0; next < ready.size(); next++) {
+		uint32_t i = ready[next];
+		placed[i] = 1;
+		r_order.push_back(nodes[i]);
+		for (uint32_t dependent : outgoing[i]) {
+			if (--in_degree[dependent] == 0) {
+				ready.push_back(dependent);
+			}
+		}
+	}
+	if (r_order.size() == nodes.size()) {
+		return true;
+	}
+
+	// What is left hangs off a cycle. Peeling the files nothing left
+	// depends on, from the other end, leaves the cycles themselves.
+	std::vector<uint32_t> out_degree(nodes.size(), 0);
+	std::vector<uint32_t> peeled;
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		if (placed[i]) {
+			continue;
+		}
+		for (uint32_t dependent : outgoing[i]) {
+			out_degree[i] += !placed[dependent];
+		}
+		if (out_degree[i] == 0) {
+			peeled.push_back(i);
+		}
+	}
+	for (size_t next = 0; next < peeled.size(); next++) {
+		uint32_t i = peeled[next];
+		placed[i] = 2;
+		for (uint32_t dependency : incoming[i]) {
+			if (!placed[dependency] && --out_degree[dependency] == 0) {
+				peeled.push_back(dependency);
+			}
+		}
+	}
+	for (uint32_t i = 0; i < nodes.size(); i++) {
+		if (!placed[i]) {
+			r_cyclic.push_back(nodes[i]);
+			r_order.push_back(nodes[i]);
+		}
+	}
+	// Peeled last-dependent first, so reversed they are in order.
+	for (size_t k = peeled.size(); k-- > 0;) {
+		r_order.push_back(nodes[peeled[k]]);
+	}
+	return false;
+}
+
+std::string DependencyGraph::resolve_path(const std::string &from_path, const std::string &path) {
+	std::string combined;
+	if (path.find("://") != std::string::npos || (!path.empty() && path[0] == '/')) {
+		combined = path;
+	} else {
+		// Up to the last slash, which for "res://a.gd" is the scheme's.
+		size_t slash = from_path.rfind('/');
+		combined = (slash == std::string::npos ? std::string() : from_path.substr(0, slash + 1)) + path;
+	}
+
+	size_t scheme = combined.find("://");
+	size_t start = scheme != std::string::npos ? scheme + 3 : (!combined.empty() && combined[0] == '/') ? 1 : 0;
+	std::vector<std::string> segments;
+	for (size_t begin = start; begin <= combined.size();) {
+		size_t end = combined.find('/', begin);
+		if (end == std::string::npos) {
+			end = combined.size();
+		}
+		std::string segment = combined.substr(begin, end - begin);
+		if (segment == "..") {
+			if (!segments.empty()) {
+				segments.pop_back();
+			}
+		} else if (!segment.empty() && segment != ".") {
+			segments.push_back(std::move(segment));
+		}
+		begin = end + 1;
+	}
+
+	std::string resolved = combined.substr(0, start);
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (i > 0) {
+			resolved.push_back('/');
+		}
+		resolved.append(segments[i]);
+	}
+	return resolved;
+}
+
+uint64_t DependencyGraph::get_memory_bytes() const {
+	uint64_t bytes = memory_usage::of(key_ids) + memory_usage::of(key_texts) + memory_usage::of(keys) + memory_usage::of(files) + memory_usage::of(free_files);
+	for (const auto &entry : key_ids) {
+		bytes += memory_usage::of(entry.first);
+	}
+	for (const Key &key : keys) {
+		bytes += memory_usage::of(key.declarers) + memory_usage::of(key.dependents);
+	}
+	for (const File &file : files) {
+		bytes += memory_usage::of(file.class_keys) + memory_usage::of(file.targets);
+	}
+	return bytes;
+}
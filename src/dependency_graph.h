@@ -0,0 +1,116 @@
+#ifndef DEPENDENCY_GRAPH_H
+#define DEPENDENCY_GRAPH_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Which scripts depend on which, through extends, preload(), load() and
+// uses of global class names.
+//
+// A file depends on keys: script paths and class names. A key resolves to
+// the file at that path and the files declaring that class_name, so edges
+// are never stored between files: setting one file updates its own keys
+// and nothing else, and a class_name appearing or moving re-targets every
+// use of it at once. Keys nothing provides (built-in classes, locals that
+// happen to be mentioned) cost a slot but never become edges.
+class DependencyGraph {
+public:
+	static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+	enum Kind {
+		KIND_EXTENDS = 1 << 0,
+		KIND_PRELOAD = 1 << 1,
+		KIND_LOAD = 1 << 2,
+		KIND_CLASS_REFERENCE = 1 << 3,
+		KIND_ALL = (1 << 4) - 1,
+	};
+
+	// Input of set_file(): a script path (already resolved) or a class name,
+	// with the mask of the ways the file uses it.
+	struct Dependency {
+		std::string target;
+		uint32_t kinds = 0;
+	};
+
+	// Another file and the mask of kinds linking the two.
+	struct Edge {
+		uint32_t file = NONE;
+		uint32_t kinds = 0;
+	};
+
+private:
+	struct Key {
+		// The file at this path, NONE if none.
+		uint32_t file = NONE;
+		// Files declaring this class name, unordered.
+		std::vector<uint32_t> declarers;
+		// Files depending on the key (Edge::file), unordered.
+		std::vector<Edge> dependents;
+	};
+
+	struct File {
+		// NONE while the slot is free.
+		uint32_t path_key = NONE;
+		std::vector<uint32_t> class_keys;
+		// Keys the file depends on (Edge::file is a key id), sorted.
+		std::vector<Edge> targets;
+	};
+
+	std::unordered_map<std::string, uint32_t> key_ids;
+	std::vector<const std::string *> key_texts;
+	std::vector<Key> keys;
+	std::vector<File> files;
+	std::vector<uint32_t> free_files;
+	uint32_t file_count = 0;
+	uint32_t target_count = 0;
+
+	uint32_t intern(const std::string &text);
+	void unlink(uint32_t file);
+	// Appends the files providing key, other than skip.
+	void add_providers(uint32_t key, uint32_t kinds, uint32_t skip, std::vector<Edge> &r_edges) const;
+	// Sorts by file and merges the kinds of duplicates.
+	static void merge_edges(std::vector<Edge> &r_edges);
+
+public:
+	// Replaces what path declares and depends on, adding the file if
+	// needed. Returns its id.
+	uint32_t set_file(const std::string &path, const std::vector<std::string> &class_names, const std::vector<Dependency> &dependencies);
+	bool remove_file(const std::string &path);
+	void clear();
+
+	// NONE if the file is not in the graph.
+	uint32_t find_file(const std::string &path) const;
+	const std::string &get_file_path(uint32_t file) const { return *key_texts[files[file].path_key]; }
+	// Ids of the files in the graph.
+	void get_files(std::vector<uint32_t> &r_files) const;
+	// Keys of the given kinds the file depends on, as passed to set_file().
+	void get_targets(uint32_t file, uint32_t kinds, std::vector<std::string> &r_targets) const;
+
+	// Files the file uses through one of kinds, sorted by id.
+	void get_dependencies(uint32_t file, uint32_t kinds, std::vector<Edge> &r_edges) const;
+	// Files using the file through one of kinds, sorted by id.
+	void get_dependents(uint32_t file, uint32_t kinds, std::vector<Edge> &r_edges) const;
+	// Everything reachable from roots (roots excluded) by following
+	// dependencies, or dependents if reverse, in breadth-first order. Each
+	// edge carries the kinds of the link it was first reached through.
+	void get_closure(const std::vector<uint32_t> &roots, uint32_t kinds, bool reverse, std::vector<Edge> &r_edges) const;
+	// Orders file_ids so every file comes after the ones it depends on (an
+	// empty list means the whole graph). Files on a cycle, or on a path
+	// between two, cannot be ordered: they are appended at the end and
+	// listed in r_cyclic. Returns false if there were any.
+	bool sort(const std::vector<uint32_t> &file_ids, uint32_t kinds, std::vector<uint32_t> &r_order, std::vector<uint32_t> &r_cyclic) const;
+
+	uint32_t get_file_count() const { return file_count; }
+	// Total of distinct keys per file.
+	uint32_t get_target_count() const { return target_count; }
+	uint32_t get_key_count() const { return keys.size(); }
+	uint64_t get_memory_bytes() const;
+
+	// Key of a script path as written in the script at from_path: relative
+	// paths resolve against its directory, "." and ".." segments fold.
+	static std::string resolve_path(const std::string &from_path, const std::string &path);
+};
+
+#endif // DEPENDENCY_GRAPH_H
@@ -0,0 +1,409 @@
+#include "document_outline.h"
+
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const struct {
+	const char *type;
+	DocumentOutline::SymbolKind kind;
+} SYMBOL_TYPES[] = {
+	{ "class_name_statement", DocumentOutline::SYMBOL_CLASS_NAME },
+	{ "class_definition", DocumentOutline::SYMBOL_CLASS },
+	{ "function_definition", DocumentOutline::SYMBOL_FUNCTION },
+	{ "constructor_definition", DocumentOutline::SYMBOL_FUNCTION },
+	{ "signal_statement", DocumentOutline::SYMBOL_SIGNAL },
+	{ "enum_definition", DocumentOutline::SYMBOL_ENUM },
+	{ "const_statement", DocumentOutline::SYMBOL_CONSTANT },
+	{ "variable_statement", DocumentOutline::SYMBOL_VARIABLE },
+	{ "export_variable_statement", DocumentOutline::SYMBOL_VARIABLE },
+	{ "onready_variable_statement", DocumentOutline::SYMBOL_VARIABLE },
+};
+
+static bool ends_with(const char *text, const char *suffix) {
+	size_t text_length = strlen(text);
+	size_t suffix_length = strlen(suffix);
+	return text_length >= suffix_length && strcmp(text + text_length - suffix_length, suffix) == 0;
+}
+
+// Last row with content: a node ending at column 0 stops at the newline of
+// the row before.
+static uint32_t last_row(TSNode node) {
+	TSPoint start = ts_node_start_point(node);
+	TSPoint end = ts_node_end_point(node);
+	return (end.column == 0 && end.row > start.row) ? end.row - 1 : end.row;
+}
+
+void DocumentOutline::collect_symbols(TSTreeCursor *cursor, const char *data, uint32_t parent, Section &section) {
+	TSNode node = ts_tree_cursor_current_node(cursor);
+	if (!ts_node_is_named(node)) {
+		return;
+	}
+
+	const char *type = ts_node_type(node);
+	for (const auto &entry : SYMBOL_TYPES) {
+		if (strcmp(type, entry.type) != 0) {
+			continue;
+		}
+		Symbol symbol;
+		symbol.kind = entry.kind;
+		symbol.start_byte = ts_node_start_byte(node) - section.start_byte;
+		symbol.end_byte = ts_node_end_byte(node) - section.start_byte;
+		symbol.start_row = ts_node_start_point(node).row - section.start_row;
+		symbol.end_row = last_row(node) - section.start_row;
+		symbol.parent = parent;
+		TSNode name = ts_node_child_by_field_name(node, "name", 4);
+		if (!ts_node_is_null(name)) {
+			uint32_t name_start = ts_node_start_byte(name);
+			uint32_t name_end = ts_node_end_byte(name);
+			symbol.name.assign(data + name_start, name_end - name_start);
+			symbol.name_start_byte = name_start - section.start_byte;
+			symbol.name_end_byte = name_end - section.start_byte;
+		} else {
+			symbol.name_start_byte = symbol.start_byte;
+			symbol.name_end_byte = symbol.start_byte;
+		}
+		section.symbols.push_back(symbol);
+
+		// Only classes have members worth listing; function bodies hold
+		// locals.
+		if (entry.kind != SYMBOL_CLASS) {
+			return;
+		}
+		parent = section.symbols.size() - 1;
+		break;
+	}
+
+	if (ts_tree_cursor_goto_first_child(cursor)) {
+		do {
+			collect_symbols(cursor, data, parent, section);
+		} while (ts_tree_cursor_goto_next_sibling(cursor));
+		ts_tree_cursor_goto_parent(cursor);
+	}
+}
+
+// Node types whose identifier children at the given position declare a
+// name; declarations with a `name` node need no entry.
+static const struct {
+	const char *type;
+	int named_index;
+} DECLARING_PARENTS[] = {
+	{ "parameters", -1 },
+	{ "typed_parameter", 0 },
+	{ "default_parameter", 0 },
+	{ "typed_default_parameter", 0 },
+	{ "for_statement", 0 },
+	{ "enumerator", 0 },
+};
+
+void DocumentOutline::collect_identifiers(TSTreeCursor *cursor, const char *data, const char *parent_type, uint32_t named_index, Section &section) {
+	TSNode node = ts_tree_cursor_current_node(cursor);
+	const char *type = ts_node_type(node);
+	if (strcmp(type, "call") == 0 && ts_node_named_child_count(node) >= 2) {
+		TSNode callee = ts_node_named_child(node, 0);
+		TSNode arguments = ts_node_named_child(node, 1);
+		if (strcmp(ts_node_type(callee), "identifier") == 0 && strcmp(ts_node_type(arguments), "arguments") == 0 &&
+				ts_node_named_child_count(arguments) > 0) {
+			uint32_t callee_start = ts_node_start_byte(callee);
+			std::string name(data + callee_start, ts_node_end_byte(callee) - callee_start);
+			TSNode path = ts_node_named_child(arguments, 0);
+			uint32_t start = ts_node_start_byte(path);
+			uint32_t end = ts_node_end_byte(path);
+			if ((name == "preload" || name == "load") && strcmp(ts_node_type(path), "string") == 0 && end - start >= 2) {
+				section.loads.push_back({ std::string(data + start + 1, end - start - 2), name == "preload" });
+			}
+		}
+	}
+	bool is_name = strcmp(type, "name") == 0;
+	if (is_name || strcmp(type, "identifier") == 0) {
+		Identifier identifier;
+		identifier.start_byte = ts_node_start_byte(node) - section.start_byte;
+		identifier.end_byte = ts_node_end_byte(node) - section.start_byte;
+		if (is_name) {
+			identifier.role = ROLE_DEFINITION;
+		} else {
+			for (const auto &entry : DECLARING_PARENTS) {
+				if (strcmp(parent_type, entry.type) == 0 && (entry.named_index < 0 || (uint32_t)entry.named_index == named_index)) {
+					identifier.role = ROLE_DEFINITION;
+					break;
+				}
+			}
+		}
+		section.identifiers.push_back(identifier);
+		return;
+	}
+	// Annotation names are keywords; strings and comments hold no code.
+	if (strcmp(type, "annotation") == 0 || strcmp(type, "string") == 0 || strcmp(type, "comment") == 0) {
+		return;
+	}
+
+	if (ts_tree_cursor_goto_first_child(cursor)) {
+		uint32_t index = 0;
+		do {
+			collect_identifiers(cursor, data, type, index, section);
+			if (ts_node_is_named(ts_tree_cursor_current_node(cursor))) {
+				index++;
+			}
+		} while (ts_tree_cursor_goto_next_sibling(cursor));
+		ts_tree_cursor_goto_parent(cursor);
+	}
+}
+
+void DocumentOutline::collect_folds(TSTreeCursor *cursor, const char *data, uint32_t header_row, Section &section) {
+	TSNode node = ts_tree_cursor_current_node(cursor);
+	const char *type = ts_node_type(node);
+	TSPoint start = ts_node_start_point(node);
+
+	if (strcmp(type, "comment") == 0) {
+		// Only comments with nothing but indentation before them.
+		uint32_t start_byte = ts_node_start_byte(node);
+		bool standalone = true;
+		for (uint32_t i = start_byte - start.column; i < start_byte && standalone; i++) {
+			standalone = data[i] == ' ' || data[i] == '\t';
+		}
+		if (standalone) {
+			section.comment_rows.push_back(start.row - section.start_row);
+		}
+		return;
+	}
+
+	if (!ts_node_is_named(node)) {
+		return;
+	}
+	uint32_t end_row = last_row(node);
+	bool is_string = strcmp(type, "string") == 0;
+	// A block folds from the line of the statement it belongs to.
+	if (strcmp(type, "block") == 0 || ends_with(type, "_body") || strcmp(type, "body") == 0) {
+		if (end_row > header_row) {
+			section.folds.push_back({ header_row - section.start_row, end_row - section.start_row, FOLD_BLOCK });
+		}
+	} else if (end_row > start.row) {
+		if (is_string) {
+			section.folds.push_back({ start.row - section.start_row, end_row - section.start_row, FOLD_LITERAL });
+		} else if (ts_node_child_count(node) > 0) {
+			TSNode first = ts_node_child(node, 0);
+			const char *first_type = ts_node_type(first);
+			if (!ts_node_is_named(first) && (strcmp(first_type, "(") == 0 || strcmp(first_type, "[") == 0 || strcmp(first_type, "{") == 0)) {
+				section.folds.push_back({ start.row - section.start_row, end_row - section.start_row, FOLD_LITERAL });
+			}
+		}
+	}
+
+	if (!is_string && ts_tree_cursor_goto_first_child(cursor)) {
+		do {
+			collect_folds(cursor, data, start.row, section);
+		} while (ts_tree_cursor_goto_next_sibling(cursor));
+		ts_tree_cursor_goto_parent(cursor);
+	}
+}
+
+void DocumentOutline::extract(TSNode node, const char *data, Section &r_section) {
+	r_section.start_byte = ts_node_start_byte(node);
+	r_section.end_byte = ts_node_end_byte(node);
+	r_section.start_row = ts_node_start_point(node).row;
+	r_section.valid = true;
+	r_section.symbols.clear();
+	r_section.identifiers.clear();
+	r_section.folds.clear();
+	r_section.comment_rows.clear();
+	r_section.extends.clear();
+	r_section.loads.clear();
+	if (strcmp(ts_node_type(node), "extends_statement") == 0 && ts_node_named_child_count(node) > 0) {
+		TSNode target = ts_node_named_child(node, 0);
+		uint32_t start = ts_node_start_byte(target);
+		uint32_t end = ts_node_end_byte(target);
+		// A path is a string literal; keep what is between the quotes.
+		if (end - start >= 2 && (data[start] == '"' || data[start] == '\'')) {
+			start++;
+			end--;
+		}
+		r_section.extends.assign(data + start, end - start);
+	}
+
+	TSTreeCursor cursor = ts_tree_cursor_new(node);
+	collect_symbols(&cursor, data, NONE, r_section);
+	ts_tree_cursor_reset(&cursor, node);
+	collect_identifiers(&cursor, data, "", 0, r_section);
+	ts_tree_cursor_reset(&cursor, node);
+	collect_folds(&cursor, data, r_section.start_row, r_section);
+	ts_tree_cursor_delete(&cursor);
+}
+
+void DocumentOutline::clear() {
+	sections.clear();
+	version = 0;
+}
+
+void DocumentOutline::apply_edit(const TSInputEdit &edit) {
+	int64_t byte_delta = (int64_t)edit.new_end_byte - edit.old_end_byte;
+	int64_t row_delta = (int64_t)edit.new_end_point.row - edit.old_end_point.row;
+	for (Section &section : sections) {
+		if (!section.valid || section.end_byte <= edit.start_byte) {
+			continue;
+		}
+		// Text inserted right before a section may join it; then its extent
+		// no longer matches and update() extracts it again.
+		if (section.start_byte >= edit.old_end_byte) {
+			section.start_byte += byte_delta;
+			section.end_byte += byte_delta;
+			section.start_row += row_delta;
+		} else {
+			section.valid = false;
+		}
+	}
+}
+
+void DocumentOutline::invalidate(uint32_t start_byte, uint32_t end_byte) {
+	end_byte = std::max(end_byte, start_byte + 1);
+	for (Section &section : sections) {
+		if (section.start_byte < end_byte && start_byte < section.end_byte) {
+			section.valid = false;
+		}
+	}
+}
+
+void DocumentOutline::update(TSNode root, const char *data, uint64_t p_version) {
+	if (version == p_version) {
+		return;
+	}
+
+	// Valid sections stay sorted (edits shift everything after them by the
+	// same amount), so one merge pass pairs them with root's children.
+	std::vector<Section> old_sections;
+	old_sections.swap(sections);
+	size_t next = 0;
+
+	TSTreeCursor cursor = ts_tree_cursor_new(root);
+	if (ts_tree_cursor_goto_first_child(&cursor)) {
+		do {
+			TSNode child = ts_tree_cursor_current_node(&cursor);
+			uint32_t start = ts_node_start_byte(child);
+			uint32_t end = ts_node_end_byte(child);
+			while (next < old_sections.size() && (!old_sections[next].valid || old_sections[next].start_byte < start)) {
+				next++;
+			}
+			if (next < old_sections.size() && old_sections[next].start_byte == start && old_sections[next].end_byte == end &&
+					old_sections[next].start_row == ts_node_start_point(child).row) {
+				sections.push_back(std::move(old_sections[next++]));
+			} else {
+				sections.emplace_back();
+				extract(child, data, sections.back());
+			}
+		} while (ts_tree_cursor_goto_next_sibling(&cursor));
+	}
+	ts_tree_cursor_delete(&cursor);
+	version = p_version;
+}
+
+void DocumentOutline::get_symbols(std::vector<Symbol> &r_symbols) const {
+	r_symbols.clear();
+	for (const Section &section : sections) {
+		uint32_t offset = r_symbols.size();
+		for (const Symbol &local : section.symbols) {
+			Symbol symbol = local;
+			symbol.start_byte += section.start_byte;
+			symbol.end_byte += section.start_byte;
+			symbol.name_start_byte += section.start_byte;
+			symbol.name_end_byte += section.start_byte;
+			symbol.start_row += section.start_row;
+			symbol.end_row += section.start_row;
+			if (symbol.parent != NONE) {
+				symbol.parent += offset;
+			}
+			r_symbols.push_back(symbol);
+		}
+	}
+}
+
+void DocumentOutline::get_identifiers(std::vector<Identifier> &r_identifiers) const {
+	r_identifiers.clear();
+	for (const Section &section : sections) {
+		for (const Identifier &local : section.identifiers) {
+			r_identifiers.push_back({ local.start_byte + section.start_byte, local.end_byte + section.start_byte, local.role });
+		}
+	}
+}
+
+std::string DocumentOutline::get_extends() const {
+	for (const Section &section : sections) {
+		if (!section.extends.empty()) {
+			return section.extends;
+		}
+	}
+	return std::string();
+}
+
+void DocumentOutline::get_loads(std::vector<Load> &r_loads) const {
+	r_loads.clear();
+	for (const Section &section : sections) {
+		r_loads.insert(r_loads.end(), section.loads.begin(), section.loads.end());
+	}
+}
+
+void DocumentOutline::get_folds(std::vector<Fold> &r_folds) const {
+	r_folds.clear();
+	uint32_t run_start = NONE;
+	uint32_t run_end = NONE;
+	for (const Section &section : sections) {
+		for (const Fold &local : section.folds) {
+			r_folds.push_back({ local.start_row + section.start_row, local.end_row + section.start_row, local.kind });
+		}
+		// Comment runs can span sections: top-level comments are sections
+		// of their own.
+		for (uint32_t local_row : section.comment_rows) {
+			uint32_t row = local_row + section.start_row;
+			if (run_end != NONE && row == run_end + 1) {
+				run_end = row;
+				continue;
+			}
+			if (run_end != NONE && run_end > run_start) {
+				r_folds.push_back({ run_start, run_end, FOLD_COMMENT });
+			}
+			run_start = row;
+			run_end = row;
+		}
+	}
+	if (run_end != NONE && run_end > run_start) {
+		r_folds.push_back({ run_start, run_end, FOLD_COMMENT });
+	}
+
+	std::sort(r_folds.begin(), r_folds.end(), [](const Fold &a, const Fold &b) {
+		return a.start_row != b.start_row ? a.start_row < b.start_row : a.end_row > b.end_row;
+	});
+	r_folds.erase(std::unique(r_folds.begin(), r_folds.end(), [](const Fold &a, const Fold &b) {
+		return a.start_row == b.start_row;
+	}),
+			r_folds.end());
+}
+
+void DocumentOutline::get_selection_ranges(TSNode root, uint32_t byte, std::vector<Range> &r_ranges) {
+	r_ranges.clear();
+	TSNode node = ts_node_descendant_for_byte_range(root, byte, byte);
+	while (!ts_node_is_null(node)) {
+		Range range;
+		range.start_byte = ts_node_start_byte(node);
+		range.end_byte = ts_node_end_byte(node);
+		range.start_row = ts_node_start_point(node).row;
+		range.end_row = ts_node_end_point(node).row;
+		if (r_ranges.empty() || range.start_byte != r_ranges.back().start_byte || range.end_byte != r_ranges.back().end_byte) {
+			r_ranges.push_back(range);
+		}
+		node = ts_node_parent(node);
+	}
+}
+
+uint64_t DocumentOutline::get_memory_bytes() const {
+	uint64_t bytes = memory_usage::of(sections);
+	for (const Section &section : sections) {
+		bytes += memory_usage::of(section.symbols) + memory_usage::of(section.identifiers) + memory_usage::of(section.folds) +
+				memory_usage::of(section.comment_rows) + memory_usage::of(section.extends) + memory_usage::of(section.loads);
+		for (const Symbol &symbol : section.symbols) {
+			bytes += memory_usage::of(symbol.name);
+		}
+		for (const Load &load : section.loads) {
+			bytes += memory_usage::of(load.path);
+		}
+	}
+	return bytes;
+}
@@ -0,0 +1,136 @@
+#ifndef DOCUMENT_OUTLINE_H
+#define DOCUMENT_OUTLINE_H
+
+#include <tree_sitter/api.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Symbol outline, folding ranges and identifier occurrences of one file,
+// kept per top-level node.
+//
+// Each top-level node of the tree is a section whose symbols and folds are
+// stored relative to its start, so an edit only drops the sections it
+// touches (or whose subtree the reparse changed) and shifts the ones after
+// it. update() then extracts just the sections that do not match a kept
+// one by extent.
+class DocumentOutline {
+public:
+	static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+	enum SymbolKind {
+		SYMBOL_CLASS_NAME,
+		SYMBOL_CLASS,
+		SYMBOL_FUNCTION,
+		SYMBOL_SIGNAL,
+		SYMBOL_ENUM,
+		SYMBOL_CONSTANT,
+		SYMBOL_VARIABLE,
+	};
+
+	enum IdentifierRole {
+		ROLE_REFERENCE,
+		ROLE_DEFINITION,
+	};
+
+	enum FoldKind {
+		FOLD_BLOCK,
+		FOLD_LITERAL,
+		FOLD_COMMENT,
+	};
+
+	struct Symbol {
+		SymbolKind kind = SYMBOL_VARIABLE;
+		std::string name;
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		uint32_t start_row = 0;
+		uint32_t end_row = 0;
+		uint32_t name_start_byte = 0;
+		uint32_t name_end_byte = 0;
+		// Index of the enclosing class in the same list, or NONE.
+		uint32_t parent = NONE;
+	};
+
+	// An identifier or declared name, in document order.
+	struct Identifier {
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		IdentifierRole role = ROLE_REFERENCE;
+	};
+
+	struct Fold {
+		uint32_t start_row = 0;
+		uint32_t end_row = 0;
+		FoldKind kind = FOLD_BLOCK;
+	};
+
+	// A preload() or load() of a constant path, as written.
+	struct Load {
+		std::string path;
+		bool preload = false;
+	};
+
+	struct Range {
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		uint32_t start_row = 0;
+		uint32_t end_row = 0;
+	};
+
+private:
+	// Positions of symbols, identifiers, folds and comment rows are
+	// relative to the section's start_byte and start_row.
+	struct Section {
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		uint32_t start_row = 0;
+		bool valid = true;
+		std::vector<Symbol> symbols;
+		std::vector<Identifier> identifiers;
+		std::vector<Fold> folds;
+		// Rows holding nothing but a comment, for comment-run folds.
+		std::vector<uint32_t> comment_rows;
+		// Target of an extends statement: a class name or a script path.
+		std::string extends;
+		std::vector<Load> loads;
+	};
+
+	std::vector<Section> sections;
+	uint64_t version = 0;
+
+	static void collect_symbols(TSTreeCursor *cursor, const char *data, uint32_t parent, Section &section);
+	static void collect_identifiers(TSTreeCursor *cursor, const char *data, const char *parent_type, uint32_t named_index, Section &section);
+	static void collect_folds(TSTreeCursor *cursor, const char *data, uint32_t header_row, Section &section);
+	static void extract(TSNode node, const char *data, Section &r_section);
+
+public:
+	// Version of the tree the sections describe; 0 when never built.
+	uint64_t get_version() const { return version; }
+	void clear();
+	uint64_t get_memory_bytes() const;
+
+	// Moves the sections over an edit (see TSInputEdit); sections it
+	// overlaps are dropped on the next update().
+	void apply_edit(const TSInputEdit &edit);
+	// Drops the sections overlapping [start_byte, end_byte).
+	void invalidate(uint32_t start_byte, uint32_t end_byte);
+	// Brings the sections in line with root, the tree of p_version.
+	void update(TSNode root, const char *data, uint64_t p_version);
+
+	void get_symbols(std::vector<Symbol> &r_symbols) const;
+	void get_identifiers(std::vector<Identifier> &r_identifiers) const;
+	// Base class named by the script's extends statement, empty if none.
+	std::string get_extends() const;
+	// In document order; calls with a computed path are left out.
+	void get_loads(std::vector<Load> &r_loads) const;
+	// Sorted by start row, at most one per row (the outermost).
+	void get_folds(std::vector<Fold> &r_folds) const;
+
+	// Ranges around byte from the innermost token outwards, without
+	// duplicates, ending with root.
+	static void get_selection_ranges(TSNode root, uint32_t byte, std::vector<Range> &r_ranges);
+};
+
+#endif // DOCUMENT_OUTLINE_H
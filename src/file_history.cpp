@@ -0,0 +1,193 @@
+#include "file_history.h"
+
+// Estimated cost of a tree snapshot: a fixed part for the root path plus a
+// multiple of the bytes edited since the previous snapshot, which bounds
+// the subtrees the snapshot does not share with the live tree.
+static const int64_t SNAPSHOT_BASE_COST = 1024;
+static const int64_t SNAPSHOT_BYTES_PER_EDITED_BYTE = 16;
+
+static int64_t edited_byte_count(const Vector<FileHistory::Edit> &edits) {
+	int64_t count = 0;
+	for (int i = 0; i < edits.size(); i++) {
+		count += edits[i].removed.size() + edits[i].inserted.size();
+	}
+	return count;
+}
+
+void FileHistory::drop_snapshot(uint64_t version) {
+	Snapshot *snapshot = snapshots.getptr(version);
+	if (!snapshot) {
+		return;
+	}
+	ts_tree_delete(snapshot->tree);
+	memory_bytes -= snapshot->cost;
+	snapshots.erase(version);
+}
+
+bool FileHistory::is_version_retained(uint64_t version) const {
+	if (entries.is_empty()) {
+		return false;
+	}
+	if (entries[0].from_version == version) {
+		return true;
+	}
+	for (int i = 0; i < entries.size(); i++) {
+		if (entries[i].to_version == version) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void FileHistory::record(uint64_t from_version, uint64_t to_version, const Vector<Edit> &edits, TSTree *old_tree, int snapshot_interval) {
+	// A new change forks away from the redo branch.
+	while (entries.size() > position) {
+		const Entry &dropped = entries[entries.size() - 1];
+		memory_bytes -= dropped.cost;
+		uint64_t dropped_version = dropped.to_version;
+		entries.remove_at(entries.size() - 1);
+		drop_snapshot(dropped_version);
+	}
+
+	Entry entry;
+	entry.from_version = from_version;
+	entry.to_version = to_version;
+	entry.edits = edits;
+	int64_t edited_bytes = edited_byte_count(edits);
+	entry.cost = (int64_t)sizeof(Entry) + (int64_t)edits.size() * (int64_t)sizeof(Edit) + edited_bytes;
+
+	pending_snapshot_cost += edited_bytes * SNAPSHOT_BYTES_PER_EDITED_BYTE;
+	changes_since_snapshot++;
+
+	if (old_tree) {
+		if (snapshot_interval > 0 && changes_since_snapshot >= snapshot_interval && !snapshots.has(from_version)) {
+			Snapshot snapshot;
+			snapshot.tree = old_tree;
+			snapshot.cost = SNAPSHOT_BASE_COST + pending_snapshot_cost;
+			snapshots.insert(from_version, snapshot);
+			memory_bytes += snapshot.cost;
+			pending_snapshot_cost = 0;
+			changes_since_snapshot = 0;
+		} else {
+			ts_tree_delete(old_tree);
+		}
+	}
+
+	memory_bytes += entry.cost;
+	entries.push_back(entry);
+	position = entries.size();
+}
+
+bool FileHistory::can_undo() const {
+	return position > 0;
+}
+
+bool FileHistory::can_redo() const {
+	return position < entries.size();
+}
+
+const FileHistory::Entry &FileHistory::get_undo_entry() const {
+	return entries[position - 1];
+}
+
+const FileHistory::Entry &FileHistory::get_redo_entry() const {
+	return entries[position];
+}
+
+void FileHistory::step_undo(TSTree *left_tree) {
+	const Entry &entry = entries[position - 1];
+	if (left_tree) {
+		if (snapshots.has(entry.to_version)) {
+			ts_tree_delete(left_tree);
+		} else {
+			Snapshot snapshot;
+			snapshot.tree = left_tree;
+			snapshot.cost = SNAPSHOT_BASE_COST + edited_byte_count(entry.edits) * SNAPSHOT_BYTES_PER_EDITED_BYTE;
+			snapshots.insert(entry.to_version, snapshot);
+			memory_bytes += snapshot.cost;
+		}
+	}
+	position--;
+}
+
+void FileHistory::step_redo(TSTree *left_tree) {
+	const Entry &entry = entries[position];
+	if (left_tree) {
+		if (snapshots.has(entry.from_version)) {
+			ts_tree_delete(left_tree);
+		} else {
+			Snapshot snapshot;
+			snapshot.tree = left_tree;
+			snapshot.cost = SNAPSHOT_BASE_COST + edited_byte_count(entry.edits) * SNAPSHOT_BYTES_PER_EDITED_BYTE;
+			snapshots.insert(entry.from_version, snapshot);
+			memory_bytes += snapshot.cost;
+		}
+	}
+	position++;
+}
+
+TSTree *FileHistory::copy_snapshot(uint64_t version) const {
+	const Snapshot *snapshot = snapshots.getptr(version);
+	return snapshot ? ts_tree_copy(snapshot->tree) : nullptr;
+}
+
+int FileHistory::get_entry_count() const {
+	return entries.size();
+}
+
+const FileHistory::Entry &FileHistory::get_entry(int index) const {
+	return entries[index];
+}
+
+int64_t FileHistory::trim_oldest() {
+	if (entries.is_empty()) {
+		return 0;
+	}
+
+	int64_t before = memory_bytes;
+	uint64_t released_version = 0;
+	if (position > 0) {
+		// Drop the oldest undo step; its starting version becomes unreachable.
+		released_version = entries[0].from_version;
+		memory_bytes -= entries[0].cost;
+		entries.remove_at(0);
+		position--;
+	} else {
+		// Only redo steps are left; drop the furthest one.
+		released_version = entries[entries.size() - 1].to_version;
+		memory_bytes -= entries[entries.size() - 1].cost;
+		entries.remove_at(entries.size() - 1);
+	}
+	if (!is_version_retained(released_version)) {
+		drop_snapshot(released_version);
+	}
+	return before - memory_bytes;
+}
+
+void FileHistory::clear() {
+	for (const KeyValue<uint64_t, Snapshot> &kv : snapshots) {
+		ts_tree_delete(kv.value.tree);
+	}
+	snapshots.clear();
+	entries.clear();
+	position = 0;
+	memory_bytes = 0;
+	pending_snapshot_cost = 0;
+	changes_since_snapshot = 0;
+}
+
+int FileHistory::get_undo_count() const {
+	return position;
+}
+
+int FileHistory::get_redo_count() const {
+	return entries.size() - position;
+}
+
+int FileHistory::get_snapshot_count() const {
+	return snapshots.size();
+}
+
+int64_t FileHistory::get_memory_bytes() const {
+	return memory_bytes;
+}
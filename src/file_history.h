@@ -0,0 +1,82 @@
+#ifndef FILE_HISTORY_H
+#define FILE_HISTORY_H
+
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/vector.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <tree_sitter/api.h>
+
+using namespace godot;
+
+// Linear undo/redo history of one open file.
+//
+// Every committed change is stored as a delta (the replaced and inserted
+// bytes of each edit) so the source of any retained version can be rebuilt
+// by splicing. Trees are kept as ts_tree_copy snapshots for some versions;
+// copies share unchanged subtrees with the live tree, so a snapshot costs
+// roughly what the edits since the previous snapshot touched. Versions
+// without a snapshot are restored by an incremental reparse.
+class FileHistory {
+public:
+	struct Edit {
+		// Offset in the buffer the change was applied to.
+		uint32_t start_byte = 0;
+		PackedByteArray removed;
+		PackedByteArray inserted;
+	};
+
+	struct Entry {
+		uint64_t from_version = 0;
+		uint64_t to_version = 0;
+		Vector<Edit> edits;
+		int64_t cost = 0;
+	};
+
+private:
+	struct Snapshot {
+		TSTree *tree = nullptr;
+		int64_t cost = 0;
+	};
+
+	Vector<Entry> entries;
+	// entries[0, position) can be undone, entries[position, size) redone.
+	int position = 0;
+	HashMap<uint64_t, Snapshot> snapshots;
+	int64_t memory_bytes = 0;
+	int64_t pending_snapshot_cost = 0;
+	int changes_since_snapshot = 0;
+
+	void drop_snapshot(uint64_t version);
+	bool is_version_retained(uint64_t version) const;
+
+public:
+	void record(uint64_t from_version, uint64_t to_version, const Vector<Edit> &edits, TSTree *old_tree, int snapshot_interval);
+
+	bool can_undo() const;
+	bool can_redo() const;
+	const Entry &get_undo_entry() const;
+	const Entry &get_redo_entry() const;
+	// Moves the cursor after the caller restored the neighbouring version.
+	// left_tree is the tree of the version being left; the history keeps it
+	// as a snapshot (so stepping back is O(1)) or deletes it.
+	void step_undo(TSTree *left_tree);
+	void step_redo(TSTree *left_tree);
+
+	// Returns a new copy of the snapshot for version, or nullptr.
+	TSTree *copy_snapshot(uint64_t version) const;
+
+	// Entries in order; the first get_undo_count() lead to the current version.
+	int get_entry_count() const;
+	const Entry &get_entry(int index) const;
+
+	// Drops the oldest retained step and returns the bytes released.
+	int64_t trim_oldest();
+	void clear();
+
+	int get_undo_count() const;
+	int get_redo_count() const;
+	int get_snapshot_count() const;
+	int64_t get_memory_bytes() const;
+};
+
+#endif // FILE_HISTORY_H
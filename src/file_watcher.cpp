@@ -0,0 +1,251 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+FileWatcher::~FileWatcher() {
+	stop();
+}
+
+bool FileWatcher::is_supported() {
+#ifdef __linux__
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool FileWatcher::wants(const std::string &name) const {
+	if (options.extensions.empty()) {
+		return true;
+	}
+	for (const std::string &extension : options.extensions) {
+		if (name.size() >= extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#ifdef __linux__
+
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR;
+
+static bool is_directory(const std::string &path) {
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+void FileWatcher::add_directory(const std::string &path, std::vector<std::string> *r_files) {
+	int watch = inotify_add_watch(inotify_fd, path.c_str(), WATCH_MASK);
+	if (watch < 0) {
+		return;
+	}
+	directories[watch] = path;
+
+	// Watched before listed, so a file created in between is reported at
+	// least once.
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		return;
+	}
+	std::vector<std::string> subdirectories;
+	while (dirent *entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name.empty() || name[0] == '.') {
+			continue;
+		}
+		std::string entry_path = path + "/" + name;
+		// Some file systems leave d_type unset.
+		if (entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && is_directory(entry_path))) {
+			subdirectories.push_back(entry_path);
+		} else if (r_files && wants(name)) {
+			r_files->push_back(entry_path);
+		}
+	}
+	closedir(dir);
+	for (const std::string &subdirectory : subdirectories) {
+		add_directory(subdirectory, r_files);
+	}
+}
+
+void FileWatcher::remove_directory(const std::string &path) {
+	std::string prefix = path + "/";
+	for (auto it = directories.begin(); it != directories.end();) {
+		if (it->second == path || it->second.compare(0, prefix.size(), prefix) == 0) {
+			inotify_rm_watch(inotify_fd, it->first);
+			it = directories.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+bool FileWatcher::start(const std::string &p_root, const Options &p_options, Callback p_callback, std::string &r_error) {
+	if (running) {
+		r_error = "Already watching " + root;
+		return false;
+	}
+	options = p_options;
+	callback = std::move(p_callback);
+	root = p_root;
+	while (root.size() > 1 && root.back() == '/') {
+		root.pop_back();
+	}
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (inotify_fd < 0 || wake_fd < 0) {
+		r_error = std::string("Cannot create inotify instance: ") + strerror(errno);
+		stop();
+		return false;
+	}
+	add_directory(root, nullptr);
+	if (directories.empty()) {
+		r_error = "Cannot watch " + root;
+		stop();
+		return false;
+	}
+
+	running = true;
+	thread = std::thread(&FileWatcher::run, this);
+	return true;
+}
+
+void FileWatcher::stop() {
+	if (thread.joinable()) {
+		uint64_t one = 1;
+		ssize_t written = write(wake_fd, &one, sizeof(one));
+		(void)written;
+		thread.join();
+	}
+	running = false;
+	if (inotify_fd >= 0) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+	if (wake_fd >= 0) {
+		close(wake_fd);
+		wake_fd = -1;
+	}
+	directories.clear();
+}
+
+void FileWatcher::run() {
+	typedef std::chrono::steady_clock Clock;
+	std::unordered_set<std::string> batch;
+	bool overflowed = false;
+	Clock::time_point first_event;
+	Clock::time_point last_event;
+	// Large enough for many events per read, aligned for inotify_event.
+	alignas(inotify_event) char buffer[64 * 1024];
+
+	while (true) {
+		int timeout = -1;
+		if (!batch.empty() || overflowed) {
+			Clock::time_point until = std::min(last_event + std::chrono::milliseconds(options.debounce_msec), first_event + std::chrono::milliseconds(options.max_delay_msec));
+			timeout = (int)std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(until - Clock::now()).count());
+		}
+
+		pollfd fds[2] = { { inotify_fd, POLLIN, 0 }, { wake_fd, POLLIN, 0 } };
+		int ready = poll(fds, 2, timeout);
+		if (ready < 0 && errno != EINTR) {
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			break;
+		}
+
+		if (ready > 0 && (fds[0].revents & POLLIN)) {
+			ssize_t length;
+			while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+				if (batch.empty() && !overflowed) {
+					first_event = Clock::now();
+				}
+				for (char *p = buffer; p < buffer + length;) {
+					const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+					p += sizeof(inotify_event) + event->len;
+					event_count++;
+					if (event->mask & IN_Q_OVERFLOW) {
+						overflowed = true;
+						continue;
+					}
+					if (event->mask & IN_IGNORED) {
+						directories.erase(event->wd);
+						continue;
+					}
+					auto directory = directories.find(event->wd);
+					if (directory == directories.end() || event->len == 0) {
+						continue;
+					}
+					std::string name = event->name;
+					if (name.empty() || name[0] == '.') {
+						continue;
+					}
+					std::string path = directory->second + "/" + name;
+					if (event->mask & IN_ISDIR) {
+						// The watches under a moved directory would keep its
+						// old path; drop them, and watch it again under the
+						// new one if it moved within the tree.
+						if (event->mask & IN_MOVED_FROM) {
+							remove_directory(path);
+						}
+						if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+							std::vector<std::string> files;
+							add_directory(path, &files);
+							batch.insert(files.begin(), files.end());
+						}
+					} else if (wants(name)) {
+						batch.insert(path);
+					}
+				}
+				last_event = Clock::now();
+			}
+		}
+
+		if (batch.empty() && !overflowed) {
+			continue;
+		}
+		Clock::time_point now = Clock::now();
+		if (now >= last_event + std::chrono::milliseconds(options.debounce_msec) || now >= first_event + std::chrono::milliseconds(options.max_delay_msec)) {
+			std::vector<std::string> paths(batch.begin(), batch.end());
+			std::sort(paths.begin(), paths.end());
+			batch.clear();
+			batch_count++;
+			callback(std::move(paths), overflowed);
+			overflowed = false;
+		}
+	}
+	running = false;
+}
+
+#else
+
+bool FileWatcher::start(const std::string &p_root, const Options &p_options, Callback p_callback, std::string &r_error) {
+	(void)p_root;
+	(void)p_options;
+	(void)p_callback;
+	r_error = "File watching is only supported on Linux";
+	return false;
+}
+
+void FileWatcher::stop() {
+}
+
+void FileWatcher::run() {
+}
+
+#endif // __linux__
@@ -0,0 +1,76 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Reports files changed under a directory tree, in debounced batches.
+//
+// A thread waits on inotify (Linux only) and gathers the paths of changed
+// files until the tree has been quiet for debounce_msec, or max_delay_msec
+// after the first change of the batch, so a branch switch touching
+// thousands of files arrives as a few batches instead of thousands of
+// calls. Directories created while watching are watched too, and the
+// files already in them reported. Directories starting with '.' (.git,
+// .godot) are skipped.
+class FileWatcher {
+public:
+	struct Options {
+		// Suffixes a file must end with to be reported; all files if empty.
+		std::vector<std::string> extensions;
+		uint32_t debounce_msec = 100;
+		uint32_t max_delay_msec = 1000;
+	};
+
+	// Runs on the watcher thread. overflowed means the kernel dropped
+	// events: any file under the root may have changed.
+	typedef std::function<void(std::vector<std::string> &&paths, bool overflowed)> Callback;
+
+private:
+	Options options;
+	Callback callback;
+	std::string root;
+	std::thread thread;
+	std::atomic<bool> running{ false };
+	std::atomic<uint64_t> batch_count{ 0 };
+	std::atomic<uint64_t> event_count{ 0 };
+#ifdef __linux__
+	int inotify_fd = -1;
+	// Written to by stop() to wake the thread.
+	int wake_fd = -1;
+	// Directory of each watch descriptor, without a trailing slash.
+	std::unordered_map<int, std::string> directories;
+
+	void add_directory(const std::string &path, std::vector<std::string> *r_files);
+	// Stops watching path and the directories under it.
+	void remove_directory(const std::string &path);
+#endif
+
+	bool wants(const std::string &name) const;
+	void run();
+
+public:
+	FileWatcher() = default;
+	FileWatcher(const FileWatcher &) = delete;
+	FileWatcher &operator=(const FileWatcher &) = delete;
+	~FileWatcher();
+
+	static bool is_supported();
+
+	// Watches p_root, a native directory path. Fails if already running.
+	bool start(const std::string &p_root, const Options &p_options, Callback p_callback, std::string &r_error);
+	// Blocks until the thread exits; a batch being gathered is dropped.
+	void stop();
+	bool is_running() const { return running; }
+
+	const std::string &get_root() const { return root; }
+	uint64_t get_batch_count() const { return batch_count; }
+	uint64_t get_event_count() const { return event_count; }
+};
+
+#endif // FILE_WATCHER_H
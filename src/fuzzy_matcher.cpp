@@ -0,0 +1,153 @@
+#include "fuzzy_matcher.h"
+
+#include <algorithm>
+
+static const int SCORE_MATCH = 16;
+static const int SCORE_GAP_START = -3;
+static const int SCORE_GAP_EXTENSION = -1;
+static const int BONUS_BOUNDARY = 8;
+static const int BONUS_CAMEL = 7;
+// Worth as much as the gap it avoids, so a run beats a scattered match.
+static const int BONUS_CONSECUTIVE = -(SCORE_GAP_START + SCORE_GAP_EXTENSION);
+static const int BONUS_FIRST_CHAR_MULTIPLIER = 2;
+static const int BONUS_EXACT_CASE = 1;
+// Far enough below any reachable score that gap penalties cannot wrap it.
+static const int SCORE_NONE = -16384;
+
+enum CharClass {
+	CLASS_OTHER,
+	CLASS_LOWER,
+	CLASS_UPPER,
+	CLASS_DIGIT,
+};
+
+static inline int char_class(uint8_t c) {
+	return (c >= 'a' && c <= 'z') ? CLASS_LOWER : (c >= 'A' && c <= 'Z') ? CLASS_UPPER : (c >= '0' && c <= '9') ? CLASS_DIGIT : CLASS_OTHER;
+}
+
+static inline uint8_t to_lower(uint8_t c) {
+	return c | ((c >= 'A' && c <= 'Z') << 5);
+}
+
+uint64_t FuzzyMatcher::char_mask(std::string_view text) {
+	uint64_t mask = 0;
+	for (char raw : text) {
+		uint8_t c = to_lower((uint8_t)raw);
+		int bit;
+		if (c >= 'a' && c <= 'z') {
+			bit = c - 'a';
+		} else if (c >= '0' && c <= '9') {
+			bit = 26 + (c - '0');
+		} else if (c == '_') {
+			bit = 36;
+		} else {
+			bit = 37 + c % 27;
+		}
+		mask |= (uint64_t)1 << bit;
+	}
+	return mask;
+}
+
+void FuzzyMatcher::set_pattern(std::string_view p_pattern) {
+	pattern_length = std::min((int)p_pattern.size(), MAX_PATTERN);
+	for (int i = 0; i < pattern_length; i++) {
+		pattern_case[i] = p_pattern[i];
+		pattern[i] = (char)to_lower((uint8_t)p_pattern[i]);
+	}
+	pattern_mask = char_mask(std::string_view(pattern, pattern_length));
+}
+
+bool FuzzyMatcher::match(std::string_view candidate, int &r_score) const {
+	int n = std::min((int)candidate.size(), MAX_LENGTH);
+	const uint8_t *text = (const uint8_t *)candidate.data();
+	r_score = 0;
+	if (pattern_length == 0) {
+		return true;
+	}
+	if (pattern_length > n) {
+		return false;
+	}
+
+	int16_t lower[MAX_LENGTH];
+	for (int j = 0; j < n; j++) {
+		lower[j] = to_lower(text[j]);
+	}
+	// Subsequence check first: most candidates that pass the mask still
+	// fail here, and it bounds the columns worth scoring.
+	int first = -1;
+	int matched = 0;
+	for (int j = 0; j < n && matched < pattern_length; j++) {
+		if (lower[j] == (uint8_t)pattern[matched]) {
+			if (matched == 0) {
+				first = j;
+			}
+			matched++;
+		}
+	}
+	if (matched < pattern_length) {
+		return false;
+	}
+
+	int16_t bonus[MAX_LENGTH];
+	int previous_class = CLASS_OTHER;
+	for (int j = 0; j < n; j++) {
+		int current_class = char_class(text[j]);
+		bonus[j] = (previous_class == CLASS_OTHER && current_class != CLASS_OTHER) ? BONUS_BOUNDARY
+				: (previous_class == CLASS_LOWER && current_class == CLASS_UPPER) ? BONUS_CAMEL
+				: (previous_class != CLASS_DIGIT && current_class == CLASS_DIGIT) ? BONUS_CAMEL
+																				: 0;
+		previous_class = current_class;
+	}
+
+	// previous[j] and row[j] are the best scores with the previous and the
+	// current pattern character matched at j, SCORE_NONE if impossible.
+	// A run keeps the bonus of the boundary it started at in
+	// previous_run[j] and run[j], so "Node" outscores "n_o_d_e".
+	int16_t previous[MAX_LENGTH];
+	int16_t row[MAX_LENGTH];
+	int16_t base[MAX_LENGTH];
+	int16_t previous_run[MAX_LENGTH];
+	int16_t run[MAX_LENGTH];
+	for (int j = 0; j < n; j++) {
+		int score = SCORE_MATCH + bonus[j] * BONUS_FIRST_CHAR_MULTIPLIER + (text[j] == (uint8_t)pattern_case[0]) * BONUS_EXACT_CASE;
+		previous[j] = (j >= first && lower[j] == (uint8_t)pattern[0]) ? score : SCORE_NONE;
+		previous_run[j] = bonus[j];
+	}
+
+	for (int i = 1; i < pattern_length; i++) {
+		uint8_t p = pattern[i];
+		uint8_t p_case = pattern_case[i];
+		// Consecutive matches: independent per column, so this loop
+		// vectorizes.
+		row[0] = SCORE_NONE;
+		base[0] = 0;
+		run[0] = bonus[0];
+		for (int j = 1; j < n; j++) {
+			int exact = (text[j] == p_case) * BONUS_EXACT_CASE;
+			base[j] = SCORE_MATCH + bonus[j] + exact;
+			int run_bonus = std::max(std::max((int)bonus[j], (int)previous_run[j - 1]), BONUS_CONSECUTIVE);
+			int consecutive = previous[j - 1] + SCORE_MATCH + run_bonus + exact;
+			row[j] = lower[j] == p ? (int16_t)std::max(consecutive, SCORE_NONE) : (int16_t)SCORE_NONE;
+			run[j] = run_bonus;
+		}
+		// Matches after a gap: gap is the best previous score at least two
+		// columns back, less the penalties of the skipped characters.
+		int gap = SCORE_NONE;
+		for (int j = 2; j < n; j++) {
+			gap = std::max(gap + SCORE_GAP_EXTENSION, previous[j - 2] + SCORE_GAP_START);
+			if (lower[j] == p && gap + base[j] > row[j]) {
+				row[j] = (int16_t)std::max(gap + base[j], SCORE_NONE);
+				run[j] = bonus[j];
+			}
+		}
+		std::copy(row, row + n, previous);
+		std::copy(run, run + n, previous_run);
+	}
+
+	int best = SCORE_NONE;
+	for (int j = 0; j < n; j++) {
+		best = std::max(best, (int)previous[j]);
+	}
+	r_score = best;
+	return true;
+}
@@ -0,0 +1,45 @@
+#ifndef FUZZY_MATCHER_H
+#define FUZZY_MATCHER_H
+
+#include <cstdint>
+#include <string_view>
+
+// Scores candidates against a fuzzy pattern: every pattern character must
+// appear in order, case-insensitively, and the best alignment wins.
+//
+// Scoring follows the Smith-Waterman style used by fzf: a fixed score per
+// matched character, bonuses for matches at word boundaries (start, after
+// '_', lower-to-upper case changes) and for runs, and penalties for gaps.
+// Rows are computed over fixed-size int16 arrays with branch-free inner
+// loops so the compiler can vectorize them; only the gap recurrence is a
+// sequential scan.
+//
+// A 64-bit mask of the characters each candidate contains lets callers
+// reject most candidates with one AND before scoring.
+class FuzzyMatcher {
+public:
+	// Candidates are scored on their first MAX_LENGTH bytes.
+	static constexpr int MAX_LENGTH = 128;
+	static constexpr int MAX_PATTERN = 64;
+
+	static uint64_t char_mask(std::string_view text);
+
+private:
+	char pattern[MAX_PATTERN];
+	char pattern_case[MAX_PATTERN];
+	int pattern_length = 0;
+	uint64_t pattern_mask = 0;
+
+public:
+	// Patterns are cut to MAX_PATTERN bytes.
+	void set_pattern(std::string_view p_pattern);
+	int get_pattern_length() const { return pattern_length; }
+
+	// False if the candidate cannot contain the pattern.
+	bool may_match(uint64_t candidate_mask) const { return (pattern_mask & ~candidate_mask) == 0; }
+	// False if the pattern is not a subsequence of candidate. An empty
+	// pattern matches everything with score 0.
+	bool match(std::string_view candidate, int &r_score) const;
+};
+
+#endif // FUZZY_MATCHER_H
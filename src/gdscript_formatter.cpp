@@ -0,0 +1,533 @@
+#include "gdscript_formatter.h"
+
+#include "content_hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+static bool is_type(const char *type, const char *name) {
+	return strcmp(type, name) == 0;
+}
+
+static bool is_space(char c) {
+	return c == ' ' || c == '\t';
+}
+
+static bool is_opening_bracket(const char *type) {
+	return is_type(type, "(") || is_type(type, "[") || is_type(type, "{");
+}
+
+static bool is_closing_bracket(const char *type) {
+	return is_type(type, ")") || is_type(type, "]") || is_type(type, "}");
+}
+
+// Nodes holding indented statement lines: function and class bodies
+// (block), match bodies and the like.
+static bool is_block(const char *type) {
+	size_t length = strlen(type);
+	return is_type(type, "block") || (length > 5 && strcmp(type + length - 5, "_body") == 0);
+}
+
+// Named nodes whose text is taken as is.
+static bool is_atomic(const char *type) {
+	return strstr(type, "string") || is_type(type, "comment") || is_type(type, "node_path") || is_type(type, "get_node");
+}
+
+static bool is_function_like(const char *type) {
+	return is_type(type, "function_definition") || is_type(type, "constructor_definition") || is_type(type, "class_definition");
+}
+
+static bool is_attachable(const char *type) {
+	return is_type(type, "comment") || is_type(type, "annotation") || is_type(type, "annotations");
+}
+
+static bool is_operator(const char *type) {
+	static const char *const operators[] = {
+		"=", ":=", "+=", "-=", "*=", "/=", "%=", "**=", "&=", "|=", "^=", "<<=", ">>=",
+		"==", "!=", "<", ">", "<=", ">=", "+", "-", "*", "/", "%", "**", "&", "|", "^", "<<", ">>",
+		"&&", "||", "!", "~", "->", "and", "or", "not", "in", "is", "as"
+	};
+	for (const char *op : operators) {
+		if (is_type(type, op)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Tokens that only appear between operands (or are declarations' = and ->)
+// so spacing them out cannot change what they mean.
+static bool is_binary_operator(const char *type, const char *parent_type) {
+	if (!is_operator(type) || strstr(parent_type, "unary")) {
+		return false;
+	}
+	if (is_type(type, "=") || is_type(type, ":=") || is_type(type, "->") || is_type(type, "and") || is_type(type, "or") ||
+			is_type(type, "in") || is_type(type, "is") || is_type(type, "as")) {
+		return true;
+	}
+	return strstr(parent_type, "operator") || strstr(parent_type, "assignment") || strstr(parent_type, "comparison");
+}
+
+bool GDScriptFormatter::overlaps(uint32_t start, uint32_t end) const {
+	end = std::max(end, start + 1);
+	auto it = std::partition_point(ranges.begin(), ranges.end(), [start](const Range &range) {
+		return range.end_byte <= start;
+	});
+	return it != ranges.end() && it->start_byte < end;
+}
+
+uint32_t GDScriptFormatter::row_of(uint32_t byte) const {
+	auto it = std::partition_point(lines->begin(), lines->end(), [byte](const LineDiff::Line &line) {
+		return line.start <= byte;
+	});
+	return it == lines->begin() ? 0 : (it - lines->begin()) - 1;
+}
+
+uint32_t GDScriptFormatter::line_start(uint32_t row) const {
+	return row < lines->size() ? (*lines)[row].start : length;
+}
+
+// The last leaf starting at or before byte.
+const GDScriptFormatter::Leaf *GDScriptFormatter::leaf_at(uint32_t byte) const {
+	auto it = std::partition_point(leaves.begin(), leaves.end(), [byte](const Leaf &leaf) {
+		return leaf.start <= byte;
+	});
+	return it == leaves.begin() ? nullptr : &*(it - 1);
+}
+
+void GDScriptFormatter::add_replacement(uint32_t start, uint32_t end, const std::string &bytes) {
+	if (end - start == bytes.size() && memcmp(data + start, bytes.data(), bytes.size()) == 0) {
+		return;
+	}
+	LineMerge::Replacement replacement;
+	replacement.start_byte = start;
+	replacement.end_byte = end;
+	replacement.bytes = bytes;
+	replacements.push_back(std::move(replacement));
+}
+
+void GDScriptFormatter::collect_leaves(TSTreeCursor *cursor, const char *parent_type, TSNode parent, uint32_t depth, bool in_bracket) {
+	TSNode node = ts_tree_cursor_current_node(cursor);
+	uint32_t start = ts_node_start_byte(node);
+	uint32_t end = ts_node_end_byte(node);
+	if (!overlaps(start, end)) {
+		return;
+	}
+
+	const char *type = ts_node_type(node);
+	bool named = ts_node_is_named(node);
+	bool error = ts_node_is_error(node) || ts_node_is_missing(node);
+	bool atomic = named && is_atomic(type);
+	if (error || atomic || !ts_tree_cursor_goto_first_child(cursor)) {
+		// Zero-width tokens (indent/dedent) have no text to format.
+		if (start == end && !error) {
+			return;
+		}
+		Leaf leaf;
+		leaf.node = node;
+		leaf.parent = parent;
+		leaf.start = start;
+		leaf.end = end;
+		leaf.type = type;
+		leaf.named = named;
+		leaf.unary = !named && strstr(parent_type, "unary");
+		leaf.binary = !named && is_binary_operator(type, parent_type);
+		leaf.keep = error || atomic;
+		leaf.in_bracket = in_bracket;
+		leaf.depth = depth;
+		leaves.push_back(leaf);
+		return;
+	}
+
+	uint32_t child_depth = depth + (is_block(type) ? 1 : 0);
+	int open = 0;
+	do {
+		TSNode child = ts_tree_cursor_current_node(cursor);
+		const char *child_type = ts_node_type(child);
+		bool token = !ts_node_is_named(child);
+		if (token && is_closing_bracket(child_type) && open > 0) {
+			open--;
+		}
+		collect_leaves(cursor, type, node, child_depth, in_bracket || open > 0);
+		if (token && is_opening_bracket(child_type)) {
+			open++;
+		}
+	} while (ts_tree_cursor_goto_next_sibling(cursor));
+	ts_tree_cursor_goto_parent(cursor);
+}
+
+void GDScriptFormatter::format_indentation() {
+	for (const Range &range : ranges) {
+		uint32_t last_row = row_of(range.end_byte - 1);
+		for (uint32_t row = row_of(range.start_byte); row <= last_row && row < lines->size(); row++) {
+			const LineDiff::Line &line = (*lines)[row];
+			uint32_t line_end = line.start + line.length;
+			uint32_t content = line.start;
+			while (content < line_end && is_space(data[content])) {
+				content++;
+			}
+			if (content == line_end || data[content] == '\r') {
+				continue;
+			}
+			const Leaf *leaf = leaf_at(content);
+			if (!leaf || leaf->start != content || leaf->keep || leaf->in_bracket) {
+				continue;
+			}
+			if (row > 0) {
+				// Continuation of a line ending in a backslash.
+				const LineDiff::Line &previous = (*lines)[row - 1];
+				uint32_t previous_end = previous.start + previous.length;
+				if (previous_end > previous.start && data[previous_end - 1] == '\r') {
+					previous_end--;
+				}
+				if (previous_end > previous.start && data[previous_end - 1] == '\\') {
+					continue;
+				}
+			}
+
+			std::string indent;
+			for (uint32_t i = 0; i < leaf->depth; i++) {
+				indent += options.indent;
+			}
+			add_replacement(line.start, content, indent);
+		}
+	}
+}
+
+// Spaces wanted between two tokens on one line, or -1 to leave them.
+static int spaces_between(const char *a, bool a_named, bool a_unary, bool a_binary, const char *b, bool b_named, bool b_binary) {
+	const char *at = a_named ? "" : a;
+	const char *bt = b_named ? "" : b;
+	if (is_type(bt, ")") || is_type(bt, "]") || is_type(bt, ",") || is_type(bt, ";") || is_type(bt, ":")) {
+		return 0;
+	}
+	if (is_type(at, "(") || is_type(at, "[")) {
+		return 0;
+	}
+	if (is_type(at, ".") || is_type(bt, ".")) {
+		return 0;
+	}
+	if (is_type(at, ",")) {
+		return 1;
+	}
+	if (is_type(at, ":")) {
+		// ":" "=" may be how the grammar spells ":=".
+		return is_type(bt, "=") ? -1 : 1;
+	}
+	if (a_unary) {
+		if (is_type(at, "not")) {
+			return 1;
+		}
+		// Keep "- -x" from turning into "--x".
+		return (!b_named && is_operator(bt)) ? -1 : 0;
+	}
+	if (a_binary || b_binary) {
+		return 1;
+	}
+	if ((is_type(bt, "(") || is_type(bt, "[")) && (a_named || is_type(at, ")") || is_type(at, "]"))) {
+		return 0;
+	}
+	return -1;
+}
+
+void GDScriptFormatter::format_spacing() {
+	for (size_t i = 1; i < leaves.size(); i++) {
+		const Leaf &a = leaves[i - 1];
+		const Leaf &b = leaves[i];
+		if (a.keep || b.keep || b.start < a.end || !overlaps(a.end, b.start)) {
+			continue;
+		}
+		bool blank = true;
+		for (uint32_t k = a.end; k < b.start && blank; k++) {
+			blank = is_space(data[k]);
+		}
+		if (!blank) {
+			continue;
+		}
+
+		int spaces = spaces_between(a.type, a.named, a.unary, a.binary, b.type, b.named, b.binary);
+		if (spaces >= 0) {
+			add_replacement(a.end, b.start, std::string(spaces, ' '));
+		}
+	}
+}
+
+void GDScriptFormatter::format_trailing_whitespace() {
+	for (const Range &range : ranges) {
+		uint32_t last_row = row_of(range.end_byte - 1);
+		for (uint32_t row = row_of(range.start_byte); row <= last_row && row < lines->size(); row++) {
+			const LineDiff::Line &line = (*lines)[row];
+			uint32_t line_end = line.start + line.length;
+			if (line_end > line.start && data[line_end - 1] == '\r') {
+				line_end--;
+			}
+			uint32_t content_end = line_end;
+			while (content_end > line.start && is_space(data[content_end - 1])) {
+				content_end--;
+			}
+			if (content_end == line_end) {
+				continue;
+			}
+			// Whitespace inside a multi-line string belongs to the string.
+			const Leaf *leaf = leaf_at(content_end);
+			if (leaf && leaf->end > content_end && !is_type(leaf->type, "comment")) {
+				continue;
+			}
+			add_replacement(content_end, line_end, "");
+		}
+	}
+}
+
+void GDScriptFormatter::format_trailing_commas() {
+	for (const Leaf &leaf : leaves) {
+		if (leaf.named || leaf.keep || !is_closing_bracket(leaf.type) || !overlaps(leaf.start, leaf.end)) {
+			continue;
+		}
+
+		// Only comma separated lists; a parenthesized expression has no commas.
+		bool has_comma = false;
+		bool has_open = false;
+		TSNode open = leaf.node;
+		TSTreeCursor cursor = ts_tree_cursor_new(leaf.parent);
+		if (ts_tree_cursor_goto_first_child(&cursor)) {
+			do {
+				TSNode child = ts_tree_cursor_current_node(&cursor);
+				if (ts_node_is_named(child)) {
+					continue;
+				}
+				const char *type = ts_node_type(child);
+				has_comma = has_comma || is_type(type, ",");
+				if (!has_open && is_opening_bracket(type)) {
+					open = child;
+					has_open = true;
+				}
+			} while (ts_tree_cursor_goto_next_sibling(&cursor));
+		}
+		ts_tree_cursor_delete(&cursor);
+		if (!has_comma || !has_open) {
+			continue;
+		}
+
+		TSNode last = ts_node_prev_sibling(leaf.node);
+		while (!ts_node_is_null(last) && is_type(ts_node_type(last), "comment")) {
+			last = ts_node_prev_sibling(last);
+		}
+		if (ts_node_is_null(last) || ts_node_eq(last, open) || ts_node_is_error(last) || ts_node_is_missing(last)) {
+			continue;
+		}
+		uint32_t last_start = ts_node_start_byte(last);
+		uint32_t last_end = ts_node_end_byte(last);
+		if (last_start == last_end) {
+			continue;
+		}
+
+		bool single_line = row_of(ts_node_start_byte(open)) == row_of(leaf.start);
+		if (!ts_node_is_named(last) && is_type(ts_node_type(last), ",")) {
+			if (single_line) {
+				uint32_t end = last_end;
+				while (end < leaf.start && is_space(data[end])) {
+					end++;
+				}
+				add_replacement(last_start, end == leaf.start ? end : last_end, "");
+			}
+			continue;
+		}
+
+		// A multi-line list whose closing bracket starts its own line.
+		if (single_line || row_of(last_end - 1) == row_of(leaf.start)) {
+			continue;
+		}
+		uint32_t end = last_end;
+		while (end < length && is_space(data[end])) {
+			end++;
+		}
+		bool line_ends = end == length || data[end] == '\n' || data[end] == '\r';
+		add_replacement(last_end, line_ends ? end : last_end, ",");
+	}
+}
+
+void GDScriptFormatter::format_blank_lines(TSNode container) {
+	std::vector<TSNode> items;
+	TSTreeCursor cursor = ts_tree_cursor_new(container);
+	if (ts_tree_cursor_goto_first_child(&cursor)) {
+		do {
+			TSNode child = ts_tree_cursor_current_node(&cursor);
+			if (ts_node_is_named(child) && ts_node_end_byte(child) > ts_node_start_byte(child)) {
+				items.push_back(child);
+			}
+		} while (ts_tree_cursor_goto_next_sibling(&cursor));
+	}
+	ts_tree_cursor_delete(&cursor);
+
+	auto last_row = [this](TSNode node) {
+		uint32_t start = ts_node_start_byte(node);
+		uint32_t end = ts_node_end_byte(node);
+		while (end > start && (is_space(data[end - 1]) || data[end - 1] == '\n' || data[end - 1] == '\r')) {
+			end--;
+		}
+		return row_of(end > start ? end - 1 : start);
+	};
+
+	for (size_t i = 0; i < items.size(); i++) {
+		const char *type = ts_node_type(items[i]);
+		if (is_type(type, "class_definition")) {
+			TSNode body = ts_node_child_by_field_name(items[i], "body", 4);
+			if (!ts_node_is_null(body) && overlaps(ts_node_start_byte(body), ts_node_end_byte(body))) {
+				format_blank_lines(body);
+			}
+		}
+		if (is_attachable(type)) {
+			// Handled with the function they belong to, if any.
+			continue;
+		}
+
+		// Comments and annotations on the lines right above a function move
+		// with it.
+		size_t first = i;
+		if (is_function_like(type)) {
+			while (first > 0 && is_attachable(ts_node_type(items[first - 1])) &&
+					last_row(items[first - 1]) + 1 == row_of(ts_node_start_byte(items[first]))) {
+				first--;
+			}
+		}
+		if (first == 0 || !(is_function_like(type) || is_function_like(ts_node_type(items[first - 1])))) {
+			continue;
+		}
+
+		uint32_t previous_row = last_row(items[first - 1]);
+		uint32_t first_row = row_of(ts_node_start_byte(items[first]));
+		if (first_row <= previous_row) {
+			continue;
+		}
+		uint32_t gap_start = line_start(previous_row + 1);
+		uint32_t gap_end = line_start(first_row);
+		if (!overlaps(gap_start, gap_end + 1)) {
+			continue;
+		}
+		bool blank = true;
+		for (uint32_t k = gap_start; k < gap_end && blank; k++) {
+			blank = is_space(data[k]) || data[k] == '\n' || data[k] == '\r';
+		}
+		if (!blank) {
+			continue;
+		}
+
+		std::string gap;
+		for (uint32_t n = 0; n < options.blank_lines; n++) {
+			gap += newline;
+		}
+		add_replacement(gap_start, gap_end, gap);
+	}
+}
+
+void GDScriptFormatter::format(TSTree *tree, const char *p_data, uint32_t p_length, const std::vector<LineDiff::Line> &p_lines,
+		const std::vector<Range> &p_ranges, const Options &p_options, std::vector<LineMerge::Replacement> &r_replacements) {
+	data = p_data;
+	length = p_length;
+	lines = &p_lines;
+	options = p_options;
+	leaves.clear();
+	replacements.clear();
+	r_replacements.clear();
+	newline = (!p_lines.empty() && p_lines[0].has_newline && p_lines[0].length > 0 && data[p_lines[0].length - 1] == '\r') ? "\r\n" : "\n";
+
+	// Whole lines, merged.
+	ranges.clear();
+	if (p_ranges.empty()) {
+		ranges.push_back({ 0, length });
+	}
+	for (const Range &range : p_ranges) {
+		uint32_t start = std::min(range.start_byte, length);
+		uint32_t end = std::min(std::max(range.end_byte, start + 1), length);
+		ranges.push_back({ line_start(row_of(start)), end > 0 ? line_start(row_of(end - 1) + 1) : 0 });
+	}
+	std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) {
+		return a.start_byte < b.start_byte;
+	});
+	size_t merged = 0;
+	for (const Range &range : ranges) {
+		if (merged > 0 && range.start_byte <= ranges[merged - 1].end_byte) {
+			ranges[merged - 1].end_byte = std::max(ranges[merged - 1].end_byte, range.end_byte);
+		} else {
+			ranges[merged++] = range;
+		}
+	}
+	ranges.resize(merged);
+	if (length == 0) {
+		return;
+	}
+
+	TSNode root = ts_tree_root_node(tree);
+	TSTreeCursor cursor = ts_tree_cursor_new(root);
+	collect_leaves(&cursor, "", root, 0, false);
+	ts_tree_cursor_delete(&cursor);
+
+	// Earlier passes win where replacements overlap: blank line gaps over the
+	// whitespace on those lines, trailing commas over the spaces they remove.
+	if (options.blank_lines_around_functions) {
+		format_blank_lines(root);
+	}
+	if (options.trailing_commas) {
+		format_trailing_commas();
+	}
+	if (options.indentation) {
+		format_indentation();
+	}
+	if (options.spacing) {
+		format_spacing();
+	}
+	if (options.trailing_whitespace) {
+		format_trailing_whitespace();
+	}
+
+	std::stable_sort(replacements.begin(), replacements.end(), [](const LineMerge::Replacement &a, const LineMerge::Replacement &b) {
+		return a.start_byte != b.start_byte ? a.start_byte < b.start_byte : a.end_byte > b.end_byte;
+	});
+	for (LineMerge::Replacement &replacement : replacements) {
+		if (!r_replacements.empty() && replacement.start_byte < r_replacements.back().end_byte) {
+			continue;
+		}
+		r_replacements.push_back(std::move(replacement));
+	}
+	replacements.clear();
+}
+
+// Comments are left out: they are extras and may attach to a different
+// parent once the whitespace around them changes.
+static bool is_structural(TSNode node) {
+	return ts_node_is_named(node) && !ts_node_is_extra(node);
+}
+
+static uint64_t hash_named_subtree(TSTreeCursor *cursor, uint64_t hash) {
+	hash = content_hash::merge_round64(hash, ts_node_symbol(ts_tree_cursor_current_node(cursor)));
+	if (ts_tree_cursor_goto_first_child(cursor)) {
+		do {
+			if (is_structural(ts_tree_cursor_current_node(cursor))) {
+				hash = hash_named_subtree(cursor, hash);
+			}
+		} while (ts_tree_cursor_goto_next_sibling(cursor));
+		ts_tree_cursor_goto_parent(cursor);
+	}
+	// Closes the child list, so the hash captures the shape.
+	return content_hash::merge_round64(hash, 0xFFFF);
+}
+
+uint64_t GDScriptFormatter::structure_hash(TSNode root, uint32_t start, uint32_t end) {
+	uint64_t hash = content_hash::PRIME64_5;
+	uint32_t child_count = 0;
+	TSTreeCursor cursor = ts_tree_cursor_new(root);
+	if (ts_tree_cursor_goto_first_child(&cursor)) {
+		do {
+			TSNode child = ts_tree_cursor_current_node(&cursor);
+			if (!is_structural(child)) {
+				continue;
+			}
+			child_count++;
+			if (ts_node_start_byte(child) < end && ts_node_end_byte(child) > start) {
+				hash = hash_named_subtree(&cursor, hash);
+			}
+		} while (ts_tree_cursor_goto_next_sibling(&cursor));
+	}
+	ts_tree_cursor_delete(&cursor);
+	return content_hash::merge_round64(hash, child_count);
+}
@@ -0,0 +1,97 @@
+#ifndef GDSCRIPT_FORMATTER_H
+#define GDSCRIPT_FORMATTER_H
+
+#include "line_diff.h"
+#include "line_merge.h"
+
+#include <tree_sitter/api.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Formatter driven by the syntax tree of a GDScript file. Produces minimal
+// replacements instead of printing a new file:
+//   - statement lines are indented by the number of enclosing blocks,
+//   - spaces between tokens on a line follow the style guide (around
+//     operators, after commas and colons, none inside brackets or calls),
+//   - trailing whitespace is removed,
+//   - functions and classes are surrounded by blank_lines empty lines,
+//   - multi-line comma lists get a trailing comma, single-line ones lose it.
+// Only lines overlapping the requested ranges are touched. Strings, comments
+// and error nodes are left as they are, as are lines continued with a
+// backslash or inside brackets (apart from the closing bracket).
+class GDScriptFormatter {
+public:
+	struct Options {
+		std::string indent = "\t";
+		uint32_t blank_lines = 2;
+		bool indentation = true;
+		bool spacing = true;
+		bool trailing_whitespace = true;
+		bool trailing_commas = true;
+		bool blank_lines_around_functions = true;
+	};
+
+	struct Range {
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+	};
+
+private:
+	struct Leaf {
+		TSNode node;
+		TSNode parent;
+		uint32_t start = 0;
+		uint32_t end = 0;
+		// Token text for anonymous nodes, node type otherwise.
+		const char *type = nullptr;
+		bool named = false;
+		// Operator tokens of unary and binary expressions.
+		bool unary = false;
+		bool binary = false;
+		// Comments, strings' insides and error nodes are never changed.
+		bool keep = false;
+		bool in_bracket = false;
+		uint32_t depth = 0;
+	};
+
+	const char *data = nullptr;
+	uint32_t length = 0;
+	const std::vector<LineDiff::Line> *lines = nullptr;
+	// Sorted, disjoint and extended to whole lines.
+	std::vector<Range> ranges;
+	Options options;
+	std::vector<Leaf> leaves;
+	// Replacements in the order they were produced; overlaps are resolved
+	// in favour of the earlier, larger one.
+	std::vector<LineMerge::Replacement> replacements;
+	std::string newline;
+
+	bool overlaps(uint32_t start, uint32_t end) const;
+	uint32_t row_of(uint32_t byte) const;
+	uint32_t line_start(uint32_t row) const;
+	const Leaf *leaf_at(uint32_t byte) const;
+	void add_replacement(uint32_t start, uint32_t end, const std::string &bytes);
+
+	void collect_leaves(TSTreeCursor *cursor, const char *parent_type, TSNode parent, uint32_t depth, bool in_bracket);
+	void format_indentation();
+	void format_spacing();
+	void format_trailing_whitespace();
+	void format_trailing_commas();
+	void format_blank_lines(TSNode container);
+
+public:
+	// Formats the parts of data (split into lines) overlapping ranges, or
+	// everything if ranges is empty. Replacements are sorted and disjoint.
+	void format(TSTree *tree, const char *p_data, uint32_t p_length, const std::vector<LineDiff::Line> &p_lines,
+			const std::vector<Range> &p_ranges, const Options &p_options, std::vector<LineMerge::Replacement> &r_replacements);
+
+	// Hash of the shape of the named nodes (comments aside) of root's
+	// children overlapping [start, end), plus root's child count. Formatting
+	// must not change it; a reparse that does means the formatter misread
+	// the grammar.
+	static uint64_t structure_hash(TSNode root, uint32_t start, uint32_t end);
+};
+
+#endif // GDSCRIPT_FORMATTER_H
@@ -0,0 +1,121 @@
+#include "highlight_cache.h"
+
+#include "memory_usage.h"
+#include "perf_stats.h"
+
+#include <algorithm>
+
+void HighlightCache::reset(uint32_t line_count, uint64_t p_generation) {
+	lines.clear();
+	lines.resize(line_count);
+	generation = p_generation;
+}
+
+bool HighlightCache::is_current(uint64_t p_generation, uint32_t line_count) const {
+	return generation != 0 && generation == p_generation && lines.size() == line_count;
+}
+
+void HighlightCache::splice(uint32_t first, uint32_t old_count, uint32_t new_count) {
+	if (first > lines.size()) {
+		return;
+	}
+	old_count = std::min<uint32_t>(old_count, lines.size() - first);
+	uint32_t kept = std::min(old_count, new_count);
+	for (uint32_t i = first; i < first + kept; i++) {
+		lines[i].spans.clear();
+		lines[i].valid = false;
+	}
+	if (new_count > old_count) {
+		lines.insert(lines.begin() + first + old_count, new_count - old_count, Line());
+	} else if (old_count > new_count) {
+		lines.erase(lines.begin() + first + new_count, lines.begin() + first + old_count);
+	}
+}
+
+void HighlightCache::invalidate(uint32_t first, uint32_t last) {
+	last = std::min<uint32_t>(last, lines.size() - 1);
+	for (uint32_t i = first; i <= last && i < lines.size(); i++) {
+		lines[i].valid = false;
+	}
+}
+
+void HighlightCache::refresh(TSQueryCursor *cursor, const TSQuery *query, TSNode root, const char *data, uint32_t length,
+		const std::vector<LineDiff::Line> &text_lines, const std::vector<bool> &capture_enabled, uint32_t first, uint32_t last) {
+	if (lines.empty() || first >= lines.size()) {
+		return;
+	}
+	last = std::min<uint32_t>(last, lines.size() - 1);
+
+	// Lines past the table are the empty line after a final newline.
+	auto line_start = [&](uint32_t row) {
+		return row < text_lines.size() ? text_lines[row].start : length;
+	};
+	auto line_end = [&](uint32_t row) {
+		return row < text_lines.size() ? text_lines[row].start + text_lines[row].length : length;
+	};
+
+	uint32_t range_start = line_start(first);
+	uint32_t range_end = line_end(last);
+	paint.assign(range_end - range_start, -1);
+
+	if (range_end > range_start) {
+		perf_stats::Scope scope(perf_stats::PHASE_QUERY_EXEC);
+		ts_query_cursor_set_byte_range(cursor, range_start, range_end);
+		ts_query_cursor_exec(cursor, query, root);
+		TSQueryMatch match;
+		uint32_t capture_index = 0;
+		while (ts_query_cursor_next_capture(cursor, &match, &capture_index)) {
+			const TSQueryCapture &capture = match.captures[capture_index];
+			scope.add_amount(1);
+			if (capture.index >= capture_enabled.size() || !capture_enabled[capture.index]) {
+				continue;
+			}
+			uint32_t start = std::max(ts_node_start_byte(capture.node), range_start);
+			uint32_t end = std::min(ts_node_end_byte(capture.node), range_end);
+			if (start < end) {
+				std::fill(paint.begin() + (start - range_start), paint.begin() + (end - range_start), (int32_t)capture.index);
+			}
+		}
+	}
+
+	for (uint32_t row = first; row <= last; row++) {
+		Line &line = lines[row];
+		if (line.valid) {
+			continue;
+		}
+		line.spans.clear();
+		line.valid = true;
+
+		uint32_t end = line_end(row);
+		uint32_t column = 0;
+		int32_t current = -1;
+		for (uint32_t i = line_start(row); i < end; i++) {
+			// Continuation bytes belong to the previous character.
+			if (((uint8_t)data[i] & 0xC0) == 0x80) {
+				continue;
+			}
+			int32_t capture = paint[i - range_start];
+			if (capture != current) {
+				if (current >= 0) {
+					line.spans.back().end_column = column;
+				}
+				if (capture >= 0) {
+					line.spans.push_back({ column, column, (uint32_t)capture });
+				}
+				current = capture;
+			}
+			column++;
+		}
+		if (current >= 0) {
+			line.spans.back().end_column = column;
+		}
+	}
+}
+
+uint64_t HighlightCache::get_memory_bytes() const {
+	uint64_t bytes = memory_usage::of(lines) + memory_usage::of(paint);
+	for (const Line &line : lines) {
+		bytes += memory_usage::of(line.spans);
+	}
+	return bytes;
+}
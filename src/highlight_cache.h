@@ -0,0 +1,63 @@
+#ifndef HIGHLIGHT_CACHE_H
+#define HIGHLIGHT_CACHE_H
+
+#include "line_diff.h"
+
+#include <tree_sitter/api.h>
+
+#include <cstdint>
+#include <vector>
+
+// Per-line highlight spans of one file, computed from a highlight query.
+//
+// Lines start out invalid and are filled in batches by refresh(), which runs
+// the query over the byte range of the batch only. Edits splice the line
+// table (lines after the edit keep their spans, just moved) and invalidate
+// the lines they touched, so reading a line costs its span count unless it
+// has to be recomputed.
+//
+// Overlapping captures are resolved by painting them in the order the query
+// cursor returns them: a capture starting later (an inner node) or from a
+// later pattern wins. Columns are in characters, as CodeEdit counts them.
+class HighlightCache {
+public:
+	struct Span {
+		uint32_t start_column = 0;
+		uint32_t end_column = 0;
+		uint32_t capture = 0;
+	};
+
+private:
+	struct Line {
+		std::vector<Span> spans;
+		bool valid = false;
+	};
+
+	std::vector<Line> lines;
+	// Query configuration the spans were computed with; 0: never filled.
+	uint64_t generation = 0;
+	std::vector<int32_t> paint;
+
+public:
+	// Drops every span; the file has line_count lines (newlines + 1).
+	void reset(uint32_t line_count, uint64_t p_generation);
+	bool is_current(uint64_t p_generation, uint32_t line_count) const;
+	uint32_t get_line_count() const { return lines.size(); }
+	uint64_t get_memory_bytes() const;
+
+	// Replaces lines [first, first + old_count) by new_count invalid lines.
+	void splice(uint32_t first, uint32_t old_count, uint32_t new_count);
+	// Marks lines [first, last] for recomputation.
+	void invalidate(uint32_t first, uint32_t last);
+
+	bool is_valid(uint32_t line) const { return line < lines.size() && lines[line].valid; }
+	const std::vector<Span> &get_spans(uint32_t line) const { return lines[line].spans; }
+
+	// Recomputes the invalid lines in [first, last]. text_lines is the line
+	// table of data (see LineDiff::split_lines); captures whose entry in
+	// capture_enabled is false are ignored.
+	void refresh(TSQueryCursor *cursor, const TSQuery *query, TSNode root, const char *data, uint32_t length,
+			const std::vector<LineDiff::Line> &text_lines, const std::vector<bool> &capture_enabled, uint32_t first, uint32_t last);
+};
+
+#endif // HIGHLIGHT_CACHE_H
@@ -0,0 +1,559 @@
+#include "line_diff.h"
+
+#include "content_hash.h"
+#include "perf_stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const uint32_t NO_INDEX = 0xFFFFFFFFu;
+// Histogram diff ignores lines that occur more often than this in the old
+// range and falls back to Myers if only such lines are shared.
+static const uint32_t HISTOGRAM_MAX_CHAIN = 64;
+
+void LineDiff::split_lines(const char *data, uint32_t length, std::vector<Line> &r_lines) {
+	r_lines.clear();
+	uint32_t line_start = 0;
+	const char *cursor = data;
+	const char *end = data + length;
+	while (cursor < end) {
+		const char *newline = static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+		if (!newline) {
+			break;
+		}
+		uint32_t newline_pos = (uint32_t)(newline - data);
+		Line line;
+		line.start = line_start;
+		line.length = newline_pos - line_start;
+		line.has_newline = true;
+		r_lines.push_back(line);
+		line_start = newline_pos + 1;
+		cursor = newline + 1;
+	}
+	if (line_start < length) {
+		Line line;
+		line.start = line_start;
+		line.length = length - line_start;
+		line.has_newline = false;
+		r_lines.push_back(line);
+	}
+}
+
+void LineDiff::intern_lines(uint32_t begin_old, uint32_t end_old, uint32_t begin_new, uint32_t end_new) {
+	struct Slot {
+		uint64_t hash;
+		const char *data;
+		uint32_t length;
+		uint32_t id;
+		bool has_newline;
+	};
+
+	uint32_t total = (end_old - begin_old) + (end_new - begin_new);
+	uint32_t capacity = 16;
+	while (capacity < total * 2) {
+		capacity <<= 1;
+	}
+	std::vector<Slot> table(capacity);
+	for (Slot &slot : table) {
+		slot.id = NO_INDEX;
+	}
+	uint32_t mask = capacity - 1;
+	id_count = 0;
+
+	auto intern = [&](const char *data, const Line &line) -> uint32_t {
+		const char *text = data + line.start;
+		uint64_t hash = content_hash::hash_bytes(text, line.length, line.has_newline ? 1 : 0);
+		uint32_t index = (uint32_t)hash & mask;
+		while (true) {
+			Slot &slot = table[index];
+			if (slot.id == NO_INDEX) {
+				slot.hash = hash;
+				slot.data = text;
+				slot.length = line.length;
+				slot.has_newline = line.has_newline;
+				slot.id = id_count++;
+				return slot.id;
+			}
+			if (slot.hash == hash && slot.length == line.length && slot.has_newline == line.has_newline &&
+					memcmp(slot.data, text, line.length) == 0) {
+				return slot.id;
+			}
+			index = (index + 1) & mask;
+		}
+	};
+
+	for (uint32_t i = begin_old; i < end_old; i++) {
+		old_ids[i] = intern(old_data, old_lines[i]);
+	}
+	for (uint32_t i = begin_new; i < end_new; i++) {
+		new_ids[i] = intern(new_data, new_lines[i]);
+	}
+}
+
+void LineDiff::mark_range(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1) {
+	for (uint32_t i = a0; i < a1; i++) {
+		old_changed[i] = 1;
+	}
+	for (uint32_t i = b0; i < b1; i++) {
+		new_changed[i] = 1;
+	}
+}
+
+bool LineDiff::trim_range(uint32_t &a0, uint32_t &a1, uint32_t &b0, uint32_t &b1) {
+	while (a0 < a1 && b0 < b1 && old_ids[a0] == new_ids[b0]) {
+		a0++;
+		b0++;
+	}
+	while (a0 < a1 && b0 < b1 && old_ids[a1 - 1] == new_ids[b1 - 1]) {
+		a1--;
+		b1--;
+	}
+	if (a0 == a1 || b0 == b1) {
+		mark_range(a0, a1, b0, b1);
+		return false;
+	}
+	return true;
+}
+
+// Finds a point on an optimal edit path roughly halfway through it by
+// running the forward and reverse searches until they overlap. Uses O(N+M)
+// space regardless of the edit distance.
+void LineDiff::split_middle_snake(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1, uint32_t &r_x, uint32_t &r_y) {
+	const uint32_t *a = old_ids.data();
+	const uint32_t *b = new_ids.data();
+	int32_t n = (int32_t)(a1 - a0);
+	int32_t m = (int32_t)(b1 - b0);
+	int32_t delta = n - m;
+	bool odd = (delta & 1) != 0;
+	int32_t max_d = (n + m + 1) / 2;
+	int32_t offset = max_d + 1;
+
+	int32_t *vf = forward_v.data();
+	int32_t *vb = backward_v.data();
+	vf[offset + 1] = 0;
+	vb[offset + 1] = 0;
+
+	for (int32_t d = 0; d <= max_d; d++) {
+		for (int32_t k = -d; k <= d; k += 2) {
+			int32_t x;
+			if (k == -d || (k != d && vf[offset + k - 1] < vf[offset + k + 1])) {
+				x = vf[offset + k + 1];
+			} else {
+				x = vf[offset + k - 1] + 1;
+			}
+			int32_t y = x - k;
+			while (x < n && y < m && a[a0 + x] == b[b0 + y]) {
+				x++;
+				y++;
+			}
+			vf[offset + k] = x;
+			if (odd && k >= delta - (d - 1) && k <= delta + (d - 1)) {
+				if (vf[offset + k] + vb[offset + delta - k] >= n) {
+					r_x = a0 + x;
+					r_y = b0 + y;
+					return;
+				}
+			}
+		}
+
+		for (int32_t k = -d; k <= d; k += 2) {
+			int32_t u;
+			if (k == -d || (k != d && vb[offset + k - 1] < vb[offset + k + 1])) {
+				u = vb[offset + k + 1];
+			} else {
+				u = vb[offset + k - 1] + 1;
+			}
+			int32_t v = u - k;
+			while (u < n && v < m && a[a1 - 1 - u] == b[b1 - 1 - v]) {
+				u++;
+				v++;
+			}
+			vb[offset + k] = u;
+			if (!odd && delta - k >= -d && delta - k <= d) {
+				if (vb[offset + k] + vf[offset + delta - k] >= n) {
+					r_x = a1 - u;
+					r_y = b1 - v;
+					return;
+				}
+			}
+		}
+	}
+
+	// Not reachable for non-empty ranges; split at the start so the caller
+	// treats the whole range as changed.
+	r_x = a0;
+	r_y = b0;
+}
+
+void LineDiff::diff_myers(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1) {
+	if (!trim_range(a0, a1, b0, b1)) {
+		return;
+	}
+
+	uint32_t x = a0;
+	uint32_t y = b0;
+	split_middle_snake(a0, a1, b0, b1, x, y);
+	if ((x == a0 && y == b0) || (x == a1 && y == b1)) {
+		mark_range(a0, a1, b0, b1);
+		return;
+	}
+
+	diff_myers(a0, x, b0, y);
+	diff_myers(x, a1, y, b1);
+}
+
+void LineDiff::diff_patience(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1) {
+	if (!trim_range(a0, a1, b0, b1)) {
+		return;
+	}
+
+	uint32_t *count_a = id_scratch_a.data();
+	uint32_t *count_b = id_scratch_b.data();
+	uint32_t *position_a = position_scratch.data();
+
+	for (uint32_t i = a0; i < a1; i++) {
+		count_a[old_ids[i]]++;
+		position_a[old_ids[i]] = i;
+	}
+	for (uint32_t j = b0; j < b1; j++) {
+		count_b[new_ids[j]]++;
+	}
+
+	struct Anchor {
+		uint32_t a;
+		uint32_t b;
+	};
+	std::vector<Anchor> candidates;
+	for (uint32_t j = b0; j < b1; j++) {
+		uint32_t id = new_ids[j];
+		if (count_a[id] == 1 && count_b[id] == 1) {
+			candidates.push_back({ position_a[id], j });
+		}
+	}
+
+	for (uint32_t i = a0; i < a1; i++) {
+		count_a[old_ids[i]] = 0;
+	}
+	for (uint32_t j = b0; j < b1; j++) {
+		count_b[new_ids[j]] = 0;
+	}
+
+	if (candidates.empty()) {
+		diff_myers(a0, a1, b0, b1);
+		return;
+	}
+
+	// Longest increasing subsequence of old positions (candidates are in new
+	// order), via patience sorting.
+	std::vector<uint32_t> pile_tops;
+	std::vector<uint32_t> previous(candidates.size(), NO_INDEX);
+	for (uint32_t c = 0; c < candidates.size(); c++) {
+		uint32_t low = 0;
+		uint32_t high = pile_tops.size();
+		while (low < high) {
+			uint32_t mid = (low + high) / 2;
+			if (candidates[pile_tops[mid]].a < candidates[c].a) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		if (low > 0) {
+			previous[c] = pile_tops[low - 1];
+		}
+		if (low == pile_tops.size()) {
+			pile_tops.push_back(c);
+		} else {
+			pile_tops[low] = c;
+		}
+	}
+
+	std::vector<Anchor> anchors;
+	for (uint32_t c = pile_tops.back(); c != NO_INDEX; c = previous[c]) {
+		anchors.push_back(candidates[c]);
+	}
+	std::reverse(anchors.begin(), anchors.end());
+
+	uint32_t prev_a = a0;
+	uint32_t prev_b = b0;
+	for (const Anchor &anchor : anchors) {
+		diff_patience(prev_a, anchor.a, prev_b, anchor.b);
+		prev_a = anchor.a + 1;
+		prev_b = anchor.b + 1;
+	}
+	diff_patience(prev_a, a1, prev_b, b1);
+}
+
+void LineDiff::diff_histogram(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1) {
+	if (!trim_range(a0, a1, b0, b1)) {
+		return;
+	}
+
+	uint32_t *occurrences = id_scratch_a.data();
+	uint32_t *chain_head = position_scratch.data();
+	std::vector<uint32_t> chain_next(a1 - a0);
+
+	for (uint32_t i = a1; i-- > a0;) {
+		uint32_t id = old_ids[i];
+		chain_next[i - a0] = occurrences[id] ? chain_head[id] : NO_INDEX;
+		chain_head[id] = i;
+		occurrences[id]++;
+	}
+
+	bool shares_lines = false;
+	uint32_t best_length = 0;
+	uint32_t best_rarity = HISTOGRAM_MAX_CHAIN;
+	uint32_t best_a0 = 0, best_a1 = 0, best_b0 = 0, best_b1 = 0;
+
+	for (uint32_t j = b0; j < b1;) {
+		uint32_t id = new_ids[j];
+		uint32_t advance = 1;
+		if (occurrences[id] > 0) {
+			shares_lines = true;
+		}
+		if (occurrences[id] > 0 && occurrences[id] <= best_rarity) {
+			for (uint32_t i = chain_head[id]; i != NO_INDEX; i = chain_next[i - a0]) {
+				uint32_t match_a0 = i, match_b0 = j;
+				while (match_a0 > a0 && match_b0 > b0 && old_ids[match_a0 - 1] == new_ids[match_b0 - 1]) {
+					match_a0--;
+					match_b0--;
+				}
+				uint32_t match_a1 = i + 1, match_b1 = j + 1;
+				while (match_a1 < a1 && match_b1 < b1 && old_ids[match_a1] == new_ids[match_b1]) {
+					match_a1++;
+					match_b1++;
+				}
+
+				uint32_t rarity = occurrences[id];
+				for (uint32_t k = match_a0; k < match_a1; k++) {
+					rarity = std::min(rarity, occurrences[old_ids[k]]);
+				}
+				uint32_t length = match_a1 - match_a0;
+				if (rarity < best_rarity || (rarity == best_rarity && length > best_length)) {
+					best_rarity = rarity;
+					best_length = length;
+					best_a0 = match_a0;
+					best_a1 = match_a1;
+					best_b0 = match_b0;
+					best_b1 = match_b1;
+				}
+				advance = std::max(advance, match_b1 - j);
+			}
+		}
+		j += advance;
+	}
+
+	for (uint32_t i = a0; i < a1; i++) {
+		occurrences[old_ids[i]] = 0;
+	}
+
+	if (best_length == 0) {
+		if (shares_lines) {
+			diff_myers(a0, a1, b0, b1);
+		} else {
+			mark_range(a0, a1, b0, b1);
+		}
+		return;
+	}
+
+	diff_histogram(a0, best_a0, b0, best_b0);
+	diff_histogram(best_a1, a1, best_b1, b1);
+}
+
+void LineDiff::collect_changes() {
+	changes.clear();
+	uint32_t i = 0;
+	uint32_t j = 0;
+	while (i < old_count || j < new_count) {
+		if (i < old_count && j < new_count && !old_changed[i] && !new_changed[j]) {
+			i++;
+			j++;
+			continue;
+		}
+		Change change;
+		change.old_start = i;
+		change.new_start = j;
+		while (i < old_count && old_changed[i]) {
+			i++;
+		}
+		while (j < new_count && new_changed[j]) {
+			j++;
+		}
+		change.old_count = i - change.old_start;
+		change.new_count = j - change.new_start;
+		if (change.old_count == 0 && change.new_count == 0) {
+			// Unbalanced unchanged lines cannot happen for a valid alignment;
+			// stop instead of looping.
+			break;
+		}
+		changes.push_back(change);
+	}
+}
+
+void LineDiff::compute(const char *p_old_data, const Line *p_old_lines, uint32_t p_old_count,
+		const char *p_new_data, const Line *p_new_lines, uint32_t p_new_count,
+		Algorithm algorithm, uint32_t equal_prefix, uint32_t equal_suffix) {
+	perf_stats::Scope scope(perf_stats::PHASE_DIFF);
+	scope.add_amount(p_old_count + p_new_count);
+	old_data = p_old_data;
+	new_data = p_new_data;
+	old_lines = p_old_lines;
+	new_lines = p_new_lines;
+	old_count = p_old_count;
+	new_count = p_new_count;
+
+	uint32_t shorter = std::min(old_count, new_count);
+	equal_prefix = std::min(equal_prefix, shorter);
+	equal_suffix = std::min(equal_suffix, shorter - equal_prefix);
+
+	old_ids.assign(old_count, 0);
+	new_ids.assign(new_count, 0);
+	old_changed.assign(old_count, 0);
+	new_changed.assign(new_count, 0);
+
+	uint32_t a0 = equal_prefix;
+	uint32_t a1 = old_count - equal_suffix;
+	uint32_t b0 = equal_prefix;
+	uint32_t b1 = new_count - equal_suffix;
+	intern_lines(a0, a1, b0, b1);
+
+	uint32_t span = (a1 - a0) + (b1 - b0);
+	forward_v.assign(span + 4, 0);
+	backward_v.assign(span + 4, 0);
+	if (algorithm != ALGORITHM_MYERS) {
+		id_scratch_a.assign(id_count, 0);
+		id_scratch_b.assign(id_count, 0);
+		position_scratch.assign(id_count, 0);
+	}
+
+	switch (algorithm) {
+		case ALGORITHM_PATIENCE:
+			diff_patience(a0, a1, b0, b1);
+			break;
+		case ALGORITHM_HISTOGRAM:
+			diff_histogram(a0, a1, b0, b1);
+			break;
+		default:
+			diff_myers(a0, a1, b0, b1);
+			break;
+	}
+
+	collect_changes();
+}
+
+std::vector<LineDiff::Hunk> LineDiff::make_hunks(uint32_t context) const {
+	std::vector<Hunk> hunks;
+	uint32_t previous_old_end = 0;
+	for (uint32_t c = 0; c < changes.size(); c++) {
+		const Change &change = changes[c];
+		bool extends_hunk = !hunks.empty() && change.old_start - previous_old_end <= 2 * context;
+		if (!extends_hunk) {
+			uint32_t lead = std::min(context, change.old_start - previous_old_end);
+			Hunk hunk;
+			hunk.old_start = change.old_start - lead;
+			hunk.new_start = change.new_start - lead;
+			hunk.first_change = c;
+			hunks.push_back(hunk);
+		}
+		hunks.back().change_count++;
+		previous_old_end = change.old_start + change.old_count;
+	}
+
+	// Lines after the last change of a hunk are unchanged on both sides, so
+	// the trailing context is the same length in old and new.
+	for (Hunk &hunk : hunks) {
+		const Change &last = changes[hunk.first_change + hunk.change_count - 1];
+		uint32_t old_end = last.old_start + last.old_count;
+		uint32_t new_end = last.new_start + last.new_count;
+		uint32_t trail = std::min(context, old_count - old_end);
+		hunk.old_count = old_end + trail - hunk.old_start;
+		hunk.new_count = new_end + trail - hunk.new_start;
+	}
+	return hunks;
+}
+
+namespace {
+
+// Either measures or writes the output, so the buffer can be sized exactly
+// before anything is copied.
+struct UnifiedWriter {
+	std::string *output = nullptr;
+	size_t size = 0;
+
+	void emit(const char *data, size_t length) {
+		if (output) {
+			output->append(data, length);
+		} else {
+			size += length;
+		}
+	}
+
+	void emit_char(char c) {
+		if (output) {
+			output->push_back(c);
+		} else {
+			size++;
+		}
+	}
+};
+
+} // namespace
+
+void LineDiff::write_unified(const std::string &old_label, const std::string &new_label, uint32_t context, std::string &r_output) const {
+	std::vector<Hunk> hunks = make_hunks(context);
+	static const char NO_NEWLINE[] = "\\ No newline at end of file\n";
+
+	auto render = [&](UnifiedWriter &writer) {
+		writer.emit("--- ", 4);
+		writer.emit(old_label.data(), old_label.size());
+		writer.emit_char('\n');
+		writer.emit("+++ ", 4);
+		writer.emit(new_label.data(), new_label.size());
+		writer.emit_char('\n');
+
+		auto emit_line = [&](char prefix, const char *data, const Line &line, bool is_last) {
+			writer.emit_char(prefix);
+			writer.emit(data + line.start, line.length);
+			writer.emit_char('\n');
+			if (is_last && !line.has_newline) {
+				writer.emit(NO_NEWLINE, sizeof(NO_NEWLINE) - 1);
+			}
+		};
+
+		for (const Hunk &hunk : hunks) {
+			char header[96];
+			int header_length = snprintf(header, sizeof(header), "@@ -%u,%u +%u,%u @@\n",
+					hunk.old_count ? hunk.old_start + 1 : hunk.old_start, hunk.old_count,
+					hunk.new_count ? hunk.new_start + 1 : hunk.new_start, hunk.new_count);
+			writer.emit(header, header_length);
+
+			uint32_t i = hunk.old_start;
+			uint32_t j = hunk.new_start;
+			for (uint32_t c = hunk.first_change; c < hunk.first_change + hunk.change_count; c++) {
+				const Change &change = changes[c];
+				for (; i < change.old_start; i++, j++) {
+					emit_line(' ', old_data, old_lines[i], i + 1 == old_count);
+				}
+				for (; i < change.old_start + change.old_count; i++) {
+					emit_line('-', old_data, old_lines[i], i + 1 == old_count);
+				}
+				for (; j < change.new_start + change.new_count; j++) {
+					emit_line('+', new_data, new_lines[j], j + 1 == new_count);
+				}
+			}
+			for (; i < hunk.old_start + hunk.old_count; i++, j++) {
+				emit_line(' ', old_data, old_lines[i], i + 1 == old_count);
+			}
+		}
+	};
+
+	UnifiedWriter measure;
+	render(measure);
+
+	r_output.clear();
+	r_output.reserve(measure.size);
+	UnifiedWriter writer;
+	writer.output = &r_output;
+	render(writer);
+}
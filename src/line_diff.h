@@ -0,0 +1,115 @@
+#ifndef LINE_DIFF_H
+#define LINE_DIFF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Line-based diff between two byte buffers.
+//
+// Lines are interned into dense integer ids (equal content -> equal id), the
+// common prefix and suffix are trimmed, and the remainder is compared with
+// one of three algorithms:
+//   - Myers O(ND) with the linear-space middle-snake divide and conquer,
+//   - patience (anchors on lines unique to both sides),
+//   - histogram (anchors on the least frequent common lines).
+// Both sides are then exposed as a list of changed regions, from which
+// unified text or structured hunks are produced.
+class LineDiff {
+public:
+	enum Algorithm {
+		ALGORITHM_MYERS,
+		ALGORITHM_PATIENCE,
+		ALGORITHM_HISTOGRAM,
+	};
+
+	// Kinds of line runs in structured output.
+	enum Op {
+		OP_EQUAL,
+		OP_DELETE,
+		OP_INSERT,
+		OP_REPLACE,
+	};
+
+	struct Line {
+		uint32_t start = 0;
+		// Length without the terminating '\n'.
+		uint32_t length = 0;
+		bool has_newline = false;
+	};
+
+	// A maximal run of changed lines: old[old_start, old_start + old_count)
+	// is replaced by new[new_start, new_start + new_count].
+	struct Change {
+		uint32_t old_start = 0;
+		uint32_t old_count = 0;
+		uint32_t new_start = 0;
+		uint32_t new_count = 0;
+	};
+
+	// Changes grouped with their surrounding context lines.
+	struct Hunk {
+		uint32_t old_start = 0;
+		uint32_t old_count = 0;
+		uint32_t new_start = 0;
+		uint32_t new_count = 0;
+		uint32_t first_change = 0;
+		uint32_t change_count = 0;
+	};
+
+private:
+	const char *old_data = nullptr;
+	const char *new_data = nullptr;
+	const Line *old_lines = nullptr;
+	const Line *new_lines = nullptr;
+	uint32_t old_count = 0;
+	uint32_t new_count = 0;
+
+	std::vector<uint32_t> old_ids;
+	std::vector<uint32_t> new_ids;
+	uint32_t id_count = 0;
+	std::vector<uint8_t> old_changed;
+	std::vector<uint8_t> new_changed;
+	std::vector<Change> changes;
+
+	// Scratch space shared by the recursive passes.
+	std::vector<int32_t> forward_v;
+	std::vector<int32_t> backward_v;
+	std::vector<uint32_t> id_scratch_a;
+	std::vector<uint32_t> id_scratch_b;
+	std::vector<uint32_t> position_scratch;
+
+	void intern_lines(uint32_t begin_old, uint32_t end_old, uint32_t begin_new, uint32_t end_new);
+	void mark_range(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1);
+	bool trim_range(uint32_t &a0, uint32_t &a1, uint32_t &b0, uint32_t &b1);
+	void split_middle_snake(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1, uint32_t &r_x, uint32_t &r_y);
+	void diff_myers(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1);
+	void diff_patience(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1);
+	void diff_histogram(uint32_t a0, uint32_t a1, uint32_t b0, uint32_t b1);
+	void collect_changes();
+
+public:
+	// Splits data into lines; a trailing '\n' does not start an extra line.
+	static void split_lines(const char *data, uint32_t length, std::vector<Line> &r_lines);
+
+	// Diffs the two line arrays. Lines in [0, equal_prefix) and the last
+	// equal_suffix lines of both sides are known to be identical (for example
+	// from edit history) and are neither hashed nor compared.
+	void compute(const char *old_data, const Line *old_lines, uint32_t old_count,
+			const char *new_data, const Line *new_lines, uint32_t new_count,
+			Algorithm algorithm, uint32_t equal_prefix = 0, uint32_t equal_suffix = 0);
+
+	const std::vector<Change> &get_changes() const { return changes; }
+	bool is_old_line_changed(uint32_t index) const { return old_changed[index] != 0; }
+	bool is_new_line_changed(uint32_t index) const { return new_changed[index] != 0; }
+	uint32_t get_old_count() const { return old_count; }
+	uint32_t get_new_count() const { return new_count; }
+
+	std::vector<Hunk> make_hunks(uint32_t context) const;
+
+	// Writes a unified diff (with ---/+++ headers) into r_output, which is
+	// sized once up front.
+	void write_unified(const std::string &old_label, const std::string &new_label, uint32_t context, std::string &r_output) const;
+};
+
+#endif // LINE_DIFF_H
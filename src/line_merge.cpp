@@ -0,0 +1,158 @@
+#include "line_merge.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint32_t LineMerge::line_byte(const Side &side, uint32_t line) {
+	return line < side.line_count ? side.lines[line].start : side.length;
+}
+
+bool LineMerge::same_lines(const Side &a, uint32_t a_start, uint32_t a_end, const Side &b, uint32_t b_start, uint32_t b_end) {
+	uint32_t a_from = line_byte(a, a_start);
+	uint32_t a_to = line_byte(a, a_end);
+	uint32_t b_from = line_byte(b, b_start);
+	uint32_t b_to = line_byte(b, b_end);
+	return a_to - a_from == b_to - b_from && memcmp(a.data + a_from, b.data + b_from, a_to - a_from) == 0;
+}
+
+// Appends whole lines, terminating the last one so a marker can follow.
+void LineMerge::append_lines(const Side &side, uint32_t start, uint32_t end, std::string &r_output) {
+	uint32_t from = line_byte(side, start);
+	uint32_t to = line_byte(side, end);
+	r_output.append(side.data + from, to - from);
+	if (to > from && side.data[to - 1] != '\n') {
+		r_output.push_back('\n');
+	}
+}
+
+void LineMerge::merge(const Side &base, const Side &ours, const Side &theirs, const Options &options,
+		std::vector<Replacement> &r_replacements, std::vector<Conflict> &r_conflicts) {
+	r_replacements.clear();
+	r_conflicts.clear();
+
+	LineDiff ours_diff;
+	LineDiff theirs_diff;
+	ours_diff.compute(base.data, base.lines, base.line_count, ours.data, ours.lines, ours.line_count, options.algorithm);
+	theirs_diff.compute(base.data, base.lines, base.line_count, theirs.data, theirs.lines, theirs.line_count, options.algorithm);
+	const std::vector<LineDiff::Change> &a = ours_diff.get_changes();
+	const std::vector<LineDiff::Change> &b = theirs_diff.get_changes();
+
+	size_t ia = 0;
+	size_t ib = 0;
+	// Offsets of ours / theirs / merged line numbers against base (merged
+	// against ours) for the text before the current chunk.
+	int64_t ours_delta = 0;
+	int64_t theirs_delta = 0;
+	int64_t merged_delta = 0;
+
+	while (ia < a.size() || ib < b.size()) {
+		bool take_ours = ib >= b.size() || (ia < a.size() && a[ia].old_start <= b[ib].old_start);
+		uint32_t lo = take_ours ? a[ia].old_start : b[ib].old_start;
+		uint32_t hi = lo;
+		size_t a_first = ia;
+		size_t b_first = ib;
+		int64_t ours_growth = 0;
+		int64_t theirs_growth = 0;
+
+		// Changes that overlap or touch the chunk join it.
+		bool grew = true;
+		while (grew) {
+			grew = false;
+			if (ia < a.size() && a[ia].old_start <= hi) {
+				hi = std::max(hi, a[ia].old_start + a[ia].old_count);
+				ours_growth += (int64_t)a[ia].new_count - a[ia].old_count;
+				ia++;
+				grew = true;
+			}
+			if (ib < b.size() && b[ib].old_start <= hi) {
+				hi = std::max(hi, b[ib].old_start + b[ib].old_count);
+				theirs_growth += (int64_t)b[ib].new_count - b[ib].old_count;
+				ib++;
+				grew = true;
+			}
+		}
+
+		uint32_t ours_start = lo + ours_delta;
+		uint32_t ours_end = hi + ours_delta + ours_growth;
+		uint32_t theirs_start = lo + theirs_delta;
+		uint32_t theirs_end = hi + theirs_delta + theirs_growth;
+		ours_delta += ours_growth;
+		theirs_delta += theirs_growth;
+
+		bool ours_changed = ia > a_first;
+		bool theirs_changed = ib > b_first;
+		if (!theirs_changed || (ours_changed && same_lines(ours, ours_start, ours_end, theirs, theirs_start, theirs_end))) {
+			continue;
+		}
+
+		Replacement replacement;
+		replacement.start_byte = line_byte(ours, ours_start);
+		replacement.end_byte = line_byte(ours, ours_end);
+		uint32_t replacement_lines = 0;
+
+		if (!ours_changed) {
+			replacement.bytes.assign(theirs.data + line_byte(theirs, theirs_start), line_byte(theirs, theirs_end) - line_byte(theirs, theirs_start));
+			replacement_lines = theirs_end - theirs_start;
+		} else {
+			Conflict conflict;
+			conflict.base_start = lo;
+			conflict.base_count = hi - lo;
+			conflict.ours_start = ours_start;
+			conflict.ours_count = ours_end - ours_start;
+			conflict.theirs_start = theirs_start;
+			conflict.theirs_count = theirs_end - theirs_start;
+			conflict.merged_start = ours_start + merged_delta;
+
+			switch (options.style) {
+				case STYLE_OURS:
+					replacement_lines = conflict.ours_count;
+					break;
+				case STYLE_THEIRS:
+					replacement.bytes.assign(theirs.data + line_byte(theirs, theirs_start), line_byte(theirs, theirs_end) - line_byte(theirs, theirs_start));
+					replacement_lines = conflict.theirs_count;
+					break;
+				default: {
+					std::string &block = replacement.bytes;
+					block.append("<<<<<<< ").append(options.ours_label).push_back('\n');
+					append_lines(ours, ours_start, ours_end, block);
+					replacement_lines = 1 + conflict.ours_count;
+					if (options.style == STYLE_DIFF3) {
+						block.append("||||||| ").append(options.base_label).push_back('\n');
+						append_lines(base, lo, hi, block);
+						replacement_lines += 1 + conflict.base_count;
+					}
+					block.append("=======\n");
+					append_lines(theirs, theirs_start, theirs_end, block);
+					block.append(">>>>>>> ").append(options.theirs_label).push_back('\n');
+					replacement_lines += 2 + conflict.theirs_count;
+				} break;
+			}
+			conflict.merged_count = replacement_lines;
+			r_conflicts.push_back(conflict);
+			if (options.style == STYLE_OURS) {
+				continue;
+			}
+		}
+
+		merged_delta += (int64_t)replacement_lines - (ours_end - ours_start);
+		r_replacements.push_back(std::move(replacement));
+	}
+}
+
+void LineMerge::apply(const Side &ours, const std::vector<Replacement> &replacements, std::string &r_merged) {
+	size_t size = ours.length;
+	for (const Replacement &replacement : replacements) {
+		size += replacement.bytes.size();
+		size -= replacement.end_byte - replacement.start_byte;
+	}
+	r_merged.clear();
+	r_merged.reserve(size);
+
+	uint32_t pos = 0;
+	for (const Replacement &replacement : replacements) {
+		r_merged.append(ours.data + pos, replacement.start_byte - pos);
+		r_merged.append(replacement.bytes);
+		pos = replacement.end_byte;
+	}
+	r_merged.append(ours.data + pos, ours.length - pos);
+}
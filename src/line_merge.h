@@ -0,0 +1,77 @@
+#ifndef LINE_MERGE_H
+#define LINE_MERGE_H
+
+#include "line_diff.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Line-based three-way merge with diff3 semantics.
+//
+// base->ours and base->theirs are diffed with LineDiff; changes from both
+// sides whose base ranges overlap or touch form one chunk. A chunk changed by
+// one side takes that side, a chunk changed identically by both is clean,
+// anything else is a conflict. The result is expressed as replacements of
+// byte ranges of ours, so callers can apply it as incremental edits.
+class LineMerge {
+public:
+	struct Side {
+		const char *data = nullptr;
+		uint32_t length = 0;
+		const LineDiff::Line *lines = nullptr;
+		uint32_t line_count = 0;
+	};
+
+	enum ConflictStyle {
+		// <<<<<<< ours / ======= / >>>>>>> theirs
+		STYLE_MERGE,
+		// Also shows the base between ||||||| and =======.
+		STYLE_DIFF3,
+		// Conflicts resolve to one side; they are still reported.
+		STYLE_OURS,
+		STYLE_THEIRS,
+	};
+
+	struct Options {
+		LineDiff::Algorithm algorithm = LineDiff::ALGORITHM_MYERS;
+		ConflictStyle style = STYLE_MERGE;
+		std::string ours_label = "ours";
+		std::string base_label = "base";
+		std::string theirs_label = "theirs";
+	};
+
+	// Line ranges are [start, start + count); merged_* is the range the
+	// conflict occupies in the merged text, markers included.
+	struct Conflict {
+		uint32_t base_start = 0;
+		uint32_t base_count = 0;
+		uint32_t ours_start = 0;
+		uint32_t ours_count = 0;
+		uint32_t theirs_start = 0;
+		uint32_t theirs_count = 0;
+		uint32_t merged_start = 0;
+		uint32_t merged_count = 0;
+	};
+
+	// Replaces ours[start_byte, end_byte) with bytes. Sorted and disjoint.
+	struct Replacement {
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		std::string bytes;
+	};
+
+private:
+	static uint32_t line_byte(const Side &side, uint32_t line);
+	static bool same_lines(const Side &a, uint32_t a_start, uint32_t a_end, const Side &b, uint32_t b_start, uint32_t b_end);
+	static void append_lines(const Side &side, uint32_t start, uint32_t end, std::string &r_output);
+
+public:
+	static void merge(const Side &base, const Side &ours, const Side &theirs, const Options &options,
+			std::vector<Replacement> &r_replacements, std::vector<Conflict> &r_conflicts);
+
+	// Applies sorted replacements to ours.
+	static void apply(const Side &ours, const std::vector<Replacement> &replacements, std::string &r_merged);
+};
+
+#endif // LINE_MERGE_H
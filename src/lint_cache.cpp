@@ -0,0 +1,153 @@
+#include "lint_cache.h"
+
+#include "memory_usage.h"
+
+#include <algorithm>
+
+typedef std::pair<uint32_t, uint32_t> ByteRange;
+
+// A zero-width edit still touches the nodes on both sides of it.
+static bool touches(uint32_t start, uint32_t end, const ByteRange &range) {
+	return start <= range.second && range.first <= end;
+}
+
+// Overlap as a cursor limited to range sees it (empty nodes count as one
+// byte wide).
+static bool overlaps(uint32_t start, uint32_t end, const ByteRange &range) {
+	return start < range.second && range.first < std::max(end, start + 1);
+}
+
+void LintCache::clear() {
+	diagnostics.clear();
+	dirty.clear();
+	version = 0;
+	generation = 0;
+	scanned_bytes = 0;
+}
+
+void LintCache::apply_edit(const TSInputEdit &edit) {
+	int64_t byte_delta = (int64_t)edit.new_end_byte - edit.old_end_byte;
+	// Positions inside the replaced text collapse onto its start, which the
+	// new dirty range touches.
+	auto move = [&](uint32_t &r_byte) {
+		if (r_byte >= edit.old_end_byte) {
+			r_byte += byte_delta;
+		} else if (r_byte > edit.start_byte) {
+			r_byte = edit.start_byte;
+		}
+	};
+	for (LintEngine::Diagnostic &diagnostic : diagnostics) {
+		move(diagnostic.start_byte);
+		move(diagnostic.end_byte);
+		move(diagnostic.match_start_byte);
+		move(diagnostic.match_end_byte);
+	}
+	for (ByteRange &range : dirty) {
+		move(range.first);
+		move(range.second);
+	}
+	dirty.push_back({ edit.start_byte, edit.new_end_byte });
+}
+
+void LintCache::invalidate(uint32_t start_byte, uint32_t end_byte) {
+	dirty.push_back({ start_byte, std::max(start_byte, end_byte) });
+}
+
+void LintCache::update(const LintEngine &engine, uint64_t p_generation, TSQueryCursor *cursor, TSNode root, const char *data, uint32_t length,
+		uint64_t p_version, std::vector<LintEngine::RuleStats> &r_stats) {
+	scanned_bytes = 0;
+	if (version == p_version && generation == p_generation && dirty.empty()) {
+		return;
+	}
+
+	if (version != p_version || generation != p_generation) {
+		diagnostics.clear();
+		engine.run(cursor, root, data, 0, UINT32_MAX, diagnostics, r_stats);
+		scanned_bytes = length;
+	} else {
+		// Widen each range to the top-level statements it touches, so a
+		// match rooted in one of them is found whole by a cursor limited to
+		// the range, and one outside it lies in an untouched statement.
+		std::vector<ByteRange> statements;
+		TSTreeCursor walk = ts_tree_cursor_new(root);
+		if (ts_tree_cursor_goto_first_child(&walk)) {
+			do {
+				TSNode child = ts_tree_cursor_current_node(&walk);
+				statements.push_back({ ts_node_start_byte(child), ts_node_end_byte(child) });
+			} while (ts_tree_cursor_goto_next_sibling(&walk));
+		}
+		ts_tree_cursor_delete(&walk);
+
+		std::vector<ByteRange> widened;
+		for (ByteRange range : dirty) {
+			auto it = std::lower_bound(statements.begin(), statements.end(), range.first, [](const ByteRange &statement, uint32_t byte) {
+				return statement.second < byte;
+			});
+			for (; it != statements.end() && touches(it->first, it->second, range); ++it) {
+				range.first = std::min(range.first, it->first);
+				range.second = std::max(range.second, it->second);
+			}
+			widened.push_back(range);
+		}
+		std::sort(widened.begin(), widened.end());
+		std::vector<ByteRange> ranges;
+		for (const ByteRange &range : widened) {
+			if (!ranges.empty() && range.first <= ranges.back().second) {
+				ranges.back().second = std::max(ranges.back().second, range.second);
+			} else {
+				ranges.push_back(range);
+			}
+		}
+
+		diagnostics.erase(std::remove_if(diagnostics.begin(), diagnostics.end(), [&](const LintEngine::Diagnostic &diagnostic) {
+			for (const ByteRange &range : ranges) {
+				if (overlaps(diagnostic.match_start_byte, diagnostic.match_end_byte, range)) {
+					return true;
+				}
+			}
+			return false;
+		}),
+				diagnostics.end());
+
+		std::vector<LintEngine::Diagnostic> found;
+		for (size_t k = 0; k < ranges.size(); k++) {
+			found.clear();
+			engine.run(cursor, root, data, ranges[k].first, std::max(ranges[k].second, ranges[k].first + 1), found, r_stats);
+			scanned_bytes += ranges[k].second - ranges[k].first;
+			for (LintEngine::Diagnostic &diagnostic : found) {
+				// The ranges are disjoint, so a match reaching back into an
+				// earlier one also overlaps the one right before; that run
+				// already kept it. A match outside the range was never
+				// dropped.
+				if (!overlaps(diagnostic.match_start_byte, diagnostic.match_end_byte, ranges[k]) ||
+						(k > 0 && overlaps(diagnostic.match_start_byte, diagnostic.match_end_byte, ranges[k - 1]))) {
+					continue;
+				}
+				diagnostics.push_back(std::move(diagnostic));
+			}
+		}
+	}
+
+	// A full run and an incremental one must list the same diagnostics in
+	// the same order.
+	std::sort(diagnostics.begin(), diagnostics.end(), [](const LintEngine::Diagnostic &a, const LintEngine::Diagnostic &b) {
+		if (a.start_byte != b.start_byte) {
+			return a.start_byte < b.start_byte;
+		}
+		if (a.rule != b.rule) {
+			return a.rule < b.rule;
+		}
+		return a.end_byte < b.end_byte;
+	});
+	dirty.clear();
+	version = p_version;
+	generation = p_generation;
+}
+
+uint64_t LintCache::get_memory_bytes() const {
+	uint64_t bytes = memory_usage::of(diagnostics) + memory_usage::of(dirty);
+	for (const LintEngine::Diagnostic &diagnostic : diagnostics) {
+		bytes += memory_usage::of(diagnostic.message);
+	}
+	return bytes;
+}
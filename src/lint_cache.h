@@ -0,0 +1,53 @@
+#ifndef LINT_CACHE_H
+#define LINT_CACHE_H
+
+#include "lint_engine.h"
+
+#include <tree_sitter/api.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Lint diagnostics of one file, carried over edits.
+//
+// Edits shift the diagnostics after them and record the byte ranges they,
+// or the reparse, touched. update() widens those ranges to whole top-level
+// statements, drops the diagnostics whose match touches one, and runs the
+// rule pack over just those ranges: any other match sees the same nodes
+// and text as before the edit, so it still stands.
+class LintCache {
+	// Sorted by start_byte.
+	std::vector<LintEngine::Diagnostic> diagnostics;
+	std::vector<std::pair<uint32_t, uint32_t>> dirty;
+	uint64_t version = 0;
+	// Rule pack the diagnostics came from.
+	uint64_t generation = 0;
+	uint32_t scanned_bytes = 0;
+
+public:
+	// Version of the tree the diagnostics describe; 0 when never built.
+	uint64_t get_version() const { return version; }
+	void clear();
+	uint64_t get_memory_bytes() const;
+
+	// Moves the diagnostics over an edit (see TSInputEdit) and marks the
+	// edited range for re-linting.
+	void apply_edit(const TSInputEdit &edit);
+	// Marks [start_byte, end_byte) for re-linting.
+	void invalidate(uint32_t start_byte, uint32_t end_byte);
+	// Declares the edits and invalidations so far to lead to p_version.
+	void set_version(uint64_t p_version) { version = p_version; }
+	// Brings the diagnostics in line with root, the tree of p_version,
+	// linted with the pack of p_generation. Rebuilds from scratch when the
+	// pack changed or the cache was not carried to p_version.
+	void update(const LintEngine &engine, uint64_t p_generation, TSQueryCursor *cursor, TSNode root, const char *data, uint32_t length,
+			uint64_t p_version, std::vector<LintEngine::RuleStats> &r_stats);
+
+	const std::vector<LintEngine::Diagnostic> &get_diagnostics() const { return diagnostics; }
+	// Bytes the last update() ran the rules over; 0 if it reused
+	// everything.
+	uint32_t get_scanned_bytes() const { return scanned_bytes; }
+};
+
+#endif // LINT_CACHE_H
@@ -0,0 +1,478 @@
+#include "lint_engine.h"
+
+#include "perf_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+
+extern "C" const TSLanguage *tree_sitter_gdscript();
+
+static const char *QUERY_ERROR_NAMES[] = {
+	"none",
+	"syntax error",
+	"unknown node type",
+	"unknown field",
+	"unknown capture",
+	"impossible pattern",
+	"language mismatch",
+};
+
+static void set_escape_chars(char c, std::bitset<256> &r_chars) {
+	std::bitset<256> chars;
+	switch (c) {
+		case 'd':
+		case 'D':
+			for (int i = '0'; i <= '9'; i++) {
+				chars.set(i);
+			}
+			break;
+		case 'w':
+		case 'W':
+			for (int i = 0; i < 256; i++) {
+				chars[i] = (i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || (i >= '0' && i <= '9') || i == '_';
+			}
+			break;
+		case 's':
+		case 'S':
+			for (char space : std::string(" \t\n\r\f\v")) {
+				chars.set((uint8_t)space);
+			}
+			break;
+		case 'n':
+			chars.set('\n');
+			break;
+		case 't':
+			chars.set('\t');
+			break;
+		default:
+			chars.set((uint8_t)c);
+			break;
+	}
+	if (c == 'D' || c == 'W' || c == 'S') {
+		chars.flip();
+	}
+	r_chars |= chars;
+}
+
+bool LintEngine::Regex::compile(const std::string &pattern, std::string &r_error) {
+	tokens.clear();
+	anchored_start = false;
+	anchored_end = false;
+	size_t i = 0;
+	size_t n = pattern.size();
+	if (i < n && pattern[i] == '^') {
+		anchored_start = true;
+		i++;
+	}
+	while (i < n) {
+		char c = pattern[i];
+		if (c == '$' && i + 1 == n) {
+			anchored_end = true;
+			break;
+		}
+		Token token;
+		if (c == '.') {
+			token.chars.set();
+			token.chars.reset('\n');
+			i++;
+		} else if (c == '\\') {
+			if (i + 1 == n) {
+				r_error = "Trailing backslash in regex: " + pattern;
+				return false;
+			}
+			set_escape_chars(pattern[i + 1], token.chars);
+			i += 2;
+		} else if (c == '[') {
+			i++;
+			bool negated = i < n && pattern[i] == '^';
+			if (negated) {
+				i++;
+			}
+			size_t first = i;
+			while (i < n && (pattern[i] != ']' || i == first)) {
+				if (pattern[i] == '\\' && i + 1 < n) {
+					set_escape_chars(pattern[i + 1], token.chars);
+					i += 2;
+				} else if (i + 2 < n && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+					for (int b = (uint8_t)pattern[i]; b <= (uint8_t)pattern[i + 2]; b++) {
+						token.chars.set(b);
+					}
+					i += 3;
+				} else {
+					token.chars.set((uint8_t)pattern[i]);
+					i++;
+				}
+			}
+			if (i == n) {
+				r_error = "Unterminated character class in regex: " + pattern;
+				return false;
+			}
+			i++;
+			if (negated) {
+				token.chars.flip();
+			}
+		} else if (strchr("()|{}*+?", c)) {
+			r_error = std::string("Unsupported regex syntax '") + c + "' in: " + pattern;
+			return false;
+		} else {
+			token.chars.set((uint8_t)c);
+			i++;
+		}
+
+		if (i < n && (pattern[i] == '*' || pattern[i] == '+' || pattern[i] == '?')) {
+			if (pattern[i] == '+') {
+				// x+ is x followed by x*.
+				tokens.push_back(token);
+				token.quantifier = STAR;
+			} else {
+				token.quantifier = pattern[i] == '*' ? STAR : OPTIONAL;
+			}
+			i++;
+		}
+		tokens.push_back(token);
+	}
+	return true;
+}
+
+bool LintEngine::Regex::search(const char *text, uint32_t length) const {
+	// states[t]: tokens [0, t) match the text read so far. Optional tokens
+	// can be skipped, which only ever moves forward, so one pass closes a
+	// state set.
+	size_t count = tokens.size();
+	std::vector<uint8_t> states(count + 1, 0);
+	std::vector<uint8_t> next(count + 1, 0);
+	auto close = [&](std::vector<uint8_t> &r_states) {
+		for (size_t t = 0; t < count; t++) {
+			if (r_states[t] && tokens[t].quantifier != ONE) {
+				r_states[t + 1] = 1;
+			}
+		}
+	};
+
+	states[0] = 1;
+	close(states);
+	if (states[count] && (!anchored_end || length == 0)) {
+		return true;
+	}
+	for (uint32_t i = 0; i < length; i++) {
+		if (!anchored_start) {
+			states[0] = 1;
+			close(states);
+		}
+		uint8_t c = (uint8_t)text[i];
+		std::fill(next.begin(), next.end(), 0);
+		bool alive = false;
+		for (size_t t = 0; t < count; t++) {
+			if (states[t] && tokens[t].chars[c]) {
+				next[tokens[t].quantifier == STAR ? t : t + 1] = 1;
+				alive = true;
+			}
+		}
+		close(next);
+		states.swap(next);
+		if (states[count] && (!anchored_end || i + 1 == length)) {
+			return true;
+		}
+		if (!alive && anchored_start) {
+			return false;
+		}
+	}
+	// A match can also start after the last character, where only tokens
+	// that accept the empty string are left to match (\s*$).
+	if (!anchored_start && length > 0) {
+		states[0] = 1;
+		close(states);
+		return states[count];
+	}
+	return false;
+}
+
+LintEngine::~LintEngine() {
+	clear();
+}
+
+void LintEngine::clear() {
+	if (query) {
+		ts_query_delete(query);
+		query = nullptr;
+	}
+	rules.clear();
+	pattern_rules.clear();
+	pattern_predicates.clear();
+}
+
+bool LintEngine::parse_predicates(uint32_t pattern, std::string &r_error) {
+	uint32_t step_count = 0;
+	const TSQueryPredicateStep *steps = ts_query_predicates_for_pattern(query, pattern, &step_count);
+	std::vector<Predicate> &predicates = pattern_predicates[pattern];
+	uint32_t i = 0;
+	while (i < step_count) {
+		uint32_t end = i;
+		while (end < step_count && steps[end].type != TSQueryPredicateStepTypeDone) {
+			end++;
+		}
+		uint32_t length = 0;
+		const char *name_data = ts_query_string_value_for_id(query, steps[i].value_id, &length);
+		std::string name(name_data, length);
+		uint32_t first_argument = i + 1;
+		uint32_t argument_count = end - first_argument;
+		i = end + 1;
+		// Directives such as #set! carry data for other tools.
+		if (!name.empty() && name.back() == '!') {
+			continue;
+		}
+
+		Predicate predicate;
+		predicate.negated = name.compare(0, 4, "not-") == 0;
+		std::string base = predicate.negated ? name.substr(4) : name;
+		if (base == "eq?") {
+			predicate.type = Predicate::EQ;
+		} else if (base == "match?") {
+			predicate.type = Predicate::MATCH;
+		} else if (base == "any-of?") {
+			predicate.type = Predicate::ANY_OF;
+		} else {
+			r_error = "Unsupported predicate #" + name;
+			return false;
+		}
+		if (argument_count < 2 || steps[first_argument].type != TSQueryPredicateStepTypeCapture) {
+			r_error = "#" + name + " takes a capture and a value";
+			return false;
+		}
+		if (predicate.type != Predicate::ANY_OF && argument_count != 2) {
+			r_error = "#" + name + " takes exactly two arguments";
+			return false;
+		}
+		predicate.capture = steps[first_argument].value_id;
+		for (uint32_t a = first_argument + 1; a < end; a++) {
+			if (steps[a].type == TSQueryPredicateStepTypeCapture) {
+				if (predicate.type != Predicate::EQ) {
+					r_error = "#" + name + " expects strings after the capture";
+					return false;
+				}
+				predicate.other_capture = steps[a].value_id;
+			} else {
+				const char *value = ts_query_string_value_for_id(query, steps[a].value_id, &length);
+				predicate.values.emplace_back(value, length);
+			}
+		}
+		if (predicate.type == Predicate::MATCH && !predicate.regex.compile(predicate.values[0], r_error)) {
+			return false;
+		}
+		predicates.push_back(std::move(predicate));
+	}
+	return true;
+}
+
+bool LintEngine::parse_message(const std::string &message, Rule &r_rule, std::string &r_error) {
+	r_rule.message.clear();
+	MessagePart part;
+	size_t i = 0;
+	while (i < message.size()) {
+		size_t open = message.find('{', i);
+		size_t close = open == std::string::npos ? std::string::npos : message.find('}', open);
+		if (close == std::string::npos) {
+			part.text += message.substr(i);
+			break;
+		}
+		part.text += message.substr(i, open - i);
+		std::string name = message.substr(open + 1, close - open - 1);
+		uint32_t capture = NONE;
+		for (uint32_t c = 0; c < ts_query_capture_count(query); c++) {
+			uint32_t length = 0;
+			const char *capture_name = ts_query_capture_name_for_id(query, c, &length);
+			if (name.size() == length && name.compare(0, length, capture_name, length) == 0) {
+				capture = c;
+				break;
+			}
+		}
+		if (capture == NONE) {
+			r_error = "Message refers to unknown capture {" + name + "}";
+			return false;
+		}
+		part.capture = capture;
+		r_rule.message.push_back(std::move(part));
+		part = MessagePart();
+		i = close + 1;
+	}
+	if (!part.text.empty()) {
+		r_rule.message.push_back(std::move(part));
+	}
+	return true;
+}
+
+bool LintEngine::load(const std::vector<RuleSource> &sources, std::string &r_error) {
+	clear();
+	perf_stats::Scope scope(perf_stats::PHASE_QUERY_COMPILE);
+
+	// Compile each rule on its own first: errors then point into that
+	// rule's query, and its pattern count tells which patterns of the
+	// joined query are its.
+	const TSLanguage *language = tree_sitter_gdscript();
+	std::string joined;
+	std::vector<uint32_t> rule_patterns;
+	for (const RuleSource &source : sources) {
+		uint32_t error_offset = 0;
+		TSQueryError error_type = TSQueryErrorNone;
+		TSQuery *rule_query = ts_query_new(language, source.query.data(), source.query.size(), &error_offset, &error_type);
+		if (!rule_query) {
+			r_error = "Rule '" + source.id + "': " + QUERY_ERROR_NAMES[error_type] + " at offset " + std::to_string(error_offset);
+			return false;
+		}
+		uint32_t pattern_count = ts_query_pattern_count(rule_query);
+		ts_query_delete(rule_query);
+		if (pattern_count == 0) {
+			r_error = "Rule '" + source.id + "' has no patterns";
+			return false;
+		}
+		rule_patterns.push_back(pattern_count);
+		joined += source.query;
+		joined += '\n';
+	}
+
+	uint32_t error_offset = 0;
+	TSQueryError error_type = TSQueryErrorNone;
+	query = ts_query_new(language, joined.data(), joined.size(), &error_offset, &error_type);
+	if (!query) {
+		r_error = std::string("Rule pack: ") + QUERY_ERROR_NAMES[error_type] + " at offset " + std::to_string(error_offset);
+		return false;
+	}
+	pattern_predicates.resize(ts_query_pattern_count(query));
+	for (size_t r = 0; r < sources.size(); r++) {
+		const RuleSource &source = sources[r];
+		Rule rule;
+		rule.id = source.id;
+		rule.severity = source.severity;
+		bool valid = parse_message(source.message.empty() ? source.id : source.message, rule, r_error);
+		if (valid && !source.capture.empty()) {
+			uint32_t capture_id = NONE;
+			for (uint32_t c = 0; c < ts_query_capture_count(query); c++) {
+				uint32_t length = 0;
+				const char *name = ts_query_capture_name_for_id(query, c, &length);
+				if (source.capture.size() == length && source.capture.compare(0, length, name, length) == 0) {
+					capture_id = c;
+				}
+			}
+			rule.capture = capture_id;
+			if (capture_id == NONE) {
+				r_error = "Unknown capture @" + source.capture;
+				valid = false;
+			}
+		}
+		for (uint32_t p = 0; valid && p < rule_patterns[r]; p++) {
+			valid = parse_predicates(pattern_rules.size(), r_error);
+			pattern_rules.push_back(r);
+		}
+		if (!valid) {
+			r_error = "Rule '" + source.id + "': " + r_error;
+			clear();
+			return false;
+		}
+		rules.push_back(std::move(rule));
+	}
+	return true;
+}
+
+static std::string_view node_text(TSNode node, const char *data) {
+	return std::string_view(data + ts_node_start_byte(node), ts_node_end_byte(node) - ts_node_start_byte(node));
+}
+
+bool LintEngine::check_predicates(const TSQueryMatch &match, const char *data) const {
+	for (const Predicate &predicate : pattern_predicates[match.pattern_index]) {
+		std::string_view other;
+		if (predicate.other_capture != NONE) {
+			for (uint16_t c = 0; c < match.capture_count; c++) {
+				if (match.captures[c].index == predicate.other_capture) {
+					other = node_text(match.captures[c].node, data);
+					break;
+				}
+			}
+		}
+		// A quantified capture can hold several nodes; all must pass.
+		for (uint16_t c = 0; c < match.capture_count; c++) {
+			if (match.captures[c].index != predicate.capture) {
+				continue;
+			}
+			std::string_view text = node_text(match.captures[c].node, data);
+			bool holds = false;
+			switch (predicate.type) {
+				case Predicate::EQ:
+					holds = predicate.other_capture != NONE ? text == other : text == predicate.values[0];
+					break;
+				case Predicate::MATCH:
+					holds = predicate.regex.search(text.data(), text.size());
+					break;
+				case Predicate::ANY_OF:
+					for (const std::string &value : predicate.values) {
+						holds = holds || text == value;
+					}
+					break;
+			}
+			if (holds == predicate.negated) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+std::string LintEngine::format_message(const Rule &rule, const TSQueryMatch &match, const char *data) const {
+	std::string message;
+	for (const MessagePart &part : rule.message) {
+		message += part.text;
+		if (part.capture == NONE) {
+			continue;
+		}
+		for (uint16_t c = 0; c < match.capture_count; c++) {
+			if (match.captures[c].index == part.capture) {
+				message += node_text(match.captures[c].node, data);
+				break;
+			}
+		}
+	}
+	return message;
+}
+
+void LintEngine::run(TSQueryCursor *cursor, TSNode root, const char *data, uint32_t start_byte, uint32_t end_byte,
+		std::vector<Diagnostic> &r_diagnostics, std::vector<RuleStats> &r_stats) const {
+	if (!query) {
+		return;
+	}
+	perf_stats::Scope scope(perf_stats::PHASE_QUERY_EXEC);
+	ts_query_cursor_set_byte_range(cursor, start_byte, end_byte);
+	ts_query_cursor_exec(cursor, query, root);
+
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+	TSQueryMatch match;
+	while (ts_query_cursor_next_match(cursor, &match)) {
+		uint32_t rule_index = pattern_rules[match.pattern_index];
+		const Rule &rule = rules[rule_index];
+		RuleStats &stats = r_stats[rule_index];
+		stats.match_count++;
+		scope.add_amount(1);
+		if (match.capture_count > 0 && check_predicates(match, data)) {
+			Diagnostic diagnostic;
+			diagnostic.rule = rule_index;
+			diagnostic.match_start_byte = UINT32_MAX;
+			TSNode target = match.captures[0].node;
+			for (uint16_t c = 0; c < match.capture_count; c++) {
+				TSNode node = match.captures[c].node;
+				diagnostic.match_start_byte = std::min(diagnostic.match_start_byte, ts_node_start_byte(node));
+				diagnostic.match_end_byte = std::max(diagnostic.match_end_byte, ts_node_end_byte(node));
+				if (match.captures[c].index == rule.capture) {
+					target = node;
+				}
+			}
+			diagnostic.start_byte = ts_node_start_byte(target);
+			diagnostic.end_byte = ts_node_end_byte(target);
+			diagnostic.message = format_message(rule, match, data);
+			r_diagnostics.push_back(std::move(diagnostic));
+			stats.diagnostic_count++;
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		stats.nsec += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+		last = now;
+	}
+}
@@ -0,0 +1,149 @@
+#ifndef LINT_ENGINE_H
+#define LINT_ENGINE_H
+
+#include <tree_sitter/api.h>
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A pack of lint rules compiled into one query.
+//
+// Each rule is a query with an id, a severity and a message template. The
+// sources of all rules are joined into a single TSQuery, so linting a file
+// is one cursor walk however many rules there are; pattern indices map
+// matches back to their rule. Text predicates in the queries (#eq?,
+// #match?, #any-of? and their #not- forms) are evaluated here, since
+// tree-sitter leaves that to the client.
+//
+// The compiled pack is read-only: several threads may run it at once, each
+// with its own cursor and stats.
+class LintEngine {
+public:
+	static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+	enum Severity {
+		SEVERITY_ERROR,
+		SEVERITY_WARNING,
+		SEVERITY_INFO,
+		SEVERITY_HINT,
+	};
+
+	struct RuleSource {
+		std::string id;
+		std::string query;
+		Severity severity = SEVERITY_WARNING;
+		// "{name}" is replaced by the text of capture @name.
+		std::string message;
+		// Capture the diagnostic points at; the first one of the match if
+		// empty.
+		std::string capture;
+	};
+
+	struct Diagnostic {
+		uint32_t rule = 0;
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		// Extent of all the captures of the match; an edit touching it
+		// makes the rule run there again.
+		uint32_t match_start_byte = 0;
+		uint32_t match_end_byte = 0;
+		std::string message;
+	};
+
+	// Accumulated per rule. Walking the tree is shared by all rules; the
+	// time spent finding a match is charged to the rule it belongs to.
+	struct RuleStats {
+		uint64_t match_count = 0;
+		uint64_t diagnostic_count = 0;
+		uint64_t nsec = 0;
+	};
+
+private:
+	// A regular expression without groups or alternation: literals, '.',
+	// [classes], \d \w \s and their negations, the * + ? quantifiers and
+	// ^ $ anchors. Matched by simulating all positions at once, so time is
+	// linear in the text.
+	struct Regex {
+		enum Quantifier {
+			ONE,
+			OPTIONAL,
+			STAR,
+		};
+		struct Token {
+			std::bitset<256> chars;
+			Quantifier quantifier = ONE;
+		};
+		std::vector<Token> tokens;
+		bool anchored_start = false;
+		bool anchored_end = false;
+
+		bool compile(const std::string &pattern, std::string &r_error);
+		bool search(const char *text, uint32_t length) const;
+	};
+
+	struct Predicate {
+		enum Type {
+			EQ,
+			MATCH,
+			ANY_OF,
+		};
+		Type type = EQ;
+		bool negated = false;
+		uint32_t capture = 0;
+		// #eq? against another capture instead of a string.
+		uint32_t other_capture = NONE;
+		std::vector<std::string> values;
+		Regex regex;
+	};
+
+	struct MessagePart {
+		std::string text;
+		// Capture whose text follows text, NONE for none.
+		uint32_t capture = NONE;
+	};
+
+	struct Rule {
+		std::string id;
+		Severity severity = SEVERITY_WARNING;
+		uint32_t capture = NONE;
+		std::vector<MessagePart> message;
+	};
+
+	TSQuery *query = nullptr;
+	std::vector<Rule> rules;
+	// Rule and predicates of each pattern of query.
+	std::vector<uint32_t> pattern_rules;
+	std::vector<std::vector<Predicate>> pattern_predicates;
+
+	bool parse_predicates(uint32_t pattern, std::string &r_error);
+	bool parse_message(const std::string &message, Rule &r_rule, std::string &r_error);
+	bool check_predicates(const TSQueryMatch &match, const char *data) const;
+	std::string format_message(const Rule &rule, const TSQueryMatch &match, const char *data) const;
+
+public:
+	LintEngine() = default;
+	LintEngine(const LintEngine &) = delete;
+	LintEngine &operator=(const LintEngine &) = delete;
+	~LintEngine();
+
+	// Replaces the pack. On failure the engine is left empty and r_error
+	// names the offending rule.
+	bool load(const std::vector<RuleSource> &sources, std::string &r_error);
+	void clear();
+	bool is_loaded() const { return query != nullptr; }
+
+	// Appends the diagnostics of the matches intersecting [start_byte,
+	// end_byte) to r_diagnostics, in the order the cursor finds them, and
+	// adds to r_stats (one entry per rule).
+	void run(TSQueryCursor *cursor, TSNode root, const char *data, uint32_t start_byte, uint32_t end_byte,
+			std::vector<Diagnostic> &r_diagnostics, std::vector<RuleStats> &r_stats) const;
+
+	uint32_t get_rule_count() const { return rules.size(); }
+	const std::string &get_rule_id(uint32_t rule) const { return rules[rule].id; }
+	Severity get_rule_severity(uint32_t rule) const { return rules[rule].severity; }
+	uint32_t get_pattern_count() const { return pattern_rules.size(); }
+};
+
+#endif // LINT_ENGINE_H
@@ -0,0 +1,40 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Approximate heap bytes held by standard containers, for the memory
+// stats. Counts what the containers own (capacity, not size), not what
+// their elements point to; callers add that where it matters. Node-based
+// containers are charged a node per element: the value plus two pointers
+// for hash tables, four for trees.
+namespace memory_usage {
+
+inline uint64_t of(const std::string &text) {
+	// Short strings live inside the object.
+	return text.capacity() >= sizeof(std::string) ? text.capacity() + 1 : 0;
+}
+
+template <typename T>
+inline uint64_t of(const std::vector<T> &items) {
+	return items.capacity() * sizeof(T);
+}
+
+template <typename K, typename V, typename H, typename E, typename A>
+inline uint64_t of(const std::unordered_map<K, V, H, E, A> &map) {
+	return map.bucket_count() * sizeof(void *) + map.size() * (sizeof(std::pair<const K, V>) + 2 * sizeof(void *));
+}
+
+template <typename K, typename V, typename C, typename A>
+inline uint64_t of(const std::map<K, V, C, A> &map) {
+	return map.size() * (sizeof(std::pair<const K, V>) + 4 * sizeof(void *));
+}
+
+} // namespace memory_usage
+
+#endif // MEMORY_USAGE_H
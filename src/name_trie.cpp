@@ -0,0 +1,109 @@
+#include "name_trie.h"
+
+#include "memory_usage.h"
+
+#include <algorithm>
+
+static const uint32_t NO_NODE = 0xFFFFFFFFu;
+
+NameTrie::NameTrie() {
+	nodes.emplace_back();
+}
+
+uint32_t NameTrie::find_node(std::string_view text) const {
+	uint32_t node = 0;
+	for (char c : text) {
+		const std::vector<std::pair<uint8_t, uint32_t>> &children = nodes[node].children;
+		auto it = std::lower_bound(children.begin(), children.end(), std::make_pair((uint8_t)c, (uint32_t)0));
+		if (it == children.end() || it->first != (uint8_t)c) {
+			return NO_NODE;
+		}
+		node = it->second;
+	}
+	return node;
+}
+
+void NameTrie::add(std::string_view name) {
+	uint32_t node = 0;
+	nodes[0].subtree_count++;
+	for (char c : name) {
+		std::vector<std::pair<uint8_t, uint32_t>> &children = nodes[node].children;
+		auto it = std::lower_bound(children.begin(), children.end(), std::make_pair((uint8_t)c, (uint32_t)0));
+		if (it == children.end() || it->first != (uint8_t)c) {
+			uint32_t child = nodes.size();
+			// Insert first: growing nodes may move the vector children is in.
+			children.insert(it, std::make_pair((uint8_t)c, child));
+			nodes.emplace_back();
+			node = child;
+		} else {
+			node = it->second;
+		}
+		nodes[node].subtree_count++;
+	}
+	if (nodes[node].count++ == 0) {
+		name_count++;
+	}
+}
+
+void NameTrie::remove(std::string_view name) {
+	uint32_t end = find_node(name);
+	if (end == NO_NODE || nodes[end].count == 0) {
+		return;
+	}
+	if (--nodes[end].count == 0) {
+		name_count--;
+	}
+	uint32_t node = 0;
+	nodes[0].subtree_count--;
+	for (char c : name) {
+		const std::vector<std::pair<uint8_t, uint32_t>> &children = nodes[node].children;
+		node = std::lower_bound(children.begin(), children.end(), std::make_pair((uint8_t)c, (uint32_t)0))->second;
+		nodes[node].subtree_count--;
+	}
+}
+
+bool NameTrie::has(std::string_view name) const {
+	uint32_t node = find_node(name);
+	return node != NO_NODE && nodes[node].count > 0;
+}
+
+void NameTrie::clear() {
+	nodes.clear();
+	nodes.emplace_back();
+	name_count = 0;
+}
+
+void NameTrie::collect(uint32_t node, std::string &r_text, uint32_t limit, std::vector<std::string> &r_names) const {
+	if (nodes[node].count > 0) {
+		r_names.push_back(r_text);
+	}
+	for (const std::pair<uint8_t, uint32_t> &child : nodes[node].children) {
+		if (r_names.size() >= limit) {
+			return;
+		}
+		if (nodes[child.second].subtree_count == 0) {
+			continue;
+		}
+		r_text.push_back((char)child.first);
+		collect(child.second, r_text, limit, r_names);
+		r_text.pop_back();
+	}
+}
+
+void NameTrie::find_prefix(std::string_view prefix, uint32_t limit, std::vector<std::string> &r_names) const {
+	r_names.clear();
+	uint32_t node = find_node(prefix);
+	if (node == NO_NODE || limit == 0 || nodes[node].subtree_count == 0) {
+		return;
+	}
+	std::string text(prefix);
+	collect(node, text, limit, r_names);
+}
+
+uint64_t NameTrie::get_memory_bytes() const {
+	uint64_t bytes = memory_usage::of(nodes);
+	for (const Node &node : nodes) {
+		bytes += memory_usage::of(node.children);
+	}
+	return bytes;
+}
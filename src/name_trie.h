@@ -0,0 +1,47 @@
+#ifndef NAME_TRIE_H
+#define NAME_TRIE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Byte-wise prefix tree of names, each with a use count (a name can be
+// declared by several files).
+//
+// Nodes keep the total count of their subtree, so enumeration skips
+// branches whose names are all gone without having to free nodes on
+// removal.
+class NameTrie {
+	struct Node {
+		// Sorted by byte.
+		std::vector<std::pair<uint8_t, uint32_t>> children;
+		uint32_t count = 0;
+		uint32_t subtree_count = 0;
+	};
+
+	std::vector<Node> nodes;
+	uint32_t name_count = 0;
+
+	uint32_t find_node(std::string_view text) const;
+	void collect(uint32_t node, std::string &r_text, uint32_t limit, std::vector<std::string> &r_names) const;
+
+public:
+	NameTrie();
+
+	void add(std::string_view name);
+	// Does nothing if name is not in the trie.
+	void remove(std::string_view name);
+	bool has(std::string_view name) const;
+	void clear();
+
+	// Up to limit names starting with prefix, in byte order.
+	void find_prefix(std::string_view prefix, uint32_t limit, std::vector<std::string> &r_names) const;
+
+	// Distinct names currently in the trie.
+	uint32_t get_name_count() const { return name_count; }
+	uint32_t get_node_count() const { return nodes.size(); }
+	uint64_t get_memory_bytes() const;
+};
+
+#endif // NAME_TRIE_H
@@ -0,0 +1,56 @@
+#include "parser_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+extern "C" const TSLanguage *tree_sitter_gdscript();
+
+ParserPool::~ParserPool() {
+	for (int i = 0; i < parsers.size(); i++) {
+		ts_parser_delete(parsers[i]);
+	}
+	parsers.clear();
+}
+
+int ParserPool::get_default_thread_count() {
+	unsigned int hardware_threads = std::thread::hardware_concurrency();
+	return hardware_threads > 0 ? (int)hardware_threads : 1;
+}
+
+void ParserPool::ensure_parsers(int count) {
+	while (parsers.size() < count) {
+		TSParser *parser = ts_parser_new();
+		ts_parser_set_language(parser, tree_sitter_gdscript());
+		parsers.push_back(parser);
+	}
+}
+
+void ParserPool::run(int job_count, int max_threads, const std::function<void(int, TSParser *)> &job) {
+	if (job_count <= 0) {
+		return;
+	}
+
+	int thread_count = max_threads > 0 ? max_threads : get_default_thread_count();
+	if (thread_count > job_count) {
+		thread_count = job_count;
+	}
+	ensure_parsers(thread_count);
+
+	std::atomic<int> next_job(0);
+	auto worker = [&](TSParser *parser) {
+		for (int index = next_job.fetch_add(1); index < job_count; index = next_job.fetch_add(1)) {
+			job(index, parser);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(thread_count - 1);
+	for (int i = 1; i < thread_count; i++) {
+		threads.emplace_back(worker, parsers[i]);
+	}
+	worker(parsers[0]);
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
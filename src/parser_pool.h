@@ -0,0 +1,28 @@
+#ifndef PARSER_POOL_H
+#define PARSER_POOL_H
+
+#include <godot_cpp/templates/vector.hpp>
+#include <tree_sitter/api.h>
+
+#include <functional>
+
+// Owns one TSParser per worker thread so independent files can be parsed
+// concurrently. A TSParser must never be used by two threads at once, so each
+// worker only ever touches the parser handed to it.
+class ParserPool {
+	godot::Vector<TSParser *> parsers;
+
+	void ensure_parsers(int count);
+
+public:
+	~ParserPool();
+
+	static int get_default_thread_count();
+
+	// Runs job(job_index, parser) for every index in [0, job_count) on up to
+	// max_threads threads (0 = one per hardware thread) and blocks until all
+	// jobs have finished. The calling thread takes part as a worker.
+	void run(int job_count, int max_threads, const std::function<void(int, TSParser *)> &job);
+};
+
+#endif // PARSER_POOL_H
@@ -0,0 +1,263 @@
+#include "perf_stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace perf_stats {
+
+static const int MAX_PROBES = 256;
+static const int SUB_BITS = 3;
+static const uint64_t SUB_BUCKETS = 1 << SUB_BITS;
+// Up to 2^42 ns, over an hour.
+static const int BUCKET_COUNT = (42 - SUB_BITS + 1) * SUB_BUCKETS;
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {
+	"transcode",
+	"parse",
+	"error_scan",
+	"query_compile",
+	"query_exec",
+	"marshal",
+	"diff",
+};
+
+static int highest_bit(uint64_t value) {
+	int bit = 0;
+	for (int shift = 32; shift > 0; shift >>= 1) {
+		if (value >> shift) {
+			value >>= shift;
+			bit += shift;
+		}
+	}
+	return bit;
+}
+
+static int bucket_of(uint64_t nanoseconds) {
+	if (nanoseconds < SUB_BUCKETS) {
+		return (int)nanoseconds;
+	}
+	int top_bit = highest_bit(nanoseconds);
+	int sub = (nanoseconds >> (top_bit - SUB_BITS)) & (SUB_BUCKETS - 1);
+	return std::min((top_bit - SUB_BITS + 1) * (int)SUB_BUCKETS + sub, BUCKET_COUNT - 1);
+}
+
+// Middle of the durations falling in the bucket.
+static uint64_t bucket_value(int bucket) {
+	if (bucket < (int)SUB_BUCKETS) {
+		return bucket;
+	}
+	int shift = bucket / SUB_BUCKETS - 1;
+	uint64_t low = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+	return low + ((uint64_t(1) << shift) >> 1);
+}
+
+// Written by one thread, read by snapshot() from any.
+struct Probe {
+	std::atomic<uint64_t> generation{ 0 };
+	std::atomic<uint64_t> count{ 0 };
+	std::atomic<uint64_t> total_nsec{ 0 };
+	std::atomic<uint64_t> max_nsec{ 0 };
+	std::atomic<uint64_t> amount{ 0 };
+	std::atomic<uint32_t> buckets[BUCKET_COUNT];
+
+	Probe() {
+		for (std::atomic<uint32_t> &bucket : buckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+};
+
+static void bump(std::atomic<uint64_t> &counter, uint64_t value) {
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Summed counters of one probe, in snapshot() and for exited threads.
+struct Totals {
+	uint64_t count = 0;
+	uint64_t total_nsec = 0;
+	uint64_t max_nsec = 0;
+	uint64_t amount = 0;
+	uint64_t buckets[BUCKET_COUNT] = {};
+
+	void add(const Probe &probe) {
+		count += probe.count.load(std::memory_order_relaxed);
+		total_nsec += probe.total_nsec.load(std::memory_order_relaxed);
+		max_nsec = std::max(max_nsec, probe.max_nsec.load(std::memory_order_relaxed));
+		amount += probe.amount.load(std::memory_order_relaxed);
+		for (int i = 0; i < BUCKET_COUNT; i++) {
+			buckets[i] += probe.buckets[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	void add(const Totals &other) {
+		count += other.count;
+		total_nsec += other.total_nsec;
+		max_nsec = std::max(max_nsec, other.max_nsec);
+		amount += other.amount;
+		for (int i = 0; i < BUCKET_COUNT; i++) {
+			buckets[i] += other.buckets[i];
+		}
+	}
+
+	uint64_t percentile(double fraction) const {
+		uint64_t rank = (uint64_t)(fraction * count);
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKET_COUNT; i++) {
+			seen += buckets[i];
+			if (seen > rank) {
+				return std::min(bucket_value(i), max_nsec);
+			}
+		}
+		return max_nsec;
+	}
+};
+
+struct ThreadBuffer {
+	// Allocated by the owner on first use.
+	std::atomic<Probe *> probes[MAX_PROBES];
+
+	ThreadBuffer();
+	~ThreadBuffer();
+};
+
+static std::atomic<bool> enabled{ true };
+static std::atomic<uint64_t> generation{ 1 };
+
+// Guards everything below.
+static std::mutex registry_mutex;
+static std::vector<std::string> method_names;
+static std::vector<ThreadBuffer *> buffers;
+// Totals of exited threads since the last reset.
+static std::vector<Totals> retired;
+
+static thread_local ThreadBuffer buffer;
+
+ThreadBuffer::ThreadBuffer() {
+	for (std::atomic<Probe *> &probe : probes) {
+		probe.store(nullptr, std::memory_order_relaxed);
+	}
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	buffers.push_back(this);
+}
+
+ThreadBuffer::~ThreadBuffer() {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	buffers.erase(std::find(buffers.begin(), buffers.end(), this));
+	uint64_t current = generation.load();
+	for (int i = 0; i < MAX_PROBES; i++) {
+		Probe *probe = probes[i].load(std::memory_order_relaxed);
+		if (probe && probe->generation.load(std::memory_order_relaxed) == current) {
+			if (retired.size() <= (size_t)i) {
+				retired.resize(i + 1);
+			}
+			retired[i].add(*probe);
+		}
+		delete probe;
+	}
+}
+
+int register_method(const char *name) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (size_t i = 0; i < method_names.size(); i++) {
+		if (method_names[i] == name) {
+			return PHASE_COUNT + (int)i;
+		}
+	}
+	if (PHASE_COUNT + (int)method_names.size() >= MAX_PROBES) {
+		return -1;
+	}
+	method_names.push_back(name);
+	return PHASE_COUNT + (int)method_names.size() - 1;
+}
+
+void set_enabled(bool p_enabled) {
+	enabled.store(p_enabled, std::memory_order_relaxed);
+}
+
+bool is_enabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record(int probe_id, uint64_t nanoseconds, uint64_t amount) {
+	if (probe_id < 0 || probe_id >= MAX_PROBES) {
+		return;
+	}
+	Probe *probe = buffer.probes[probe_id].load(std::memory_order_relaxed);
+	if (!probe) {
+		probe = new Probe();
+		buffer.probes[probe_id].store(probe, std::memory_order_release);
+	}
+	uint64_t current = generation.load(std::memory_order_relaxed);
+	if (probe->generation.load(std::memory_order_relaxed) != current) {
+		probe->count.store(0, std::memory_order_relaxed);
+		probe->total_nsec.store(0, std::memory_order_relaxed);
+		probe->max_nsec.store(0, std::memory_order_relaxed);
+		probe->amount.store(0, std::memory_order_relaxed);
+		for (std::atomic<uint32_t> &bucket : probe->buckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		probe->generation.store(current, std::memory_order_release);
+	}
+	bump(probe->count, 1);
+	bump(probe->total_nsec, nanoseconds);
+	bump(probe->amount, amount);
+	if (nanoseconds > probe->max_nsec.load(std::memory_order_relaxed)) {
+		probe->max_nsec.store(nanoseconds, std::memory_order_relaxed);
+	}
+	std::atomic<uint32_t> &bucket = probe->buckets[bucket_of(nanoseconds)];
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+std::vector<ProbeStats> snapshot() {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	uint64_t current = generation.load();
+	int probe_count = PHASE_COUNT + (int)method_names.size();
+	std::unique_ptr<Totals[]> totals(new Totals[probe_count]);
+	for (size_t i = 0; i < retired.size() && (int)i < probe_count; i++) {
+		totals[i].add(retired[i]);
+	}
+	for (ThreadBuffer *thread_buffer : buffers) {
+		for (int i = 0; i < probe_count; i++) {
+			Probe *probe = thread_buffer->probes[i].load(std::memory_order_acquire);
+			if (probe && probe->generation.load(std::memory_order_acquire) == current) {
+				totals[i].add(*probe);
+			}
+		}
+	}
+
+	std::vector<ProbeStats> result;
+	for (int i = 0; i < probe_count; i++) {
+		const Totals &total = totals[i];
+		if (total.count == 0) {
+			continue;
+		}
+		ProbeStats stats;
+		stats.name = i < PHASE_COUNT ? PHASE_NAMES[i] : method_names[i - PHASE_COUNT];
+		stats.phase = i < PHASE_COUNT;
+		stats.count = total.count;
+		stats.total_nsec = total.total_nsec;
+		stats.max_nsec = total.max_nsec;
+		stats.amount = total.amount;
+		stats.p50_nsec = total.percentile(0.50);
+		stats.p95_nsec = total.percentile(0.95);
+		stats.p99_nsec = total.percentile(0.99);
+		result.push_back(stats);
+	}
+	return result;
+}
+
+void reset() {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	generation.fetch_add(1);
+	retired.clear();
+}
+
+} // namespace perf_stats
@@ -0,0 +1,122 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Call timings of the public ASTManager methods and of the phases inside
+// them, process-wide.
+//
+// Every thread records into its own buffer: a probe's counters are only
+// written by the owning thread (relaxed stores, no read-modify-write), so
+// recording costs two steady_clock reads and a few stores, and the worker
+// threads of a parallel parse never contend. snapshot() sums the live
+// buffers and those of threads that have exited. Durations also go to a
+// log-linear histogram (8 buckets per power of two, so within 12.5%) for
+// the percentiles. reset() bumps a generation; a buffer zeroes a probe the
+// next time it records into it, and stale probes are skipped meanwhile.
+namespace perf_stats {
+
+enum Phase {
+	// Whole sources between String and UTF-8; amount is bytes.
+	PHASE_TRANSCODE,
+	// ts_parser_parse_string(); amount is bytes parsed.
+	PHASE_PARSE,
+	// Walks collecting or counting ERROR and MISSING nodes.
+	PHASE_ERROR_SCAN,
+	// ts_query_new(); amount is bytes of query source.
+	PHASE_QUERY_COMPILE,
+	// Running a query cursor; amount is matches or captures.
+	PHASE_QUERY_EXEC,
+	// Building Dictionaries and Arrays of results; amount is entries.
+	PHASE_MARSHAL,
+	// Line, token and tree diffs; amount is lines, tokens or nodes
+	// compared.
+	PHASE_DIFF,
+	PHASE_COUNT,
+};
+
+struct ProbeStats {
+	std::string name;
+	bool phase = false;
+	uint64_t count = 0;
+	uint64_t total_nsec = 0;
+	uint64_t max_nsec = 0;
+	uint64_t amount = 0;
+	uint64_t p50_nsec = 0;
+	uint64_t p95_nsec = 0;
+	uint64_t p99_nsec = 0;
+};
+
+// Probe id of a method, registered once per name; -1 once the table is
+// full. Use PERF_METHOD_SCOPE() rather than calling it directly.
+int register_method(const char *name);
+
+void set_enabled(bool enabled);
+bool is_enabled();
+
+// Monotonic nanoseconds.
+uint64_t now();
+void record(int probe, uint64_t nanoseconds, uint64_t amount = 0);
+
+// Probes called since the last reset, phases first, then methods in
+// registration order.
+std::vector<ProbeStats> snapshot();
+void reset();
+
+// Times the enclosing block.
+class Scope {
+	int probe;
+	uint64_t start;
+	uint64_t amount = 0;
+
+public:
+	explicit Scope(int p_probe) :
+			probe(p_probe), start(p_probe >= 0 && is_enabled() ? now() : 0) {}
+	~Scope() {
+		if (start) {
+			record(probe, now() - start, amount);
+		}
+	}
+	void add_amount(uint64_t p_amount) { amount += p_amount; }
+
+	Scope(const Scope &) = delete;
+	Scope &operator=(const Scope &) = delete;
+};
+
+// Time spread over several intervals, e.g. the cursor steps of a query
+// interleaved with marshalling its matches. Recorded as one call.
+class Stopwatch {
+	uint64_t total = 0;
+	uint64_t started = 0;
+	bool enabled;
+
+public:
+	Stopwatch() :
+			enabled(is_enabled()) {}
+	void start() {
+		if (enabled) {
+			started = now();
+		}
+	}
+	void stop() {
+		if (enabled) {
+			total += now() - started;
+		}
+	}
+	void record(int probe, uint64_t amount = 0) {
+		if (enabled) {
+			perf_stats::record(probe, total, amount);
+		}
+	}
+};
+
+} // namespace perf_stats
+
+// Times the rest of the calling method under its own name.
+#define PERF_METHOD_SCOPE()                                                   \
+	static const int perf_method_probe = perf_stats::register_method(__func__); \
+	perf_stats::Scope perf_method_scope(perf_method_probe)
+
+#endif // PERF_STATS_H
@@ -0,0 +1,193 @@
+#include "reference_index.h"
+
+#include "memory_usage.h"
+
+#include <algorithm>
+
+static void write_varint(std::vector<uint8_t> &r_out, uint64_t value) {
+	while (value >= 0x80) {
+		r_out.push_back((uint8_t)value | 0x80);
+		value >>= 7;
+	}
+	r_out.push_back((uint8_t)value);
+}
+
+void ReferenceIndex::decode(const uint8_t *data, uint32_t size, uint32_t name_length, std::vector<Occurrence> &r_occurrences) {
+	const uint8_t *end = data + size;
+	uint32_t start = 0;
+	while (data < end) {
+		// Bounded by end and by 64 bits, so a corrupt stream cannot run
+		// away.
+		uint64_t value = 0;
+		for (int shift = 0; data < end && shift < 64; shift += 7) {
+			uint8_t byte = *data++;
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				break;
+			}
+		}
+		start += (uint32_t)(value >> 1);
+		Occurrence occurrence;
+		occurrence.start_byte = start;
+		occurrence.end_byte = start + name_length;
+		occurrence.role = (value & 1) ? DocumentOutline::ROLE_DEFINITION : DocumentOutline::ROLE_REFERENCE;
+		r_occurrences.push_back(occurrence);
+	}
+}
+
+uint32_t ReferenceIndex::intern(std::string_view name) {
+	auto found = name_ids.find(name);
+	if (found != name_ids.end()) {
+		return found->second;
+	}
+	uint32_t id = names.size();
+	name_texts.emplace_back(name);
+	names.emplace_back();
+	names.back().text = &name_texts.back();
+	name_ids.emplace(std::string_view(name_texts.back()), id);
+	return id;
+}
+
+void ReferenceIndex::set_file_names(uint32_t file, std::vector<uint32_t> &new_names) {
+	// Both lists are sorted: walk them together and only touch the posting
+	// lists of names that differ.
+	std::vector<uint32_t> &old_names = files[file].names;
+	size_t i = 0;
+	size_t j = 0;
+	while (i < old_names.size() || j < new_names.size()) {
+		if (j == new_names.size() || (i < old_names.size() && old_names[i] < new_names[j])) {
+			std::vector<uint32_t> &posting = names[old_names[i]].files;
+			auto it = std::find(posting.begin(), posting.end(), file);
+			*it = posting.back();
+			posting.pop_back();
+			i++;
+		} else if (i == old_names.size() || new_names[j] < old_names[i]) {
+			names[new_names[j]].files.push_back(file);
+			j++;
+		} else {
+			i++;
+			j++;
+		}
+	}
+	old_names.swap(new_names);
+}
+
+void ReferenceIndex::update_file(const std::string &path, const char *data, const std::vector<DocumentOutline::Identifier> &identifiers) {
+	uint32_t file;
+	auto found = file_ids.find(path);
+	if (found != file_ids.end()) {
+		file = found->second;
+	} else {
+		if (free_files.empty()) {
+			file = files.size();
+			files.emplace_back();
+		} else {
+			file = free_files.back();
+			free_files.pop_back();
+		}
+		files[file].path = path;
+		file_ids.emplace(path, file);
+	}
+
+	struct Entry {
+		uint32_t name;
+		uint32_t start_byte;
+		uint32_t role;
+	};
+	std::vector<Entry> entries;
+	entries.reserve(identifiers.size());
+	for (const DocumentOutline::Identifier &identifier : identifiers) {
+		uint32_t name = intern(std::string_view(data + identifier.start_byte, identifier.end_byte - identifier.start_byte));
+		entries.push_back({ name, identifier.start_byte, (uint32_t)identifier.role });
+	}
+	// Identifiers come in document order; a stable sort keeps each name's
+	// group in it, so the gaps are non-negative.
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+		return a.name < b.name;
+	});
+
+	std::vector<uint32_t> new_names;
+	std::vector<uint32_t> offsets;
+	std::vector<uint8_t> postings;
+	postings.reserve(entries.size() * 2);
+	uint32_t previous = 0;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (i == 0 || entries[i].name != entries[i - 1].name) {
+			new_names.push_back(entries[i].name);
+			offsets.push_back(postings.size());
+			previous = 0;
+		}
+		write_varint(postings, ((uint64_t)(entries[i].start_byte - previous) << 1) | entries[i].role);
+		previous = entries[i].start_byte;
+	}
+	offsets.push_back(postings.size());
+	postings.shrink_to_fit();
+
+	File &entry = files[file];
+	occurrence_count += entries.size();
+	occurrence_count -= entry.occurrence_count;
+	posting_bytes += postings.size();
+	posting_bytes -= entry.postings.size();
+	entry.occurrence_count = entries.size();
+	entry.offsets.swap(offsets);
+	entry.postings.swap(postings);
+	set_file_names(file, new_names);
+}
+
+bool ReferenceIndex::remove_file(const std::string &path) {
+	auto found = file_ids.find(path);
+	if (found == file_ids.end()) {
+		return false;
+	}
+	uint32_t file = found->second;
+	std::vector<uint32_t> no_names;
+	set_file_names(file, no_names);
+	occurrence_count -= files[file].occurrence_count;
+	posting_bytes -= files[file].postings.size();
+	files[file] = File();
+	free_files.push_back(file);
+	file_ids.erase(found);
+	return true;
+}
+
+uint32_t ReferenceIndex::find_file(const std::string &path) const {
+	auto found = file_ids.find(path);
+	return found != file_ids.end() ? found->second : NONE;
+}
+
+uint32_t ReferenceIndex::find_name(std::string_view name) const {
+	auto found = name_ids.find(name);
+	return found != name_ids.end() ? found->second : NONE;
+}
+
+void ReferenceIndex::get_occurrences(uint32_t file, uint32_t name, std::vector<Occurrence> &r_occurrences) const {
+	const File &entry = files[file];
+	auto it = std::lower_bound(entry.names.begin(), entry.names.end(), name);
+	if (it == entry.names.end() || *it != name) {
+		return;
+	}
+	size_t index = it - entry.names.begin();
+	decode(entry.postings.data() + entry.offsets[index], entry.offsets[index + 1] - entry.offsets[index], names[name].text->size(), r_occurrences);
+}
+
+const uint8_t *ReferenceIndex::get_file_postings(uint32_t file, uint32_t index, uint32_t &r_size) const {
+	const File &entry = files[file];
+	r_size = entry.offsets[index + 1] - entry.offsets[index];
+	return entry.postings.data() + entry.offsets[index];
+}
+
+uint64_t ReferenceIndex::get_memory_bytes() const {
+	uint64_t bytes = name_texts.size() * sizeof(std::string) + memory_usage::of(name_ids) + memory_usage::of(names) + memory_usage::of(file_ids) +
+			memory_usage::of(files) + memory_usage::of(free_files);
+	for (const std::string &text : name_texts) {
+		bytes += memory_usage::of(text);
+	}
+	for (const Name &name : names) {
+		bytes += memory_usage::of(name.files);
+	}
+	for (const File &file : files) {
+		// The path again as a key of file_ids.
+		bytes += memory_usage::of(file.path) * 2 + memory_usage::of(file.names) + memory_usage::of(file.offsets) + memory_usage::of(file.postings);
+	}
+	return bytes;
+}
@@ -0,0 +1,94 @@
+#ifndef REFERENCE_INDEX_H
+#define REFERENCE_INDEX_H
+
+#include "document_outline.h"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Every identifier occurrence of the indexed files, by name.
+//
+// Names are interned once and each keeps the files it occurs in. A file
+// stores, per name it uses, the occurrences as a varint stream of
+// (start - previous start) << 1 | role: ends follow from the length of the
+// name, and most gaps fit in one or two bytes. Replacing a file's
+// occurrences only touches the posting lists of names that appeared in or
+// disappeared from it.
+class ReferenceIndex {
+public:
+	static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+	struct Occurrence {
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		DocumentOutline::IdentifierRole role = DocumentOutline::ROLE_REFERENCE;
+	};
+
+	// Appends the occurrences of a name name_length bytes long encoded in
+	// [data, data + size).
+	static void decode(const uint8_t *data, uint32_t size, uint32_t name_length, std::vector<Occurrence> &r_occurrences);
+
+private:
+	struct Name {
+		const std::string *text = nullptr;
+		// Files using the name, unordered and without duplicates.
+		std::vector<uint32_t> files;
+	};
+
+	struct File {
+		std::string path;
+		// Sorted ids of the names used in the file; the postings of
+		// names[i] are postings[offsets[i], offsets[i + 1]).
+		std::vector<uint32_t> names;
+		std::vector<uint32_t> offsets;
+		std::vector<uint8_t> postings;
+		uint32_t occurrence_count = 0;
+	};
+
+	std::deque<std::string> name_texts;
+	std::unordered_map<std::string_view, uint32_t> name_ids;
+	std::vector<Name> names;
+	std::unordered_map<std::string, uint32_t> file_ids;
+	std::vector<File> files;
+	std::vector<uint32_t> free_files;
+	uint64_t occurrence_count = 0;
+	uint64_t posting_bytes = 0;
+
+	uint32_t intern(std::string_view name);
+	void set_file_names(uint32_t file, std::vector<uint32_t> &new_names);
+
+public:
+	// Replaces the occurrences of path (adding the file if needed);
+	// identifiers index into data.
+	void update_file(const std::string &path, const char *data, const std::vector<DocumentOutline::Identifier> &identifiers);
+	bool remove_file(const std::string &path);
+	// NONE if the file is not indexed.
+	uint32_t find_file(const std::string &path) const;
+
+	// NONE if no file ever used the name.
+	uint32_t find_name(std::string_view name) const;
+	const std::vector<uint32_t> &get_name_files(uint32_t name) const { return names[name].files; }
+	// Appends the occurrences of name in file, in document order.
+	void get_occurrences(uint32_t file, uint32_t name, std::vector<Occurrence> &r_occurrences) const;
+
+	// The names of a file with their encoded postings, for saving.
+	uint32_t get_file_name_count(uint32_t file) const { return files[file].names.size(); }
+	uint32_t get_file_name(uint32_t file, uint32_t index) const { return files[file].names[index]; }
+	const uint8_t *get_file_postings(uint32_t file, uint32_t index, uint32_t &r_size) const;
+
+	const std::string &get_name(uint32_t name) const { return *names[name].text; }
+	const std::string &get_file_path(uint32_t file) const { return files[file].path; }
+
+	uint32_t get_file_count() const { return file_ids.size(); }
+	uint32_t get_name_count() const { return names.size(); }
+	uint64_t get_occurrence_count() const { return occurrence_count; }
+	// Bytes of encoded postings, about one and a half per occurrence.
+	uint64_t get_posting_bytes() const { return posting_bytes; }
+	uint64_t get_memory_bytes() const;
+};
+
+#endif // REFERENCE_INDEX_H
@@ -1,19 +1,54 @@
 #include "register_types.h"
 
 #include "ast_manager.h"
+#include "staged_edit.h"
+#include "tree_cache.h"
+#include "ts_allocator.h"
 
+#include <godot_cpp/classes/performance.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/core/defs.hpp>
 #include <godot_cpp/godot.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
 
 using namespace godot;
 
+// Process-wide monitors; each manager can add its own with
+// add_memory_monitors().
+static int64_t get_tree_sitter_bytes() {
+	return ts_allocator::get_stats().bytes;
+}
+
+static int64_t get_tree_sitter_blocks() {
+	return ts_allocator::get_stats().block_count;
+}
+
+static int64_t get_tree_cache_bytes() {
+	return TreeCache::get_singleton().get_stats().source_bytes;
+}
+
+static const char *const TREE_SITTER_BYTES_MONITOR = "AST/tree_sitter_bytes";
+static const char *const TREE_SITTER_BLOCKS_MONITOR = "AST/tree_sitter_blocks";
+static const char *const TREE_CACHE_BYTES_MONITOR = "AST/tree_cache_source_bytes";
+
 void initialize_ast_module(ModuleInitializationLevel p_level) {
 	if (p_level != MODULE_INITIALIZATION_LEVEL_SCENE) {
 		return;
 	}
 
+	// Before anything allocates through tree-sitter: blocks from another
+	// allocator cannot be freed by this one.
+	ts_allocator::install();
+
 	ClassDB::register_class<ASTManager>();
+	ClassDB::register_abstract_class<StagedEdit>();
+
+	Performance *performance = Performance::get_singleton();
+	if (performance) {
+		performance->add_custom_monitor(TREE_SITTER_BYTES_MONITOR, callable_mp_static(&get_tree_sitter_bytes));
+		performance->add_custom_monitor(TREE_SITTER_BLOCKS_MONITOR, callable_mp_static(&get_tree_sitter_blocks));
+		performance->add_custom_monitor(TREE_CACHE_BYTES_MONITOR, callable_mp_static(&get_tree_cache_bytes));
+	}
 }
 
 void uninitialize_ast_module(ModuleInitializationLevel p_level) {
@@ -21,7 +56,16 @@ void uninitialize_ast_module(ModuleInitializationLevel p_level) {
 		return;
 	}
 
-	// Nothing to clean up
+	Performance *performance = Performance::get_singleton();
+	if (performance) {
+		performance->remove_custom_monitor(TREE_SITTER_BYTES_MONITOR);
+		performance->remove_custom_monitor(TREE_SITTER_BLOCKS_MONITOR);
+		performance->remove_custom_monitor(TREE_CACHE_BYTES_MONITOR);
+	}
+
+	// The cache outlives every manager; its buffers must go while Godot
+	// is still there to free them.
+	TreeCache::get_singleton().clear();
 }
 
 extern "C" {
@@ -0,0 +1,90 @@
+#include "staged_edit.h"
+
+#include <godot_cpp/core/class_db.hpp>
+
+StagedEdit::~StagedEdit() {
+	release_tree();
+}
+
+void StagedEdit::release_tree() {
+	if (tree) {
+		ts_tree_delete(tree);
+		tree = nullptr;
+	}
+}
+
+Dictionary StagedEdit::commit() {
+	if (status != STATUS_PENDING || manager.is_null()) {
+		Dictionary err;
+		err["success"] = false;
+		err["error"] = status == STATUS_COMMITTED ? "Staged edit already committed" : "Staged edit was discarded";
+		err["file_path"] = file_path;
+		return err;
+	}
+	Ref<ASTManager> owner = manager;
+	Dictionary result = owner->commit_staged_edit(this);
+	if (status == STATUS_COMMITTED) {
+		manager.unref();
+	}
+	return result;
+}
+
+void StagedEdit::discard() {
+	if (status != STATUS_PENDING) {
+		return;
+	}
+	release_tree();
+	source_bytes = PackedByteArray();
+	error_ranges = Array();
+	status = STATUS_DISCARDED;
+	manager.unref();
+}
+
+bool StagedEdit::is_pending() const {
+	return status == STATUS_PENDING;
+}
+
+bool StagedEdit::is_stale() const {
+	if (status != STATUS_PENDING || manager.is_null()) {
+		return true;
+	}
+	const FileState *state = manager->open_files.getptr(file_path);
+	return !state || state->version != base_version;
+}
+
+String StagedEdit::get_file_path() const {
+	return file_path;
+}
+
+String StagedEdit::get_new_source() const {
+	return String::utf8(reinterpret_cast<const char *>(source_bytes.ptr()), source_bytes.size());
+}
+
+bool StagedEdit::get_has_error() const {
+	return has_error;
+}
+
+int StagedEdit::get_error_count() const {
+	return error_ranges.size();
+}
+
+Array StagedEdit::get_error_ranges() const {
+	return error_ranges;
+}
+
+int StagedEdit::get_edits_applied() const {
+	return edits_applied;
+}
+
+void StagedEdit::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("commit"), &StagedEdit::commit);
+	ClassDB::bind_method(D_METHOD("discard"), &StagedEdit::discard);
+	ClassDB::bind_method(D_METHOD("is_pending"), &StagedEdit::is_pending);
+	ClassDB::bind_method(D_METHOD("is_stale"), &StagedEdit::is_stale);
+	ClassDB::bind_method(D_METHOD("get_file_path"), &StagedEdit::get_file_path);
+	ClassDB::bind_method(D_METHOD("get_new_source"), &StagedEdit::get_new_source);
+	ClassDB::bind_method(D_METHOD("has_error"), &StagedEdit::get_has_error);
+	ClassDB::bind_method(D_METHOD("get_error_count"), &StagedEdit::get_error_count);
+	ClassDB::bind_method(D_METHOD("get_error_ranges"), &StagedEdit::get_error_ranges);
+	ClassDB::bind_method(D_METHOD("get_edits_applied"), &StagedEdit::get_edits_applied);
+}
@@ -0,0 +1,61 @@
+#ifndef STAGED_EDIT_H
+#define STAGED_EDIT_H
+
+#include "ast_manager.h"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <tree_sitter/api.h>
+
+using namespace godot;
+
+// A previewed edit of one open file. Holds the modified buffer and the tree
+// parsed from it, so committing only swaps them into the file's FileState
+// instead of applying and parsing the edits a second time.
+class StagedEdit : public RefCounted {
+	GDCLASS(StagedEdit, RefCounted)
+
+	friend class ASTManager;
+
+public:
+	enum Status {
+		STATUS_PENDING,
+		STATUS_COMMITTED,
+		STATUS_DISCARDED,
+	};
+
+private:
+	Ref<ASTManager> manager;
+	String file_path;
+	uint64_t base_version = 0;
+	Vector<ByteEdit> byte_edits;
+	PackedByteArray source_bytes;
+	TSTree *tree = nullptr;
+	bool has_error = false;
+	Array error_ranges;
+	int edits_applied = 0;
+	Status status = STATUS_PENDING;
+
+	void release_tree();
+
+protected:
+	static void _bind_methods();
+
+public:
+	~StagedEdit();
+
+	Dictionary commit();
+	void discard();
+
+	bool is_pending() const;
+	bool is_stale() const;
+	String get_file_path() const;
+	String get_new_source() const;
+	bool get_has_error() const;
+	int get_error_count() const;
+	Array get_error_ranges() const;
+	int get_edits_applied() const;
+};
+
+#endif // STAGED_EDIT_H
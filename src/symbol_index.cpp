@@ -0,0 +1,197 @@
+#include "symbol_index.h"
+
+#include "memory_usage.h"
+
+#include <algorithm>
+
+uint32_t SymbolIndex::intern(const std::string &name) {
+	auto found = name_ids.find(std::string_view(name));
+	if (found != name_ids.end()) {
+		return found->second;
+	}
+	uint32_t id = names.size();
+	auto inserted = sorted_names.emplace(name, id).first;
+	names.emplace_back();
+	names.back().text = &inserted->first;
+	name_ids.emplace(std::string_view(inserted->first), id);
+	return id;
+}
+
+void SymbolIndex::set_file_names(uint32_t file, std::vector<uint32_t> &new_names) {
+	std::sort(new_names.begin(), new_names.end());
+	new_names.erase(std::unique(new_names.begin(), new_names.end()), new_names.end());
+
+	// Both lists are sorted: walk them together and only touch the posting
+	// lists of names that differ.
+	std::vector<uint32_t> &old_names = files[file].names;
+	size_t i = 0;
+	size_t j = 0;
+	while (i < old_names.size() || j < new_names.size()) {
+		if (j == new_names.size() || (i < old_names.size() && old_names[i] < new_names[j])) {
+			std::vector<uint32_t> &posting = names[old_names[i]].files;
+			auto it = std::find(posting.begin(), posting.end(), file);
+			*it = posting.back();
+			posting.pop_back();
+			i++;
+		} else if (i == old_names.size() || new_names[j] < old_names[i]) {
+			names[new_names[j]].files.push_back(file);
+			j++;
+		} else {
+			i++;
+			j++;
+		}
+	}
+	old_names.swap(new_names);
+}
+
+void SymbolIndex::update_file(const std::string &path, const std::vector<DocumentOutline::Symbol> &symbols) {
+	uint32_t file;
+	auto found = file_ids.find(path);
+	if (found != file_ids.end()) {
+		file = found->second;
+	} else {
+		if (free_files.empty()) {
+			file = files.size();
+			files.emplace_back();
+		} else {
+			file = free_files.back();
+			free_files.pop_back();
+		}
+		files[file].path = path;
+		file_ids.emplace(path, file);
+	}
+
+	File &entry = files[file];
+	entry.content_hash = 0;
+	entry.mtime = 0;
+	entry.extends.clear();
+	entry.preloads.clear();
+	entry.loads.clear();
+	symbol_count -= entry.symbols.size();
+	entry.symbols.resize(symbols.size());
+	std::vector<uint32_t> new_names;
+	new_names.reserve(symbols.size());
+	for (size_t i = 0; i < symbols.size(); i++) {
+		const DocumentOutline::Symbol &source = symbols[i];
+		Symbol &symbol = entry.symbols[i];
+		symbol.name = intern(source.name);
+		// Parents come first, so their name is already set.
+		symbol.container = source.parent == DocumentOutline::NONE ? NONE : entry.symbols[source.parent].name;
+		symbol.kind = source.kind;
+		symbol.start_byte = source.start_byte;
+		symbol.end_byte = source.end_byte;
+		symbol.start_row = source.start_row;
+		symbol.end_row = source.end_row;
+		symbol.name_start_byte = source.name_start_byte;
+		symbol.name_end_byte = source.name_end_byte;
+		new_names.push_back(symbol.name);
+	}
+	symbol_count += symbols.size();
+	set_file_names(file, new_names);
+}
+
+bool SymbolIndex::remove_file(const std::string &path) {
+	auto found = file_ids.find(path);
+	if (found == file_ids.end()) {
+		return false;
+	}
+	uint32_t file = found->second;
+	std::vector<uint32_t> no_names;
+	set_file_names(file, no_names);
+	symbol_count -= files[file].symbols.size();
+	files[file] = File();
+	free_files.push_back(file);
+	file_ids.erase(found);
+	return true;
+}
+
+bool SymbolIndex::has_file(const std::string &path) const {
+	return file_ids.count(path) > 0;
+}
+
+void SymbolIndex::set_persistent(const std::string &path, bool persistent) {
+	auto found = file_ids.find(path);
+	if (found != file_ids.end()) {
+		files[found->second].persistent = persistent;
+	}
+}
+
+bool SymbolIndex::is_persistent(const std::string &path) const {
+	auto found = file_ids.find(path);
+	return found != file_ids.end() && files[found->second].persistent;
+}
+
+void SymbolIndex::get_files(std::vector<uint32_t> &r_files) const {
+	r_files.clear();
+	r_files.reserve(file_ids.size());
+	for (const auto &entry : file_ids) {
+		r_files.push_back(entry.second);
+	}
+}
+
+uint32_t SymbolIndex::find_file(const std::string &path) const {
+	auto found = file_ids.find(path);
+	return found != file_ids.end() ? found->second : NONE;
+}
+
+void SymbolIndex::set_file_stamp(uint32_t file, uint64_t content_hash, int64_t mtime) {
+	files[file].content_hash = content_hash;
+	files[file].mtime = mtime;
+}
+
+uint32_t SymbolIndex::find_name(std::string_view name) const {
+	auto found = name_ids.find(name);
+	return found != name_ids.end() ? found->second : NONE;
+}
+
+void SymbolIndex::find(uint32_t name, std::vector<Location> &r_locations) const {
+	r_locations.clear();
+	if (name >= names.size()) {
+		return;
+	}
+	for (uint32_t file : names[name].files) {
+		const std::vector<Symbol> &symbols = files[file].symbols;
+		for (uint32_t i = 0; i < symbols.size(); i++) {
+			if (symbols[i].name == name) {
+				r_locations.push_back({ file, i });
+			}
+		}
+	}
+}
+
+void SymbolIndex::find_prefix(std::string_view prefix, uint32_t limit, std::vector<uint32_t> &r_names) const {
+	r_names.clear();
+	for (auto it = sorted_names.lower_bound(std::string(prefix)); it != sorted_names.end() && r_names.size() < limit; ++it) {
+		if (it->first.compare(0, prefix.size(), prefix) != 0) {
+			break;
+		}
+		// Names stay interned after their last declaration goes away.
+		if (!names[it->second].files.empty()) {
+			r_names.push_back(it->second);
+		}
+	}
+}
+
+uint64_t SymbolIndex::get_memory_bytes() const {
+	// Name texts are stored once, as the keys of sorted_names.
+	uint64_t bytes = memory_usage::of(sorted_names) + memory_usage::of(name_ids) + memory_usage::of(names) + memory_usage::of(file_ids) +
+			memory_usage::of(files) + memory_usage::of(free_files);
+	for (const auto &entry : sorted_names) {
+		bytes += memory_usage::of(entry.first);
+	}
+	for (const Name &name : names) {
+		bytes += memory_usage::of(name.files);
+	}
+	for (const File &file : files) {
+		// The path again as a key of file_ids.
+		bytes += memory_usage::of(file.path) * 2 + memory_usage::of(file.symbols) + memory_usage::of(file.names) + memory_usage::of(file.extends) +
+				memory_usage::of(file.preloads) + memory_usage::of(file.loads);
+		for (const std::string &path : file.preloads) {
+			bytes += memory_usage::of(path);
+		}
+		for (const std::string &path : file.loads) {
+			bytes += memory_usage::of(path);
+		}
+	}
+	return bytes;
+}
@@ -0,0 +1,124 @@
+#ifndef SYMBOL_INDEX_H
+#define SYMBOL_INDEX_H
+
+#include "document_outline.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Declarations of every indexed file, by name.
+//
+// Names are interned once: a hash table maps a name to its id and an ordered
+// map of the same strings serves prefix enumeration. Each name keeps the
+// files declaring it, and each file its own symbol list, so replacing a
+// file's symbols after an edit only touches the posting lists of names
+// that appeared in or disappeared from that file.
+class SymbolIndex {
+public:
+	static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+	struct Symbol {
+		uint32_t name = 0;
+		// Name of the enclosing class, NONE at the top level.
+		uint32_t container = NONE;
+		DocumentOutline::SymbolKind kind = DocumentOutline::SYMBOL_VARIABLE;
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		uint32_t start_row = 0;
+		uint32_t end_row = 0;
+		uint32_t name_start_byte = 0;
+		uint32_t name_end_byte = 0;
+	};
+
+	struct Location {
+		uint32_t file = 0;
+		uint32_t symbol = 0;
+	};
+
+private:
+	struct Name {
+		const std::string *text = nullptr;
+		// Files declaring the name, unordered and without duplicates.
+		std::vector<uint32_t> files;
+	};
+
+	struct File {
+		std::string path;
+		std::vector<Symbol> symbols;
+		// Sorted ids of the names declared in the file.
+		std::vector<uint32_t> names;
+		// Kept when the file is closed in the editor.
+		bool persistent = false;
+		// Content the symbols were extracted from, for skipping unchanged
+		// files at startup (0: unknown).
+		uint64_t content_hash = 0;
+		int64_t mtime = 0;
+		// Base class or script from the extends statement, if any.
+		std::string extends;
+		// Paths of the constant preload() and load() calls.
+		std::vector<std::string> preloads;
+		std::vector<std::string> loads;
+	};
+
+	std::map<std::string, uint32_t> sorted_names;
+	std::unordered_map<std::string_view, uint32_t> name_ids;
+	std::vector<Name> names;
+	std::unordered_map<std::string, uint32_t> file_ids;
+	std::vector<File> files;
+	std::vector<uint32_t> free_files;
+	uint32_t symbol_count = 0;
+
+	uint32_t intern(const std::string &name);
+	void set_file_names(uint32_t file, std::vector<uint32_t> &new_names);
+
+public:
+	// Replaces the symbols of path (adding the file if needed) and clears
+	// its stamp, base and loads.
+	void update_file(const std::string &path, const std::vector<DocumentOutline::Symbol> &symbols);
+	bool remove_file(const std::string &path);
+	bool has_file(const std::string &path) const;
+	void set_persistent(const std::string &path, bool persistent);
+	bool is_persistent(const std::string &path) const;
+
+	// Ids of the indexed files, for walking the whole index.
+	void get_files(std::vector<uint32_t> &r_files) const;
+	// NONE if the file is not indexed.
+	uint32_t find_file(const std::string &path) const;
+	const std::vector<Symbol> &get_file_symbols(uint32_t file) const { return files[file].symbols; }
+	bool is_file_persistent(uint32_t file) const { return files[file].persistent; }
+	uint64_t get_file_hash(uint32_t file) const { return files[file].content_hash; }
+	int64_t get_file_mtime(uint32_t file) const { return files[file].mtime; }
+	void set_file_stamp(uint32_t file, uint64_t content_hash, int64_t mtime);
+	const std::string &get_file_extends(uint32_t file) const { return files[file].extends; }
+	void set_file_extends(uint32_t file, const std::string &extends) { files[file].extends = extends; }
+	const std::vector<std::string> &get_file_preloads(uint32_t file) const { return files[file].preloads; }
+	const std::vector<std::string> &get_file_loads(uint32_t file) const { return files[file].loads; }
+	void set_file_loads(uint32_t file, std::vector<std::string> preloads, std::vector<std::string> loads) {
+		files[file].preloads = std::move(preloads);
+		files[file].loads = std::move(loads);
+	}
+
+	// NONE if no file ever declared the name.
+	uint32_t find_name(std::string_view name) const;
+	void find(uint32_t name, std::vector<Location> &r_locations) const;
+	// False once the last file declaring the name dropped it.
+	bool is_name_declared(uint32_t name) const { return !names[name].files.empty(); }
+	// Up to limit declared names starting with prefix, in byte order.
+	void find_prefix(std::string_view prefix, uint32_t limit, std::vector<uint32_t> &r_names) const;
+
+	const std::string &get_name(uint32_t name) const { return *names[name].text; }
+	const std::string &get_file_path(uint32_t file) const { return files[file].path; }
+	const Symbol &get_symbol(const Location &location) const { return files[location.file].symbols[location.symbol]; }
+
+	uint32_t get_file_count() const { return file_ids.size(); }
+	uint32_t get_symbol_count() const { return symbol_count; }
+	uint32_t get_name_count() const { return names.size(); }
+	uint64_t get_memory_bytes() const;
+};
+
+#endif // SYMBOL_INDEX_H
@@ -0,0 +1,494 @@
+#include "symbol_index_file.h"
+#include "content_hash.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char INDEX_MAGIC[8] = { 'G', 'D', 'S', 'Y', 'M', 'I', 'D', 'X' };
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+static uint64_t align8(uint64_t offset) {
+	return (offset + 7) & ~(uint64_t)7;
+}
+
+static bool table_fits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t total) {
+	return offset % 8 == 0 && offset <= total && count <= (total - offset) / item_size;
+}
+
+static bool string_fits(const SymbolIndexFile::Header &h, uint32_t offset, uint32_t length) {
+	return offset <= h.strings_size && length <= h.strings_size - offset;
+}
+
+#ifdef _WIN32
+static std::wstring to_wide(const std::string &path) {
+	int length = MultiByteToWideChar(CP_UTF8, 0, path.data(), (int)path.size(), nullptr, 0);
+	std::wstring wide(length, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, path.data(), (int)path.size(), &wide[0], length);
+	return wide;
+}
+#endif
+
+SymbolIndexFile::~SymbolIndexFile() {
+	close();
+}
+
+bool SymbolIndexFile::validate(std::string &r_error) const {
+	const Header &h = *header;
+	if (memcmp(h.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+		r_error = "Not a symbol index file";
+		return false;
+	}
+	if (h.byte_order != BYTE_ORDER_MARK) {
+		r_error = "Symbol index was written with a different byte order";
+		return false;
+	}
+	if (h.version != FORMAT_VERSION) {
+		r_error = "Symbol index format " + std::to_string(h.version) + " is not supported (expected " + std::to_string(FORMAT_VERSION) + ")";
+		return false;
+	}
+	if (h.total_size != size || !table_fits(h.files_offset, h.file_count, sizeof(FileRecord), size) ||
+			!table_fits(h.symbols_offset, h.symbol_count, sizeof(SymbolRecord), size) ||
+			!table_fits(h.names_offset, h.name_count, sizeof(NameRecord), size) ||
+			!table_fits(h.postings_offset, h.posting_count, sizeof(uint32_t), size) ||
+			!table_fits(h.references_offset, h.reference_count, sizeof(ReferenceRecord), size) ||
+			!table_fits(h.buckets_offset, h.bucket_count, sizeof(uint32_t), size) ||
+			h.strings_offset > size || h.strings_size > size - h.strings_offset ||
+			h.reference_data_offset > size || h.reference_data_size > size - h.reference_data_offset ||
+			(h.bucket_count & (h.bucket_count - 1)) != 0 || (h.name_count > 0 && h.bucket_count <= h.name_count)) {
+		r_error = "Symbol index is truncated or corrupt";
+		return false;
+	}
+	return true;
+}
+
+void SymbolIndexFile::validate_file(uint32_t file) const {
+	const Header &h = *header;
+	FileRecord &record = files[file];
+	checked_files[file] = 1;
+	bool valid = string_fits(h, record.path_offset, record.path_length) && string_fits(h, record.extends_offset, record.extends_length) &&
+			string_fits(h, record.preloads_offset, record.preloads_length) && string_fits(h, record.loads_offset, record.loads_length) &&
+			record.first_symbol <= h.symbol_count && record.symbol_count <= h.symbol_count - record.first_symbol;
+	for (uint32_t i = record.first_symbol; valid && i < record.first_symbol + record.symbol_count; i++) {
+		check_symbol(i);
+		valid = symbols[i].file == file;
+	}
+	if (!valid) {
+		record = FileRecord();
+		hidden[file] = 1;
+	}
+}
+
+void SymbolIndexFile::validate_symbol(uint32_t symbol) const {
+	const Header &h = *header;
+	SymbolRecord &record = symbols[symbol];
+	checked_symbols[symbol] = 1;
+	if (record.file >= h.file_count || record.name >= h.name_count || (record.container != NONE && record.container >= h.name_count)) {
+		record.file = NONE;
+	}
+}
+
+void SymbolIndexFile::validate_name(uint32_t name) const {
+	const Header &h = *header;
+	NameRecord &record = names[name];
+	checked_names[name] = 1;
+	bool valid = string_fits(h, record.text_offset, record.text_length) && record.first_posting <= h.posting_count &&
+			record.posting_count <= h.posting_count - record.first_posting && record.first_reference <= h.reference_count &&
+			record.reference_count <= h.reference_count - record.first_reference;
+	for (uint32_t i = 0; valid && i < record.posting_count; i++) {
+		valid = postings[record.first_posting + i] < h.symbol_count;
+	}
+	for (uint32_t i = 0; valid && i < record.reference_count; i++) {
+		const ReferenceRecord &reference = references[record.first_reference + i];
+		valid = reference.file < h.file_count && reference.data_offset <= h.reference_data_size &&
+				reference.data_size <= h.reference_data_size - reference.data_offset;
+	}
+	if (!valid) {
+		// Keeps the hash, so find_name() still probes past it.
+		record.text_offset = 0;
+		record.text_length = 0;
+		record.posting_count = 0;
+		record.reference_count = 0;
+	}
+}
+
+bool SymbolIndexFile::open(const std::string &path, std::string &r_error) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileW(to_wide(path).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		r_error = "Cannot open " + path;
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(Header)) {
+		CloseHandle(file);
+		r_error = "Symbol index is truncated or corrupt";
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping) {
+		r_error = "Cannot map " + path;
+		return false;
+	}
+	void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!view) {
+		r_error = "Cannot map " + path;
+		return false;
+	}
+	base = static_cast<uint8_t *>(view);
+	size = (size_t)file_size.QuadPart;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		r_error = "Cannot open " + path;
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(Header)) {
+		::close(fd);
+		r_error = "Symbol index is truncated or corrupt";
+		return false;
+	}
+	void *view = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED) {
+		r_error = "Cannot map " + path;
+		return false;
+	}
+	base = static_cast<uint8_t *>(view);
+	size = (size_t)info.st_size;
+#endif
+
+	header = reinterpret_cast<const Header *>(base);
+	files = reinterpret_cast<FileRecord *>(base + header->files_offset);
+	symbols = reinterpret_cast<SymbolRecord *>(base + header->symbols_offset);
+	names = reinterpret_cast<NameRecord *>(base + header->names_offset);
+	postings = reinterpret_cast<const uint32_t *>(base + header->postings_offset);
+	references = reinterpret_cast<const ReferenceRecord *>(base + header->references_offset);
+	buckets = reinterpret_cast<const uint32_t *>(base + header->buckets_offset);
+	strings = reinterpret_cast<const char *>(base + header->strings_offset);
+	reference_data = base + header->reference_data_offset;
+	// Offsets are only dereferenced once validate() has checked the tables.
+	if (!validate(r_error)) {
+		close();
+		return false;
+	}
+	hidden.assign(header->file_count, 0);
+	checked_files.assign(header->file_count, 0);
+	checked_symbols.assign(header->symbol_count, 0);
+	checked_names.assign(header->name_count, 0);
+	return true;
+}
+
+void SymbolIndexFile::close() {
+	if (base) {
+#ifdef _WIN32
+		UnmapViewOfFile(base);
+#else
+		munmap(base, size);
+#endif
+	}
+	base = nullptr;
+	size = 0;
+	header = nullptr;
+	files = nullptr;
+	symbols = nullptr;
+	names = nullptr;
+	postings = nullptr;
+	references = nullptr;
+	buckets = nullptr;
+	strings = nullptr;
+	reference_data = nullptr;
+	hidden.clear();
+	checked_files.clear();
+	checked_symbols.clear();
+	checked_names.clear();
+}
+
+bool SymbolIndexFile::is_hidden(uint32_t file) const {
+	if (file >= get_file_count()) {
+		return true;
+	}
+	check_file(file);
+	return hidden[file] != 0;
+}
+
+const uint32_t *SymbolIndexFile::get_postings(uint32_t name, uint32_t &r_count) const {
+	check_name(name);
+	r_count = names[name].posting_count;
+	return postings + names[name].first_posting;
+}
+
+const SymbolIndexFile::ReferenceRecord *SymbolIndexFile::get_references(uint32_t name, uint32_t &r_count) const {
+	check_name(name);
+	r_count = names[name].reference_count;
+	return references + names[name].first_reference;
+}
+
+uint32_t SymbolIndexFile::find_file(std::string_view path) const {
+	uint32_t low = 0;
+	uint32_t high = get_file_count();
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (get_file_path(middle) < path) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return (low < get_file_count() && get_file_path(low) == path) ? low : NONE;
+}
+
+uint32_t SymbolIndexFile::find_name(std::string_view name) const {
+	if (!header || header->name_count == 0) {
+		return NONE;
+	}
+	uint64_t hash = content_hash::hash_bytes(name.data(), name.size());
+	uint32_t mask = header->bucket_count - 1;
+	uint32_t slot = hash & mask;
+	// Bounded, since a corrupt table need not have an empty slot.
+	for (uint32_t probe = 0; probe < header->bucket_count; probe++, slot = (slot + 1) & mask) {
+		uint32_t entry = buckets[slot];
+		if (entry == 0 || entry > header->name_count) {
+			return NONE;
+		}
+		if (names[entry - 1].hash == hash && get_name(entry - 1) == name) {
+			return entry - 1;
+		}
+	}
+	return NONE;
+}
+
+uint32_t SymbolIndexFile::lower_bound_name(std::string_view text) const {
+	uint32_t low = 0;
+	uint32_t high = get_name_count();
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (get_name(middle) < text) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+bool SymbolIndexFile::write(const std::string &path, std::vector<FileData> &files, std::string &r_error) {
+	std::sort(files.begin(), files.end(), [](const FileData &a, const FileData &b) {
+		return a.path < b.path;
+	});
+
+	// Name ids follow the sorted order of the names.
+	std::map<std::string_view, uint32_t> name_ids;
+	uint32_t symbol_count = 0;
+	for (const FileData &file : files) {
+		for (const SymbolData &symbol : file.symbols) {
+			name_ids.emplace(symbol.name, 0);
+			if (!symbol.container.empty()) {
+				name_ids.emplace(symbol.container, 0);
+			}
+		}
+		for (const ReferenceData &reference : file.references) {
+			name_ids.emplace(reference.name, 0);
+		}
+		symbol_count += file.symbols.size();
+	}
+
+	std::string string_data;
+	std::vector<NameRecord> name_records;
+	name_records.reserve(name_ids.size());
+	for (auto &entry : name_ids) {
+		entry.second = name_records.size();
+		NameRecord record = {};
+		record.hash = content_hash::hash_bytes(entry.first.data(), entry.first.size());
+		record.text_offset = string_data.size();
+		record.text_length = entry.first.size();
+		name_records.push_back(record);
+		string_data.append(entry.first);
+	}
+
+	std::vector<FileRecord> file_records;
+	std::vector<SymbolRecord> symbol_records;
+	file_records.reserve(files.size());
+	symbol_records.reserve(symbol_count);
+	for (uint32_t i = 0; i < files.size(); i++) {
+		const FileData &file = files[i];
+		FileRecord record = {};
+		record.content_hash = file.content_hash;
+		record.mtime = file.mtime;
+		record.path_offset = string_data.size();
+		record.path_length = file.path.size();
+		record.first_symbol = symbol_records.size();
+		record.symbol_count = file.symbols.size();
+		string_data.append(file.path);
+		record.extends_offset = string_data.size();
+		record.extends_length = file.extends.size();
+		string_data.append(file.extends);
+		auto append_lines = [&](const std::vector<std::string> &lines, uint32_t &r_offset, uint32_t &r_length) {
+			r_offset = string_data.size();
+			for (size_t k = 0; k < lines.size(); k++) {
+				if (k > 0) {
+					string_data.push_back('\n');
+				}
+				string_data.append(lines[k]);
+			}
+			r_length = string_data.size() - r_offset;
+		};
+		append_lines(file.preloads, record.preloads_offset, record.preloads_length);
+		append_lines(file.loads, record.loads_offset, record.loads_length);
+		file_records.push_back(record);
+
+		for (const SymbolData &symbol : file.symbols) {
+			SymbolRecord symbol_record = {};
+			symbol_record.file = i;
+			symbol_record.name = name_ids[symbol.name];
+			symbol_record.container = symbol.container.empty() ? NONE : name_ids[symbol.container];
+			symbol_record.kind = symbol.kind;
+			symbol_record.start_byte = symbol.start_byte;
+			symbol_record.end_byte = symbol.end_byte;
+			symbol_record.start_row = symbol.start_row;
+			symbol_record.end_row = symbol.end_row;
+			symbol_record.name_start_byte = symbol.name_start_byte;
+			symbol_record.name_end_byte = symbol.name_end_byte;
+			symbol_records.push_back(symbol_record);
+		}
+	}
+	if (string_data.size() > NONE) {
+		r_error = "Symbol index is too large";
+		return false;
+	}
+
+	// Posting lists: count per name, then place symbols in order.
+	for (const SymbolRecord &symbol : symbol_records) {
+		name_records[symbol.name].posting_count++;
+	}
+	uint32_t posting_total = 0;
+	for (NameRecord &record : name_records) {
+		record.first_posting = posting_total;
+		posting_total += record.posting_count;
+		record.posting_count = 0;
+	}
+	std::vector<uint32_t> posting_data(posting_total);
+	for (uint32_t i = 0; i < symbol_records.size(); i++) {
+		NameRecord &record = name_records[symbol_records[i].name];
+		posting_data[record.first_posting + record.posting_count++] = i;
+	}
+
+	// Reference records the same way, and their streams in file order.
+	std::vector<uint8_t> reference_bytes;
+	uint32_t reference_total = 0;
+	for (const FileData &file : files) {
+		for (const ReferenceData &reference : file.references) {
+			name_records[name_ids[reference.name]].reference_count++;
+		}
+		reference_total += file.references.size();
+	}
+	uint32_t first_reference = 0;
+	for (NameRecord &record : name_records) {
+		record.first_reference = first_reference;
+		first_reference += record.reference_count;
+		record.reference_count = 0;
+	}
+	std::vector<ReferenceRecord> reference_records(reference_total);
+	for (uint32_t i = 0; i < files.size(); i++) {
+		for (const ReferenceData &reference : files[i].references) {
+			NameRecord &record = name_records[name_ids[reference.name]];
+			ReferenceRecord &reference_record = reference_records[record.first_reference + record.reference_count++];
+			reference_record.data_offset = reference_bytes.size();
+			reference_record.file = i;
+			reference_record.data_size = reference.occurrences.size();
+			reference_bytes.insert(reference_bytes.end(), reference.occurrences.begin(), reference.occurrences.end());
+		}
+	}
+
+	uint32_t bucket_count = 1;
+	while (bucket_count <= name_records.size() * 2) {
+		bucket_count *= 2;
+	}
+	std::vector<uint32_t> bucket_data(bucket_count, 0);
+	for (uint32_t i = 0; i < name_records.size(); i++) {
+		uint32_t slot = name_records[i].hash & (bucket_count - 1);
+		while (bucket_data[slot] != 0) {
+			slot = (slot + 1) & (bucket_count - 1);
+		}
+		bucket_data[slot] = i + 1;
+	}
+
+	Header header = {};
+	memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = FORMAT_VERSION;
+	header.byte_order = BYTE_ORDER_MARK;
+	header.file_count = file_records.size();
+	header.symbol_count = symbol_records.size();
+	header.name_count = name_records.size();
+	header.posting_count = posting_total;
+	header.bucket_count = bucket_count;
+	header.reference_count = reference_total;
+	header.files_offset = align8(sizeof(Header));
+	header.symbols_offset = align8(header.files_offset + file_records.size() * sizeof(FileRecord));
+	header.names_offset = align8(header.symbols_offset + symbol_records.size() * sizeof(SymbolRecord));
+	header.postings_offset = align8(header.names_offset + name_records.size() * sizeof(NameRecord));
+	header.references_offset = align8(header.postings_offset + posting_data.size() * sizeof(uint32_t));
+	header.buckets_offset = align8(header.references_offset + reference_records.size() * sizeof(ReferenceRecord));
+	header.strings_offset = align8(header.buckets_offset + bucket_data.size() * sizeof(uint32_t));
+	header.strings_size = string_data.size();
+	header.reference_data_offset = header.strings_offset + string_data.size();
+	header.reference_data_size = reference_bytes.size();
+	header.total_size = header.reference_data_offset + reference_bytes.size();
+
+	std::vector<uint8_t> buffer(header.total_size, 0);
+	memcpy(buffer.data(), &header, sizeof(Header));
+	memcpy(buffer.data() + header.files_offset, file_records.data(), file_records.size() * sizeof(FileRecord));
+	memcpy(buffer.data() + header.symbols_offset, symbol_records.data(), symbol_records.size() * sizeof(SymbolRecord));
+	memcpy(buffer.data() + header.names_offset, name_records.data(), name_records.size() * sizeof(NameRecord));
+	memcpy(buffer.data() + header.postings_offset, posting_data.data(), posting_data.size() * sizeof(uint32_t));
+	memcpy(buffer.data() + header.references_offset, reference_records.data(), reference_records.size() * sizeof(ReferenceRecord));
+	memcpy(buffer.data() + header.buckets_offset, bucket_data.data(), bucket_data.size() * sizeof(uint32_t));
+	memcpy(buffer.data() + header.strings_offset, string_data.data(), string_data.size());
+	memcpy(buffer.data() + header.reference_data_offset, reference_bytes.data(), reference_bytes.size());
+
+	std::string temp_path = path + ".tmp";
+#ifdef _WIN32
+	FILE *out = _wfopen(to_wide(temp_path).c_str(), L"wb");
+#else
+	FILE *out = fopen(temp_path.c_str(), "wb");
+#endif
+	if (!out) {
+		r_error = "Cannot write " + temp_path;
+		return false;
+	}
+	bool written = fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+	written = fclose(out) == 0 && written;
+	if (!written) {
+		std::remove(temp_path.c_str());
+		r_error = "Cannot write " + temp_path;
+		return false;
+	}
+
+#ifdef _WIN32
+	bool renamed = MoveFileExW(to_wide(temp_path).c_str(), to_wide(path).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	bool renamed = std::rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+	if (!renamed) {
+		std::remove(temp_path.c_str());
+		r_error = "Cannot replace " + path;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,245 @@
+#ifndef SYMBOL_INDEX_FILE_H
+#define SYMBOL_INDEX_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// On-disk form of the project symbol index, used in place by mapping it
+// into memory.
+//
+// Layout (little endian, every table 8-byte aligned):
+//   Header
+//   FileRecord[file_count]      sorted by path
+//   SymbolRecord[symbol_count]  grouped by file, in document order
+//   NameRecord[name_count]      sorted by text, for prefix searches
+//   uint32_t[]                  symbol indices, grouped by name
+//   ReferenceRecord[]           identifier occurrences, grouped by name
+//   uint32_t[bucket_count]      open-addressing table of name index + 1
+//   char[]                      paths and names
+//   uint8_t[]                   occurrence streams (see ReferenceIndex)
+// Records refer to each other by index and to strings by offset, so
+// nothing has to be rebuilt after mapping. The view is copy-on-write:
+// refreshing a file's mtime patches the record in memory only.
+//
+// open() only checks the header and that every table lies in the file, so
+// it touches one page however large the index is. Records are
+// bounds-checked the first time they are read; a corrupt one is emptied
+// in the private mapping (files are also hidden), so lookups can trust
+// every index they are handed.
+class SymbolIndexFile {
+public:
+	static constexpr uint32_t FORMAT_VERSION = 4;
+	static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint32_t file_count;
+		uint32_t symbol_count;
+		uint32_t name_count;
+		uint32_t posting_count;
+		uint32_t bucket_count;
+		uint32_t reference_count;
+		uint64_t files_offset;
+		uint64_t symbols_offset;
+		uint64_t names_offset;
+		uint64_t postings_offset;
+		uint64_t references_offset;
+		uint64_t buckets_offset;
+		uint64_t strings_offset;
+		uint64_t strings_size;
+		uint64_t reference_data_offset;
+		uint64_t reference_data_size;
+		uint64_t total_size;
+	};
+
+	struct FileRecord {
+		uint64_t content_hash;
+		int64_t mtime;
+		uint32_t path_offset;
+		uint32_t path_length;
+		uint32_t first_symbol;
+		uint32_t symbol_count;
+		// Base from the extends statement; empty if none.
+		uint32_t extends_offset;
+		uint32_t extends_length;
+		// Paths of the constant preload() and load() calls, one per line.
+		uint32_t preloads_offset;
+		uint32_t preloads_length;
+		uint32_t loads_offset;
+		uint32_t loads_length;
+	};
+
+	struct SymbolRecord {
+		uint32_t file;
+		uint32_t name;
+		// Name index of the enclosing class, NONE at the top level.
+		uint32_t container;
+		uint32_t kind;
+		uint32_t start_byte;
+		uint32_t end_byte;
+		uint32_t start_row;
+		uint32_t end_row;
+		uint32_t name_start_byte;
+		uint32_t name_end_byte;
+	};
+
+	struct NameRecord {
+		uint64_t hash;
+		uint32_t text_offset;
+		uint32_t text_length;
+		uint32_t first_posting;
+		uint32_t posting_count;
+		uint32_t first_reference;
+		uint32_t reference_count;
+	};
+
+	// Occurrences of a name in one file.
+	struct ReferenceRecord {
+		uint64_t data_offset;
+		uint32_t file;
+		uint32_t data_size;
+	};
+
+	// Input of write().
+	struct SymbolData {
+		std::string name;
+		std::string container;
+		uint32_t kind = 0;
+		uint32_t start_byte = 0;
+		uint32_t end_byte = 0;
+		uint32_t start_row = 0;
+		uint32_t end_row = 0;
+		uint32_t name_start_byte = 0;
+		uint32_t name_end_byte = 0;
+	};
+
+	struct ReferenceData {
+		std::string name;
+		std::vector<uint8_t> occurrences;
+	};
+
+	struct FileData {
+		std::string path;
+		uint64_t content_hash = 0;
+		int64_t mtime = 0;
+		std::string extends;
+		std::vector<std::string> preloads;
+		std::vector<std::string> loads;
+		std::vector<SymbolData> symbols;
+		std::vector<ReferenceData> references;
+	};
+
+private:
+	uint8_t *base = nullptr;
+	size_t size = 0;
+	const Header *header = nullptr;
+	FileRecord *files = nullptr;
+	SymbolRecord *symbols = nullptr;
+	NameRecord *names = nullptr;
+	const uint32_t *postings = nullptr;
+	const ReferenceRecord *references = nullptr;
+	const uint32_t *buckets = nullptr;
+	const char *strings = nullptr;
+	const uint8_t *reference_data = nullptr;
+	// Files superseded by newer in-memory data, removed from the project or
+	// corrupt.
+	mutable std::vector<uint8_t> hidden;
+	// Records already bounds-checked.
+	mutable std::vector<uint8_t> checked_files;
+	mutable std::vector<uint8_t> checked_symbols;
+	mutable std::vector<uint8_t> checked_names;
+
+	std::string_view get_string(uint32_t offset, uint32_t length) const { return std::string_view(strings + offset, length); }
+	bool validate(std::string &r_error) const;
+	void validate_file(uint32_t file) const;
+	void validate_symbol(uint32_t symbol) const;
+	void validate_name(uint32_t name) const;
+	void check_file(uint32_t file) const {
+		if (!checked_files[file]) {
+			validate_file(file);
+		}
+	}
+	void check_symbol(uint32_t symbol) const {
+		if (!checked_symbols[symbol]) {
+			validate_symbol(symbol);
+		}
+	}
+	void check_name(uint32_t name) const {
+		if (!checked_names[name]) {
+			validate_name(name);
+		}
+	}
+
+public:
+	~SymbolIndexFile();
+
+	bool open(const std::string &path, std::string &r_error);
+	void close();
+	bool is_open() const { return base != nullptr; }
+	// Mapped, and resident only as far as pages were read.
+	uint64_t get_mapped_bytes() const { return size; }
+
+	uint32_t get_file_count() const { return header ? header->file_count : 0; }
+	uint32_t get_symbol_count() const { return header ? header->symbol_count : 0; }
+	uint32_t get_name_count() const { return header ? header->name_count : 0; }
+	uint32_t get_reference_count() const { return header ? header->reference_count : 0; }
+
+	FileRecord &get_file(uint32_t file) {
+		check_file(file);
+		return files[file];
+	}
+	const FileRecord &get_file(uint32_t file) const {
+		check_file(file);
+		return files[file];
+	}
+	std::string_view get_file_path(uint32_t file) const {
+		const FileRecord &record = get_file(file);
+		return get_string(record.path_offset, record.path_length);
+	}
+	std::string_view get_file_extends(uint32_t file) const {
+		const FileRecord &record = get_file(file);
+		return get_string(record.extends_offset, record.extends_length);
+	}
+	std::string_view get_file_preloads(uint32_t file) const {
+		const FileRecord &record = get_file(file);
+		return get_string(record.preloads_offset, record.preloads_length);
+	}
+	std::string_view get_file_loads(uint32_t file) const {
+		const FileRecord &record = get_file(file);
+		return get_string(record.loads_offset, record.loads_length);
+	}
+	// A corrupt symbol belongs to no file (NONE), which is_hidden() skips.
+	const SymbolRecord &get_symbol(uint32_t symbol) const {
+		check_symbol(symbol);
+		return symbols[symbol];
+	}
+	std::string_view get_name(uint32_t name) const {
+		check_name(name);
+		return get_string(names[name].text_offset, names[name].text_length);
+	}
+	// Symbols declaring the name, as indices for get_symbol().
+	const uint32_t *get_postings(uint32_t name, uint32_t &r_count) const;
+	// Files using the name, with their occurrence streams.
+	const ReferenceRecord *get_references(uint32_t name, uint32_t &r_count) const;
+	const uint8_t *get_reference_data(const ReferenceRecord &reference) const { return reference_data + reference.data_offset; }
+
+	// Also true for corrupt files and for NONE.
+	bool is_hidden(uint32_t file) const;
+	void hide(uint32_t file) { hidden[file] = 1; }
+
+	// NONE when absent.
+	uint32_t find_file(std::string_view path) const;
+	uint32_t find_name(std::string_view name) const;
+	// First name not less than text; get_name_count() if none.
+	uint32_t lower_bound_name(std::string_view text) const;
+
+	// Writes files (sorted by path in place) to path through a temporary
+	// file, so a reader never sees a partial index.
+	static bool write(const std::string &path, std::vector<FileData> &files, std::string &r_error);
+};
+
+#endif // SYMBOL_INDEX_FILE_H
@@ -0,0 +1,114 @@
+#include "tree_cache.h"
+
+#include <cstring>
+
+TreeCache::~TreeCache() {
+	clear();
+}
+
+TreeCache &TreeCache::get_singleton() {
+	static TreeCache singleton;
+	return singleton;
+}
+
+void TreeCache::evict_to(uint64_t bytes) {
+	while (stats.source_bytes > bytes && !lru.empty()) {
+		auto found = entries.find(lru.back());
+		stats.source_bytes -= found->second.bytes.size();
+		ts_tree_delete(found->second.tree);
+		entries.erase(found);
+		lru.pop_back();
+		stats.evictions++;
+	}
+	stats.entry_count = entries.size();
+}
+
+TSTree *TreeCache::acquire(uint64_t hash, const uint8_t *data, uint32_t length, PackedByteArray *r_bytes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!enabled) {
+		return nullptr;
+	}
+	auto found = entries.find(hash);
+	if (found == entries.end() || (uint32_t)found->second.bytes.size() != length || memcmp(found->second.bytes.ptr(), data, length) != 0) {
+		stats.misses++;
+		return nullptr;
+	}
+	stats.hits++;
+	lru.splice(lru.begin(), lru, found->second.lru);
+	if (r_bytes) {
+		*r_bytes = found->second.bytes;
+	}
+	return ts_tree_copy(found->second.tree);
+}
+
+void TreeCache::store(uint64_t hash, const PackedByteArray &bytes, const TSTree *tree) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!enabled || !tree || (uint64_t)bytes.size() > max_bytes) {
+		return;
+	}
+	auto found = entries.find(hash);
+	if (found != entries.end()) {
+		stats.source_bytes -= found->second.bytes.size();
+		ts_tree_delete(found->second.tree);
+		lru.erase(found->second.lru);
+		entries.erase(found);
+	}
+	evict_to(max_bytes - bytes.size());
+
+	lru.push_front(hash);
+	Entry &entry = entries[hash];
+	entry.bytes = bytes;
+	entry.tree = ts_tree_copy(tree);
+	entry.lru = lru.begin();
+	stats.source_bytes += bytes.size();
+	stats.entry_count = entries.size();
+	stats.stores++;
+}
+
+void TreeCache::set_enabled(bool p_enabled) {
+	std::lock_guard<std::mutex> lock(mutex);
+	enabled = p_enabled;
+	if (!enabled) {
+		evict_to(0);
+	}
+}
+
+bool TreeCache::is_enabled() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return enabled;
+}
+
+void TreeCache::set_max_bytes(uint64_t p_max_bytes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	max_bytes = p_max_bytes;
+	evict_to(max_bytes);
+}
+
+uint64_t TreeCache::get_max_bytes() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return max_bytes;
+}
+
+void TreeCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto &entry : entries) {
+		ts_tree_delete(entry.second.tree);
+	}
+	entries.clear();
+	lru.clear();
+	stats.entry_count = 0;
+	stats.source_bytes = 0;
+}
+
+TreeCache::Stats TreeCache::get_stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void TreeCache::reset_stats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.hits = 0;
+	stats.misses = 0;
+	stats.stores = 0;
+	stats.evictions = 0;
+}
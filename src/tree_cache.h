@@ -0,0 +1,76 @@
+#ifndef TREE_CACHE_H
+#define TREE_CACHE_H
+
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <tree_sitter/api.h>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+using namespace godot;
+
+// Parse trees by content, shared by every ASTManager in the process.
+//
+// Entries are keyed by content_hash::hash_bytes of the source and hold the
+// source (a copy-on-write buffer, so every file opened from an entry shares
+// it) and a tree. Lookups hand out ts_tree_copy() handles, which are cheap
+// reference-counted views of the same nodes, so two managers opening the
+// same script parse it once. Least recently used entries go once the
+// cached sources exceed the byte limit; their trees usually take several
+// times that.
+class TreeCache {
+public:
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t stores = 0;
+		uint64_t evictions = 0;
+		uint32_t entry_count = 0;
+		uint64_t source_bytes = 0;
+	};
+
+private:
+	struct Entry {
+		PackedByteArray bytes;
+		TSTree *tree = nullptr;
+		std::list<uint64_t>::iterator lru;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, Entry> entries;
+	// Hashes, most recently used first.
+	std::list<uint64_t> lru;
+	uint64_t max_bytes = 32 * 1024 * 1024;
+	bool enabled = true;
+	Stats stats;
+
+	TreeCache() = default;
+	void evict_to(uint64_t bytes);
+
+public:
+	~TreeCache();
+	static TreeCache &get_singleton();
+
+	// A copy of the tree of data (the caller deletes it) and the shared
+	// buffer holding data in r_bytes; nullptr on a miss. Contents are
+	// compared, so a hash collision is just a miss.
+	TSTree *acquire(uint64_t hash, const uint8_t *data, uint32_t length, PackedByteArray *r_bytes);
+	// Caches a copy of tree, parsed from bytes, replacing any entry with
+	// the same hash.
+	void store(uint64_t hash, const PackedByteArray &bytes, const TSTree *tree);
+
+	void set_enabled(bool p_enabled);
+	bool is_enabled() const;
+	// Evicts right away if the cache is over the new limit.
+	void set_max_bytes(uint64_t p_max_bytes);
+	uint64_t get_max_bytes() const;
+	void clear();
+
+	Stats get_stats() const;
+	// Zeroes the counters; entry_count and source_bytes stay.
+	void reset_stats();
+};
+
+#endif // TREE_CACHE_H
@@ -0,0 +1,367 @@
+#include "tree_diff.h"
+
+#include "content_hash.h"
+#include "perf_stats.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+static uint64_t mix_hash(uint64_t hash, uint64_t value) {
+	return content_hash::merge_round64(hash, value);
+}
+
+void TreeDiff::flatten(TSTreeCursor *cursor, uint32_t parent, const char *data, std::vector<Node> &r_nodes) {
+	uint32_t index = r_nodes.size();
+	r_nodes.emplace_back();
+	TSNode node = ts_tree_cursor_current_node(cursor);
+	TSSymbol symbol = ts_node_symbol(node);
+
+	uint64_t structure = mix_hash(content_hash::PRIME64_5, symbol);
+	uint64_t label = 0;
+	uint32_t height = 1;
+	uint32_t named_children = 0;
+	if (ts_tree_cursor_goto_first_child(cursor)) {
+		do {
+			TSNode child = ts_tree_cursor_current_node(cursor);
+			if (!ts_node_is_named(child)) {
+				label = mix_hash(label, (uint64_t)ts_node_symbol(child) + 1);
+				continue;
+			}
+			uint32_t child_index = r_nodes.size();
+			flatten(cursor, index, data, r_nodes);
+			r_nodes[child_index].child_index = named_children++;
+			height = std::max(height, r_nodes[child_index].height + 1);
+			structure = mix_hash(structure, r_nodes[child_index].tree_hash);
+		} while (ts_tree_cursor_goto_next_sibling(cursor));
+		ts_tree_cursor_goto_parent(cursor);
+	}
+	if (named_children == 0) {
+		uint32_t start = ts_node_start_byte(node);
+		label = content_hash::hash_bytes(data + start, ts_node_end_byte(node) - start, label);
+	}
+
+	Node &entry = r_nodes[index];
+	entry.node = node;
+	entry.parent = parent;
+	entry.size = r_nodes.size() - index;
+	entry.height = height;
+	entry.symbol = symbol;
+	entry.label_hash = label;
+	entry.tree_hash = mix_hash(structure, label);
+}
+
+void TreeDiff::match_nodes(uint32_t a, uint32_t b) {
+	old_nodes[a].match = b;
+	new_nodes[b].match = a;
+	match_count++;
+}
+
+void TreeDiff::match_subtrees(uint32_t a, uint32_t b) {
+	for (uint32_t k = 0; k < old_nodes[a].size; k++) {
+		match_nodes(a + k, b + k);
+	}
+}
+
+void TreeDiff::match_top_down() {
+	std::unordered_map<uint64_t, std::vector<uint32_t>> old_buckets;
+	std::unordered_map<uint64_t, std::vector<uint32_t>> new_buckets;
+	for (uint32_t b = 0; b < new_nodes.size(); b++) {
+		if (new_nodes[b].height >= options.min_height) {
+			new_buckets[new_nodes[b].tree_hash].push_back(b);
+		}
+	}
+
+	// Distinct hashes shared by both trees, highest subtrees first.
+	std::vector<uint32_t> group_heads;
+	for (uint32_t a = 0; a < old_nodes.size(); a++) {
+		const Node &node = old_nodes[a];
+		if (node.height < options.min_height || new_buckets.find(node.tree_hash) == new_buckets.end()) {
+			continue;
+		}
+		std::vector<uint32_t> &bucket = old_buckets[node.tree_hash];
+		if (bucket.empty()) {
+			group_heads.push_back(a);
+		}
+		bucket.push_back(a);
+	}
+	std::stable_sort(group_heads.begin(), group_heads.end(), [this](uint32_t x, uint32_t y) {
+		return old_nodes[x].height > old_nodes[y].height;
+	});
+
+	std::vector<uint32_t> olds;
+	std::vector<uint32_t> news;
+	for (uint32_t head : group_heads) {
+		uint64_t hash = old_nodes[head].tree_hash;
+		olds.clear();
+		news.clear();
+		for (uint32_t a : old_buckets[hash]) {
+			if (old_nodes[a].match == NONE) {
+				olds.push_back(a);
+			}
+		}
+		for (uint32_t b : new_buckets[hash]) {
+			if (new_nodes[b].match == NONE) {
+				news.push_back(b);
+			}
+		}
+		if (olds.empty() || news.empty()) {
+			continue;
+		}
+
+		// Both lists are in document order. Equal counts pair up in order;
+		// otherwise each old subtree takes the nearest remaining candidate
+		// without crossing earlier pairs.
+		uint32_t j = 0;
+		for (uint32_t a : olds) {
+			if (j >= news.size()) {
+				break;
+			}
+			if (olds.size() != news.size()) {
+				uint32_t start = ts_node_start_byte(old_nodes[a].node);
+				auto distance = [&](uint32_t b) {
+					uint32_t other = ts_node_start_byte(new_nodes[b].node);
+					return other > start ? other - start : start - other;
+				};
+				while (j + 1 < news.size() && distance(news[j + 1]) <= distance(news[j])) {
+					j++;
+				}
+			}
+			uint32_t b = news[j++];
+			if (old_nodes[a].size == new_nodes[b].size && old_nodes[a].symbol == new_nodes[b].symbol) {
+				match_subtrees(a, b);
+			}
+		}
+	}
+}
+
+uint32_t TreeDiff::count_common_descendants(uint32_t a, uint32_t b) const {
+	uint32_t b_end = b + new_nodes[b].size;
+	uint32_t common = 0;
+	for (uint32_t d = a + 1; d < a + old_nodes[a].size; d++) {
+		uint32_t partner = old_nodes[d].match;
+		if (partner != NONE && partner > b && partner < b_end) {
+			common++;
+		}
+	}
+	return common;
+}
+
+void TreeDiff::match_bottom_up() {
+	std::vector<uint32_t> candidates;
+	// Descending pre-order index visits children before their parents.
+	for (uint32_t a = old_nodes.size(); a-- > 0;) {
+		const Node &node = old_nodes[a];
+		if (node.match != NONE || node.size == 1) {
+			continue;
+		}
+
+		candidates.clear();
+		for (uint32_t c = a + 1; c < a + node.size; c += old_nodes[c].size) {
+			if (old_nodes[c].match == NONE) {
+				continue;
+			}
+			for (uint32_t p = new_nodes[old_nodes[c].match].parent; p != NONE && new_nodes[p].match == NONE; p = new_nodes[p].parent) {
+				if (new_nodes[p].symbol == node.symbol && std::find(candidates.begin(), candidates.end(), p) == candidates.end()) {
+					candidates.push_back(p);
+				}
+			}
+		}
+		bool is_root = node.parent == NONE;
+		if (is_root && !new_nodes.empty() && new_nodes[0].match == NONE && new_nodes[0].symbol == node.symbol &&
+				std::find(candidates.begin(), candidates.end(), 0u) == candidates.end()) {
+			candidates.push_back(0);
+		}
+
+		uint32_t best = NONE;
+		float best_dice = -1.0f;
+		for (uint32_t b : candidates) {
+			uint32_t descendants = (node.size - 1) + (new_nodes[b].size - 1);
+			float dice = descendants ? 2.0f * count_common_descendants(a, b) / descendants : 0.0f;
+			if (dice > best_dice) {
+				best_dice = dice;
+				best = b;
+			}
+		}
+		if (best != NONE && (best_dice >= options.min_dice || (is_root && best == 0))) {
+			match_nodes(a, best);
+			recover(a, best);
+		}
+	}
+}
+
+void TreeDiff::recover(uint32_t a, uint32_t b) {
+	if (old_nodes[a].size > options.max_recovery_size || new_nodes[b].size > options.max_recovery_size) {
+		return;
+	}
+
+	std::vector<uint32_t> olds;
+	std::vector<uint32_t> news;
+	for (uint32_t c = a + 1; c < a + old_nodes[a].size; c += old_nodes[c].size) {
+		if (old_nodes[c].match == NONE) {
+			olds.push_back(c);
+		}
+	}
+	for (uint32_t c = b + 1; c < b + new_nodes[b].size; c += new_nodes[c].size) {
+		if (new_nodes[c].match == NONE) {
+			news.push_back(c);
+		}
+	}
+
+	// Pairs remaining children in order, first as identical subtrees, then by
+	// type and label; a type that is left exactly once on both sides pairs
+	// up last.
+	for (int pass = 0; pass < 2; pass++) {
+		uint32_t j = 0;
+		for (uint32_t x : olds) {
+			if (old_nodes[x].match != NONE) {
+				continue;
+			}
+			for (uint32_t k = j; k < news.size(); k++) {
+				uint32_t y = news[k];
+				if (new_nodes[y].match != NONE || new_nodes[y].symbol != old_nodes[x].symbol) {
+					continue;
+				}
+				if (pass == 0 && new_nodes[y].tree_hash == old_nodes[x].tree_hash && new_nodes[y].size == old_nodes[x].size) {
+					match_subtrees(x, y);
+				} else if (pass == 1 && new_nodes[y].label_hash == old_nodes[x].label_hash) {
+					match_nodes(x, y);
+					recover(x, y);
+				} else {
+					continue;
+				}
+				j = k + 1;
+				break;
+			}
+		}
+	}
+
+	for (uint32_t x : olds) {
+		if (old_nodes[x].match != NONE) {
+			continue;
+		}
+		uint32_t only = NONE;
+		uint32_t old_same = 0;
+		uint32_t new_same = 0;
+		for (uint32_t other : olds) {
+			old_same += old_nodes[other].match == NONE && old_nodes[other].symbol == old_nodes[x].symbol;
+		}
+		for (uint32_t y : news) {
+			if (new_nodes[y].match == NONE && new_nodes[y].symbol == old_nodes[x].symbol) {
+				new_same++;
+				only = y;
+			}
+		}
+		if (old_same == 1 && new_same == 1) {
+			match_nodes(x, only);
+			recover(x, only);
+		}
+	}
+}
+
+void TreeDiff::build_operations() {
+	for (uint32_t a = 0; a < old_nodes.size(); a++) {
+		const Node &node = old_nodes[a];
+		if (node.match == NONE) {
+			if (node.parent == NONE || old_nodes[node.parent].match != NONE) {
+				operations.push_back({ OP_DELETE, a, NONE });
+			}
+			continue;
+		}
+		const Node &partner = new_nodes[node.match];
+		// A leaf that gained children (or lost them) changes its label kind;
+		// that shows up as the inserted or deleted children instead.
+		if (partner.label_hash != node.label_hash && (partner.size == 1) == (node.size == 1)) {
+			operations.push_back({ OP_UPDATE, a, node.match });
+		}
+		if (node.parent != NONE && partner.parent != NONE && old_nodes[node.parent].match != partner.parent) {
+			operations.push_back({ OP_MOVE, a, node.match });
+		}
+	}
+
+	for (uint32_t b = 0; b < new_nodes.size(); b++) {
+		const Node &node = new_nodes[b];
+		if (node.match == NONE && (node.parent == NONE || new_nodes[node.parent].match != NONE)) {
+			operations.push_back({ OP_INSERT, NONE, b });
+		}
+	}
+
+	// Children that stayed under the same parent but left the longest
+	// in-order run of their siblings were reordered.
+	std::vector<uint32_t> moved_children;
+	std::vector<uint32_t> sequence;
+	std::vector<uint32_t> pile_tops;
+	std::vector<uint32_t> previous;
+	for (uint32_t pb = 0; pb < new_nodes.size(); pb++) {
+		uint32_t pa = new_nodes[pb].match;
+		if (pa == NONE || new_nodes[pb].size == 1) {
+			continue;
+		}
+		sequence.clear();
+		for (uint32_t c = pb + 1; c < pb + new_nodes[pb].size; c += new_nodes[c].size) {
+			uint32_t partner = new_nodes[c].match;
+			if (partner != NONE && old_nodes[partner].parent == pa) {
+				sequence.push_back(c);
+			}
+		}
+		if (sequence.size() < 2) {
+			continue;
+		}
+
+		pile_tops.clear();
+		previous.assign(sequence.size(), NONE);
+		for (uint32_t s = 0; s < sequence.size(); s++) {
+			uint32_t key = old_nodes[new_nodes[sequence[s]].match].child_index;
+			uint32_t low = 0;
+			uint32_t high = pile_tops.size();
+			while (low < high) {
+				uint32_t mid = (low + high) / 2;
+				if (old_nodes[new_nodes[sequence[pile_tops[mid]]].match].child_index < key) {
+					low = mid + 1;
+				} else {
+					high = mid;
+				}
+			}
+			if (low > 0) {
+				previous[s] = pile_tops[low - 1];
+			}
+			if (low == pile_tops.size()) {
+				pile_tops.push_back(s);
+			} else {
+				pile_tops[low] = s;
+			}
+		}
+		if (pile_tops.size() == sequence.size()) {
+			continue;
+		}
+
+		std::vector<bool> in_order(sequence.size(), false);
+		for (uint32_t s = pile_tops.back(); s != NONE; s = previous[s]) {
+			in_order[s] = true;
+		}
+		for (uint32_t s = 0; s < sequence.size(); s++) {
+			if (!in_order[s]) {
+				operations.push_back({ OP_MOVE, new_nodes[sequence[s]].match, sequence[s] });
+			}
+		}
+	}
+}
+
+void TreeDiff::compute(TSTree *old_tree, const char *old_data, TSTree *new_tree, const char *new_data, const Options &p_options) {
+	perf_stats::Scope scope(perf_stats::PHASE_DIFF);
+	options = p_options;
+	old_nodes.clear();
+	new_nodes.clear();
+	operations.clear();
+	match_count = 0;
+
+	TSTreeCursor cursor = ts_tree_cursor_new(ts_tree_root_node(old_tree));
+	flatten(&cursor, NONE, old_data, old_nodes);
+	ts_tree_cursor_reset(&cursor, ts_tree_root_node(new_tree));
+	flatten(&cursor, NONE, new_data, new_nodes);
+	ts_tree_cursor_delete(&cursor);
+	scope.add_amount(old_nodes.size() + new_nodes.size());
+
+	match_top_down();
+	match_bottom_up();
+	build_operations();
+}
@@ -0,0 +1,81 @@
+#ifndef TREE_DIFF_H
+#define TREE_DIFF_H
+
+#include <tree_sitter/api.h>
+
+#include <cstdint>
+#include <vector>
+
+// Structural diff between two syntax trees, after GumTree (Falleri et al.):
+//   1. top-down: identical subtrees (equal structural hash) of decreasing
+//      height are matched,
+//   2. bottom-up: an unmatched node is matched to the candidate of the same
+//      type sharing most matched descendants (dice coefficient), and their
+//      remaining children are recovered by hash, label and type,
+//   3. the matching is turned into insert/delete/update/move operations.
+// Only named nodes take part; anonymous tokens (operators, keywords) are
+// folded into their parent's label.
+class TreeDiff {
+public:
+	static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+	enum OpType {
+		OP_INSERT,
+		OP_DELETE,
+		OP_UPDATE,
+		OP_MOVE,
+	};
+
+	struct Node {
+		TSNode node;
+		uint32_t parent = NONE;
+		// Nodes are stored in pre-order, so a subtree is [index, index + size).
+		uint32_t size = 1;
+		uint32_t height = 1;
+		uint32_t child_index = 0;
+		TSSymbol symbol = 0;
+		uint64_t label_hash = 0;
+		uint64_t tree_hash = 0;
+		uint32_t match = NONE;
+	};
+
+	// old_node / new_node is NONE for inserts / deletes.
+	struct Operation {
+		OpType type;
+		uint32_t old_node;
+		uint32_t new_node;
+	};
+
+	struct Options {
+		uint32_t min_height = 2;
+		float min_dice = 0.5f;
+		// Subtrees larger than this are not searched during recovery.
+		uint32_t max_recovery_size = 1000;
+	};
+
+private:
+	std::vector<Node> old_nodes;
+	std::vector<Node> new_nodes;
+	std::vector<Operation> operations;
+	uint32_t match_count = 0;
+	Options options;
+
+	static void flatten(TSTreeCursor *cursor, uint32_t parent, const char *data, std::vector<Node> &r_nodes);
+	void match_nodes(uint32_t a, uint32_t b);
+	void match_subtrees(uint32_t a, uint32_t b);
+	void match_top_down();
+	void match_bottom_up();
+	void recover(uint32_t a, uint32_t b);
+	uint32_t count_common_descendants(uint32_t a, uint32_t b) const;
+	void build_operations();
+
+public:
+	void compute(TSTree *old_tree, const char *old_data, TSTree *new_tree, const char *new_data, const Options &p_options);
+
+	const std::vector<Node> &get_old_nodes() const { return old_nodes; }
+	const std::vector<Node> &get_new_nodes() const { return new_nodes; }
+	const std::vector<Operation> &get_operations() const { return operations; }
+	uint32_t get_match_count() const { return match_count; }
+};
+
+#endif // TREE_DIFF_H
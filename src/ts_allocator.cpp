@@ -0,0 +1,333 @@
+#include "ts_allocator.h"
+
+#include <tree_sitter/api.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace ts_allocator {
+
+// Keeps the block aligned the way malloc would.
+struct alignas(std::max_align_t) Header {
+	size_t size;
+	// Pool size class the block belongs to; 0 for malloc.
+	uint32_t size_class;
+};
+
+static std::atomic<bool> installed{ false };
+static std::atomic<int> current_backend{ BACKEND_SYSTEM };
+static std::atomic<int64_t> live_bytes{ 0 };
+static std::atomic<int64_t> peak_bytes{ 0 };
+static std::atomic<int64_t> live_blocks{ 0 };
+static std::atomic<uint64_t> allocations{ 0 };
+static std::atomic<int64_t> pool_reserved_bytes{ 0 };
+static std::atomic<int64_t> pool_free_bytes{ 0 };
+static thread_local int64_t thread_bytes = 0;
+
+static void count(int64_t bytes, int64_t blocks) {
+	int64_t now = live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	live_blocks.fetch_add(blocks, std::memory_order_relaxed);
+	thread_bytes += bytes;
+	int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+	while (now > peak && !peak_bytes.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+	}
+}
+
+// Size classes: multiples of 16 bytes up to 256, then of 64 up to 512,
+// which covers subtrees, stack nodes and most child arrays. Bigger
+// requests go to malloc.
+static const size_t POOL_MAX_SIZE = 512;
+static const uint32_t CLASS_COUNT = 20;
+static const size_t CHUNK_BYTES = 64 * 1024;
+// Blocks moved between a thread and the depot at once.
+static const size_t BATCH_BYTES = 16 * 1024;
+
+static size_t class_size(uint32_t size_class) {
+	return size_class <= 16 ? size_class * 16 : 256 + (size_class - 16) * 64;
+}
+
+static uint32_t class_of(size_t size) {
+	if (size <= 256) {
+		return size == 0 ? 1 : (size + 15) / 16;
+	}
+	return 16 + (size - 256 + 63) / 64;
+}
+
+static size_t block_stride(uint32_t size_class) {
+	return sizeof(Header) + class_size(size_class);
+}
+
+static uint32_t batch_size(uint32_t size_class) {
+	return std::max<uint32_t>(8, BATCH_BYTES / block_stride(size_class));
+}
+
+// A free block's payload links it to the next one.
+struct FreeBlock {
+	FreeBlock *next;
+};
+
+struct FreeList {
+	FreeBlock *head = nullptr;
+	uint32_t count = 0;
+
+	void push(FreeBlock *block) {
+		block->next = head;
+		head = block;
+		count++;
+	}
+
+	// Takes up to n blocks off the front.
+	FreeList split(uint32_t n) {
+		FreeList taken;
+		taken.head = head;
+		FreeBlock *last = head;
+		taken.count = 1;
+		while (taken.count < n && last->next) {
+			last = last->next;
+			taken.count++;
+		}
+		head = last->next;
+		last->next = nullptr;
+		count -= taken.count;
+		return taken;
+	}
+};
+
+struct Depot {
+	std::mutex mutex;
+	std::vector<FreeList> batches;
+};
+
+static Depot depots[CLASS_COUNT + 1];
+
+static void give_to_depot(uint32_t size_class, FreeList batch) {
+	std::lock_guard<std::mutex> lock(depots[size_class].mutex);
+	depots[size_class].batches.push_back(batch);
+}
+
+struct ThreadCache {
+	FreeList lists[CLASS_COUNT + 1];
+
+	~ThreadCache();
+};
+
+// Plain flag, valid after the cache itself is gone: a thread can still
+// free blocks from other thread-local destructors.
+static thread_local bool cache_destroyed = false;
+static thread_local ThreadCache cache;
+
+ThreadCache::~ThreadCache() {
+	// The thread is exiting: its blocks go to the depot for the others.
+	for (uint32_t size_class = 1; size_class <= CLASS_COUNT; size_class++) {
+		FreeList &list = lists[size_class];
+		while (list.count > 0) {
+			give_to_depot(size_class, list.split(batch_size(size_class)));
+		}
+	}
+	cache_destroyed = true;
+}
+
+static bool refill(uint32_t size_class, FreeList &r_list) {
+	{
+		Depot &depot = depots[size_class];
+		std::lock_guard<std::mutex> lock(depot.mutex);
+		if (!depot.batches.empty()) {
+			r_list = depot.batches.back();
+			depot.batches.pop_back();
+			return true;
+		}
+	}
+
+	char *chunk = static_cast<char *>(std::malloc(CHUNK_BYTES));
+	if (!chunk) {
+		return false;
+	}
+	size_t stride = block_stride(size_class);
+	size_t block_count = CHUNK_BYTES / stride;
+	// Pushed back to front so blocks are handed out in address order.
+	for (size_t i = block_count; i-- > 0;) {
+		r_list.push(reinterpret_cast<FreeBlock *>(chunk + i * stride + sizeof(Header)));
+	}
+	pool_reserved_bytes.fetch_add(CHUNK_BYTES, std::memory_order_relaxed);
+	pool_free_bytes.fetch_add(block_count * stride, std::memory_order_relaxed);
+	return true;
+}
+
+static Header *pool_alloc(size_t size) {
+	if (cache_destroyed) {
+		return nullptr;
+	}
+	uint32_t size_class = class_of(size);
+	FreeList &list = cache.lists[size_class];
+	if (!list.head && !refill(size_class, list)) {
+		return nullptr;
+	}
+	FreeBlock *block = list.head;
+	list.head = block->next;
+	list.count--;
+	pool_free_bytes.fetch_sub(block_stride(size_class), std::memory_order_relaxed);
+
+	Header *header = reinterpret_cast<Header *>(block) - 1;
+	header->size_class = size_class;
+	return header;
+}
+
+static void pool_free(Header *header) {
+	uint32_t size_class = header->size_class;
+	FreeBlock *block = reinterpret_cast<FreeBlock *>(header + 1);
+	pool_free_bytes.fetch_add(block_stride(size_class), std::memory_order_relaxed);
+	if (cache_destroyed) {
+		FreeList single;
+		single.push(block);
+		give_to_depot(size_class, single);
+		return;
+	}
+	// A thread that only frees (blocks parsed elsewhere) hands the surplus
+	// on instead of hoarding it.
+	FreeList &list = cache.lists[size_class];
+	list.push(block);
+	uint32_t batch = batch_size(size_class);
+	if (list.count >= 2 * batch) {
+		give_to_depot(size_class, list.split(batch));
+	}
+}
+
+static Header *system_alloc(size_t size, bool zeroed) {
+	Header *header = static_cast<Header *>(zeroed ? std::calloc(1, sizeof(Header) + size) : std::malloc(sizeof(Header) + size));
+	if (header) {
+		header->size_class = 0;
+	}
+	return header;
+}
+
+static Header *allocate(size_t size, bool zeroed) {
+	Header *header = nullptr;
+	if (size <= POOL_MAX_SIZE && current_backend.load(std::memory_order_relaxed) == BACKEND_POOL) {
+		header = pool_alloc(size);
+		if (header && zeroed) {
+			memset(header + 1, 0, size);
+		}
+	}
+	if (!header) {
+		header = system_alloc(size, zeroed);
+	}
+	if (!header) {
+		return nullptr;
+	}
+	header->size = size;
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	count(size, 1);
+	return header;
+}
+
+static void release(Header *header) {
+	count(-(int64_t)header->size, -1);
+	if (header->size_class != 0) {
+		pool_free(header);
+	} else {
+		std::free(header);
+	}
+}
+
+static void *counting_malloc(size_t size) {
+	Header *header = allocate(size, false);
+	return header ? header + 1 : nullptr;
+}
+
+static void *counting_calloc(size_t number, size_t size) {
+	if (size != 0 && number > (SIZE_MAX - sizeof(Header)) / size) {
+		return nullptr;
+	}
+	Header *header = allocate(number * size, true);
+	return header ? header + 1 : nullptr;
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+	if (!ptr) {
+		return counting_malloc(size);
+	}
+	Header *header = static_cast<Header *>(ptr) - 1;
+	size_t old_size = header->size;
+	if (header->size_class != 0 && size <= class_size(header->size_class)) {
+		// Still fits its block.
+		header->size = size;
+		count((int64_t)size - (int64_t)old_size, 0);
+		return ptr;
+	}
+	bool pooled = size <= POOL_MAX_SIZE && current_backend.load(std::memory_order_relaxed) == BACKEND_POOL;
+	if (header->size_class == 0 && !pooled) {
+		Header *moved = static_cast<Header *>(std::realloc(header, sizeof(Header) + size));
+		if (!moved) {
+			return nullptr;
+		}
+		moved->size = size;
+		count((int64_t)size - (int64_t)old_size, 0);
+		return moved + 1;
+	}
+
+	// Between a pool block and anything else: move the contents.
+	Header *moved = allocate(size, false);
+	if (!moved) {
+		return nullptr;
+	}
+	memcpy(moved + 1, ptr, std::min(old_size, size));
+	release(header);
+	return moved + 1;
+}
+
+static void counting_free(void *ptr) {
+	if (ptr) {
+		release(static_cast<Header *>(ptr) - 1);
+	}
+}
+
+void install() {
+	if (!installed.exchange(true)) {
+		ts_set_allocator(counting_malloc, counting_calloc, counting_realloc, counting_free);
+	}
+}
+
+bool is_installed() {
+	return installed.load();
+}
+
+void set_backend(Backend backend) {
+	current_backend.store(backend);
+}
+
+Backend get_backend() {
+	return (Backend)current_backend.load();
+}
+
+void free(void *ptr) {
+	if (installed.load(std::memory_order_relaxed)) {
+		counting_free(ptr);
+	} else {
+		std::free(ptr);
+	}
+}
+
+Stats get_stats() {
+	Stats stats;
+	stats.bytes = live_bytes.load(std::memory_order_relaxed);
+	stats.peak_bytes = peak_bytes.load(std::memory_order_relaxed);
+	stats.block_count = live_blocks.load(std::memory_order_relaxed);
+	stats.allocation_count = allocations.load(std::memory_order_relaxed);
+	stats.pool_reserved_bytes = pool_reserved_bytes.load(std::memory_order_relaxed);
+	stats.pool_free_bytes = pool_free_bytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void reset_peak() {
+	peak_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+int64_t get_thread_bytes() {
+	return thread_bytes;
+}
+
+} // namespace ts_allocator
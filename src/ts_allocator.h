@@ -0,0 +1,62 @@
+#ifndef TS_ALLOCATOR_H
+#define TS_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Counting allocator for tree-sitter, installed with ts_set_allocator()
+// when the extension loads, before any parser or tree exists.
+//
+// Each block carries its size in a header so frees can be counted. The
+// totals are relaxed atomics: exact once the threads touching them are
+// joined, close enough while they run. A thread-local running total lets
+// a caller measure what one call on its own thread kept allocated, e.g. a
+// compiled query.
+//
+// Blocks come from malloc or, with the pool backend, from size-class pools:
+// tree-sitter's subtrees, child arrays and stack nodes are small and die in
+// large batches, which fragments a general-purpose heap over hours of
+// indexing. Each thread keeps a free list per class, refilled from and
+// drained to a shared depot in batches, and new blocks are carved from
+// 64 KiB chunks that are kept for reuse. The header also records the
+// class, so switching backends at run time is safe: a block always goes
+// back where it came from.
+namespace ts_allocator {
+
+enum Backend {
+	BACKEND_SYSTEM,
+	BACKEND_POOL,
+};
+
+struct Stats {
+	// Live bytes requested by tree-sitter, headers excluded.
+	int64_t bytes = 0;
+	int64_t peak_bytes = 0;
+	int64_t block_count = 0;
+	uint64_t allocation_count = 0;
+	// Chunks the pools have taken from malloc, and how much of them is
+	// free in a thread's list or the depot.
+	int64_t pool_reserved_bytes = 0;
+	int64_t pool_free_bytes = 0;
+};
+
+void install();
+bool is_installed();
+
+// Applies to allocations from now on.
+void set_backend(Backend backend);
+Backend get_backend();
+
+// Frees memory tree-sitter handed out to be freed by the caller
+// (ts_node_string(), ts_tree_get_changed_ranges()).
+void free(void *ptr);
+
+Stats get_stats();
+// Restarts the peak from the current live bytes.
+void reset_peak();
+// Net bytes allocated minus freed by tree-sitter on the calling thread.
+int64_t get_thread_bytes();
+
+} // namespace ts_allocator
+
+#endif // TS_ALLOCATOR_H
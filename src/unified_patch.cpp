@@ -0,0 +1,408 @@
+#include "unified_patch.h"
+
+#include <algorithm>
+#include <cstring>
+
+static bool starts_with(const char *text, uint32_t length, const char *prefix) {
+	size_t prefix_length = strlen(prefix);
+	return length >= prefix_length && memcmp(text, prefix, prefix_length) == 0;
+}
+
+static uint32_t target_line_byte(const LineMerge::Side &target, uint32_t line) {
+	return line < target.line_count ? target.lines[line].start : target.length;
+}
+
+static bool parse_number(const char *&r_cursor, const char *end, uint32_t &r_value) {
+	if (r_cursor == end || *r_cursor < '0' || *r_cursor > '9') {
+		return false;
+	}
+	uint64_t value = 0;
+	while (r_cursor < end && *r_cursor >= '0' && *r_cursor <= '9') {
+		value = value * 10 + (*r_cursor - '0');
+		if (value > UINT32_MAX) {
+			return false;
+		}
+		r_cursor++;
+	}
+	r_value = (uint32_t)value;
+	return true;
+}
+
+// Parses "start[,count]"; a missing count means 1.
+static bool parse_range(const char *&r_cursor, const char *end, uint32_t &r_start, uint32_t &r_count) {
+	if (!parse_number(r_cursor, end, r_start)) {
+		return false;
+	}
+	r_count = 1;
+	if (r_cursor < end && *r_cursor == ',') {
+		r_cursor++;
+		return parse_number(r_cursor, end, r_count);
+	}
+	return true;
+}
+
+bool UnifiedPatch::parse_hunk_header(const char *line, uint32_t length, Hunk &r_hunk) {
+	const char *cursor = line + 2;
+	const char *end = line + length;
+	while (cursor < end && (*cursor == ' ' || *cursor == '\r')) {
+		cursor++;
+	}
+	if (cursor == end || *cursor == '@') {
+		r_hunk.has_position = false;
+		return true;
+	}
+	if (*cursor != '-') {
+		return false;
+	}
+	cursor++;
+	if (!parse_range(cursor, end, r_hunk.old_start, r_hunk.old_count)) {
+		return false;
+	}
+	while (cursor < end && *cursor == ' ') {
+		cursor++;
+	}
+	if (cursor == end || *cursor != '+') {
+		return false;
+	}
+	cursor++;
+	return parse_range(cursor, end, r_hunk.new_start, r_hunk.new_count);
+}
+
+// Path of a ---/+++ line, without the trailing timestamp.
+std::string UnifiedPatch::parse_path(const char *line, uint32_t length) {
+	const char *start = line + 4;
+	const char *end = line + length;
+	const char *tab = static_cast<const char *>(memchr(start, '\t', end - start));
+	if (tab) {
+		end = tab;
+	}
+	while (end > start && (end[-1] == '\r' || end[-1] == ' ')) {
+		end--;
+	}
+	return std::string(start, end - start);
+}
+
+bool UnifiedPatch::parse(const char *p_data, uint32_t length, std::string &r_error) {
+	data = p_data;
+	lines.clear();
+	hunks.clear();
+	sections.clear();
+
+	std::vector<LineDiff::Line> patch_lines;
+	LineDiff::split_lines(data, length, patch_lines);
+	uint32_t count = patch_lines.size();
+
+	auto is_file_header = [&](uint32_t i) {
+		return i + 1 < count && starts_with(data + patch_lines[i].start, patch_lines[i].length, "--- ") &&
+				starts_with(data + patch_lines[i + 1].start, patch_lines[i + 1].length, "+++ ");
+	};
+
+	uint32_t i = 0;
+	while (i < count) {
+		const char *text = data + patch_lines[i].start;
+		uint32_t text_length = patch_lines[i].length;
+
+		if (is_file_header(i)) {
+			FileSection section;
+			section.old_path = parse_path(text, text_length);
+			section.new_path = parse_path(data + patch_lines[i + 1].start, patch_lines[i + 1].length);
+			section.first_hunk = hunks.size();
+			sections.push_back(section);
+			i += 2;
+			continue;
+		}
+		if (!starts_with(text, text_length, "@@")) {
+			// git headers, mode lines, prose around the patch
+			i++;
+			continue;
+		}
+
+		Hunk hunk;
+		if (!parse_hunk_header(text, text_length, hunk)) {
+			r_error = "Malformed hunk header at line " + std::to_string(i + 1);
+			return false;
+		}
+		hunk.header_line = i;
+		hunk.first_line = lines.size();
+		if (sections.empty()) {
+			sections.push_back(FileSection());
+		}
+
+		uint32_t old_lines = 0;
+		uint32_t new_lines = 0;
+		for (i++; i < count; i++) {
+			const LineDiff::Line &patch_line = patch_lines[i];
+			// A "--- "/"+++ " pair inside a hunk is a deleted "-- " line
+			// followed by an inserted "++ " one; it only starts the next
+			// file once the declared counts are used up.
+			bool counts_used = !hunk.has_position || (old_lines >= hunk.old_count && new_lines >= hunk.new_count);
+			HunkLine line;
+			line.start = patch_line.start + 1;
+			line.length = patch_line.length ? patch_line.length - 1 : 0;
+			char marker = patch_line.length ? data[patch_line.start] : ' ';
+			if (patch_line.length == 0) {
+				// Blank context line whose leading space was stripped.
+				line.start = patch_line.start;
+			} else if (marker == '\\') {
+				if (lines.size() > hunk.first_line) {
+					lines.back().has_newline = false;
+				}
+				continue;
+			} else if (marker == ' ') {
+				line.type = LINE_CONTEXT;
+			} else if (marker == '-' && !(is_file_header(i) && counts_used)) {
+				line.type = LINE_DELETE;
+			} else if (marker == '+') {
+				line.type = LINE_INSERT;
+			} else {
+				break;
+			}
+			old_lines += line.type != LINE_INSERT;
+			new_lines += line.type != LINE_DELETE;
+			lines.push_back(line);
+		}
+
+		// Blank lines past the declared counts separate the patch from
+		// whatever follows it.
+		while (hunk.has_position && lines.size() > hunk.first_line && (old_lines > hunk.old_count || new_lines > hunk.new_count)) {
+			const HunkLine &last = lines.back();
+			if (last.type != LINE_CONTEXT || last.length != 0) {
+				break;
+			}
+			lines.pop_back();
+			old_lines--;
+			new_lines--;
+		}
+
+		hunk.line_count = lines.size() - hunk.first_line;
+		hunks.push_back(hunk);
+		sections.back().hunk_count++;
+	}
+
+	sections.erase(std::remove_if(sections.begin(), sections.end(), [](const FileSection &section) {
+		return section.hunk_count == 0;
+	}),
+			sections.end());
+	if (hunks.empty()) {
+		r_error = "No hunks found in patch";
+		return false;
+	}
+	return true;
+}
+
+int UnifiedPatch::find_section(const std::string &file_path) const {
+	if (sections.size() == 1) {
+		return 0;
+	}
+	for (size_t i = 0; i < sections.size(); i++) {
+		for (const std::string *path : { &sections[i].new_path, &sections[i].old_path }) {
+			std::string name = *path;
+			if (name.size() > 2 && (name.compare(0, 2, "a/") == 0 || name.compare(0, 2, "b/") == 0)) {
+				name = name.substr(2);
+			}
+			if (name.empty() || name == "/dev/null" || name.size() > file_path.size()) {
+				continue;
+			}
+			size_t offset = file_path.size() - name.size();
+			if (file_path.compare(offset, name.size(), name) != 0) {
+				continue;
+			}
+			if (offset == 0 || file_path[offset - 1] == '/' || file_path[offset - 1] == ':') {
+				return i;
+			}
+		}
+	}
+	return -1;
+}
+
+bool UnifiedPatch::lines_equal(const HunkLine &hunk_line, const LineMerge::Side &target, uint32_t target_line, bool ignore_whitespace) const {
+	const char *a = data + hunk_line.start;
+	const char *a_end = a + hunk_line.length;
+	const char *b = target.data + target.lines[target_line].start;
+	const char *b_end = b + target.lines[target_line].length;
+	if (!ignore_whitespace) {
+		return a_end - a == b_end - b && memcmp(a, b, a_end - a) == 0;
+	}
+
+	auto is_space = [](char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	};
+	while (true) {
+		while (a < a_end && is_space(*a)) {
+			a++;
+		}
+		while (b < b_end && is_space(*b)) {
+			b++;
+		}
+		if (a == a_end || b == b_end) {
+			return a == a_end && b == b_end;
+		}
+		if (*a++ != *b++) {
+			return false;
+		}
+	}
+}
+
+// Whether the old text of hunk (old_length lines), without its first front
+// and last back lines, is at target lines [position, ...).
+bool UnifiedPatch::matches(const Hunk &hunk, uint32_t old_length, uint32_t front, uint32_t back, const LineMerge::Side &target, uint32_t position, bool ignore_whitespace) const {
+	uint32_t old_index = 0;
+	for (uint32_t i = 0; i < hunk.line_count; i++) {
+		const HunkLine &line = lines[hunk.first_line + i];
+		if (line.type == LINE_INSERT) {
+			continue;
+		}
+		if (old_index >= front && old_index < old_length - back) {
+			if (!lines_equal(line, target, position + old_index - front, ignore_whitespace)) {
+				return false;
+			}
+		}
+		old_index++;
+	}
+	return true;
+}
+
+bool UnifiedPatch::apply(uint32_t section, const LineMerge::Side &target, const Options &options,
+		std::vector<LineMerge::Replacement> &r_replacements, std::vector<HunkResult> &r_results) const {
+	const FileSection &file_section = sections[section];
+	r_replacements.clear();
+	r_results.assign(file_section.hunk_count, HunkResult());
+
+	bool all_applied = true;
+	// Hunks apply in order and may not overlap: the next one starts at or
+	// after min_line.
+	uint32_t min_line = 0;
+	int64_t offset = 0;
+
+	for (uint32_t h = 0; h < file_section.hunk_count; h++) {
+		const Hunk &hunk = hunks[file_section.first_hunk + h];
+		HunkResult &hunk_result = r_results[h];
+
+		uint32_t old_length = 0;
+		uint32_t leading = 0;
+		uint32_t trailing = 0;
+		uint32_t first_change = hunk.line_count;
+		uint32_t last_change = 0;
+		for (uint32_t i = 0; i < hunk.line_count; i++) {
+			const HunkLine &line = lines[hunk.first_line + i];
+			old_length += line.type != LINE_INSERT;
+			if (line.type == LINE_CONTEXT) {
+				if (first_change == hunk.line_count) {
+					leading++;
+				}
+				trailing++;
+			} else {
+				first_change = std::min(first_change, i);
+				last_change = i;
+				trailing = 0;
+			}
+		}
+
+		// The declared start is the line before an insertion-only hunk.
+		int64_t declared = hunk.has_position ? (old_length == 0 ? hunk.old_start : (int64_t)hunk.old_start - 1) : min_line;
+		int64_t expected = hunk.has_position ? declared + offset : min_line;
+		if (first_change == hunk.line_count) {
+			// Context only; nothing to change.
+			hunk_result.applied = true;
+			hunk_result.line = (uint32_t)std::max<int64_t>(expected, 0);
+			continue;
+		}
+
+		bool found = false;
+		uint32_t position = 0;
+		uint32_t front = 0;
+		uint32_t back = 0;
+		for (uint32_t fuzz = 0; fuzz <= options.max_fuzz && !found; fuzz++) {
+			if (fuzz > 0 && front == std::min(fuzz, leading) && back == std::min(fuzz, trailing)) {
+				// No more context to drop.
+				break;
+			}
+			front = std::min(fuzz, leading);
+			back = std::min(fuzz, trailing);
+			uint32_t match_length = old_length - front - back;
+			if ((match_length == 0 && old_length > 0) || target.line_count < match_length || target.line_count - match_length < min_line) {
+				break;
+			}
+			int64_t lowest = min_line;
+			int64_t highest = target.line_count - match_length;
+			// A hunk with less context on one side was cut off by the start or
+			// the end of the file; try that position first.
+			int64_t anchor = -1;
+			if (hunk.has_position && leading < trailing && hunk.old_start <= 1) {
+				anchor = front;
+			} else if (hunk.has_position && trailing < leading && target.line_count >= match_length + back) {
+				anchor = target.line_count - back - match_length;
+			}
+			if (anchor >= lowest && anchor <= highest && matches(hunk, old_length, front, back, target, anchor, options.ignore_whitespace)) {
+				position = anchor;
+				found = true;
+				break;
+			}
+			int64_t start = std::min(std::max(expected + front, lowest), highest);
+			for (int64_t distance = 0;; distance++) {
+				if (options.max_offset >= 0 && distance > options.max_offset) {
+					break;
+				}
+				int64_t after = start + distance;
+				int64_t before = start - distance;
+				if (after > highest && before < lowest) {
+					break;
+				}
+				if (after <= highest && matches(hunk, old_length, front, back, target, after, options.ignore_whitespace)) {
+					position = after;
+					found = true;
+					break;
+				}
+				if (distance > 0 && before >= lowest && matches(hunk, old_length, front, back, target, before, options.ignore_whitespace)) {
+					position = before;
+					found = true;
+					break;
+				}
+			}
+		}
+
+		if (!found) {
+			all_applied = false;
+			hunk_result.line = (uint32_t)std::max<int64_t>(expected, 0);
+			continue;
+		}
+
+		hunk_result.applied = true;
+		hunk_result.line = position;
+		hunk_result.fuzz = std::max(front, back);
+		hunk_result.offset = (int64_t)position - front - declared;
+		if (hunk.has_position) {
+			offset = hunk_result.offset;
+		}
+
+		// Replace only the lines from the first to the last change; context in
+		// between is copied from the target.
+		uint32_t cursor = position + leading - front;
+		LineMerge::Replacement replacement;
+		replacement.start_byte = target_line_byte(target, cursor);
+		if (replacement.start_byte == target.length && target.length > 0 && target.data[target.length - 1] != '\n') {
+			replacement.bytes.push_back('\n');
+		}
+		for (uint32_t i = first_change; i <= last_change; i++) {
+			const HunkLine &line = lines[hunk.first_line + i];
+			if (line.type == LINE_INSERT) {
+				replacement.bytes.append(data + line.start, line.length);
+				if (line.has_newline) {
+					replacement.bytes.push_back('\n');
+				}
+				continue;
+			}
+			if (line.type == LINE_CONTEXT) {
+				const LineDiff::Line &target_line = target.lines[cursor];
+				replacement.bytes.append(target.data + target_line.start, target_line.length);
+				replacement.bytes.push_back('\n');
+			}
+			cursor++;
+		}
+		replacement.end_byte = target_line_byte(target, cursor);
+		min_line = position + old_length - front - back;
+		r_replacements.push_back(std::move(replacement));
+	}
+
+	return all_applied;
+}
@@ -0,0 +1,109 @@
+#ifndef UNIFIED_PATCH_H
+#define UNIFIED_PATCH_H
+
+#include "line_diff.h"
+#include "line_merge.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Parser and applier for unified diffs.
+//
+// Hunk bodies are read up to the next header rather than trusting the
+// @@ counts, which generated patches often get wrong; the counts are only
+// used to drop trailing blank lines that belong to the surrounding text.
+// "@@" headers without line numbers are accepted and located by context.
+//
+// Hunks are applied in order against a line table of the target: each is
+// searched nearest to its expected position (declared line plus the offset
+// of the previous hunk), then with up to max_fuzz lines of leading and
+// trailing context ignored. Context lines keep the target's bytes, so only
+// the changed lines end up in the replacements.
+class UnifiedPatch {
+public:
+	enum LineType {
+		LINE_CONTEXT,
+		LINE_DELETE,
+		LINE_INSERT,
+	};
+
+	// A line of a hunk body, as a byte range of the patch text.
+	struct HunkLine {
+		LineType type = LINE_CONTEXT;
+		uint32_t start = 0;
+		uint32_t length = 0;
+		// False after "\ No newline at end of file".
+		bool has_newline = true;
+	};
+
+	struct Hunk {
+		// 1-based as in the header; 0 when the header had no numbers.
+		uint32_t old_start = 0;
+		uint32_t old_count = 0;
+		uint32_t new_start = 0;
+		uint32_t new_count = 0;
+		bool has_position = true;
+		// Body is lines[first_line, first_line + line_count).
+		uint32_t first_line = 0;
+		uint32_t line_count = 0;
+		// 0-based line of the @@ header in the patch text.
+		uint32_t header_line = 0;
+	};
+
+	// Hunks following one ---/+++ header pair (or all of them if there is none).
+	struct FileSection {
+		std::string old_path;
+		std::string new_path;
+		uint32_t first_hunk = 0;
+		uint32_t hunk_count = 0;
+	};
+
+	struct Options {
+		uint32_t max_fuzz = 2;
+		// Furthest a hunk may move from its expected line; < 0 searches the
+		// whole target.
+		int64_t max_offset = -1;
+		// Compare lines with spaces, tabs and carriage returns removed.
+		bool ignore_whitespace = false;
+	};
+
+	struct HunkResult {
+		bool applied = false;
+		// 0-based line of the target where the hunk's old text starts.
+		uint32_t line = 0;
+		// Lines between the declared and the actual position.
+		int64_t offset = 0;
+		uint32_t fuzz = 0;
+	};
+
+private:
+	const char *data = nullptr;
+	std::vector<HunkLine> lines;
+	std::vector<Hunk> hunks;
+	std::vector<FileSection> sections;
+
+	static bool parse_hunk_header(const char *line, uint32_t length, Hunk &r_hunk);
+	static std::string parse_path(const char *line, uint32_t length);
+	bool lines_equal(const HunkLine &hunk_line, const LineMerge::Side &target, uint32_t target_line, bool ignore_whitespace) const;
+	bool matches(const Hunk &hunk, uint32_t old_length, uint32_t front, uint32_t back, const LineMerge::Side &target, uint32_t position, bool ignore_whitespace) const;
+
+public:
+	// Parses the patch; data must outlive this object. Fails when there is
+	// no hunk or a header is malformed.
+	bool parse(const char *p_data, uint32_t length, std::string &r_error);
+
+	const std::vector<Hunk> &get_hunks() const { return hunks; }
+	const std::vector<FileSection> &get_sections() const { return sections; }
+
+	// Section whose old or new path is a suffix of file_path, ignoring the
+	// a/ and b/ prefixes; the only section if there is just one. -1 if none.
+	int find_section(const std::string &file_path) const;
+
+	// Applies the hunks of a section to target. Hunks that do not apply are
+	// left out of r_replacements; returns true when every hunk applied.
+	bool apply(uint32_t section, const LineMerge::Side &target, const Options &options,
+			std::vector<LineMerge::Replacement> &r_replacements, std::vector<HunkResult> &r_results) const;
+};
+
+#endif // UNIFIED_PATCH_H